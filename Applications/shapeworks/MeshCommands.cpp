@@ -568,7 +568,7 @@ void Distance::buildParser()
   parser.add_option("--name").action("store").type("string").set_default("").help("Filename of other mesh.");
   std::list<std::string> methods{"point-to-point", "point-to-cell"};
   parser.add_option("--method").action("store").type("choice").choices(methods.begin(), methods.end()).set_default("point-to-point").help("Method used to compute distance [default: %default].");
-  parser.add_option("--summary").action("store").type("bool").set_default(false).help("Print largest distance of any point in mesh to target [default: %default].");
+  parser.add_option("--summary").action("store").type("bool").set_default(false).help("Print largest and mean distances from mesh to target, target to mesh, and the Hausdorff distance [default: %default].");
 
   Command::buildParser();
 }
@@ -600,13 +600,17 @@ bool Distance::execute(const optparse::Values &options, SharedCommandData &share
   }
 
   Mesh other(otherMesh);
-  sharedData.mesh->distance(other, method);
+  Mesh::DistanceSummary dist;
+  sharedData.mesh->distance(other, method, false, summary ? &dist : nullptr);
 
   if (summary)
   {
-    auto range = sharedData.mesh->getFieldRange("distance");
-    auto dist = std::max(range[0], range[1]);
-    std::cout << "Maximum distance to target mesh: " << dist << std::endl;
+    std::cout << "Maximum distance to target mesh: " << dist.forwardMax << std::endl;
+    std::cout << "Maximum distance from target mesh: " << dist.backwardMax << std::endl;
+    std::cout << "Hausdorff distance: " << dist.hausdorff << std::endl;
+    std::cout << "Mean distance to target mesh: " << dist.forwardMean << std::endl;
+    std::cout << "Mean distance from target mesh: " << dist.backwardMean << std::endl;
+    std::cout << "Mean symmetric distance: " << dist.mean << std::endl;
   }
 
   return sharedData.validMesh();
@@ -952,6 +956,8 @@ void MeshToDT::buildParser()
   parser.add_option("--originx").action("store").type("double").set_default(-1.0).help("Origin of output image in x-direction [default: current origin].");
   parser.add_option("--originy").action("store").type("double").set_default(-1.0).help("Origin of output image in y-direction [default: current origin].");
   parser.add_option("--originz").action("store").type("double").set_default(-1.0).help("Origin of output image in z-direction [default: current origin].");
+  parser.add_option("--exact").action("store").type("bool").set_default(false).help("Compute the signed distance to the mesh directly instead of antialiasing its rasterization [default: %default].");
+  parser.add_option("--band").action("store").type("double").set_default(0.0).help("With exact, only compute distances up to this value, clamping the rest [default: %default (entire image)].");
 
   Command::buildParser();
 }
@@ -978,7 +984,10 @@ bool MeshToDT::execute(const optparse::Values &options, SharedCommandData &share
   Dims size({sizeX,sizeY, sizeZ});
   Point3 origin({originX,originY,originZ});
 
-  sharedData.image = sharedData.mesh->toDistanceTransform(spacing, size, origin);
+  bool exact = static_cast<bool>(options.get("exact"));
+  double band = static_cast<double>(options.get("band"));
+
+  sharedData.image = sharedData.mesh->toDistanceTransform(spacing, size, origin, exact, band);
   return true;
 }
 
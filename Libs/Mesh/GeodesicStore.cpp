@@ -0,0 +1,378 @@
+#include "GeodesicStore.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace shapeworks {
+
+namespace {
+
+const char fileMagic[8] = {'S', 'W', 'G', 'E', 'O', 'C', 'S', 'R'};
+const uint32_t fileVersion = 1;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t precision;   // bytes per distance
+  uint32_t numVertices;
+  float stopDistance;
+  uint64_t numEntries;
+};
+
+// offsets of the sections, each one aligned for its element type, returns
+// false if a corrupt entry count would overflow them
+bool sectionOffsets(uint32_t numVertices, uint64_t numEntries, uint32_t precision,
+                    uint64_t& neighbors, uint64_t& distances, uint64_t& end)
+{
+  neighbors = sizeof(FileHeader) + sizeof(uint64_t) * (uint64_t(numVertices) + 1);
+  if (numEntries > (UINT64_MAX - neighbors) / (sizeof(uint32_t) + precision)) {
+    return false;
+  }
+  distances = neighbors + sizeof(uint32_t) * numEntries;
+  end = distances + precision * numEntries;
+  return true;
+}
+
+}
+
+//---------------------------------------------------------------------------
+void GeodesicStore::resize(unsigned numVertices)
+{
+  if (numVertices == numVertices_) {
+    return;
+  }
+
+  // stage the distances that remain in front of any already staged ones
+  std::vector<Entry> kept;
+  for (unsigned v = 0; v < std::min(numVertices, numVertices_); v++) {
+    for (unsigned k = 0; k < rowSize(v); k++) {
+      kept.push_back(Entry{v, rowNeighbors(v)[k], rowDistance(v, k)});
+    }
+  }
+  for (const auto& entry : staged_) {
+    if (entry.row < numVertices) {
+      kept.push_back(entry);
+    }
+  }
+
+  setOwned(numVertices);
+  staged_.swap(kept);
+  finalize();
+}
+
+//---------------------------------------------------------------------------
+void GeodesicStore::clear(unsigned numVertices)
+{
+  setOwned(numVertices);
+}
+
+//---------------------------------------------------------------------------
+void GeodesicStore::insert(unsigned v1, unsigned v2, float distance)
+{
+  // the larger id is the row
+  if (v2 > v1) {
+    std::swap(v1, v2);
+  }
+  staged_.push_back(Entry{v1, v2, distance});
+}
+
+//---------------------------------------------------------------------------
+void GeodesicStore::finalize()
+{
+  if (staged_.empty()) {
+    return;
+  }
+
+  auto less = [](const Entry& a, const Entry& b) {
+    return a.row < b.row || (a.row == b.row && a.col < b.col);
+  };
+
+  // later entries replace earlier ones, so keep the staging order among equal keys
+  std::vector<Entry> entries;
+  entries.reserve(numEntries() + staged_.size());
+  for (unsigned v = 0; v < numVertices_; v++) {
+    for (unsigned k = 0; k < rowSize(v); k++) {
+      entries.push_back(Entry{v, rowNeighbors(v)[k], rowDistance(v, k)});
+    }
+  }
+  entries.insert(entries.end(), staged_.begin(), staged_.end());
+  staged_.clear();
+  staged_.shrink_to_fit();
+
+  // rows generated in order are already sorted
+  if (!std::is_sorted(entries.begin(), entries.end(), less)) {
+    std::stable_sort(entries.begin(), entries.end(), less);
+  }
+
+  unsigned numVertices = numVertices_;
+  if (!entries.empty()) {
+    numVertices = std::max(numVertices, entries.back().row + 1);
+  }
+  setOwned(numVertices);
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (i + 1 < entries.size() && !less(entries[i], entries[i + 1])) {
+      continue; // replaced by a later entry
+    }
+    ownedOffsets_[entries[i].row + 1]++;
+    ownedNeighbors_.push_back(entries[i].col);
+    ownedDistances_.push_back(entries[i].distance);
+  }
+  for (unsigned v = 0; v < numVertices; v++) {
+    ownedOffsets_[v + 1] += ownedOffsets_[v];
+  }
+
+  neighbors_ = ownedNeighbors_.data();
+  distances32_ = ownedDistances_.data();
+}
+
+//---------------------------------------------------------------------------
+float GeodesicStore::getDistance(unsigned v1, unsigned v2, float missing) const
+{
+  if (v2 > v1) {
+    std::swap(v1, v2);
+  }
+  if (v1 >= numVertices_) {
+    return missing;
+  }
+
+  const uint32_t* begin = rowNeighbors(v1);
+  const uint32_t* end = begin + rowSize(v1);
+  const uint32_t* it = std::lower_bound(begin, end, v2);
+  if (it == end || *it != v2) {
+    return missing;
+  }
+  return distanceAt(offsets_[v1] + (it - begin));
+}
+
+//---------------------------------------------------------------------------
+bool GeodesicStore::save(const std::string& filename, float stopDistance, Precision precision) const
+{
+  std::ofstream out(filename, std::ios::binary);
+  if (!out) {
+    return false;
+  }
+
+  FileHeader header;
+  std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+  header.version = fileVersion;
+  header.precision = static_cast<uint32_t>(precision);
+  header.numVertices = numVertices_;
+  header.stopDistance = stopDistance;
+  header.numEntries = numEntries();
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  if (numVertices_ > 0) {
+    out.write(reinterpret_cast<const char*>(offsets_), sizeof(uint64_t) * (numVertices_ + 1));
+  }
+  else {
+    const uint64_t zero = 0;
+    out.write(reinterpret_cast<const char*>(&zero), sizeof(zero));
+  }
+  out.write(reinterpret_cast<const char*>(neighbors_), sizeof(uint32_t) * header.numEntries);
+
+  if (precision == Precision::Float32) {
+    for (uint64_t i = 0; i < header.numEntries; i++) {
+      const float d = distanceAt(i);
+      out.write(reinterpret_cast<const char*>(&d), sizeof(d));
+    }
+  }
+  else {
+    for (uint64_t i = 0; i < header.numEntries; i++) {
+      const uint16_t d = floatToHalf(distanceAt(i));
+      out.write(reinterpret_cast<const char*>(&d), sizeof(d));
+    }
+  }
+
+  return static_cast<bool>(out);
+}
+
+//---------------------------------------------------------------------------
+bool GeodesicStore::load(const std::string& filename, float& stopDistance)
+{
+  MappedFile file;
+  if (!file.Open(filename)) {
+    return false;
+  }
+  if (!file.HasMagic(fileMagic)) {
+    file.Close();
+    return loadLegacy(filename, stopDistance);
+  }
+
+  FileHeader header;
+  if (file.GetSize() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, file.GetData(), sizeof(header));
+  if (header.version != fileVersion ||
+      (header.precision != 2 && header.precision != 4)) {
+    return false;
+  }
+
+  uint64_t neighborsOffset, distancesOffset, endOffset;
+  if (!sectionOffsets(header.numVertices, header.numEntries, header.precision,
+                      neighborsOffset, distancesOffset, endOffset) ||
+      file.GetSize() < endOffset) {
+    return false;
+  }
+
+  // the rows are read without bounds checks, so validate their offsets once
+  const char* offsetData = file.GetData() + sizeof(FileHeader);
+  uint64_t previous = 0;
+  for (uint64_t v = 0; v <= header.numVertices; v++) {
+    uint64_t offset;
+    std::memcpy(&offset, offsetData + sizeof(uint64_t) * v, sizeof(offset));
+    if (offset < previous || offset > header.numEntries) {
+      return false;
+    }
+    previous = offset;
+  }
+  if (previous != header.numEntries) {
+    return false;
+  }
+
+  setOwned(0);
+  file_ = std::move(file);
+
+  const char* base = file_.GetData();
+  numVertices_ = header.numVertices;
+  precision_ = static_cast<Precision>(header.precision);
+  offsets_ = reinterpret_cast<const uint64_t*>(base + sizeof(FileHeader));
+  neighbors_ = reinterpret_cast<const uint32_t*>(base + neighborsOffset);
+  if (precision_ == Precision::Float32) {
+    distances32_ = reinterpret_cast<const float*>(base + distancesOffset);
+  }
+  else {
+    distances16_ = reinterpret_cast<const uint16_t*>(base + distancesOffset);
+  }
+
+  stopDistance = header.stopDistance;
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool GeodesicStore::loadLegacy(const std::string& filename, float& stopDistance)
+{
+  // stop distance, then for each vertex the number of entries followed by
+  // (vertex id, distance) pairs, the number of vertices is not stored
+  std::ifstream in(filename, std::ios::binary);
+  float distance;
+  if (!in.read(reinterpret_cast<char*>(&distance), sizeof(float))) {
+    return false;
+  }
+
+  const unsigned numVertices = numVertices_;
+  setOwned(numVertices);
+  for (unsigned i = 0; i < numVertices; i++) {
+    uint32_t length;
+    in.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
+    for (uint32_t j = 0; j < length && in; j++) {
+      uint32_t index;
+      float dist;
+      in.read(reinterpret_cast<char*>(&index), sizeof(uint32_t));
+      in.read(reinterpret_cast<char*>(&dist), sizeof(float));
+      if (index != i) {
+        insert(i, index, dist);
+      }
+    }
+  }
+  finalize();
+  resize(numVertices);
+
+  stopDistance = distance;
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void GeodesicStore::setOwned(unsigned numVertices)
+{
+  file_.Close();
+  numVertices_ = numVertices;
+  precision_ = Precision::Float32;
+  ownedOffsets_.assign(numVertices + 1, 0);
+  ownedNeighbors_.clear();
+  ownedDistances_.clear();
+  offsets_ = ownedOffsets_.data();
+  neighbors_ = ownedNeighbors_.data();
+  distances32_ = ownedDistances_.data();
+  distances16_ = nullptr;
+}
+
+//---------------------------------------------------------------------------
+uint16_t GeodesicStore::floatToHalf(float value)
+{
+  uint32_t f;
+  std::memcpy(&f, &value, sizeof(f));
+
+  const uint32_t sign = (f >> 16) & 0x8000;
+  const uint32_t biased = (f >> 23) & 0xff;
+  uint32_t mantissa = f & 0x7fffff;
+
+  if (biased == 0xff) { // inf or nan
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  }
+
+  const int exponent = static_cast<int>(biased) - 127 + 15;
+  if (exponent >= 31) { // overflow
+    return sign | 0x7c00;
+  }
+
+  if (exponent <= 0) { // subnormal or zero
+    if (exponent < -10) {
+      return sign;
+    }
+    mantissa |= 0x800000;
+    const int shift = 14 - exponent;
+    uint32_t half = mantissa >> shift;
+    const uint32_t remainder = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (half & 1))) {
+      half++;
+    }
+    return sign | half;
+  }
+
+  // round to nearest even, a carry correctly moves into the exponent
+  uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+  const uint32_t remainder = mantissa & 0x1fff;
+  if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+    half++;
+  }
+  return static_cast<uint16_t>(half);
+}
+
+//---------------------------------------------------------------------------
+float GeodesicStore::halfToFloat(uint16_t value)
+{
+  const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  uint32_t exponent = (value >> 10) & 0x1f;
+  uint32_t mantissa = value & 0x3ff;
+
+  uint32_t f;
+  if (exponent == 0) {
+    if (mantissa == 0) {
+      f = sign;
+    }
+    else { // normalize the subnormal
+      int e = -1;
+      do {
+        e++;
+        mantissa <<= 1;
+      } while (!(mantissa & 0x400));
+      f = sign | ((127 - 15 - e) << 23) | ((mantissa & 0x3ff) << 13);
+    }
+  }
+  else if (exponent == 31) {
+    f = sign | 0x7f800000 | (mantissa << 13);
+  }
+  else {
+    f = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+  }
+
+  float result;
+  std::memcpy(&result, &f, sizeof(result));
+  return result;
+}
+
+} // shapeworks
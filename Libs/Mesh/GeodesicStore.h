@@ -0,0 +1,97 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace shapeworks {
+
+/// Sparse symmetric store of pairwise geodesic distances between mesh vertices
+///
+/// Distances are kept in compressed sparse row form: the row of vertex v holds
+/// the sorted ids of the vertices u < v within the stop distance, and their
+/// distances as float32 or float16.  Rows are built by staging entries with
+/// insert() and merging them with finalize().  The binary file written by
+/// save() has the same layout and is memory mapped by load(), so opening a
+/// geodesic file does not parse or copy it.
+class GeodesicStore
+{
+public:
+  enum class Precision { Float16 = 2, Float32 = 4 };
+
+  GeodesicStore() = default;
+  GeodesicStore(const GeodesicStore&) = delete;
+  GeodesicStore& operator=(const GeodesicStore&) = delete;
+
+  /// set the number of vertices, keeping the distances between vertices that remain
+  void resize(unsigned numVertices);
+
+  /// remove all distances
+  void clear(unsigned numVertices);
+
+  /// stage the distance between v1 and v2, a later value for the same pair replaces an earlier one
+  void insert(unsigned v1, unsigned v2, float distance);
+
+  /// merge the staged distances into the rows
+  void finalize();
+
+  /// distance between v1 and v2 (which must differ), or missing if it is not stored
+  float getDistance(unsigned v1, unsigned v2, float missing) const;
+
+  unsigned numVertices() const { return numVertices_; }
+  uint64_t numEntries() const { return numVertices_ ? offsets_[numVertices_] : 0; }
+
+  /// number of distances stored in the row of v, i.e. to vertices with a smaller id
+  unsigned rowSize(unsigned v) const { return static_cast<unsigned>(offsets_[v + 1] - offsets_[v]); }
+  /// sorted vertex ids of the row of v
+  const uint32_t* rowNeighbors(unsigned v) const { return neighbors_ + offsets_[v]; }
+  /// k-th distance of the row of v
+  float rowDistance(unsigned v, unsigned k) const { return distanceAt(offsets_[v] + k); }
+
+  /// write the store, returns false if the file cannot be written
+  bool save(const std::string& filename, float stopDistance, Precision precision = Precision::Float32) const;
+
+  /// memory map a file written by save(), or read a file in the legacy per
+  /// vertex format.  Returns false if the file cannot be read.
+  bool load(const std::string& filename, float& stopDistance);
+
+  static uint16_t floatToHalf(float value);
+  static float halfToFloat(uint16_t value);
+
+private:
+  struct Entry {
+    uint32_t row;
+    uint32_t col;
+    float distance;
+  };
+
+  float distanceAt(uint64_t i) const
+  {
+    return precision_ == Precision::Float32 ? distances32_[i] : halfToFloat(distances16_[i]);
+  }
+
+  bool loadLegacy(const std::string& filename, float& stopDistance);
+  void setOwned(unsigned numVertices);
+
+  unsigned numVertices_ = 0;
+  Precision precision_ = Precision::Float32;
+
+  // views of the rows, into the owned vectors or the mapped file
+  const uint64_t* offsets_ = nullptr;
+  const uint32_t* neighbors_ = nullptr;
+  const float* distances32_ = nullptr;
+  const uint16_t* distances16_ = nullptr;
+
+  std::vector<uint64_t> ownedOffsets_;
+  std::vector<uint32_t> ownedNeighbors_;
+  std::vector<float> ownedDistances_;
+
+  std::vector<Entry> staged_;
+
+  MappedFile file_;
+};
+
+} // shapeworks
@@ -33,12 +33,24 @@
 #include <vtkPolyDataToImageStencil.h>
 #include <vtkImageStencil.h>
 #include <vtkDoubleArray.h>
-#include <vtkKdTreePointLocator.h>
-#include <vtkCellLocator.h>
-#include <vtkGenericCell.h>
+#include <vtkStaticPointLocator.h>
+#include <vtkCellArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkIdList.h>
 #include <vtkPlaneCollection.h>
 #include <vtkClipClosedSurface.h>
 
+#include <numeric>
+
+#include <igl/AABB.h>
+#include <igl/per_edge_normals.h>
+#include <igl/per_face_normals.h>
+#include <igl/per_vertex_normals.h>
+#include <igl/signed_distance.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/blocked_range.h>
+
 namespace shapeworks {
 
 Mesh::MeshType Mesh::read(const std::string &pathname)
@@ -336,64 +348,204 @@ Region Mesh::boundingBox(bool center) const
   return bbox;
 }
 
-Mesh& Mesh::distance(const Mesh &target, const DistanceMethod method)
+namespace {
+
+/// copies the points of a mesh
+Eigen::MatrixXd meshVertices(vtkPolyData* mesh)
 {
-  if (target.numPoints() == 0 || numPoints() == 0)
-    throw std::invalid_argument("meshes must have points");
+  Eigen::MatrixXd vertices(mesh->GetNumberOfPoints(), 3);
+  double p[3];
+  for (vtkIdType i = 0; i < mesh->GetNumberOfPoints(); i++) {
+    mesh->GetPoint(i, p);
+    vertices.row(i) << p[0], p[1], p[2];
+  }
+  return vertices;
+}
 
-  vtkSmartPointer<vtkKdTreePointLocator> targetPointLocator = vtkSmartPointer<vtkKdTreePointLocator>::New();
-  vtkSmartPointer<vtkCellLocator> targetCellLocator = vtkSmartPointer<vtkCellLocator>::New();
-  if (method == POINT_TO_POINT)
+/// triangulates the polygons and strips of a mesh, optionally remembering the cell each triangle came from,
+/// vertices, lines and poly lines have no surface and are skipped
+Eigen::MatrixXi meshTriangles(vtkPolyData* mesh, std::vector<vtkIdType>* triangleCells = nullptr)
+{
+  std::vector<Eigen::Vector3i> triangles;
+  vtkSmartPointer<vtkIdList> ids = vtkSmartPointer<vtkIdList>::New();
+  for (vtkIdType c = 0; c < mesh->GetNumberOfCells(); c++) {
+    const int type = mesh->GetCellType(c);
+    if (type != VTK_TRIANGLE && type != VTK_POLYGON && type != VTK_QUAD && type != VTK_TRIANGLE_STRIP) {
+      continue;
+    }
+    mesh->GetCellPoints(c, ids);
+    const vtkIdType n = ids->GetNumberOfIds();
+    const bool strip = type == VTK_TRIANGLE_STRIP;
+    for (vtkIdType k = 0; k + 2 < n; k++) {
+      if (strip) {
+        if (k % 2 == 0)
+          triangles.emplace_back(ids->GetId(k), ids->GetId(k + 1), ids->GetId(k + 2));
+        else
+          triangles.emplace_back(ids->GetId(k + 1), ids->GetId(k), ids->GetId(k + 2));
+      }
+      else {
+        triangles.emplace_back(ids->GetId(0), ids->GetId(k + 1), ids->GetId(k + 2));
+      }
+      if (triangleCells) triangleCells->push_back(c);
+    }
+  }
+
+  Eigen::MatrixXi faces(triangles.size(), 3);
+  for (size_t t = 0; t < triangles.size(); t++) {
+    faces.row(t) = triangles[t].transpose();
+  }
+  return faces;
+}
+
+/// closest point queries against a target mesh, which are const and safe to issue from many threads
+class ClosestPointQuery
+{
+public:
+  ClosestPointQuery(vtkPolyData* target, Mesh::DistanceMethod method) : method(method)
   {
-    targetPointLocator->SetDataSet(target.mesh);
-    targetPointLocator->BuildLocator();
+    vertices = meshVertices(target);
+
+    if (method == Mesh::POINT_TO_POINT) {
+      pointLocator = vtkSmartPointer<vtkStaticPointLocator>::New();
+      pointLocator->SetDataSet(target);
+      pointLocator->BuildLocator();
+      return;
+    }
+
+    faces = meshTriangles(target, &triangleCells);
+    if (faces.rows() == 0)
+      throw std::invalid_argument("target mesh must have faces for point to cell distance");
+    tree.init(vertices, faces);
   }
-  else
+
+  /// returns the id of the closest target point (POINT_TO_POINT) or cell (POINT_TO_CELL) to p
+  vtkIdType find(const double p[3], double closest[3], double& dist2) const
   {
-    targetCellLocator->SetDataSet(target.mesh);
-    targetCellLocator->BuildLocator();
+    if (method == Mesh::POINT_TO_POINT) {
+      const vtkIdType id = pointLocator->FindClosestPoint(p);
+      Eigen::Map<Eigen::RowVector3d>(closest) = vertices.row(id);
+      dist2 = (vertices.row(id) - Eigen::Map<const Eigen::RowVector3d>(p)).squaredNorm();
+      return id;
+    }
+
+    int face;
+    Eigen::RowVector3d c;
+    dist2 = tree.squared_distance(vertices, faces, Eigen::RowVector3d(p[0], p[1], p[2]), face, c);
+    Eigen::Map<Eigen::RowVector3d>(closest) = c;
+    return triangleCells[face];
   }
 
+private:
+  Mesh::DistanceMethod method;
+  Eigen::MatrixXd vertices;
+  Eigen::MatrixXi faces;
+  std::vector<vtkIdType> triangleCells;
+  vtkSmartPointer<vtkStaticPointLocator> pointLocator;
+  igl::AABB<Eigen::MatrixXd, 3> tree;
+};
+
+/// distances of all points of source to target (in parallel), optionally keeping each closest
+/// point and its id, returns the sum and the maximum of the distances
+std::pair<double, double> computeDistances(vtkPolyData* source, vtkPolyData* target, Mesh::DistanceMethod method,
+                                           double* distances, double* closestPoints, vtkIdType* closestIds)
+{
+  const ClosestPointQuery query(target, method);
+
+  using SumMax = std::pair<double, double>;
+  return tbb::parallel_reduce(
+    tbb::blocked_range<vtkIdType>{0, source->GetNumberOfPoints(), 256}, SumMax(0.0, 0.0),
+    [&](const tbb::blocked_range<vtkIdType>& r, SumMax result) {
+      double p[3], closest[3], dist2;
+      for (vtkIdType i = r.begin(); i < r.end(); ++i) {
+        source->GetPoint(i, p);
+        const vtkIdType id = query.find(p, closest, dist2);
+        const double dist = std::sqrt(dist2);
+        if (distances) distances[i] = dist;
+        if (closestPoints) std::copy(closest, closest + 3, closestPoints + 3 * i);
+        if (closestIds) closestIds[i] = id;
+        result.first += dist;
+        result.second = std::max(result.second, dist);
+      }
+      return result;
+    },
+    [](const SumMax& a, const SumMax& b) { return SumMax(a.first + b.first, std::max(a.second, b.second)); });
+}
+
+/// combines the sums and maxima of the distances from source to target and back
+Mesh::DistanceSummary summarizeDistances(const std::pair<double, double>& forward, vtkIdType numSourcePoints,
+                                         const std::pair<double, double>& backward, vtkIdType numTargetPoints)
+{
+  Mesh::DistanceSummary summary;
+  summary.forwardMean = forward.first / numSourcePoints;
+  summary.backwardMean = backward.first / numTargetPoints;
+  summary.forwardMax = forward.second;
+  summary.backwardMax = backward.second;
+  summary.mean = (forward.first + backward.first) / (numSourcePoints + numTargetPoints);
+  summary.hausdorff = std::max(forward.second, backward.second);
+  return summary;
+}
+
+}
+
+Mesh& Mesh::distance(const Mesh &target, const DistanceMethod method, bool storeClosest, DistanceSummary* summary)
+{
+  if (target.numPoints() == 0 || numPoints() == 0)
+    throw std::invalid_argument("meshes must have points");
+
   // allocate Array to store distances from each point to target
   vtkSmartPointer<vtkDoubleArray> distance = vtkSmartPointer<vtkDoubleArray>::New();
   distance->SetNumberOfComponents(1);
   distance->SetNumberOfTuples(numPoints());
   distance->SetName("distance");
 
-  // Find the nearest neighbors to each point and compute distance between them
-  double dist, currentPoint[3], closestPoint[3];
-  if (method == POINT_TO_POINT)
+  vtkSmartPointer<vtkDoubleArray> closestPoints;
+  vtkSmartPointer<vtkIdTypeArray> closestIds;
+  if (storeClosest)
   {
-    for (int i = 0; i < numPoints(); i++)
-    {
-      mesh->GetPoint(i, currentPoint);
-      vtkIdType closestPointId = targetPointLocator->FindClosestPoint(currentPoint);
-      target.mesh->GetPoint(closestPointId, closestPoint);
-      dist = std::sqrt(std::pow(currentPoint[0] - closestPoint[0], 2) +
-                       std::pow(currentPoint[1] - closestPoint[1], 2) +
-                       std::pow(currentPoint[2] - closestPoint[2], 2));
-      distance->SetValue(i, dist);
-    }
+    closestPoints = vtkSmartPointer<vtkDoubleArray>::New();
+    closestPoints->SetNumberOfComponents(3);
+    closestPoints->SetNumberOfTuples(numPoints());
+    closestPoints->SetName("closest_point");
+    closestIds = vtkSmartPointer<vtkIdTypeArray>::New();
+    closestIds->SetNumberOfComponents(1);
+    closestIds->SetNumberOfTuples(numPoints());
+    closestIds->SetName("closest_id");
   }
-  else
+
+  // Find the nearest neighbors to each point and compute distance between them
+  auto forward = computeDistances(mesh, target.mesh, method, distance->GetPointer(0),
+                                  storeClosest ? closestPoints->GetPointer(0) : nullptr,
+                                  storeClosest ? closestIds->GetPointer(0) : nullptr);
+
+  // only the backward pass is left for the summary
+  if (summary)
   {
-    vtkIdType cellId;
-    vtkSmartPointer<vtkGenericCell> cell = vtkSmartPointer<vtkGenericCell>::New();
-    int subId;
-    for (int i = 0; i < numPoints(); i++)
-    {
-      mesh->GetPoint(i, currentPoint);
-      targetCellLocator->FindClosestPoint(currentPoint, closestPoint, cell, cellId, subId, dist);
-      distance->SetValue(i, std::sqrt(dist));
-    }
+    auto backward = computeDistances(target.mesh, mesh, method, nullptr, nullptr, nullptr);
+    *summary = summarizeDistances(forward, numPoints(), backward, target.numPoints());
   }
 
   // add distance field to this mesh
   this->setField("distance", distance);
+  if (storeClosest)
+  {
+    mesh->GetPointData()->AddArray(closestPoints);
+    this->setField("closest_id", closestIds);
+  }
 
   return *this;
 }
 
+Mesh::DistanceSummary Mesh::distanceSummary(const Mesh &target, const DistanceMethod method) const
+{
+  if (target.numPoints() == 0 || numPoints() == 0)
+    throw std::invalid_argument("meshes must have points");
+
+  auto forward = computeDistances(mesh, target.mesh, method, nullptr, nullptr, nullptr);
+  auto backward = computeDistances(target.mesh, mesh, method, nullptr, nullptr, nullptr);
+
+  return summarizeDistances(forward, numPoints(), backward, target.numPoints());
+}
+
 Mesh& Mesh::clipClosedSurface(const Plane plane)
 {
   vtkSmartPointer<vtkPlaneCollection> planeCollection = vtkSmartPointer<vtkPlaneCollection>::New();
@@ -497,11 +649,96 @@ Image Mesh::toImage(Vector3 spacing, Dims size, Point3 origin) const
   return Image(imgstenc->GetOutput());
 }
 
-Image Mesh::toDistanceTransform(Vector3 spacing, Dims size, Point3 origin) const
+Image Mesh::toDistanceTransform(Vector3 spacing, Dims size, Point3 origin, bool exact, double narrowBand) const
 {
-  // TODO: convert directly to DT (github #810)
+  // the rasterized mesh gives the grid, and the side of the surface of the voxels outside the narrow band
   Image image(toImage(spacing, size, origin));
-  image.antialias(50, 0.00).computeDT(); // need maxrms = 0 and iterations = 30 to reproduce results
+
+  if (!exact)
+  {
+    image.antialias(50, 0.00).computeDT(); // need maxrms = 0 and iterations = 30 to reproduce results
+    return image;
+  }
+
+  Eigen::MatrixXd V = meshVertices(mesh);
+  Eigen::MatrixXi F = meshTriangles(mesh);
+  if (F.rows() == 0)
+    throw std::invalid_argument("mesh must have faces to compute a distance transform");
+
+  // the angle weighted pseudonormal at the closest point gives the sign (Baerentzen and Aanaes)
+  igl::AABB<Eigen::MatrixXd, 3> tree;
+  tree.init(V, F);
+  Eigen::MatrixXd FN, VN, EN;
+  Eigen::MatrixXi E;
+  Eigen::VectorXi EMAP;
+  igl::per_face_normals(V, F, FN);
+  igl::per_vertex_normals(V, F, igl::PER_VERTEX_NORMALS_WEIGHTING_TYPE_ANGLE, FN, VN);
+  igl::per_edge_normals(V, F, igl::PER_EDGE_NORMALS_WEIGHTING_TYPE_UNIFORM, FN, EN, E, EMAP);
+
+  Image::ImageType::Pointer itkImage = image.getITKImage();
+  const auto dims = itkImage->GetLargestPossibleRegion().GetSize();
+  const auto imageOrigin = itkImage->GetOrigin();
+  const auto imageSpacing = itkImage->GetSpacing();
+  Image::PixelType* pixels = itkImage->GetBufferPointer();
+  const size_t numVoxels = dims[0] * dims[1] * dims[2];
+
+  // voxels to compute, all of them or only those within the narrow band of some triangle
+  std::vector<size_t> voxels;
+  if (narrowBand > 0.0)
+  {
+    std::vector<char> inBand(numVoxels, 0);
+    for (int f = 0; f < F.rows(); f++)
+    {
+      const Eigen::RowVector3d lower = V.row(F(f, 0)).cwiseMin(V.row(F(f, 1))).cwiseMin(V.row(F(f, 2))).array() - narrowBand;
+      const Eigen::RowVector3d upper = V.row(F(f, 0)).cwiseMax(V.row(F(f, 1))).cwiseMax(V.row(F(f, 2))).array() + narrowBand;
+      long first[3], last[3];
+      for (int d = 0; d < 3; d++)
+      {
+        first[d] = std::max(0L, static_cast<long>(std::ceil((lower[d] - imageOrigin[d]) / imageSpacing[d])));
+        last[d] = std::min(static_cast<long>(dims[d]) - 1, static_cast<long>(std::floor((upper[d] - imageOrigin[d]) / imageSpacing[d])));
+      }
+      for (long z = first[2]; z <= last[2]; z++)
+        for (long y = first[1]; y <= last[1]; y++)
+          for (long x = first[0]; x <= last[0]; x++)
+            inBand[(z * dims[1] + y) * dims[0] + x] = 1;
+    }
+
+    for (size_t i = 0; i < numVoxels; i++)
+    {
+      if (inBand[i])
+        voxels.push_back(i);
+      else
+        pixels[i] = pixels[i] > 0 ? -narrowBand : narrowBand;
+    }
+  }
+  else
+  {
+    voxels.resize(numVoxels);
+    std::iota(voxels.begin(), voxels.end(), 0);
+  }
+
+  tbb::parallel_for(tbb::blocked_range<size_t>{0, voxels.size(), 1024},
+                    [&](const tbb::blocked_range<size_t>& r) {
+                      for (size_t i = r.begin(); i < r.end(); ++i)
+                      {
+                        const size_t v = voxels[i];
+                        const size_t x = v % dims[0];
+                        const size_t y = (v / dims[0]) % dims[1];
+                        const size_t z = v / (dims[0] * dims[1]);
+                        const Eigen::RowVector3d q(imageOrigin[0] + x * imageSpacing[0],
+                                                   imageOrigin[1] + y * imageSpacing[1],
+                                                   imageOrigin[2] + z * imageSpacing[2]);
+                        double sign, sqrd;
+                        int face;
+                        Eigen::RowVector3d closest, normal;
+                        igl::signed_distance_pseudonormal(tree, V, F, FN, VN, EN, EMAP, q, sign, sqrd, face, closest, normal);
+                        double dist = sign * std::sqrt(sqrd);
+                        if (narrowBand > 0.0)
+                          dist = std::max(-narrowBand, std::min(narrowBand, dist));
+                        pixels[v] = dist;
+                      }
+                    });
+
   return image;
 }
 
@@ -16,6 +16,16 @@ public:
   enum AlignmentType { Rigid, Similarity, Affine };
   enum DistanceMethod { POINT_TO_POINT, POINT_TO_CELL };
 
+  /// symmetric surface to surface distance between two meshes
+  struct DistanceSummary {
+    double forwardMean;   // mean distance from the points of this mesh to target
+    double backwardMean;  // mean distance from the points of target to this mesh
+    double forwardMax;
+    double backwardMax;
+    double mean;          // mean over the points of both meshes
+    double hausdorff;     // largest of forwardMax and backwardMax
+  };
+
   using MeshType = vtkSmartPointer<vtkPolyData>;
 
   Mesh(const std::string& pathname) : mesh(read(pathname)) {}
@@ -74,8 +84,14 @@ public:
   /// quality control mesh
   Mesh& fix(bool smoothBefore = true, bool smoothAfter = true, double lambda = 0.5, int iterations = 1, bool decimate = true, double percentage = 0.5);
 
-  /// computes surface to surface distance, compute method: POINT_TO_POINT (default) or POINT_TO_CELL
-  Mesh& distance(const Mesh &target, const DistanceMethod method = POINT_TO_POINT);
+  /// computes surface to surface distance, compute method: POINT_TO_POINT (default) or POINT_TO_CELL,
+  /// optionally also storing the closest target point and its id (point or cell) in the "closest_point"
+  /// and "closest_id" fields, and optionally also computing the distances back from target into summary
+  Mesh& distance(const Mesh &target, const DistanceMethod method = POINT_TO_POINT, bool storeClosest = false,
+                 DistanceSummary* summary = nullptr);
+
+  /// computes distances from this mesh to target and back without adding fields
+  DistanceSummary distanceSummary(const Mesh &target, const DistanceMethod method = POINT_TO_POINT) const;
 
   /// clips a mesh using a cutting plane resulting in a closed surface
   Mesh& clipClosedSurface(const Plane plane);
@@ -86,8 +102,12 @@ public:
   /// rasterizes mesh to create binary images, automatically computing size and origin if necessary
   Image toImage(Vector3 spacing = makeVector({1.0, 1.0, 1.0}), Dims size = {0, 0, 0}, Point3 origin = Point3({-1.0, -1.0, -1.0})) const;
 
-  /// converts mesh to distance transform, automatically computing size and origin if necessary
-  Image toDistanceTransform(Vector3 spacing = makeVector({1.0, 1.0, 1.0}), Dims size = {0, 0, 0}, Point3 origin = Point3({-1.0, -1.0, -1.0})) const;
+  /// converts mesh to distance transform, automatically computing size and origin if necessary.
+  /// By default the rasterized mesh is antialiased and reinitialized, with exact the signed distance
+  /// to the triangles (negative inside) is computed directly, and a positive narrowBand limits it to
+  /// the voxels near the surface, clamping the others to -narrowBand inside and narrowBand outside
+  Image toDistanceTransform(Vector3 spacing = makeVector({1.0, 1.0, 1.0}), Dims size = {0, 0, 0}, Point3 origin = Point3({-1.0, -1.0, -1.0}),
+                            bool exact = false, double narrowBand = 0.0) const;
 
   // query functions //
 
@@ -1,5 +1,6 @@
 #include "MeshUtils.h"
 #include "ParticleSystem.h"
+#include "StringUtils.h"
 
 #include <vtkIterativeClosestPointTransform.h>
 #include <vtkTransformPolyDataFilter.h>
@@ -7,19 +8,182 @@
 #include <igl/biharmonic_coordinates.h>
 #include <igl/cat.h>
 #include <igl/cotmatrix.h>
+#include <igl/massmatrix.h>
 #include <igl/matrix_to_list.h>
 #include <igl/point_mesh_squared_distance.h>
 #include <igl/remove_unreferenced.h>
 #include <igl/slice.h>
 
+#include <Eigen/SparseCholesky>
+
+#include <vtkObjectFactory.h>
+#include <vtkOutputWindow.h>
+
 // tbb
-#include <tbb/mutex.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 
+#include <algorithm>
+#include <mutex>
+#include <numeric>
 
 namespace shapeworks {
 
-// locking to handle non-thread-safe code
-static tbb::mutex mesh_mutex;
+namespace {
+
+// The legacy and XML poly data readers and writers used by Mesh::read and Mesh::write for vtk and vtp
+// files are created per call and keep no shared state, the only shared VTK state they touch are
+// singletons created on first use.  The readers and writers of the other types have not been audited
+// for concurrent use and still share one lock.
+std::once_flag vtk_io_initialized;
+std::mutex unaudited_io_mutex;
+
+std::unique_lock<std::mutex> lockMeshIO(const std::string& filename)
+{
+  std::call_once(vtk_io_initialized, []() {
+    vtkObjectFactory::GetRegisteredFactories();
+    vtkOutputWindow::GetInstance();
+  });
+
+  std::unique_lock<std::mutex> lock(unaudited_io_mutex, std::defer_lock);
+  if (!StringUtils::hasSuffix(filename, ".vtk") && !StringUtils::hasSuffix(filename, ".vtp"))
+    lock.lock();
+  return lock;
+}
+
+/// builds the triangle connectivity of the given faces
+vtkSmartPointer<vtkCellArray> buildCells(const Eigen::MatrixXi& F)
+{
+  vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+  polys->Allocate(4 * F.rows());
+  for (vtkIdType i = 0; i < F.rows(); i++)
+  {
+    polys->InsertNextCell(3);
+    polys->InsertCellPoint(F(i, 0));
+    polys->InsertCellPoint(F(i, 1));
+    polys->InsertCellPoint(F(i, 2));
+  }
+  return polys;
+}
+
+/// builds a mesh from the given vertices and (possibly shared) connectivity
+Mesh buildWarpedMesh(const Eigen::Ref<const Eigen::MatrixXd>& V, vtkSmartPointer<vtkCellArray> polys)
+{
+  vtkSmartPointer<vtkPoints> outpoints = vtkSmartPointer<vtkPoints>::New();
+  outpoints->SetNumberOfPoints(V.rows());
+  for (vtkIdType i = 0; i < V.rows(); i++)
+    outpoints->SetPoint(i, V(i, 0), V(i, 1), V(i, 2));
+
+  vtkSmartPointer<vtkPolyData> outmesh = vtkSmartPointer<vtkPolyData>::New();
+  outmesh->SetPoints(outpoints);
+  outmesh->SetPolys(polys);
+  return Mesh(outmesh);
+}
+
+Mesh buildWarpedMesh(const Eigen::MatrixXd& V, const Eigen::MatrixXi& F)
+{
+  return buildWarpedMesh(V, buildCells(F));
+}
+
+/// warps the shapes in the columns of points (x0, y0, z0, x1, ...) as one product with W
+template<typename WarpMatrix>
+std::vector<Mesh> warpAll(const Eigen::MatrixXd& points, const WarpMatrix& W, const Eigen::MatrixXi& Fref)
+{
+  const Eigen::Index numP = W.cols();
+  if (points.rows() != 3 * numP)
+    throw std::invalid_argument("warp matrix does not match the number of particles");
+
+  // gather the shapes side by side, shape s in columns 3s..3s+2
+  const Eigen::Index numShapes = points.cols();
+  Eigen::MatrixXd handles(numP, 3 * numShapes);
+  for (Eigen::Index s = 0; s < numShapes; s++)
+    handles.middleCols(3 * s, 3) = Eigen::Map<const Eigen::MatrixXd>(points.col(s).data(), 3, numP).transpose();
+
+  const Eigen::MatrixXd vertices = W * handles;
+
+  // every mesh references the same connectivity array, but gets its own cell array since
+  // traversing cells (as the writers do) moves a cursor stored in the cell array
+  vtkSmartPointer<vtkCellArray> shared = buildCells(Fref);
+  std::vector<Mesh> meshes;
+  meshes.reserve(numShapes);
+  for (Eigen::Index s = 0; s < numShapes; s++)
+  {
+    vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+    polys->SetCells(shared->GetNumberOfCells(), shared->GetData());
+    meshes.push_back(buildWarpedMesh(vertices.middleCols(3 * s, 3), polys));
+  }
+  return meshes;
+}
+
+/// warps the shapes in chunks (bounding the memory of the product) and writes them in parallel
+template<typename WarpMatrix>
+bool warpAndWrite(const std::vector<std::string>& movingPointPaths, const std::vector<std::string>& outputMeshPaths,
+                  const WarpMatrix& W, const Eigen::MatrixXi& Fref, const int numP)
+{
+  if (movingPointPaths.size() != outputMeshPaths.size())
+    throw std::invalid_argument("number of point files and output meshes differ");
+
+  ParticleSystem particlesystem(movingPointPaths);
+  const Eigen::MatrixXd& pts = particlesystem.Particles();
+  if (pts.rows() != 3 * numP)
+    throw std::invalid_argument("particle files do not hold numP particles");
+
+  const Eigen::Index chunk = 64;
+  for (Eigen::Index first = 0; first < pts.cols(); first += chunk)
+  {
+    const Eigen::Index count = std::min(chunk, pts.cols() - first);
+    std::vector<Mesh> meshes = warpAll(pts.middleCols(first, count), W, Fref);
+    tbb::parallel_for(tbb::blocked_range<Eigen::Index>{0, count},
+                      [&](const tbb::blocked_range<Eigen::Index>& r) {
+      for (Eigen::Index i = r.begin(); i < r.end(); i++)
+        MeshUtils::threadSafeWriteMesh(outputMeshPaths[first + i], std::move(meshes[i]));
+    });
+  }
+  return true;
+}
+
+using WarpWeights = std::vector<std::pair<int, double>>; // (handle, weight) of one vertex
+
+/// keeps the keep largest of the weights of a vertex and rescales them to sum to one (so that translations
+/// are still reproduced exactly), returns the magnitude of the weights dropped from total
+double finishWarpWeights(WarpWeights& weights, double total, size_t keep)
+{
+  if (weights.size() > keep)
+  {
+    std::nth_element(weights.begin(), weights.begin() + keep, weights.end(),
+                     [](const std::pair<int, double>& a, const std::pair<int, double>& b) {
+      return std::abs(a.second) > std::abs(b.second);
+    });
+    weights.resize(keep);
+  }
+  std::sort(weights.begin(), weights.end());
+
+  double sum = 0.0, keptTotal = 0.0;
+  for (const auto& entry : weights)
+  {
+    sum += entry.second;
+    keptTotal += std::abs(entry.second);
+  }
+  if (sum != 0.0)
+    for (auto& entry : weights)
+      entry.second /= sum;
+  return total - keptTotal;
+}
+
+Eigen::SparseMatrix<double> assembleWarpMatrix(const std::vector<WarpWeights>& rows, int numHandles)
+{
+  std::vector<Eigen::Triplet<double>> triplets;
+  for (size_t i = 0; i < rows.size(); i++)
+    for (const auto& entry : rows[i])
+      triplets.emplace_back(i, entry.first, entry.second);
+
+  Eigen::SparseMatrix<double> W(rows.size(), numHandles);
+  W.setFromTriplets(triplets.begin(), triplets.end());
+  return W;
+}
+
+}
+
 
 const vtkSmartPointer<vtkMatrix4x4> MeshUtils::createICPTransform(const vtkSmartPointer<vtkPolyData> source,
                                                                   const vtkSmartPointer<vtkPolyData> target,
@@ -131,61 +295,202 @@ Eigen::MatrixXd MeshUtils::generateWarpMatrix(Eigen::MatrixXd TV , Eigen::Matrix
   return W;
 }
 
+Eigen::SparseMatrix<double> MeshUtils::generateSparseWarpMatrix(Eigen::MatrixXd TV, Eigen::MatrixXi TF, Eigen::MatrixXd Vref,
+                                                                double threshold, int maxHandles)
+{
+  if (threshold < 0.0 || threshold >= 1.0)
+    throw std::invalid_argument("threshold must be in [0, 1)");
+
+  // weights are only computed for the vertices of the faces, as in generateWarpMatrix
+  {
+    Eigen::VectorXi I, J;
+    igl::remove_unreferenced(TV.rows(), TF, I, J);
+    std::for_each(TF.data(), TF.data() + TF.size(), [&I](int& a) { a = I(a); });
+    igl::slice(Eigen::MatrixXd(TV), J, 1, TV);
+  }
+  const int numVertices = TV.rows();
+  const int numHandles = Vref.rows();
+  const size_t keep = maxHandles > 0 ? std::min(maxHandles, numHandles) : numHandles;
+
+  // each particle is a point handle at its closest vertex
+  Eigen::VectorXi b;
+  {
+    Eigen::VectorXi J = Eigen::VectorXi::LinSpaced(numVertices, 0, numVertices - 1);
+    Eigen::VectorXd sqrD;
+    Eigen::MatrixXd _2;
+    igl::point_mesh_squared_distance(Vref, TV, J, sqrD, b, _2);
+  }
+  std::vector<int> handle(numVertices, -1), freeIndex(numVertices, -1);
+  for (int h = 0; h < numHandles; h++)
+    if (handle[b(h)] < 0)
+      handle[b(h)] = h;
+  int numFree = 0;
+  for (int v = 0; v < numVertices; v++)
+    if (handle[v] < 0)
+      freeIndex[v] = numFree++;
+
+  // The biharmonic coordinates (k = 2, as used by generateWarpMatrix) minimize trace(W' A W) with
+  // A = L' M^-1 L subject to W(b, :) = I, so the weights of the free vertices are -A_ff^-1 A_fb.
+  Eigen::SparseMatrix<double> L, M;
+  igl::cotmatrix(TV, TF, L);
+  igl::massmatrix(TV, TF, igl::MASSMATRIX_TYPE_DEFAULT, M);
+  const Eigen::VectorXd Minv = M.diagonal().cwiseInverse();
+  const Eigen::SparseMatrix<double> A = L.transpose() * (Minv.asDiagonal() * L);
+
+  std::vector<Eigen::Triplet<double>> ff, fb;
+  for (int k = 0; k < A.outerSize(); k++)
+    for (Eigen::SparseMatrix<double>::InnerIterator it(A, k); it; ++it)
+    {
+      const int row = freeIndex[it.row()];
+      if (row < 0)
+        continue;
+      if (freeIndex[it.col()] >= 0)
+        ff.emplace_back(row, freeIndex[it.col()], it.value());
+      else
+        fb.emplace_back(row, handle[it.col()], -it.value());
+    }
+  Eigen::SparseMatrix<double> Aff(numFree, numFree), Afb(numFree, numHandles);
+  Aff.setFromTriplets(ff.begin(), ff.end());
+  Afb.setFromTriplets(fb.begin(), fb.end());
+
+  Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> solver(Aff);
+  if (solver.info() != Eigen::Success)
+    throw std::runtime_error("unable to solve for the biharmonic coordinates, does every part of the mesh have particles?");
+
+  // The columns of the weights are solved a block of handles at a time, so the dense weights are never held
+  // at once.  A weight can only pass the threshold of its row if it passes the threshold of the largest
+  // weight seen so far, so the candidates are pruned against that as the blocks come in.
+  std::vector<WarpWeights> rows(numVertices);
+  std::vector<double> rowMax(numVertices, 0.0), rowTotal(numVertices, 0.0);
+  for (int v = 0; v < numVertices; v++)
+    if (handle[v] >= 0)
+    {
+      rows[v].emplace_back(handle[v], 1.0);
+      rowMax[v] = rowTotal[v] = 1.0;
+    }
+
+  std::vector<int> freeVertices(numFree);
+  for (int v = 0; v < numVertices; v++)
+    if (freeIndex[v] >= 0)
+      freeVertices[freeIndex[v]] = v;
+
+  const int blockSize = 64;
+  for (int first = 0; first < numHandles; first += blockSize)
+  {
+    const int count = std::min(blockSize, numHandles - first);
+    const Eigen::MatrixXd block = solver.solve(Eigen::MatrixXd(Afb.middleCols(first, count)));
+
+    tbb::parallel_for(tbb::blocked_range<int>{0, numFree, 256}, [&](const tbb::blocked_range<int>& r) {
+      for (int i = r.begin(); i < r.end(); i++)
+      {
+        const int v = freeVertices[i];
+        auto& weights = rows[v];
+        for (int c = 0; c < count; c++)
+        {
+          const double w = block(i, c);
+          rowTotal[v] += std::abs(w);
+          rowMax[v] = std::max(rowMax[v], std::abs(w));
+          if (w != 0.0 && std::abs(w) >= threshold * rowMax[v])
+            weights.emplace_back(first + c, w);
+        }
+        const double cutoff = threshold * rowMax[v];
+        weights.erase(std::remove_if(weights.begin(), weights.end(), [cutoff](const std::pair<int, double>& entry) {
+          return std::abs(entry.second) < cutoff;
+        }), weights.end());
+      }
+    });
+  }
+
+  tbb::parallel_for(tbb::blocked_range<int>{0, numVertices, 256}, [&](const tbb::blocked_range<int>& r) {
+    for (int v = r.begin(); v < r.end(); v++)
+      finishWarpWeights(rows[v], rowTotal[v], keep);
+  });
+
+  return assembleWarpMatrix(rows, numHandles);
+}
+
+Eigen::SparseMatrix<double> MeshUtils::sparsifyWarpMatrix(const Eigen::MatrixXd& W, double threshold,
+                                                          int maxHandles, double* maxDropped)
+{
+  if (threshold < 0.0 || threshold >= 1.0)
+    throw std::invalid_argument("threshold must be in [0, 1)");
+
+  const int numHandles = W.cols();
+  const size_t keep = maxHandles > 0 ? std::min(maxHandles, numHandles) : numHandles;
+
+  // rows are independent, each keeps its own handles and the weight it dropped
+  std::vector<WarpWeights> rows(W.rows());
+  std::vector<double> dropped(W.rows(), 0.0);
+  tbb::parallel_for(tbb::blocked_range<Eigen::Index>{0, W.rows(), 256},
+                    [&](const tbb::blocked_range<Eigen::Index>& r) {
+    for (Eigen::Index i = r.begin(); i < r.end(); i++)
+    {
+      double maxWeight = 0.0, total = 0.0;
+      for (int j = 0; j < numHandles; j++)
+      {
+        maxWeight = std::max(maxWeight, std::abs(W(i, j)));
+        total += std::abs(W(i, j));
+      }
+      const double cutoff = threshold * maxWeight;
+
+      for (int j = 0; j < numHandles; j++)
+        if (std::abs(W(i, j)) >= cutoff && W(i, j) != 0.0)
+          rows[i].emplace_back(j, W(i, j));
+      dropped[i] = finishWarpWeights(rows[i], total, keep);
+    }
+  });
+
+  if (maxDropped)
+    *maxDropped = dropped.empty() ? 0.0 : *std::max_element(dropped.begin(), dropped.end());
+
+  return assembleWarpMatrix(rows, numHandles);
+}
+
 Mesh MeshUtils::warpMesh(Eigen::MatrixXd movPts, Eigen::MatrixXd W, Eigen::MatrixXi Fref){
   
-  int numVertices = W.rows();
-  int numFaces = Fref.rows();
-  // std::cout<< (Vcontrol_moving.rowwise() + Eigen::RowVector3d(0,0,0)) <<std::endl;
-	Eigen::MatrixXd Voutput = W * (movPts.rowwise() + Eigen::RowVector3d(0,0,0));
-	vtkSmartPointer<vtkPolyData> outmesh = vtkSmartPointer<vtkPolyData>::New();
-	vtkSmartPointer<vtkPoints> outpoints = vtkSmartPointer<vtkPoints>::New();
-	outpoints->SetNumberOfPoints(numVertices);
-  for (vtkIdType i = 0; i < numVertices; i++)
-	{
-		outpoints->SetPoint(i, Voutput(i, 0), Voutput(i, 1), Voutput(i, 2));
-  }
-	vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
-	for (vtkIdType i = 0; i < numFaces; i++)
-	{
-		vtkIdType a, b, c;
-		polys->InsertNextCell(3);
-		polys->InsertCellPoint(Fref(i, 0));
-		polys->InsertCellPoint(Fref(i, 1));
-		polys->InsertCellPoint(Fref(i, 2));
-	}
-	outmesh->SetPoints(outpoints);
-	outmesh->SetPolys(polys);
-	
-  return Mesh(outmesh);
+  return buildWarpedMesh(W * movPts, Fref);
+}
+
+Mesh MeshUtils::warpMesh(const Eigen::MatrixXd& movPts, const Eigen::SparseMatrix<double>& W, const Eigen::MatrixXi& Fref)
+{
+  if (W.cols() != movPts.rows())
+    throw std::invalid_argument("warp matrix does not match the number of particles");
+
+  Eigen::MatrixXd Voutput = W * movPts;
+  return buildWarpedMesh(Voutput, Fref);
 }
 
 bool MeshUtils::warpMeshes(std::vector< std::string> movingPointpaths, std::vector< std::string> outputMeshPaths, Eigen::MatrixXd W, Eigen::MatrixXi Fref, const int numP){
   
-  // assert for pointsPath.size() == outMeshPaths.size()
-  // now tranform the meshes
-  ParticleSystem particlesystem(movingPointpaths);
-  Eigen::MatrixXd pts = particlesystem.Particles();
-  Eigen::MatrixXd temp;
-  for(int i = 0; i < movingPointpaths.size(); i++){	
-    temp = pts.col(i);
-    temp.resize(3, numP);
-		Mesh warped = warpMesh(temp.transpose(), W, Fref);
-    // write the mesh
-    warped.write(outputMeshPaths[i]);
-	}
-  return true;
+  return warpAndWrite(movingPointpaths, outputMeshPaths, W, Fref, numP);
+}
+
+bool MeshUtils::warpMeshes(std::vector<std::string> movingPointPaths, std::vector<std::string> outputMeshPaths,
+                           const Eigen::SparseMatrix<double>& W, const Eigen::MatrixXi& Fref, const int numP)
+{
+  return warpAndWrite(movingPointPaths, outputMeshPaths, W, Fref, numP);
+}
+
+std::vector<Mesh> MeshUtils::warpMeshes(const Eigen::MatrixXd& points, const Eigen::MatrixXd& W, const Eigen::MatrixXi& Fref)
+{
+  return warpAll(points, W, Fref);
+}
+
+std::vector<Mesh> MeshUtils::warpMeshes(const Eigen::MatrixXd& points, const Eigen::SparseMatrix<double>& W, const Eigen::MatrixXi& Fref)
+{
+  return warpAll(points, W, Fref);
 }
 
 Mesh MeshUtils::threadSafeReadMesh(std::string filename)
 {
-  tbb::mutex::scoped_lock lock(mesh_mutex);
+  auto lock = lockMeshIO(filename);
   Mesh mesh(filename);
   return mesh;
 }
 
 void MeshUtils::threadSafeWriteMesh(std::string filename, Mesh mesh)
 {
-  tbb::mutex::scoped_lock lock(mesh_mutex);
+  auto lock = lockMeshIO(filename);
   mesh.write(filename);
 }
 
@@ -4,6 +4,7 @@
 #include "Mesh.h"
 #include "Eigen/Core"
 #include "Eigen/Dense"
+#include "Eigen/Sparse"
 
 namespace shapeworks {
 
@@ -26,16 +27,39 @@ public:
   /// compute the warp matrix using the mesh and reference points
   static Eigen::MatrixXd generateWarpMatrix(Eigen::MatrixXd TV , Eigen::MatrixXi TF, Eigen::MatrixXd Vref);
 
+  /// compute the warp matrix and keep only the significant weights of each vertex (see sparsifyWarpMatrix),
+  /// solving for the weights a block of particles at a time so the dense matrix is never formed
+  static Eigen::SparseMatrix<double> generateSparseWarpMatrix(Eigen::MatrixXd TV, Eigen::MatrixXi TF, Eigen::MatrixXd Vref,
+                                                              double threshold = 1e-3, int maxHandles = 0);
+
+  /// drops the weights of each vertex smaller than threshold times its largest weight and, if maxHandles is
+  /// positive, all but its maxHandles largest weights, then rescales the kept weights to sum to one.
+  /// maxDropped (if given) is set to the largest total magnitude of the weights dropped from a vertex,
+  /// which bounds its displacement error relative to the spread of the particles
+  static Eigen::SparseMatrix<double> sparsifyWarpMatrix(const Eigen::MatrixXd& W, double threshold = 1e-3,
+                                                        int maxHandles = 0, double* maxDropped = nullptr);
+
   /// compute individual warp
   static Mesh warpMesh(Eigen::MatrixXd movPts, Eigen::MatrixXd W, Eigen::MatrixXi Fref);
 
+  /// compute individual warp using a sparse warp matrix
+  static Mesh warpMesh(const Eigen::MatrixXd& movPts, const Eigen::SparseMatrix<double>& W, const Eigen::MatrixXi& Fref);
+
   /// compute transformation from set of points files using template mesh warp&face matrices
   static bool warpMeshes(std::vector<std::string> movingPointPsaths, std::vector<std::string> outputMeshPaths, Eigen::MatrixXd W, Eigen::MatrixXi Fref, const int numP);
 
-  /// Thread safe reading of a mesh, uses a lock
+  /// compute transformation from set of points files using a sparse template mesh warp and face matrix
+  static bool warpMeshes(std::vector<std::string> movingPointPaths, std::vector<std::string> outputMeshPaths, const Eigen::SparseMatrix<double>& W, const Eigen::MatrixXi& Fref, const int numP);
+
+  /// warps all shapes with a single product, column i of points holds the particles of shape i (x0, y0, z0, x1, ...).
+  /// The returned meshes share one connectivity array, which must not be modified in place
+  static std::vector<Mesh> warpMeshes(const Eigen::MatrixXd& points, const Eigen::MatrixXd& W, const Eigen::MatrixXi& Fref);
+  static std::vector<Mesh> warpMeshes(const Eigen::MatrixXd& points, const Eigen::SparseMatrix<double>& W, const Eigen::MatrixXi& Fref);
+
+  /// Thread safe reading of a mesh, vtk and vtp files are read concurrently, other types under a lock
   static Mesh threadSafeReadMesh(std::string filename);
 
-  /// Thread safe writing of a mesh, uses a lock
+  /// Thread safe writing of a mesh, vtk and vtp files are written concurrently, other types under a lock
   static void threadSafeWriteMesh(std::string filename, Mesh mesh);
 
   /// calculate bounding box incrementally for meshes
@@ -1,6 +1,58 @@
 #include "stdafx.h"
 #include "FEAreaCoverage.h"
 #include "Intersect.h"
+#include <algorithm>
+#include <cfloat>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+namespace {
+  // faces per leaf, and the depth at which the remaining faces are put in one leaf (bounds the query stack)
+  const int bvhLeafSize = 4;
+  const int bvhMaxDepth = 48;
+
+  // IntersectTriangle accepts points up to this far outside of a triangle (in natural coordinates)
+  const double triangleTolerance = 0.01;
+
+  vec3d vmin(const vec3d& a, const vec3d& b) { return vec3d(min(a.x, b.x), min(a.y, b.y), min(a.z, b.z)); }
+  vec3d vmax(const vec3d& a, const vec3d& b) { return vec3d(max(a.x, b.x), max(a.y, b.y), max(a.z, b.z)); }
+
+  // grow the box by the region of the plane of the triangle in which IntersectTriangle finds intersections
+  void growTriangle(const vec3d& n1, const vec3d& n2, const vec3d& n3, vec3d& lower, vec3d& upper)
+  {
+    vec3d e1 = n2 - n1;
+    vec3d e2 = n3 - n1;
+    const double lo = -triangleTolerance;
+    const double hi = 1.0 + 2.0 * triangleTolerance;
+    vec3d c[3] = { n1 + e1*lo + e2*lo, n1 + e1*hi + e2*lo, n1 + e1*lo + e2*hi };
+    for (int i = 0; i < 3; ++i) {
+      lower = vmin(lower, c[i]);
+      upper = vmax(upper, c[i]);
+    }
+  }
+
+  // find the range of the line r + t*N (t in [tmin, tmax]) inside the box, returns false if it misses the box
+  bool clipLine(const vec3d& r, const vec3d& N, const vec3d& lower, const vec3d& upper, double& tmin, double& tmax)
+  {
+    const double o[3] = { r.x, r.y, r.z };
+    const double d[3] = { N.x, N.y, N.z };
+    const double lo[3] = { lower.x, lower.y, lower.z };
+    const double hi[3] = { upper.x, upper.y, upper.z };
+    for (int i = 0; i < 3; ++i) {
+      if (d[i] == 0.0) {
+        if ((o[i] < lo[i]) || (o[i] > hi[i])) return false;
+        continue;
+      }
+      double t0 = (lo[i] - o[i]) / d[i];
+      double t1 = (hi[i] - o[i]) / d[i];
+      if (t0 > t1) std::swap(t0, t1);
+      tmin = max(tmin, t0);
+      tmax = min(tmax, t1);
+      if (tmin > tmax) return false;
+    }
+    return true;
+  }
+}
 
 //-----------------------------------------------------------------------------
 void FEAreaCoverage::Surface::Create(std::shared_ptr<FEMesh> mesh)
@@ -79,6 +131,7 @@ FEAreaCoverage::FEAreaCoverage()
 	m_ballowBackIntersections = false;
 	m_angleThreshold = 0.0;
 	m_backSearchRadius = 0.0;
+	m_buseBVH = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -115,6 +168,18 @@ double FEAreaCoverage::GetBackSearchRadius() const
 	return m_backSearchRadius;
 }
 
+//-----------------------------------------------------------------------------
+void FEAreaCoverage::UseBVH(bool b)
+{
+	m_buseBVH = b;
+}
+
+//-----------------------------------------------------------------------------
+bool FEAreaCoverage::UseBVH() const
+{
+	return m_buseBVH;
+}
+
 //-----------------------------------------------------------------------------
 vector<double> FEAreaCoverage::Apply(std::shared_ptr<FEMesh> mesh1, std::shared_ptr<FEMesh> mesh2)
 {
@@ -129,9 +194,12 @@ vector<double> FEAreaCoverage::Apply(std::shared_ptr<FEMesh> mesh1, std::shared_
   UpdateSurface(m_surf1);
   UpdateSurface(m_surf2);
 
-  // repeat over all nodes of surface 1
-  vector<float> a(m_surf1.Nodes(), 0.f);
-  for (int i = 0; i < m_surf1.Nodes(); ++i)
+  // rays are only cast at surface 2
+  if (m_buseBVH) BuildBVH(m_surf2);
+
+  // repeat over all nodes of surface 1, each node only writes its own value
+  tbb::parallel_for(tbb::blocked_range<int>(0, m_surf1.Nodes(), 256), [&](const tbb::blocked_range<int>& range) {
+  for (int i = range.begin(); i < range.end(); ++i)
   {
     int inode = m_surf1.m_node[i];
     FENode& node = mesh1->Node(inode);
@@ -161,6 +229,7 @@ vector<double> FEAreaCoverage::Apply(std::shared_ptr<FEMesh> mesh1, std::shared_
 		}      
     }
   }
+  });
 
   return val;
 }
@@ -206,13 +275,145 @@ void FEAreaCoverage::UpdateSurface(FEAreaCoverage::Surface& s)
   }
 }
 
+//-----------------------------------------------------------------------------
+void FEAreaCoverage::BuildBVH(FEAreaCoverage::Surface& s)
+{
+  int NF = s.Faces();
+  s.m_bvh.clear();
+  s.m_bvhFace.resize(NF);
+  if (NF == 0) return;
+
+  // bound the region of each face in which faceIntersect can find an intersection
+  vector<vec3d> lower(NF), upper(NF);
+  for (int i = 0; i < NF; ++i) {
+    FEFace& f = s.m_mesh->Face(s.m_face[i]);
+    vec3d r[4];
+    for (int j = 0; j < f.Nodes(); ++j) r[j] = s.m_pos[s.m_lnode[4 * i + j]];
+
+    lower[i] = vec3d(DBL_MAX, DBL_MAX, DBL_MAX);
+    upper[i] = vec3d(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+    growTriangle(r[0], r[1], r[2], lower[i], upper[i]);
+    if (f.Nodes() == 4) growTriangle(r[2], r[3], r[0], lower[i], upper[i]);
+
+    // allow for round off in the intersection point
+    vec3d pad = (upper[i] - lower[i]) * 1e-6 + vec3d(1e-12, 1e-12, 1e-12);
+    lower[i] -= pad;
+    upper[i] += pad;
+    s.m_bvhFace[i] = i;
+  }
+
+  s.m_bvh.reserve(2 * (NF / bvhLeafSize + 1));
+  BuildBVHNode(s, lower, upper, 0, NF, 0);
+}
+
+//-----------------------------------------------------------------------------
+int FEAreaCoverage::BuildBVHNode(FEAreaCoverage::Surface& s, vector<vec3d>& lower, vector<vec3d>& upper, int first, int count, int depth)
+{
+  int index = (int)s.m_bvh.size();
+  s.m_bvh.push_back(Surface::BVHNode());
+
+  vec3d clower(DBL_MAX, DBL_MAX, DBL_MAX), cupper(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+  vec3d blower = clower, bupper = cupper;
+  for (int i = first; i < first + count; ++i) {
+    int n = s.m_bvhFace[i];
+    vec3d c = (lower[n] + upper[n]) * 0.5;
+    clower = vmin(clower, c);
+    cupper = vmax(cupper, c);
+    blower = vmin(blower, lower[n]);
+    bupper = vmax(bupper, upper[n]);
+  }
+  s.m_bvh[index].lower = blower;
+  s.m_bvh[index].upper = bupper;
+
+  vec3d extent = cupper - clower;
+  int axis = (extent.x >= extent.y) ? ((extent.x >= extent.z) ? 0 : 2) : ((extent.y >= extent.z) ? 1 : 2);
+  double size = (axis == 0 ? extent.x : (axis == 1 ? extent.y : extent.z));
+  if ((count <= bvhLeafSize) || (depth >= bvhMaxDepth) || (size <= 0.0)) {
+    s.m_bvh[index].offset = first;
+    s.m_bvh[index].count = count;
+    return index;
+  }
+
+  // median split along the longest axis of the face centers
+  auto center = [&](int n) {
+    vec3d c = lower[n] + upper[n];
+    return (axis == 0 ? c.x : (axis == 1 ? c.y : c.z));
+  };
+  int half = count / 2;
+  std::nth_element(s.m_bvhFace.begin() + first, s.m_bvhFace.begin() + first + half,
+                   s.m_bvhFace.begin() + first + count, [&](int a, int b) { return center(a) < center(b); });
+
+  BuildBVHNode(s, lower, upper, first, half, depth + 1);
+  int right = BuildBVHNode(s, lower, upper, first + half, count - half, depth + 1);
+  s.m_bvh[index].offset = right;
+  s.m_bvh[index].count = 0;
+  return index;
+}
+
 //-----------------------------------------------------------------------------
 bool FEAreaCoverage::intersect(const vec3d& r, const vec3d& N, FEAreaCoverage::Surface& surf, Intersection& qmin)
+{
+  if (!m_buseBVH) return linearIntersect(r, N, surf, qmin);
+
+  // create the ray
+  Ray ray = {r, N};
+  if (surf.m_bvh.empty()) return false;
+
+	// find the closest intersection, only visiting the faces whose bounds the ray passes through.
+	// Without back intersections only points in front of the node are accepted.
+	const double tstart = (m_ballowBackIntersections ? -DBL_MAX : 0.0);
+	Intersection q;
+	int imin = -1;
+	double Lmin;
+
+	int stack[bvhMaxDepth + 2];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		int index = stack[--top];
+		const Surface::BVHNode& node = surf.m_bvh[index];
+		double t0 = tstart, t1 = DBL_MAX;
+		if (!clipLine(r, N, node.lower, node.upper, t0, t1)) continue;
+
+		// the distance to the closest point of the node on the ray
+		double Lnode = ((t0 <= 0.0) && (t1 >= 0.0) ? 0.0 : min(fabs(t0), fabs(t1)));
+		if ((imin != -1) && (Lnode > Lmin * (1.0 + 1e-9))) continue;
+
+		if (node.count > 0)
+		{
+			for (int n = node.offset; n < node.offset + node.count; ++n)
+			{
+				// see if the ray intersects this face, ties go to the first face as in a linear search
+				int i = surf.m_bvhFace[n];
+				if (faceIntersect(surf, ray, i, q))
+				{
+					double L = (q.point - r).Length();
+					if ((imin == -1) || (L < Lmin) || ((L == Lmin) && (i < imin)))
+					{
+						imin = i;
+						Lmin = L;
+						qmin = q;
+					}
+				}
+			}
+			continue;
+		}
+
+		stack[top++] = node.offset;
+		stack[top++] = index + 1;
+	}
+
+	return (imin != -1);
+}
+
+//-----------------------------------------------------------------------------
+bool FEAreaCoverage::linearIntersect(const vec3d& r, const vec3d& N, FEAreaCoverage::Surface& surf, Intersection& qmin)
 {
   // create the ray
   Ray ray = {r, N};
 
-	// loop over all facets connected to this node
+	// loop over all facets of the surface
 	Intersection q;
 	int imin = -1;
 	double Lmin;
@@ -238,10 +439,9 @@ bool FEAreaCoverage::intersect(const vec3d& r, const vec3d& N, FEAreaCoverage::S
 bool FEAreaCoverage::faceIntersect(FEAreaCoverage::Surface& surf, const Ray& ray, int nface, Intersection& q)
 {
   q.m_index = -1;
-  std::shared_ptr<FEMesh> mesh = surf.m_mesh;
 
   vec3d rn[4];
-  FEFace& face = mesh->Face(surf.m_face[nface]);
+  FEFace& face = surf.m_mesh->Face(surf.m_face[nface]);
 
   bool bfound = false;
   switch (face.m_nodes) {
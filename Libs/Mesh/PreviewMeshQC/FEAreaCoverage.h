@@ -29,6 +29,17 @@ class FEAreaCoverage
     vector<vec3d> m_fnorm;                    // face normals
 
     vector<vector<int>> m_NLT;                // node-facet look-up table
+
+    // bounding volume hierarchy over the faces, nodes are stored depth first
+    // so that the left child of an inner node directly follows it
+    struct BVHNode {
+      vec3d lower;
+      vec3d upper;
+      int   offset;                           // leaf: first entry of m_bvhFace, inner: right child
+      int   count;                            // number of faces of a leaf, 0 for inner nodes
+    };
+    vector<BVHNode> m_bvh;
+    vector<int>     m_bvhFace;                // face list in leaf order
   };
 
 public:
@@ -54,12 +65,21 @@ public:
 	void SetBackSearchRadius(double R);
 	double GetBackSearchRadius() const;
 
+  // set/get whether rays are cast against the bounding volume hierarchy (default) or every face
+	void UseBVH(bool b);
+	bool UseBVH() const;
+
 protected:
   // build node normal list
   void UpdateSurface(FEAreaCoverage::Surface& s);
 
+  // build the bounding volume hierarchy of the surface faces
+  void BuildBVH(FEAreaCoverage::Surface& s);
+  int BuildBVHNode(FEAreaCoverage::Surface& s, vector<vec3d>& lower, vector<vec3d>& upper, int first, int count, int depth);
+
   // see if a ray intersects with a surface
   bool intersect(const vec3d& r, const vec3d& N, FEAreaCoverage::Surface& surf, Intersection& q);
+  bool linearIntersect(const vec3d& r, const vec3d& N, FEAreaCoverage::Surface& surf, Intersection& q);
   bool faceIntersect(FEAreaCoverage::Surface& surf, const Ray& ray, int nface, Intersection& q);
 
 protected:
@@ -69,4 +89,5 @@ protected:
 	bool		  m_ballowBackIntersections;	// include back intersections
   double		m_angleThreshold;			      // angular threshold (between 0 and 1)
 	double		m_backSearchRadius;			    // search radius for back intersections (set to 0 to ignore)
+	bool		  m_buseBVH;			            // cast rays against the bounding volume hierarchy
 };
@@ -10,6 +10,9 @@
 #include <fcntl.h>
 //#include <termios.h>
 
+#include <tbb/parallel_for.h>
+#include <tbb/enumerable_thread_specific.h>
+
 
 #define NB_ENABLE 0
 #define NB_DISABLE 1
@@ -131,7 +134,8 @@ void meshFIM::need_edge_lengths() {
 
 void meshFIM::SetMesh(TriMesh *mesh) {
   m_meshPtr = mesh;
-  this->geodesicMap.resize(m_meshPtr->vertices.size());
+  vertOneringFaces.clear();
+  this->geodesicStore.resize(m_meshPtr->vertices.size());
   // orient the mesh for consistent vertex ordering...
   orient(m_meshPtr);//  Manasi
   // have to recompute the normals and other attributes required for rendering
@@ -152,39 +156,30 @@ void meshFIM::SetMesh(TriMesh *mesh) {
   need_speed();
 }
 
-void meshFIM::InitializeLabels() {
+void meshFIM::InitializeSolve(const std::vector<index> &seeds, FIMScratch &scratch) {
   if (!m_meshPtr) {
     std::cerr << "Label-vector size unknown, please set the mesh first..." << std::endl;
     throw(1);
   }
-  else {
-    // initialize all labels to 'Far'
-    int nv = m_meshPtr->vertices.size();
-    if (m_Label.size() != nv) m_Label.resize(nv);
-    for (int l = 0; l < nv; l++) {
-      m_Label[l] = FarPoint;
-    }
 
-    // if seeed-points are present, treat them differently
-    if (!m_SeedPoints.empty()) {
-      for (int s = 0; s < m_SeedPoints.size(); s++) {
-        m_Label[m_SeedPoints[s]] = SeedPoint;//m_Label[s] = LabelType::SeedPoint;
-      }
-    }
+  // initialize all labels to 'Far'
+  int nv = m_meshPtr->vertices.size();
+  scratch.label.assign(nv, FarPoint);
+  scratch.geodesic.assign(nv, LARGENUM);
+  scratch.active.clear();
+
+  // if seeed-points are present, treat them differently
+  for (int s = 0; s < seeds.size(); s++) {
+    scratch.label[seeds[s]] = SeedPoint;
+    scratch.geodesic[seeds[s]] = 0;
   }
-}
 
-void meshFIM::InitializeActivePoints() {
-  if (!m_SeedPoints.empty()) {
-    int ns = m_SeedPoints.size();
-    std::vector<index> nb;
-    for (int s = 0; s < ns; s++) {
-      nb = m_meshPtr->neighbors[m_SeedPoints[s]];
-      for (int i = 0; i < nb.size(); i++) {
-        if (m_Label[nb[i]] != SeedPoint) {
-          m_ActivePoints.push_back(nb[i]);
-          m_Label[nb[i]] = ActivePoint;
-        }
+  for (int s = 0; s < seeds.size(); s++) {
+    const std::vector<int> &nb = m_meshPtr->neighbors[seeds[s]];
+    for (int i = 0; i < nb.size(); i++) {
+      if (scratch.label[nb[i]] != SeedPoint && scratch.label[nb[i]] != ActivePoint) {
+        scratch.active.push_back(nb[i]);
+        scratch.label[nb[i]] = ActivePoint;
       }
     }
   }
@@ -303,7 +298,7 @@ std::vector<TriMesh::Face> meshFIM::GetOneRing(int v/*, int currentVert*/) {
 }
 
 
-float meshFIM::LocalSolver(index vet, TriMesh::Face triangle, index currentVert) {
+float meshFIM::LocalSolver(index vet, const TriMesh::Face &triangle, const std::vector<float> &geodesic) {
   float a, b, delta, cosA, lamda1, lamda2, TC1, TC2;
   float TAB, TA, TB, TC;
   int A, B, C;
@@ -338,9 +333,9 @@ float meshFIM::LocalSolver(index vet, TriMesh::Face triangle, index currentVert)
   TC1 = LARGENUM;
   TC2 = LARGENUM;
 
-  TA = this->geodesic[triangle[A]];
-  TB = this->geodesic[triangle[B]];
-  TC = this->geodesic[triangle[C]];
+  TA = geodesic[triangle[A]];
+  TB = geodesic[triangle[B]];
+  TC = geodesic[triangle[C]];
 
 
   TAB = TB - TA;
@@ -391,148 +386,225 @@ float meshFIM::LocalSolver(index vet, TriMesh::Face triangle, index currentVert)
   return TC;
 }
 
-float meshFIM::Upwind(index currentVert,index vet)
+float meshFIM::Upwind(index vet, const std::vector<float> &geodesic)
 {
     float result=LARGENUM;
-    float tmp;
-    std::vector<TriMesh::Face> neighborFaces = this->GetOneRing(vet/*, currentVert*/);
-    // WAS THIS LINE BELOW ON Nov17 - Change Back when GetOneRing works for speed!
-    //vector<TriMesh::Face> neighborFaces = m_meshPtr->vertOneringFaces[vet];
-
-    //vector<int> neighborFaces = m_meshPtr->adjacentfaces[vet];
-    int i;
-    for (i = 0; i < neighborFaces.size(); i++)
+    const std::vector<TriMesh::Face> &neighborFaces = this->vertOneringFaces[vet];
+    for (int i = 0; i < neighborFaces.size(); i++)
     {
-        tmp = LocalSolver(vet, neighborFaces[i], currentVert);
-        //tmp = LocalSolver(vet, m_meshPtr->faces[neighborFaces[i]], currentVert);
-        NumComputation++;
-
-        result = MIN(result,tmp );
-        //m_meshPtr->vertT[currentVert][vet] = result;
+        result = MIN(result, LocalSolver(vet, neighborFaces[i], geodesic));
     }
 
     return result;
 }
 
-// FIM: initialize attributes
-void meshFIM::InitializeAttributes(int currentVert, std::vector<int> seeds = std::vector<int>()) {
-
-  for (int v = 0; v < m_meshPtr->vertices.size(); v++) {
-    this->geodesic.push_back(LARGENUM);
-  }
-  // initialize seed points if present...
-  for (int s = 0; s < seeds.size(); s++) {
-    this->geodesic[seeds[s]] = 0;
-  }
-  // pre-compute faces, normals, and other per-vertex properties that may be needed
+// FIM: pre-compute faces, normals, and other per-vertex properties read by the solver, so that
+// solves can run concurrently without modifying the mesh
+void meshFIM::PrepareSolve() {
   m_meshPtr->need_neighbors();
   m_meshPtr->need_normals();
   m_meshPtr->need_adjacentfaces();
   m_meshPtr->need_across_edge();
   m_meshPtr->need_faces();
+  need_oneringfaces();
 }
 
-// FIM:  Remove data lingering from computation
-void meshFIM::CleanupAttributes() {
-  this->geodesic.clear();
-}
-
-
-void meshFIM::GenerateReducedData() {
-  std::list<index>::iterator iter = m_ActivePoints.begin();
-  float oldT1, newT1, oldT2, newT2;
-  index tmpIndex1, tmpIndex2;
-  std::vector<int>  nb;
-  NumComputation = 0;
-  double total_duration = 0;
-
-  clock_t starttime, endtime;
-  starttime = clock();
-
-  char c;
-  int i = 0;
-
-  for (int currentVert = 0; currentVert < m_meshPtr->vertices.size(); currentVert++) {
-
-    std::vector<int> seedPointList(1, currentVert);
-    SetSeedPoint(seedPointList);
-
-    this->InitializeAttributes(currentVert, m_SeedPoints);
-
-    InitializeLabels();
-    InitializeActivePoints();
+// FIM: single threaded solve from the given seeds, updating the active list in place
+void meshFIM::Solve(const std::vector<index> &seeds, float stopDistance, FIMScratch &scratch)
+{
+  InitializeSolve(seeds, scratch);
+  std::vector<float> &geodesic = scratch.geodesic;
+  std::vector<LabelType> &label = scratch.label;
+  std::list<index> activePoints(scratch.active.begin(), scratch.active.end());
 
-    while (!m_ActivePoints.empty()) {
-      iter = m_ActivePoints.begin();
+  while (!activePoints.empty()) {
+    std::list<index>::iterator iter = activePoints.begin();
 
-      while (iter != m_ActivePoints.end()) {
-        tmpIndex1 = *iter;
-        nb = m_meshPtr->neighbors[tmpIndex1];
-        oldT1 = this->geodesic[tmpIndex1];
+    while (iter != activePoints.end()) {
+      index tmpIndex1 = *iter;
+      const std::vector<int> &nb = m_meshPtr->neighbors[tmpIndex1];
+      float oldT1 = geodesic[tmpIndex1];
 
-        newT1 = Upwind(currentVert, tmpIndex1);
+      float newT1 = Upwind(tmpIndex1, geodesic);
+      scratch.numComputation += vertOneringFaces[tmpIndex1].size();
 
-        if (abs(oldT1 - newT1) < _EPS)    //if converges
-        {
-          if (oldT1 > newT1) {
-            this->geodesic[tmpIndex1] = newT1;
-          }
-          if (this->geodesic[tmpIndex1] < m_StopDistance) {
-            for (i = 0; i < nb.size(); i++) {
-              tmpIndex2 = nb[i];
-              if (m_Label[tmpIndex2] == AlivePoint || m_Label[tmpIndex2] == FarPoint) {
-                oldT2 = this->geodesic[tmpIndex2];
-
-                newT2 = Upwind(currentVert, tmpIndex2);
-                if (oldT2 > newT2) {
-                  this->geodesic[tmpIndex2] = newT2;
-
-                  if (m_Label[tmpIndex2] != ActivePoint) {
-                    m_ActivePoints.insert(iter, tmpIndex2);
-                    m_Label[tmpIndex2] = ActivePoint;
-                  }
+      if (abs(oldT1 - newT1) < _EPS)    //if converges
+      {
+        if (oldT1 > newT1) {
+          geodesic[tmpIndex1] = newT1;
+        }
+        if (geodesic[tmpIndex1] < stopDistance) {
+          for (int i = 0; i < nb.size(); i++) {
+            index tmpIndex2 = nb[i];
+            if (label[tmpIndex2] == AlivePoint || label[tmpIndex2] == FarPoint) {
+              float oldT2 = geodesic[tmpIndex2];
+
+              float newT2 = Upwind(tmpIndex2, geodesic);
+              scratch.numComputation += vertOneringFaces[tmpIndex2].size();
+              if (oldT2 > newT2) {
+                geodesic[tmpIndex2] = newT2;
+
+                if (label[tmpIndex2] != ActivePoint) {
+                  activePoints.insert(iter, tmpIndex2);
+                  label[tmpIndex2] = ActivePoint;
                 }
               }
             }
           }
-          iter = m_ActivePoints.erase(iter);
-          m_Label[tmpIndex1] = AlivePoint;
         }
-        else   // if not converge
-        {
-          if (newT1 < oldT1) {
-            this->geodesic[tmpIndex1] = newT1;
-          }
-          iter++;
+        iter = activePoints.erase(iter);
+        label[tmpIndex1] = AlivePoint;
+      }
+      else   // if not converge
+      {
+        if (newT1 < oldT1) {
+          geodesic[tmpIndex1] = newT1;
         }
+        iter++;
       }
     }
-    // Loop Through And Copy Only Values < than m_StopDistance
-    int nv = m_meshPtr->vertices.size();
-    for (int v = 0; v < currentVert; v++) {
-      if ((this->geodesic[v] <= m_StopDistance) && (this->geodesic[v] > 0)) {
-        //m_meshPtr->geoMap[currentVert][v] = m_meshPtr->geodesic[v];
-        //(*(m_meshPtr->dMap))[currentVert].push_back(m_meshPtr->geodesic[v]);
-        //(*(m_meshPtr->iMap))[currentVert].push_back(v);
-        (this->geodesicMap[currentVert])[v] = this->geodesic[v];
+  }
+}
+
+// FIM: data parallel solve from the given seeds.  Each sweep updates all active points from the
+// values of the previous sweep, then the neighbors of the converged points, so that the upwind
+// evaluations, which dominate the cost, only read the shared distances and run concurrently.
+void meshFIM::SolveParallel(const std::vector<index> &seeds, float stopDistance, FIMScratch &scratch)
+{
+  InitializeSolve(seeds, scratch);
+  std::vector<float> &geodesic = scratch.geodesic;
+  std::vector<LabelType> &label = scratch.label;
+  std::vector<index> &active = scratch.active;
+
+  std::vector<float> newT;
+  std::vector<index> converged;
+  std::vector<size_t> candidateOffsets;
+  std::vector<float> candidates;
+  std::vector<index> nextActive;
+
+  while (!active.empty()) {
+    // update the active points
+    newT.resize(active.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>{0, active.size(), 64},
+                      [&](const tbb::blocked_range<size_t> &r) {
+                        for (size_t i = r.begin(); i < r.end(); ++i) {
+                          newT[i] = Upwind(active[i], geodesic);
+                        }
+                      });
+
+    converged.clear();
+    nextActive.clear();
+    for (size_t i = 0; i < active.size(); i++) {
+      index tmpIndex1 = active[i];
+      float oldT1 = geodesic[tmpIndex1];
+      scratch.numComputation += vertOneringFaces[tmpIndex1].size();
+      if (newT[i] < oldT1) {
+        geodesic[tmpIndex1] = newT[i];
+      }
+      if (abs(oldT1 - newT[i]) < _EPS)    //if converges
+      {
+        label[tmpIndex1] = AlivePoint;
+        if (geodesic[tmpIndex1] < stopDistance) {
+          converged.push_back(tmpIndex1);
+        }
+      }
+      else {
+        nextActive.push_back(tmpIndex1);
+      }
+    }
+
+    // evaluate the neighbors of the converged points that may improve
+    candidateOffsets.resize(converged.size() + 1);
+    candidateOffsets[0] = 0;
+    for (size_t i = 0; i < converged.size(); i++) {
+      candidateOffsets[i + 1] = candidateOffsets[i] + m_meshPtr->neighbors[converged[i]].size();
+    }
+    candidates.resize(candidateOffsets.back());
+    tbb::parallel_for(tbb::blocked_range<size_t>{0, converged.size(), 16},
+                      [&](const tbb::blocked_range<size_t> &r) {
+                        for (size_t i = r.begin(); i < r.end(); ++i) {
+                          const std::vector<int> &nb = m_meshPtr->neighbors[converged[i]];
+                          for (size_t j = 0; j < nb.size(); j++) {
+                            const LabelType l = label[nb[j]];
+                            candidates[candidateOffsets[i] + j] =
+                              (l == AlivePoint || l == FarPoint) ? Upwind(nb[j], geodesic) : LARGENUM;
+                          }
+                        }
+                      });
+
+    for (size_t i = 0; i < converged.size(); i++) {
+      const std::vector<int> &nb = m_meshPtr->neighbors[converged[i]];
+      for (size_t j = 0; j < nb.size(); j++) {
+        index tmpIndex2 = nb[j];
+        float newT2 = candidates[candidateOffsets[i] + j];
+        if (newT2 < geodesic[tmpIndex2]) {
+          geodesic[tmpIndex2] = newT2;
+          if (label[tmpIndex2] != ActivePoint) {
+            nextActive.push_back(tmpIndex2);
+            label[tmpIndex2] = ActivePoint;
+          }
+        }
       }
     }
-    // Now Erase the duplicate data
-    this->CleanupAttributes();
-
-    endtime = clock();
-    total_duration = ( double) (endtime - starttime) / CLOCKS_PER_SEC;
-    float percent = (currentVert + 1) / ( float) m_meshPtr->vertices.size();
-
-    double total_time = total_duration / percent;
-    double time_left = total_time - total_duration;
-    int hours = ( int) (time_left / (60 * 60));
-    int minutes = ( int) ((time_left - hours * 60 * 60) / 60);
-    int seconds = ( int) (time_left - hours * 60 * 60 - minutes * 60);
-    int count = (this->geodesicMap[currentVert]).size();
+
+    active.swap(nextActive);
   }
 }
 
+std::vector<float> meshFIM::ComputeDistances(const std::vector<index> &seeds, float stopDistance, bool parallel)
+{
+  PrepareSolve();
+
+  FIMScratch scratch;
+  if (parallel) {
+    SolveParallel(seeds, stopDistance, scratch);
+  }
+  else {
+    Solve(seeds, stopDistance, scratch);
+  }
+  NumComputation = scratch.numComputation;
+  return scratch.geodesic;
+}
+
+// Each source vertex is solved independently on a thread local scratch buffer, and the rows are
+// merged into the geodesic store in vertex order.
+void meshFIM::GenerateReducedData() {
+  const int nv = m_meshPtr->vertices.size();
+  PrepareSolve();
+
+  std::vector< std::vector<gDistPair> > rows(nv);
+  tbb::enumerable_thread_specific<FIMScratch> scratches;
+  const float stopDistance = m_StopDistance;
+
+  tbb::parallel_for(tbb::blocked_range<int>{0, nv},
+                    [&](const tbb::blocked_range<int> &r) {
+                      FIMScratch &scratch = scratches.local();
+                      for (int currentVert = r.begin(); currentVert < r.end(); ++currentVert) {
+                        Solve(std::vector<index>(1, currentVert), stopDistance, scratch);
+
+                        // Loop Through And Copy Only Values < than m_StopDistance
+                        for (int v = 0; v < currentVert; v++) {
+                          if ((scratch.geodesic[v] <= stopDistance) && (scratch.geodesic[v] > 0)) {
+                            rows[currentVert].push_back(gDistPair(v, scratch.geodesic[v]));
+                          }
+                        }
+                      }
+                    });
+
+  NumComputation = 0;
+  for (const FIMScratch &scratch : scratches) {
+    NumComputation += scratch.numComputation;
+  }
+
+  for (int currentVert = 0; currentVert < nv; currentVert++) {
+    for (const gDistPair &entry : rows[currentVert]) {
+      this->geodesicStore.insert(currentVert, entry.first, entry.second);
+    }
+    std::vector<gDistPair>().swap(rows[currentVert]);
+  }
+  this->geodesicStore.finalize();
+}
+
 // SHIREEN - modified the loading to control the generation of geo files (till we add the geo repulsion stuff)
 void meshFIM::loadGeodesicFile(TriMesh *mesh, const char *geoFileName)
 {
@@ -545,7 +617,7 @@ void meshFIM::loadGeodesicFile(TriMesh *mesh, const char *geoFileName)
         {
 //            cout << "File Not Found, will generate the geo file now ..." << endl;
             int numVert = mesh->vertices.size();
-            this->geodesicMap.resize(numVert);
+            this->geodesicStore.resize(numVert);
             this->computeFIM(mesh,geoFileName);
         }
 //        else
@@ -553,38 +625,15 @@ void meshFIM::loadGeodesicFile(TriMesh *mesh, const char *geoFileName)
     }
     else
     {
+        infile.close();
         int numVert = mesh->vertices.size();
-        //mesh->geoMap.resize(numVert);
-        //mesh->geoIndex.resize(numVert);
-
-        this->geodesicMap.resize(numVert);
 
-        // read stop distance
+        // memory map the file, older per vertex files are read and converted
+        this->geodesicStore.resize(numVert);
         float distance;
-        infile.read(reinterpret_cast<char *>(&distance), sizeof(float));
-        this->SetStopDistance(distance);
-
-        // loop over vertices
-        for (int i = 0; i < numVert; i++)
-        {
-            // read map size for vertex
-            unsigned int dLength;
-            infile.read( reinterpret_cast<char *>(&dLength), sizeof(unsigned int) );
-
-            // read key and distance pair
-            for (int j = 0; j < dLength; j++)
-            {
-                unsigned int index;
-                infile.read( reinterpret_cast<char *>(&index), sizeof(unsigned int) );
-
-                float dist;
-                infile.read( reinterpret_cast<char *>(&dist), sizeof(float) );
-
-                (this->geodesicMap[i])[index] = dist;
-            }
+        if (this->geodesicStore.load(geoFileName, distance)) {
+            this->SetStopDistance(distance);
         }
-
-        infile.close();
     }
 
 }
@@ -685,124 +734,29 @@ void meshFIM::computeFIM(TriMesh *mesh, const char *vertT_filename)
     //(mesh->dMap)->resize(numVert);
     //(mesh->iMap)->resize(numVert);
 
-    this->geodesicMap.resize(numVert);
+    this->geodesicStore.resize(numVert);
 
     this->SetMesh(mesh);
 
     if (!infile.is_open())
     {
-        //vertTFile = fopen(vertT_filename, "w+");
-//        ofstream outfile(vertT_filename, std::ios::binary);
-      std::ofstream outfile(vertT_filename, std::ofstream::out);
       std::cout << "No vertT file!!!\n Writing..." << std::endl;
       std::cout << "stop distance = " << this->GetStopDistance() << std::endl;
       std::cout << "# vertices in mesh: " << numVert << std::endl;
 
         this->GenerateReducedData();
 
-        // write stop distance
-        float dStop = this->GetStopDistance();
-//        outfile.write( reinterpret_cast<char *>(&dStop), sizeof(float) );
-
-        // loop over each vertex
-        for (int i = 0; i < numVert; i++)
-        {
-            // write map size for vertex
-            unsigned int dLength = this->geodesicMap[i].size();
-//            outfile.write( reinterpret_cast<char *>(&dLength), sizeof(unsigned int) );
-
-            // write key and distance pair
-            for (std::map<unsigned int,float>::iterator it= this->geodesicMap[i].begin(); it != this->geodesicMap[i].end(); it++)
-            {
-                unsigned int index = (*it).first;
-//                outfile.write( reinterpret_cast<char *>(&index), sizeof(unsigned int) );
-
-                float dist = (*it).second;
-//                outfile.write( reinterpret_cast<char *>(&dist), sizeof(float) );
-
-                outfile << i << " " << index << " " << dist << std::endl;
-            }
+        if (!this->geodesicStore.save(vertT_filename, this->GetStopDistance())) {
+          std::cerr << "Unable to write " << vertT_filename << std::endl;
         }
-
-        //// First Line In File Is Stop Distance
-        //outfile << this->GetStopDistance() * s << endl;
-
-        //// Loop Over Each Vertex
-        //for (int i = 0; i < numVert; i++)
-        //{
-        //    std::map<unsigned int,unsigned int>::iterator mIter;
-        //
-        //    for(mIter = mesh->geodesicMap[i].begin(); mIter != mesh->geodesicMap[i].end(); mIter++)
-        //    {
-        //      outfile << (*mIter).first << " " << (*mIter).second << " ";
-        //	}
-
-        //	outfile << endl;
-        //}
-
-        outfile.close();
     }
     else
     {
-        // read stop distance
+        infile.close();
         float distance;
-        infile.read(reinterpret_cast<char *>(&distance), sizeof(float));
-        this->SetStopDistance(distance);
-
-        // loop over vertices
-        for (int i = 0; i < numVert; i++)
-        {
-            // read map size for vertex
-            unsigned int dLength;
-            infile.read( reinterpret_cast<char *>(&dLength), sizeof(unsigned int) );
-
-            // read key and distance pair
-            for (int j = 0; j < dLength; j++)
-            {
-                unsigned int index;
-                infile.read( reinterpret_cast<char *>(&index), sizeof(unsigned int) );
-
-                float dist;
-                infile.read( reinterpret_cast<char *>(&dist), sizeof(float) );
-
-                (this->geodesicMap[i])[index] = dist;
-            }
+        if (this->geodesicStore.load(vertT_filename, distance)) {
+          this->SetStopDistance(distance);
         }
-
-        //unsigned int vertex;
-        //unsigned int distance;
-        //string line;
-
-        //// First Line In File Is Stop Distance
-        //getline(infile, line);
-        //stringstream str(line);
-        //str >> distance;
-        //
-        //this->SetStopDistance((float)distance/(float)s);
-        //  cout << "Loading " << vertT_filename << endl;
-
-        //for(int i=0; i < numVert; i++){
-        //
-        //	string line;
-        //	getline(infile, line);
-        //	stringstream str(line);
-        //
-        //	str >> vertex >> distance;
-        //	while(!str.eof())
-        //    {
-        //		//mesh->geoMap[i].push_back(distance);
-        //		//mesh->geoIndex[i].push_back(vertex);
-        //      (mesh->geodesicMap[i])[vertex] = distance;
-        //		str >> vertex >> distance;
-        //	}
-
-        //	//printf("\r                                              \r");
-        //	//printf("progress %.1f%%", (i+1.0f)/(numVert)*100);
-        //	//fflush(stdout);
-        //
-        //}
-        //cout << endl;
-        infile.close();
     }
 }
 
@@ -1621,15 +1575,7 @@ float meshFIM::GetGeodesicDistance(int v1, int v2) {
     key = v1;
   }
 
-  std::map<unsigned int, float>::iterator geoIter = this->geodesicMap[vert].find(key);
-  if (geoIter != this->geodesicMap[vert].end()) {
-    gDist = geoIter->second;
-  }
-  else {
-    gDist = LARGENUM;
-  }
-
-  return gDist;
+  return this->geodesicStore.getDistance(vert, key, LARGENUM);
 }
 
 float meshFIM::GetBronsteinGeodesicDistance(TriMesh::Face Sa, TriMesh::Face Sb, vnl_vector <float> baryCoord_a, vnl_vector <float> baryCoord_b, char *method) {
@@ -1736,7 +1682,7 @@ void meshFIM::ComputeDistanceToLandmarksGivenTriangleInfo(TriMesh *mesh, const c
     // initialize the geodesic map to hold the geodesics from the triangle vertices of the given landmark to all other mesh vertices
     SetStopDistance(1e7);
     int numVert = mesh->vertices.size();
-    this->geodesicMap.resize(numVert);
+    this->geodesicStore.resize(numVert);
     SetMesh(mesh);
 
     std::ifstream pointsFile(infilename);
@@ -1823,7 +1769,7 @@ void meshFIM::ComputeDistanceToLandmark(TriMesh *mesh, point landmark, bool appl
 {
     // initialize the geodesic map to hold the geodesics from the triangle vertices of the given landmark to all other mesh vertices
     int numVert = mesh->vertices.size();
-    this->geodesicMap.resize(numVert);
+    this->geodesicStore.resize(numVert);
     SetMesh(mesh);
 
     // get which triangle the given landmark should belong to
@@ -1871,109 +1817,37 @@ void meshFIM::ComputeDistanceToLandmark(TriMesh *mesh, point landmark, bool appl
 
 void meshFIM::UpdateGeodesicMapWithDistancesFromVertices(std::vector<int> vertexIdlist)
 {
-    std::list<index>::iterator iter = m_ActivePoints.begin();
-    float oldT1 , newT1, oldT2, newT2;
-    index tmpIndex1, tmpIndex2;
-    std::vector<int>  nb;
-    int i = 0;
+    // to enable computing geodesic from the current vertex to all mesh vertices
+    SetStopDistance(LARGENUM);
+    PrepareSolve();
+
+    // a few sources, each of which is solved with the parallel active list, so every source gets
+    // its own scratch buffers rather than a thread local one
+    std::vector<FIMScratch> scratches(vertexIdlist.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>{0, vertexIdlist.size(), 1},
+                      [&](const tbb::blocked_range<size_t> &r) {
+                        for (size_t ii = r.begin(); ii < r.end(); ++ii) {
+                          SolveParallel(std::vector<index>(1, vertexIdlist[ii]), m_StopDistance, scratches[ii]);
+                        }
+                      });
 
+    int nv = m_meshPtr->vertices.size();
     for (int ii = 0 ; ii < vertexIdlist.size(); ii++)
     {
         int currentVert = vertexIdlist[ii];
-
-        std::vector<int> seedPointList(1, currentVert);
-        SetSeedPoint(seedPointList);
-
-        this->InitializeAttributes(currentVert, m_SeedPoints);
-
-        InitializeLabels();
-        InitializeActivePoints();
-
-        // to enable computing geodesic from the current vertex to all mesh vertices
-        SetStopDistance(LARGENUM);
-        while (!m_ActivePoints.empty())
-        {
-            //printf("Size of Activelist is: %d \n", m_ActivePoints.size());
-            iter = m_ActivePoints.begin();
-
-            while(iter != m_ActivePoints.end()) {
-                tmpIndex1 = *iter;
-                nb = m_meshPtr->neighbors[tmpIndex1];
-                oldT1 = this->geodesic[tmpIndex1];
-
-                newT1 = Upwind(currentVert,tmpIndex1);
-
-                if (abs(oldT1-newT1)<_EPS)    //if converges
-                {
-                    if (oldT1>newT1){
-                      this->geodesic[tmpIndex1] = newT1;
-                    }
-
-                    if(this->geodesic[tmpIndex1] < m_StopDistance)
-                    {
-                        for (i=0;i<nb.size();i++)
-                        {
-                            tmpIndex2 = nb[i];
-                            if (m_Label[tmpIndex2]==AlivePoint || m_Label[tmpIndex2]==FarPoint)
-                            {
-                                oldT2 = this->geodesic[tmpIndex2];
-
-                                newT2 = Upwind(currentVert,tmpIndex2);
-                                if (oldT2>newT2)
-                                {
-                                  this->geodesic[tmpIndex2] = newT2;
-
-                                    if (m_Label[tmpIndex2]!=ActivePoint)
-                                    {
-                                        m_ActivePoints.insert(iter, tmpIndex2);
-                                        //iter++;
-                                        m_Label[tmpIndex2] = ActivePoint;
-                                    }
-                                }
-                            }
-                        }
-                    }
-
-                    iter =  m_ActivePoints.erase(iter);
-                    m_Label[tmpIndex1] = AlivePoint;
-
-                }
-                else   // if not converge
-                {
-                    if(newT1 < oldT1){
-                      this->geodesic[tmpIndex1] = newT1;
-                    }
-
-                    iter++;
-                }
-            }
-        }
+        const std::vector<float> &geodesic = scratches[ii].geodesic;
 
         // Loop Through And Copy Only Values < than
-        int nv = m_meshPtr->vertices.size();
         for(int v = 0; v < nv; v++){
-            if ((this->geodesic[v] <= m_StopDistance) && (this->geodesic[v] > 0))
+            if ((geodesic[v] <= m_StopDistance) && (geodesic[v] > 0))
             {
-                int v1 = currentVert;
-                int v2 = v;
-
-                int vert = v1;
-                int key = v2;
-
-                if (v2 > v1)
-                {
-                    vert = v2;
-                    key = v1;
-                }
-                //(m_meshPtr->geodesicMap[currentVert])[v] = m_meshPtr->geodesic[v];
-                (this->geodesicMap[vert])[key] = this->geodesic[v];
+                this->geodesicStore.insert(currentVert, v, geodesic[v]);
             }
         }
-
-        // Now Erase the duplicate data
-        this->CleanupAttributes();
     }
 
+    this->geodesicStore.finalize();
+
 }
 
 // end SHIREEN
@@ -1983,7 +1857,7 @@ void meshFIM::ComputeDistanceToCurve(TriMesh *mesh, std::vector< point > curvePo
 {
     // initialize the geodesic map to hold the geodesics from the triangle vertices of the given landmark to all other mesh vertices
     int numVert = mesh->vertices.size();
-    this->geodesicMap.resize(numVert);
+    this->geodesicStore.resize(numVert);
     SetMesh(mesh);
 
     // get which triangle the given landmark should belong to
@@ -2143,19 +2017,9 @@ int meshFIM::GetVertexInfoForPoint(point x) {
 std::vector<float> meshFIM::ComputeDistanceToCurve(TriMesh *mesh, std::vector< point > curvePoints)
 {
     int numVert = mesh->vertices.size();
-    this->geodesicMap.resize(numVert);
+    this->geodesicStore.resize(numVert);
     SetMesh(mesh);
 
-    std::list<index>::iterator iter = m_ActivePoints.begin();
-    float oldT1 , newT1, oldT2, newT2;
-    index tmpIndex1, tmpIndex2;
-    std::vector<int>  nb;
-    NumComputation = 0;
-
-    double total_duration = 0;
-    char c;
-    int i=0;
-
     std::vector<int> seedPointList;
     for (int pIndex = 0; pIndex < curvePoints.size(); pIndex++)
     {
@@ -2166,81 +2030,21 @@ std::vector<float> meshFIM::ComputeDistanceToCurve(TriMesh *mesh, std::vector< p
     }
     SetSeedPoint(seedPointList);
 
-    this->InitializeAttributes(0, m_SeedPoints);
-
-    InitializeLabels();
-    InitializeActivePoints();
-
     SetStopDistance(LARGENUM);
+    PrepareSolve();
 
-    while (!m_ActivePoints.empty())
-    {
-        //printf("Size of Activelist is: %d \n", m_ActivePoints.size());
-        iter = m_ActivePoints.begin();
-
-        while(iter != m_ActivePoints.end())
-        {
-            tmpIndex1 = *iter;
-            nb = m_meshPtr->neighbors[tmpIndex1];
-            oldT1 = this->geodesic[tmpIndex1];
-
-            newT1 = Upwind(0,tmpIndex1);
-
-            if (abs(oldT1-newT1)<_EPS)    //if converges
-            {
-                if (oldT1>newT1)
-                {
-                  this->geodesic[tmpIndex1] = newT1;
-                }
-
-                if(this->geodesic[tmpIndex1] < m_StopDistance)
-                {
-                    for (i=0;i<nb.size();i++)
-                    {
-                        tmpIndex2 = nb[i];
-                        if (m_Label[tmpIndex2]==AlivePoint || m_Label[tmpIndex2]==FarPoint)
-                        {
-                            oldT2 = this->geodesic[tmpIndex2];
-
-                            newT2 = Upwind(0,tmpIndex2);
-                            if (oldT2>newT2)
-                            {
-                              this->geodesic[tmpIndex2] = newT2;
-
-                                if (m_Label[tmpIndex2]!=ActivePoint)
-                                {
-                                    m_ActivePoints.insert(iter, tmpIndex2);
-                                    m_Label[tmpIndex2] = ActivePoint;
-                                }
-                            }
-                        }
-                    }
-                }
-
-                iter =  m_ActivePoints.erase(iter);
-                m_Label[tmpIndex1] = AlivePoint;
-
-            }
-            else   // if not converge
-            {
-                if(newT1 < oldT1)
-                {
-                  this->geodesic[tmpIndex1] = newT1;
-                }
-
-                iter++;
-            }
-        }
-    }
+    FIMScratch scratch;
+    SolveParallel(m_SeedPoints, m_StopDistance, scratch);
+    NumComputation = scratch.numComputation;
 
     std::vector<float> geodesics;geodesics.clear();
     // loop over each vertex
     for (int i = 0; i < numVert; i++)
     {
-        geodesics.push_back(this->geodesic[i] + 0.0001f);
+        geodesics.push_back(scratch.geodesic[i] + 0.0001f);
     }
-    // Now Erase the duplicate data
-    this->CleanupAttributes();
+    // keep the distances for WriteFeaFile
+    this->geodesic.swap(scratch.geodesic);
 
     return geodesics;
 }
@@ -6,6 +6,7 @@
 #include "TriMesh_algo.h"
 #include "KDtree.h"
 #include "Color.h"
+#include "GeodesicStore.h"
 
 
 //#include "itkImageToImageFilter.h"
@@ -92,6 +93,11 @@ public:
 
 
     void SetMesh(TriMesh *mesh);
+
+    // distances from the seed vertices to every vertex of the mesh within stopDistance, using the serial
+    // or the parallel solver (vertices further away keep a large value)
+    std::vector<float> ComputeDistances(const std::vector<index> &seeds, float stopDistance, bool parallel);
+
     void SetStopDistance(float d) {
       m_StopDistance = d;
     }
@@ -114,11 +120,17 @@ protected:
 
 private:
 
-  std::list<index>                             m_ActivePoints;
   std::vector<index>                           m_SeedPoints;
-  std::vector<LabelType>                       m_Label;
   float                                        m_StopDistance;
 
+  // per solve state of the fast iterative method, one per thread when solving many sources
+  struct FIMScratch {
+    std::vector<float> geodesic;
+    std::vector<LabelType> label;
+    std::vector<index> active;
+    int numComputation = 0;
+  };
+
   TriMesh *GetOutputMesh() {
     return m_meshPtr;
   }
@@ -127,10 +139,12 @@ private:
   bool IsNonObtuse(int v, TriMesh::Face f);
   void SplitFace(std::vector<TriMesh::Face> &acFaces, int v, TriMesh::Face cf, int nfAdj);
   std::vector<TriMesh::Face> GetOneRing(int v);
-  float Upwind(index currentVert, index vet);
-  void InitializeAttributes(int currentVert, std::vector<int> seeds);
-  void CleanupAttributes();
-  float LocalSolver(index C, TriMesh::Face triangle, index currentVert);
+  float Upwind(index vet, const std::vector<float> &geodesic);
+  float LocalSolver(index C, const TriMesh::Face &triangle, const std::vector<float> &geodesic);
+  void PrepareSolve();
+  void InitializeSolve(const std::vector<index> &seeds, FIMScratch &scratch);
+  void Solve(const std::vector<index> &seeds, float stopDistance, FIMScratch &scratch);
+  void SolveParallel(const std::vector<index> &seeds, float stopDistance, FIMScratch &scratch);
 
   void SetSeedPoint(std::vector<index> SeedPoints) {
     m_SeedPoints = SeedPoints;
@@ -144,8 +158,6 @@ private:
   }
 
 
-  void InitializeLabels();
-  void InitializeActivePoints();
   float PointLength(point v);
 
   void GenerateReducedData();
@@ -204,10 +216,10 @@ private:
   // maps face index to vec3 of edge lengths with edges in this order: {01, 12, 20}
   std::vector<vec3> edgeLengthsVector;
 
-  // maps vertex index to vertex index to distance?
-  std::vector< std::map<unsigned int, float> > geodesicMap;
+  // geodesic distances between pairs of vertices within the stop distance
+  shapeworks::GeodesicStore geodesicStore;
 
-  // maps vertex index to something to do with the geodesic computation
+  // distances from the seeds of the last ComputeDistanceToCurve, written by WriteFeaFile
   std::vector<float> geodesic;
 
   // maps something to something
@@ -0,0 +1,140 @@
+#include "CheckpointWriter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+
+namespace shapeworks {
+
+//---------------------------------------------------------------------------
+CheckpointWriter::CheckpointWriter(size_t max_pending) : m_max_pending(std::max<size_t>(1, max_pending))
+{}
+
+//---------------------------------------------------------------------------
+CheckpointWriter::~CheckpointWriter()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_changed.notify_all();
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+
+  // nobody is left to report a failure to, only log it
+  if (m_error) {
+    try {
+      std::rethrow_exception(m_error);
+    }
+    catch (std::exception& e) {
+      std::cerr << "Unreported checkpoint failure: " << e.what() << std::endl;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+void CheckpointWriter::Enqueue(Checkpoint checkpoint)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  ThrowPendingError();
+  if (!m_thread.joinable()) {
+    m_thread = std::thread(&CheckpointWriter::Run, this);
+  }
+  m_changed.wait(lock, [this] { return m_queue.size() < m_max_pending; });
+  m_queue.push_back(std::move(checkpoint));
+  m_changed.notify_all();
+}
+
+//---------------------------------------------------------------------------
+bool CheckpointWriter::Write(const Checkpoint& checkpoint)
+{
+  this->Flush();
+
+  bool ok = true;
+  for (const auto& file : checkpoint) {
+    ok = WriteFile(file) && ok;
+  }
+  return ok;
+}
+
+//---------------------------------------------------------------------------
+void CheckpointWriter::Flush()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_changed.wait(lock, [this] { return m_queue.empty() && !m_writing; });
+  ThrowPendingError();
+}
+
+//---------------------------------------------------------------------------
+void CheckpointWriter::Run()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_changed.wait(lock, [this] { return !m_queue.empty() || m_stop; });
+    if (m_queue.empty()) {
+      return; // stopped with nothing left to write
+    }
+
+    Checkpoint checkpoint = std::move(m_queue.front());
+    m_queue.pop_front();
+    m_writing = true;
+    m_changed.notify_all();
+
+    lock.unlock();
+    std::string failed;
+    for (const auto& file : checkpoint) {
+      if (!WriteFile(file) && failed.empty()) {
+        failed = file.filename;
+      }
+    }
+    lock.lock();
+
+    if (!failed.empty() && !m_error) {
+      m_error = std::make_exception_ptr(std::runtime_error("Error writing output file: " + failed));
+    }
+
+    m_writing = false;
+    m_changed.notify_all();
+  }
+}
+
+//---------------------------------------------------------------------------
+void CheckpointWriter::ThrowPendingError()
+{
+  if (m_error) {
+    std::exception_ptr error;
+    std::swap(error, m_error);
+    std::rethrow_exception(error);
+  }
+}
+
+//---------------------------------------------------------------------------
+bool CheckpointWriter::WriteFile(const File& file)
+{
+  const std::string temp_file = file.filename + ".tmp";
+  bool ok = false;
+  try {
+    ok = file.write(temp_file);
+  }
+  catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+  }
+  catch (...) {
+  }
+
+  if (ok) {
+#ifdef _WIN32
+    std::remove(file.filename.c_str()); // rename does not replace an existing file on windows
+#endif
+    ok = std::rename(temp_file.c_str(), file.filename.c_str()) == 0;
+  }
+  if (!ok) {
+    std::remove(temp_file.c_str());
+    std::cerr << "Error writing output file: " << file.filename << std::endl;
+  }
+  return ok;
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace shapeworks {
+
+//! Writes the output files of the optimizer on a background thread
+/*!
+ * A checkpoint is a list of files whose contents have already been copied out
+ * of the optimizer, each with a function that writes them.  Checkpoints are
+ * written in the order they are queued, each file to a temporary name that is
+ * renamed into place once complete, so readers never see a partial file.  At
+ * most max_pending checkpoints wait in the queue: Enqueue blocks beyond that,
+ * so a slow disk throttles the optimizer instead of growing memory.
+ *
+ * A file that fails to be written in the background is reported by the next
+ * call to Enqueue, Write or Flush, which throw a std::runtime_error naming the
+ * file.  Call Flush before destruction to be told about the last checkpoints,
+ * the destructor only logs a failure that was not reported yet.
+ */
+class CheckpointWriter {
+public:
+  //! Writes the contents of a file to the given (temporary) filename, returns false on failure
+  using WriteFunction = std::function<bool(const std::string& filename)>;
+
+  struct File {
+    std::string filename;
+    WriteFunction write;
+  };
+
+  using Checkpoint = std::vector<File>;
+
+  explicit CheckpointWriter(size_t max_pending = 2);
+
+  //! Writes the pending checkpoints before returning, logs a failure that was not reported yet
+  ~CheckpointWriter();
+
+  CheckpointWriter(const CheckpointWriter&) = delete;
+  CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+  //! Queue a checkpoint to be written in the background
+  void Enqueue(Checkpoint checkpoint);
+
+  //! Write a checkpoint now, after the pending ones.  Returns false if a file could not be written.
+  bool Write(const Checkpoint& checkpoint);
+
+  //! Wait until the pending checkpoints are written
+  void Flush();
+
+private:
+  void Run();
+
+  //! Rethrow the error of a failed background write, if any (call with m_mutex held)
+  void ThrowPendingError();
+
+  static bool WriteFile(const File& file);
+
+  const size_t m_max_pending;
+
+  std::mutex m_mutex;
+  std::condition_variable m_changed;
+  std::deque<Checkpoint> m_queue;
+  bool m_writing = false;
+  bool m_stop = false;
+  std::exception_ptr m_error; // first background write that failed and was not reported yet
+
+  std::thread m_thread;
+};
+
+}
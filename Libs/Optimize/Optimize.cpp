@@ -1,4 +1,5 @@
 // std
+#include <fstream>
 #include <sstream>
 #include <string>
 #include <iostream>
@@ -26,6 +27,7 @@
 #include "ParticleSystem/itkParticleImplicitSurfaceDomain.h"
 #include "ParticleSystem/object_reader.h"
 #include "ParticleSystem/object_writer.h"
+#include "itkParticlePositionWriter.h"
 #include "OptimizeParameterFile.h"
 
 #include "Optimize.h"
@@ -37,6 +39,52 @@ namespace py = pybind11;
 
 namespace shapeworks {
 
+namespace {
+
+// writes a vector, one value per line
+CheckpointWriter::WriteFunction VectorWriter(std::vector<double> values)
+{
+  return [values](const std::string& filename) {
+    std::ofstream out(filename.c_str());
+    for (unsigned int i = 0; i < values.size(); i++) {
+      out << values[i] << "\n";
+    }
+    return static_cast<bool>(out);
+  };
+}
+
+// writes a matrix, one row per line
+CheckpointWriter::WriteFunction MatrixWriter(vnl_matrix<double> values)
+{
+  return [values](const std::string& filename) {
+    std::ofstream out(filename.c_str());
+    for (unsigned int i = 0; i < values.rows(); i++) {
+      for (unsigned int j = 0; j < values.cols(); j++) {
+        out << values.get(i, j) << " ";
+      }
+      out << "\n";
+    }
+    return static_cast<bool>(out);
+  };
+}
+
+// appends a value to a text file, by writing its current contents and the
+// value to the given (temporary) filename
+CheckpointWriter::WriteFunction AppendWriter(std::string target, double value)
+{
+  return [target, value](const std::string& filename) {
+    std::ofstream out(filename.c_str());
+    std::ifstream in(target.c_str());
+    if (in && in.peek() != std::ifstream::traits_type::eof()) {
+      out << in.rdbuf();
+    }
+    out << value << std::endl;
+    return static_cast<bool>(out);
+  };
+}
+
+}
+
 //---------------------------------------------------------------------------
 Optimize::Optimize()
 {
@@ -175,6 +223,9 @@ bool Optimize::Run()
     }
   }
 
+  // finish writing the checkpoints
+  m_checkpoint_writer.Flush();
+
   this->UpdateExportablePoints();
 
   if (this->m_python_filename != "") {
@@ -206,6 +257,24 @@ void Optimize::SetParameters()
   this->m_sampler->SetTimeptsPerIndividual(this->m_timepts_per_subject);
   this->m_sampler->GetParticleSystem()->SetDomainsPerShape(this->m_domains_per_shape);
   this->m_sampler->SetVerbosity(this->m_verbosity_level);
+  this->m_sampler->GetOptimizer()->SetUseJacobiUpdate(this->m_use_jacobi_update);
+
+  this->m_sampler->GetEnsembleEntropyFunction()
+    ->SetEigensystemRefreshInterval(this->m_shape_statistics_refresh_interval);
+  this->m_sampler->GetEnsembleEntropyFunction()
+    ->SetEigensystemDriftTolerance(this->m_shape_statistics_drift_tolerance);
+  this->m_sampler->GetEnsembleRegressionEntropyFunction()
+    ->SetEigensystemRefreshInterval(this->m_shape_statistics_refresh_interval);
+  this->m_sampler->GetEnsembleRegressionEntropyFunction()
+    ->SetEigensystemDriftTolerance(this->m_shape_statistics_drift_tolerance);
+  this->m_sampler->GetEnsembleMixedEffectsEntropyFunction()
+    ->SetEigensystemRefreshInterval(this->m_shape_statistics_refresh_interval);
+  this->m_sampler->GetEnsembleMixedEffectsEntropyFunction()
+    ->SetEigensystemDriftTolerance(this->m_shape_statistics_drift_tolerance);
+  this->m_sampler->GetMeshBasedGeneralEntropyGradientFunction()
+    ->SetEigensystemRefreshInterval(this->m_shape_statistics_refresh_interval);
+  this->m_sampler->GetMeshBasedGeneralEntropyGradientFunction()
+    ->SetEigensystemDriftTolerance(this->m_shape_statistics_drift_tolerance);
 
   if (this->m_use_xyz.size() > 0) {
     for (int i = 0; i < this->m_domains_per_shape; i++) {
@@ -1088,19 +1157,23 @@ void Optimize::IterateCallback(itk::Object*, const itk::EventObject&)
     if (m_checkpoint_counter == (int) m_checkpointing_interval) {
       m_checkpoint_counter = 0;
 
-      this->WritePointFiles();
-      this->WriteTransformFile();
-      this->WritePointFilesWithFeatures();
-      this->WriteModes();
-      this->WriteParameters();
-      this->WriteEnergyFiles();
-
+      // copy the particles and transforms now and write them in the background,
+      // while the optimization continues
+      CheckpointWriter::Checkpoint checkpoint;
+      this->SnapshotPointFiles(m_output_dir, checkpoint);
+      this->SnapshotTransformFile(m_output_dir + "/" + m_output_transform_file, checkpoint);
+      this->SnapshotPointFilesWithFeatures(m_output_dir, checkpoint);
+      this->SnapshotModes(checkpoint);
+      this->SnapshotParameters("", checkpoint);
+      this->SnapshotEnergyFiles(checkpoint);
       if (m_keep_checkpoints) {
-        this->WritePointFiles(this->GetCheckpointDir());
-        this->WritePointFilesWithFeatures(this->GetCheckpointDir());
-        this->WriteTransformFile(this->GetCheckpointDir() + "/transform");
-        this->WriteParameters(this->GetCheckpointDir());
+        const std::string checkpoint_dir = this->GetCheckpointDir();
+        this->SnapshotPointFiles(checkpoint_dir, checkpoint);
+        this->SnapshotPointFilesWithFeatures(checkpoint_dir, checkpoint);
+        this->SnapshotTransformFile(checkpoint_dir + "/transform", checkpoint);
+        this->SnapshotParameters(checkpoint_dir, checkpoint);
       }
+      m_checkpoint_writer.Enqueue(std::move(checkpoint));
     }
   }
 
@@ -1300,6 +1373,10 @@ void Optimize::PrintParamInfo()
   std::cout << "m_save_init_splits = " << m_save_init_splits << std::endl;
   std::cout << "m_checkpointing_interval = " << m_checkpointing_interval << std::endl;
   std::cout << "m_keep_checkpoints = " << m_keep_checkpoints << std::endl;
+  std::cout << "m_use_jacobi_update = " << m_use_jacobi_update << std::endl;
+  std::cout << "m_use_grid_neighborhood = " << m_use_grid_neighborhood << std::endl;
+  std::cout << "m_shape_statistics_refresh_interval = " << m_shape_statistics_refresh_interval << std::endl;
+  std::cout << "m_shape_statistics_drift_tolerance = " << m_shape_statistics_drift_tolerance << std::endl;
 
   std::cout << std::endl;
 
@@ -1336,6 +1413,16 @@ void Optimize::WriteTransformFile(int iter) const
 
 //---------------------------------------------------------------------------
 void Optimize::WriteTransformFile(std::string iter_prefix) const
+{
+  CheckpointWriter::Checkpoint checkpoint;
+  this->SnapshotTransformFile(iter_prefix, checkpoint);
+  if (!m_checkpoint_writer.Write(checkpoint)) {
+    throw 1;
+  }
+}
+
+//---------------------------------------------------------------------------
+void Optimize::SnapshotTransformFile(std::string iter_prefix, CheckpointWriter::Checkpoint& checkpoint) const
 {
   if (!this->m_file_output_enabled) {
     return;
@@ -1352,10 +1439,13 @@ void Optimize::WriteTransformFile(std::string iter_prefix) const
 
   std::string str = "writing " + output_file + " ...";
   PrintStartMessage(str);
-  object_writer<itk::ParticleSystem<3>::TransformType> writer;
-  writer.SetFileName(output_file);
-  writer.SetInput(tlist);
-  writer.Update();
+  checkpoint.push_back({output_file, [tlist](const std::string& filename) {
+    object_writer<itk::ParticleSystem<3>::TransformType> writer;
+    writer.SetFileName(filename);
+    writer.SetInput(tlist);
+    writer.Update();
+    return true;
+  }});
   PrintDoneMessage();
 }
 
@@ -1383,6 +1473,16 @@ void Optimize::WritePointFiles(int iter)
 
 //---------------------------------------------------------------------------
 void Optimize::WritePointFiles(std::string iter_prefix)
+{
+  CheckpointWriter::Checkpoint checkpoint;
+  this->SnapshotPointFiles(iter_prefix, checkpoint);
+  if (!m_checkpoint_writer.Write(checkpoint)) {
+    throw 1;
+  }
+}
+
+//---------------------------------------------------------------------------
+void Optimize::SnapshotPointFiles(std::string iter_prefix, CheckpointWriter::Checkpoint& checkpoint)
 {
   if (!this->m_file_output_enabled) {
     return;
@@ -1405,39 +1505,31 @@ void Optimize::WritePointFiles(std::string iter_prefix)
     std::string local_file = iter_prefix + "/" + m_filenames[i] + "_local.particles";
     std::string world_file = iter_prefix + "/" + m_filenames[i] + "_world.particles";
 
-    std::ofstream out(local_file.c_str());
-    std::ofstream outw(world_file.c_str());
-
     std::string str = "Writing " + world_file + " and " + local_file + " files...";
     this->PrintStartMessage(str, 1);
-    if (!out) {
-      std::cerr << "Error opening output file: " << local_file << std::endl;
-      throw 1;
-    }
-    if (!outw) {
-      std::cerr << "Error opening output file: " << world_file << std::endl;
-      throw 1;
-    }
 
-    for (unsigned int j = 0; j < m_sampler->GetParticleSystem()->GetNumberOfParticles(i); j++) {
+    const unsigned int num_particles = m_sampler->GetParticleSystem()->GetNumberOfParticles(i);
+    std::vector<double> local(3 * num_particles);
+    std::vector<double> world(3 * num_particles);
+    for (unsigned int j = 0; j < num_particles; j++) {
       PointType pos = m_sampler->GetParticleSystem()->GetPosition(j, i);
       PointType wpos = m_sampler->GetParticleSystem()->GetTransformedPosition(j, i);
 
       for (unsigned int k = 0; k < 3; k++) {
-        out << pos[k] << " ";
+        local[3 * j + k] = pos[k];
+        world[3 * j + k] = wpos[k];
       }
-      out << std::endl;
-
-      for (unsigned int k = 0; k < 3; k++) {
-        outw << wpos[k] << " ";
-      }
-      outw << std::endl;
 
       counter++;
     }      // end for points
 
-    out.close();
-    outw.close();
+    const auto format = m_particle_file_format;
+    checkpoint.push_back({local_file, [values = std::move(local), num_particles, format](const std::string& filename) {
+      return ParticleFile::Write(filename, values.data(), num_particles, 3, format);
+    }});
+    checkpoint.push_back({world_file, [values = std::move(world), num_particles, format](const std::string& filename) {
+      return ParticleFile::Write(filename, values.data(), num_particles, 3, format);
+    }});
 
     std::stringstream st;
     st << counter;
@@ -1470,6 +1562,16 @@ void Optimize::WritePointFilesWithFeatures(int iter)
 
 //---------------------------------------------------------------------------
 void Optimize::WritePointFilesWithFeatures(std::string iter_prefix)
+{
+  CheckpointWriter::Checkpoint checkpoint;
+  this->SnapshotPointFilesWithFeatures(iter_prefix, checkpoint);
+  if (!m_checkpoint_writer.Write(checkpoint)) {
+    throw 1;
+  }
+}
+
+//---------------------------------------------------------------------------
+void Optimize::SnapshotPointFilesWithFeatures(std::string iter_prefix, CheckpointWriter::Checkpoint& checkpoint)
 {
   if (!this->m_file_output_enabled) {
     return;
@@ -1489,8 +1591,6 @@ void Optimize::WritePointFilesWithFeatures(std::string iter_prefix)
 
     std::string world_file = iter_prefix + "/" + m_filenames[i] + "_wptsFeatures.particles";
 
-    std::ofstream outw(world_file.c_str());
-
     std::string str = "Writing " + world_file + "...";
     int attrNum = 3 * int(m_use_xyz[i % m_domains_per_shape]) + 3 *
                                                                 int(m_use_normals[i % m_domains_per_shape]);
@@ -1502,19 +1602,16 @@ void Optimize::WritePointFilesWithFeatures(std::string iter_prefix)
     str += "with " + st.str() + " attributes per point...";
     this->PrintStartMessage(str, 1);
 
-    if (!outw) {
-      std::cerr << "Error opening output file: " << world_file << std::endl;
-      throw 1;
-    }
-
     std::vector<float> fVals;
+    std::vector<double> values;
+    unsigned int values_per_particle = 3;
 
     for (unsigned int j = 0; j < m_sampler->GetParticleSystem()->GetNumberOfParticles(i); j++) {
       PointType pos = m_sampler->GetParticleSystem()->GetPosition(j, i);
       PointType wpos = m_sampler->GetParticleSystem()->GetTransformedPosition(j, i);
 
       for (unsigned int k = 0; k < 3; k++) {
-        outw << wpos[k] << " ";
+        values.push_back(wpos[k]);
       }
 
       if (m_use_normals[i % m_domains_per_shape]) {
@@ -1528,7 +1625,9 @@ void Optimize::WritePointFilesWithFeatures(std::string iter_prefix)
                                                                i) *
                                                              m_sampler->GetParticleSystem()->GetPrefixTransform(
                                                                i));
-        outw << pN[0] << " " << pN[1] << " " << pN[2] << " ";
+        values.push_back(pN[0]);
+        values.push_back(pN[1]);
+        values.push_back(pN[2]);
       }
 
       // Only run the following code if we are dealing with ImplicitSurfaceDomains
@@ -1547,17 +1646,24 @@ void Optimize::WritePointFilesWithFeatures(std::string iter_prefix)
             domain->GetMesh()->GetFeatureValues(pt, fVals);
           }
           for (unsigned int k = 0; k < m_attributes_per_domain[i % m_domains_per_shape]; k++) {
-            outw << fVals[k] << " ";
+            values.push_back(fVals[k]);
           }
         }
       }
 
-      outw << std::endl;
+      if (j == 0) {
+        values_per_particle = values.size();
+      }
 
       counter++;
     }      // end for points
 
-    outw.close();
+    const auto format = m_particle_file_format;
+    const size_t num_particles = counter;
+    checkpoint.push_back({world_file, [values = std::move(values), num_particles, values_per_particle, format](
+      const std::string& filename) {
+      return ParticleFile::Write(filename, values.data(), num_particles, values_per_particle, format);
+    }});
     this->PrintDoneMessage(1);
   }   // end for files
   this->PrintDoneMessage();
@@ -1565,6 +1671,16 @@ void Optimize::WritePointFilesWithFeatures(std::string iter_prefix)
 
 //---------------------------------------------------------------------------
 void Optimize::WriteEnergyFiles()
+{
+  CheckpointWriter::Checkpoint checkpoint;
+  this->SnapshotEnergyFiles(checkpoint);
+  if (!m_checkpoint_writer.Write(checkpoint)) {
+    throw 1;
+  }
+}
+
+//---------------------------------------------------------------------------
+void Optimize::SnapshotEnergyFiles(CheckpointWriter::Checkpoint& checkpoint)
 {
   if (!this->m_file_output_enabled) {
     return;
@@ -1577,42 +1693,23 @@ void Optimize::WriteEnergyFiles()
   std::string strA = m_output_dir + "/" + this->m_str_energy + "_samplingEnergy.txt";
   std::string strB = m_output_dir + "/" + this->m_str_energy + "_correspondenceEnergy.txt";
   std::string strTotal = m_output_dir + "/" + this->m_str_energy + "_totalEnergy.txt";
-  std::ofstream outA(strA.c_str(), std::ofstream::app);
-  std::ofstream outB(strB.c_str(), std::ofstream::app);
-  std::ofstream outTotal(strTotal.c_str(), std::ofstream::app);
-
-  if (!outA) {
-    std::cerr << "Error opening output energy file: " << strA << std::endl;
-    throw 1;
-  }
-  if (!outB) {
-    std::cerr << "Error opening output energy file: " << strB << std::endl;
-    throw 1;
-  }
-  if (!outTotal) {
-    std::cerr << "Error opening output energy file: " << strTotal << std::endl;
-    throw 1;
-  }
 
   int n = m_energy_a.size() - 1;
   n = n < 0 ? 0 : n;
 
   std::string str = "Appending to " + strA + " ...";
   this->PrintStartMessage(str, 1);
-  outA << m_energy_a[n] << std::endl;
-  outA.close();
+  checkpoint.push_back({strA, AppendWriter(strA, m_energy_a[n])});
   this->PrintDoneMessage(1);
 
   str = "Appending to " + strB + " ...";
   this->PrintStartMessage(str, 1);
-  outB << m_energy_b[n] << std::endl;
-  outB.close();
+  checkpoint.push_back({strB, AppendWriter(strB, m_energy_b[n])});
   this->PrintDoneMessage(1);
 
   str = "Appending to " + strTotal + " ...";
   this->PrintStartMessage(str, 1);
-  outTotal << m_total_energy[n] << std::endl;
-  outTotal.close();
+  checkpoint.push_back({strTotal, AppendWriter(strTotal, m_total_energy[n])});
   this->PrintDoneMessage(1);
 
   this->PrintDoneMessage();
@@ -1651,6 +1748,16 @@ void Optimize::WriteCuttingPlanePoints(int iter)
 
 //---------------------------------------------------------------------------
 void Optimize::WriteParameters(std::string output_dir)
+{
+  CheckpointWriter::Checkpoint checkpoint;
+  this->SnapshotParameters(output_dir, checkpoint);
+  if (!m_checkpoint_writer.Write(checkpoint)) {
+    throw 1;
+  }
+}
+
+//---------------------------------------------------------------------------
+void Optimize::SnapshotParameters(std::string output_dir, CheckpointWriter::Checkpoint& checkpoint)
 {
   if (!this->m_file_output_enabled) {
     return;
@@ -1674,34 +1781,17 @@ void Optimize::WriteParameters(std::string output_dir)
   std::vector<double> intercept;
 
   if (m_use_mixed_effects == true) {
-    vnl_vector<double> slopevec = dynamic_cast < itk::ParticleShapeMixedEffectsMatrixAttribute<
-      double, 3>* >
-    (m_sampler->GetEnsembleMixedEffectsEntropyFunction()->
-        GetShapeMatrix())->GetSlope();
+    const auto shape_matrix = dynamic_cast < itk::ParticleShapeMixedEffectsMatrixAttribute<double, 3>* >
+    (m_sampler->GetEnsembleMixedEffectsEntropyFunction()->GetShapeMatrix());
 
+    const vnl_vector<double>& slopevec = shape_matrix->GetSlope();
+    const vnl_vector<double>& interceptvec = shape_matrix->GetIntercept();
     for (unsigned int i = 0; i < slopevec.size(); i++) {
       slope.push_back(slopevec[i]);
-    }
-
-    std::ofstream out(slopename.c_str());
-    for (unsigned int i = 0; i < slope.size(); i++) {
-      out << slope[i] << "\n";
-    }
-    out.close();
-
-    vnl_vector<double> interceptvec = dynamic_cast <
-      itk::ParticleShapeMixedEffectsMatrixAttribute<double,3>* >
-    (m_sampler->GetEnsembleMixedEffectsEntropyFunction()->GetShapeMatrix())->GetIntercept();
-
-    for (unsigned int i = 0; i < slopevec.size(); i++) {
       intercept.push_back(interceptvec[i]);
     }
-
-    out.open(interceptname.c_str());
-    for (unsigned int i = 0; i < slope.size(); i++) {
-      out << intercept[i] << "\n";
-    }
-    out.close();
+    checkpoint.push_back({slopename, VectorWriter(slope)});
+    checkpoint.push_back({interceptname, VectorWriter(intercept)});
 
     slopename = output_dir + std::string("sloperand");
     interceptname = output_dir + std::string("interceptrand");
@@ -1709,65 +1799,21 @@ void Optimize::WriteParameters(std::string output_dir)
     std::cout << "writing " << slopename << std::endl;
     std::cout << "writing " << interceptname << std::endl;
 
-    vnl_matrix<double> sloperand_mat = dynamic_cast <
-      itk::ParticleShapeMixedEffectsMatrixAttribute<double, 3>* >
-    (m_sampler->GetEnsembleMixedEffectsEntropyFunction()->
-        GetShapeMatrix())->GetSlopeRandom();
-
-    out.open(slopename.c_str());
-    for (unsigned int i = 0; i < sloperand_mat.rows(); i++) {
-      for (unsigned int j = 0; j < sloperand_mat.cols(); j++) {
-        out << sloperand_mat.get(i, j) << " ";
-      }
-      out << "\n";
-    }
-    out.close();
-
-    vnl_matrix<double> interceptrand_mat = dynamic_cast <
-      itk::ParticleShapeMixedEffectsMatrixAttribute< double, 3>* >
-    (m_sampler->GetEnsembleMixedEffectsEntropyFunction()->
-        GetShapeMatrix())->GetInterceptRandom();
-
-    out.open(interceptname.c_str());
-    for (unsigned int i = 0; i < interceptrand_mat.rows(); i++) {
-      for (unsigned int j = 0; j < interceptrand_mat.cols(); j++) {
-        out << interceptrand_mat.get(i, j) << " ";
-      }
-      out << "\n";
-    }
-    out.close();
+    checkpoint.push_back({slopename, MatrixWriter(shape_matrix->GetSlopeRandom())});
+    checkpoint.push_back({interceptname, MatrixWriter(shape_matrix->GetInterceptRandom())});
   }
   else {
-    vnl_vector<double> slopevec = dynamic_cast <
-      itk::ParticleShapeLinearRegressionMatrixAttribute<double,3>* >
-    (m_sampler->GetEnsembleRegressionEntropyFunction()->
-        GetShapeMatrix())->GetSlope();
+    const auto shape_matrix = dynamic_cast < itk::ParticleShapeLinearRegressionMatrixAttribute<double, 3>* >
+    (m_sampler->GetEnsembleRegressionEntropyFunction()->GetShapeMatrix());
 
+    const vnl_vector<double>& slopevec = shape_matrix->GetSlope();
+    const vnl_vector<double>& interceptvec = shape_matrix->GetIntercept();
     for (unsigned int i = 0; i < slopevec.size(); i++) {
       slope.push_back(slopevec[i]);
-    }
-
-    std::ofstream out(slopename.c_str());
-    for (unsigned int i = 0; i < slope.size(); i++) {
-      out << slope[i] << "\n";
-    }
-    out.close();
-
-    std::vector<double> intercept;
-    vnl_vector<double> interceptvec = dynamic_cast <
-      itk::ParticleShapeLinearRegressionMatrixAttribute<double,3>* >
-    (m_sampler->GetEnsembleRegressionEntropyFunction()->
-        GetShapeMatrix())->GetIntercept();
-
-    for (unsigned int i = 0; i < slopevec.size(); i++) {
       intercept.push_back(interceptvec[i]);
     }
-
-    out.open(interceptname.c_str());
-    for (unsigned int i = 0; i < slope.size(); i++) {
-      out << intercept[i] << "\n";
-    }
-    out.close();
+    checkpoint.push_back({slopename, VectorWriter(slope)});
+    checkpoint.push_back({interceptname, VectorWriter(intercept)});
   }
 }
 
@@ -1975,10 +2021,16 @@ void Optimize::SetLogEnergy(bool log_energy)
 //---------------------------------------------------------------------------
 void Optimize::AddImage(ImageType::Pointer image)
 {
-  this->m_sampler->AddImage(image, this->GetNarrowBand());
+  this->AddImageDomain(Sampler::CreateImageDomain(image, this->GetNarrowBand()));
+}
+
+//---------------------------------------------------------------------------
+void Optimize::AddImageDomain(Sampler::ImageDomainType::Pointer domain)
+{
+  this->m_sampler->AddImageDomain(domain);
   this->m_num_shapes++;
-  if (image) {
-    this->m_spacing = image->GetSpacing()[0] * 5;
+  if (!domain->IsDomainFixed()) {
+    this->m_spacing = domain->GetSpacing()[0] * 5;
   }
 }
 
@@ -2081,6 +2133,12 @@ void Optimize::SetFileOutputEnabled(bool enabled)
   this->m_file_output_enabled = enabled;
 }
 
+//---------------------------------------------------------------------------
+void Optimize::SetParticleFileFormat(ParticleFile::Format format)
+{
+  this->m_particle_file_format = format;
+}
+
 //---------------------------------------------------------------------------
 std::vector<bool> Optimize::GetUseXYZ()
 {
@@ -2127,6 +2185,31 @@ int Optimize::GetUseShapeStatisticsAfter()
   return this->m_use_shape_statistics_after;
 }
 
+//---------------------------------------------------------------------------
+void Optimize::SetUseJacobiUpdate(bool use_jacobi_update)
+{
+  this->m_use_jacobi_update = use_jacobi_update;
+}
+
+//---------------------------------------------------------------------------
+void Optimize::SetUseGridNeighborhood(bool use_grid_neighborhood)
+{
+  this->m_use_grid_neighborhood = use_grid_neighborhood;
+  this->m_sampler->SetUseGridNeighborhood(use_grid_neighborhood);
+}
+
+//---------------------------------------------------------------------------
+void Optimize::SetShapeStatisticsRefreshInterval(int shape_statistics_refresh_interval)
+{
+  this->m_shape_statistics_refresh_interval = shape_statistics_refresh_interval;
+}
+
+//---------------------------------------------------------------------------
+void Optimize::SetShapeStatisticsDriftTolerance(double shape_statistics_drift_tolerance)
+{
+  this->m_shape_statistics_drift_tolerance = shape_statistics_drift_tolerance;
+}
+
 //---------------------------------------------------------------------------
 void Optimize::SetIterationCallback()
 {
@@ -2137,10 +2220,32 @@ void Optimize::SetIterationCallback()
 
 //---------------------------------------------------------------------------
 void Optimize::WriteModes()
+{
+  CheckpointWriter::Checkpoint checkpoint;
+  this->SnapshotModes(checkpoint);
+  if (!m_checkpoint_writer.Write(checkpoint)) {
+    throw 1;
+  }
+}
+
+//---------------------------------------------------------------------------
+void Optimize::SnapshotModes(CheckpointWriter::Checkpoint& checkpoint)
 {
   const int n = m_sampler->GetParticleSystem()->GetNumberOfDomains() % m_domains_per_shape;
   if (n >= 5) {
-    m_sampler->GetEnsembleEntropyFunction()->WriteModes(m_output_dir + "/pts", 5);
+    // the modes are computed now, only writing them is left to the checkpoint
+    std::vector<std::string> filenames;
+    std::vector<std::vector<Sampler::PointType>> lists;
+    m_sampler->GetEnsembleEntropyFunction()->ComputeModes(m_output_dir + "/pts", 5, filenames, lists);
+    for (unsigned int i = 0; i < filenames.size(); i++) {
+      checkpoint.push_back({filenames[i], [list = std::move(lists[i])](const std::string& filename) {
+        auto writer = itk::ParticlePositionWriter<3>::New();
+        writer->SetFileName(filename);
+        writer->SetInput(list);
+        writer->Update();
+        return true;
+      }});
+    }
   }
 }
 
@@ -24,6 +24,8 @@
 #include "ParticleSystem/DomainType.h"
 #include "ParticleSystem/MeshWrapper.h"
 #include "ParticleSystem/OptimizationVisualizer.h"
+#include "ParticleFile.h"
+#include "CheckpointWriter.h"
 
 
 
@@ -207,6 +209,8 @@ public:
 
   //! Set the shape input images
   void AddImage(ImageType::Pointer image);
+  //! Add an image domain built by Sampler::CreateImageDomain
+  void AddImageDomain(Sampler::ImageDomainType::Pointer domain);
   void AddMesh(std::shared_ptr<shapeworks::MeshWrapper> mesh);
 
   //! Set the shape filenames (TODO: details)
@@ -237,6 +241,9 @@ public:
   //! Set if file output is enabled
   void SetFileOutputEnabled(bool enabled);
 
+  //! Set the format of the point files written (ascii by default)
+  void SetParticleFileFormat(ParticleFile::Format format);
+
   //! Return if XYZ is used, per shape
   std::vector<bool> GetUseXYZ();
 
@@ -255,6 +262,18 @@ public:
   //! Return the number of particles when correspondence based multiscale takes over
   int GetUseShapeStatisticsAfter();
 
+  //! Set if Jacobi updates (particles within a domain updated in parallel) should be used
+  void SetUseJacobiUpdate(bool use_jacobi_update);
+
+  //! Set if the cell grid particle neighborhood should be used (must be set before adding inputs)
+  void SetUseGridNeighborhood(bool use_grid_neighborhood);
+
+  //! Set the number of shape statistics updates between full eigen decompositions (1 recomputes every time)
+  void SetShapeStatisticsRefreshInterval(int shape_statistics_refresh_interval);
+
+  //! Set the relative change of the shape matrix that forces a full eigen decomposition early
+  void SetShapeStatisticsDriftTolerance(double shape_statistics_drift_tolerance);
+
   //! Print parameter info to stdout
   void PrintParamInfo();
 
@@ -307,6 +326,12 @@ protected:
   void WritePointFiles(std::string iter_prefix);
   void WritePointFilesWithFeatures(int iter = -1);
   void WritePointFilesWithFeatures(std::string iter_prefix);
+
+  // copy the contents of the files written by the functions above into a checkpoint
+  void SnapshotTransformFile(std::string iter_prefix, CheckpointWriter::Checkpoint& checkpoint) const;
+  void SnapshotPointFiles(std::string iter_prefix, CheckpointWriter::Checkpoint& checkpoint);
+  void SnapshotPointFilesWithFeatures(std::string iter_prefix, CheckpointWriter::Checkpoint& checkpoint);
+
   void WriteEnergyFiles();
   void WriteCuttingPlanePoints(int iter = -1);
   void WriteParameters(std::string output_dir = "");
@@ -315,6 +340,11 @@ protected:
   void SetParameters();
   void WriteModes();
 
+  // copy the contents of the files written by the functions above into a checkpoint
+  void SnapshotEnergyFiles(CheckpointWriter::Checkpoint& checkpoint);
+  void SnapshotParameters(std::string output_dir, CheckpointWriter::Checkpoint& checkpoint);
+  void SnapshotModes(CheckpointWriter::Checkpoint& checkpoint);
+
   void PrintStartMessage(std::string str, unsigned int vlevel = 0) const;
 
   void PrintDoneMessage(unsigned int vlevel = 0) const;
@@ -386,6 +416,10 @@ protected:
   bool m_narrow_band_set = false;
   bool m_fixed_domains_present = false;
   int m_use_shape_statistics_after = -1;
+  bool m_use_jacobi_update = false;
+  bool m_use_grid_neighborhood = false;
+  int m_shape_statistics_refresh_interval = 1;
+  double m_shape_statistics_drift_tolerance = 0.05;
   std::string m_python_filename;
 
   // Keeps track of which state the optimization is in.
@@ -411,6 +445,8 @@ protected:
   std::vector<int> m_spheres_per_input;
 
   bool m_file_output_enabled = true;
+  ParticleFile::Format m_particle_file_format = ParticleFile::Format::Ascii;
+  mutable CheckpointWriter m_checkpoint_writer;
   bool m_aborted = false;
   std::vector<std::array<itk::Point<double>, 3 >> m_cut_planes;
 
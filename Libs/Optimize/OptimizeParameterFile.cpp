@@ -5,6 +5,11 @@
 #include <itkImageFileReader.h>
 #include <vtkPLYReader.h>
 
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <chrono>
+
 #include <tinyxml.h>
 
 #include "ParticleSystem/MeshWrapper.h"
@@ -194,6 +199,19 @@ bool OptimizeParameterFile::set_io_parameters(TiXmlHandle* docHandle, Optimize*
   if (elem) { output_transform_file = elem->GetText(); }
   optimize->SetOutputTransformFile(output_transform_file);
 
+  // point file format
+  elem = docHandle->FirstChild("particle_format").Element();
+  if (elem) {
+    std::string name;
+    std::istringstream(elem->GetText()) >> name;
+    ParticleFile::Format format;
+    if (!ParticleFile::ParseFormat(name, format)) {
+      std::cerr << "Unknown particle_format: " << name << ", expected ascii, binary or binary32\n";
+      return false;
+    }
+    optimize->SetParticleFileFormat(format);
+  }
+
   // python filename
   std::string python_file = "";
   elem = docHandle->FirstChild("python_filename").Element();
@@ -359,6 +377,18 @@ bool OptimizeParameterFile::set_optimization_parameters(TiXmlHandle* docHandle,
   elem = docHandle->FirstChild("use_shape_statistics_after").Element();
   if (elem) { optimize->SetUseShapeStatisticsAfter(atof(elem->GetText())); }
 
+  elem = docHandle->FirstChild("use_jacobi_update").Element();
+  if (elem) { optimize->SetUseJacobiUpdate((bool) atoi(elem->GetText())); }
+
+  elem = docHandle->FirstChild("use_grid_neighborhood").Element();
+  if (elem) { optimize->SetUseGridNeighborhood((bool) atoi(elem->GetText())); }
+
+  elem = docHandle->FirstChild("shape_statistics_refresh_interval").Element();
+  if (elem) { optimize->SetShapeStatisticsRefreshInterval(atoi(elem->GetText())); }
+
+  elem = docHandle->FirstChild("shape_statistics_drift_tolerance").Element();
+  if (elem) { optimize->SetShapeStatisticsDriftTolerance(atof(elem->GetText())); }
+
   return true;
 }
 
@@ -402,30 +432,89 @@ bool OptimizeParameterFile::read_image_inputs(TiXmlHandle* docHandle, Optimize*
     imageFiles.push_back(imagefilename);
   }
 
-  for (int index = 0; index < imageFiles.size(); index++) {
-    bool fixed_domain = false;
-    for (int i = 0; i < flags.size(); i++) {
-      if (flags[i] == index) {
-        fixed_domain = true;
+  // limit (in MB) on the images held in memory while loading
+  double memory_budget = 4096;
+  elem = docHandle->FirstChild("load_memory_budget").Element();
+  if (elem) { memory_budget = atof(elem->GetText()); }
+
+  // reuse the domains cached by earlier runs (off unless a cache directory is given)
+  std::string domain_cache_dir;
+  elem = docHandle->FirstChild("domain_cache_dir").Element();
+  if (elem && elem->GetText()) { domain_cache_dir = elem->GetText(); }
+
+  std::vector<bool> fixed_domains(imageFiles.size(), false);
+  for (int i = 0; i < flags.size(); i++) {
+    if (flags[i] >= 0 && flags[i] < static_cast<int>(imageFiles.size())) {
+      fixed_domains[flags[i]] = true;
+    }
+  }
+
+  // Read the images and build their domains concurrently, in batches sized so that the images
+  // in flight (counted at twice their dense size) stay within the budget.  The first batch has
+  // a single image to measure the size.  Domains are added in input order.
+  const auto start = std::chrono::steady_clock::now();
+  const double narrow_band = optimize->GetNarrowBand();
+  size_t batch_size = 1;
+  size_t index = 0;
+  while (index < imageFiles.size()) {
+    const size_t count = std::min(batch_size, imageFiles.size() - index);
+    if (this->verbosity_level_ > 1) {
+      for (size_t i = index; i < index + count; i++) {
+        if (!fixed_domains[i]) {
+          std::cout << "Reading inputfile: " << imageFiles[i] << "...\n" << std::flush;
+        }
       }
     }
 
-    if (!fixed_domain) {
-      if (this->verbosity_level_ > 1) {
-        std::cout << "Reading inputfile: " << imageFiles[index] << "...\n" << std::flush;
+    std::vector<Sampler::ImageDomainType::Pointer> domains(count);
+    std::vector<double> image_sizes(count, 0.0);
+    tbb::parallel_for(tbb::blocked_range<size_t>{0, count, 1}, [&](const tbb::blocked_range<size_t>& r) {
+      for (size_t i = r.begin(); i < r.end(); i++) {
+        const auto& filename = imageFiles[index + i];
+        std::string cache_key;
+        if (!fixed_domains[index + i] && !domain_cache_dir.empty()) {
+          cache_key = Sampler::ImageDomainCacheKey(filename, narrow_band);
+          domains[i] = Sampler::LoadImageDomainCache(domain_cache_dir, cache_key);
+          if (domains[i]) {
+            const auto size = domains[i]->GetSize();
+            image_sizes[i] = static_cast<double>(size[0]) * size[1] * size[2]
+                             * sizeof(Optimize::ImageType::PixelType) / (1024.0 * 1024.0);
+            continue;
+          }
+        }
+
+        Optimize::ImageType::Pointer image;
+        if (!fixed_domains[index + i]) {
+          auto reader = itk::ImageFileReader<Optimize::ImageType>::New();
+          reader->SetFileName(filename);
+          reader->UpdateLargestPossibleRegion();
+          image = reader->GetOutput();
+          image_sizes[i] = image->GetLargestPossibleRegion().GetNumberOfPixels()
+                           * sizeof(Optimize::ImageType::PixelType) / (1024.0 * 1024.0);
+        }
+        domains[i] = Sampler::CreateImageDomain(image, narrow_band);
+        if (!cache_key.empty()) {
+          Sampler::SaveImageDomainCache(domain_cache_dir, cache_key, domains[i]);
+        }
       }
-      typename itk::ImageFileReader<Optimize::ImageType>::Pointer reader = itk::ImageFileReader<
-        Optimize::ImageType>::New();
-      reader->SetFileName(imageFiles[index]);
-      reader->UpdateLargestPossibleRegion();
-      const auto image = reader->GetOutput();
-      optimize->AddImage(image);
+    });
+
+    for (auto& domain : domains) {
+      optimize->AddImageDomain(domain);
     }
-    else {
-      optimize->AddImage(nullptr);
+    index += count;
+
+    const double image_size = *std::max_element(image_sizes.begin(), image_sizes.end());
+    if (image_size > 0) {
+      batch_size = std::max<size_t>(1, static_cast<size_t>(memory_budget / (2.0 * image_size)));
     }
   }
 
+  if (this->verbosity_level_ > 0) {
+    const auto time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Loaded " << imageFiles.size() << " image domains in " << time << " seconds\n";
+  }
+
   inputsBuffer.clear();
   inputsBuffer.str("");
 
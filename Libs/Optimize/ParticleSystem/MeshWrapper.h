@@ -2,6 +2,9 @@
 
 #include <vnl/vnl_vector_fixed.h>
 
+#include <array>
+#include <mutex>
+
 #include "itkParticleDomain.h"
 #include "DomainType.h"
 
@@ -34,6 +37,20 @@ public:
   virtual PointType SnapToMesh(PointType pointa, int idx) const = 0;
 
   virtual void InvalidateParticle(int idx) {};
+
+protected:
+  // Lock of the per particle cache entries of particle idx.  The particles of a
+  // domain are evaluated in parallel, and each one also queries (and caches)
+  // the entries of its neighbors, so an entry may be used by several threads
+  // at once.  The locks are striped over the particle indices and must only be
+  // held while an entry is read or written.
+  std::mutex& GetParticleCacheMutex(int idx) const
+  {
+    return particle_cache_mutexes_[idx % particle_cache_mutexes_.size()];
+  }
+
+private:
+  mutable std::array<std::mutex, 64> particle_cache_mutexes_;
 };
 
 }
@@ -5,8 +5,26 @@
 #include "itkParticleImageDomain.h"
 #include "Sampler.h"
 
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+
+#include <openvdb/io/File.h>
+
 namespace shapeworks {
 
+namespace {
+// bump when the contents of the cache change
+constexpr int image_domain_cache_version = 2;
+
+std::string image_domain_cache_file(const std::string& cache_dir, const std::string& key)
+{
+  return cache_dir + "/" + key + ".vdb";
+}
+}
+
 Sampler::Sampler()
 {
   // Allocate the particle system members.
@@ -152,6 +170,14 @@ void Sampler::AllocateDomainsAndNeighborhoods()
   }
 }
 
+itk::ParticleNeighborhood<Sampler::Dimension>::Pointer Sampler::CreateNeighborhood() const
+{
+  if (m_UseGridNeighborhood) {
+    return itk::ParticleGridNeighborhood<Dimension>::New().GetPointer();
+  }
+  return itk::ParticleSurfaceNeighborhood<ImageType>::New().GetPointer();
+}
+
 void Sampler::ReadPointsFiles()
 {
   // If points file names have been specified, then read the initial points.
@@ -286,7 +312,7 @@ void Sampler::ReInitialize()
 void Sampler::AddMesh(std::shared_ptr<shapeworks::MeshWrapper> mesh)
 {
   auto domain = itk::MeshDomain::New();
-  m_NeighborhoodList.push_back(itk::ParticleSurfaceNeighborhood<ImageType>::New());
+  m_NeighborhoodList.push_back(this->CreateNeighborhood());
   if (mesh) {
     this->m_Spacing = 1;
     domain->SetMesh(mesh);
@@ -349,17 +375,109 @@ void Sampler::AddSphere(unsigned int i, vnl_vector_fixed<double, Dimension>& c,
 
 void Sampler::AddImage(ImageType::Pointer image, double narrow_band)
 {
-  const auto domain = itk::ParticleImplicitSurfaceDomain<ImageType::PixelType>::New();
-  m_NeighborhoodList.push_back(itk::ParticleSurfaceNeighborhood<ImageType>::New());
+  this->AddImageDomain(CreateImageDomain(image, narrow_band));
+}
+
+Sampler::ImageDomainType::Pointer Sampler::CreateImageDomain(ImageType::Pointer image, double narrow_band)
+{
+  const auto domain = ImageDomainType::New();
 
   if (image) {
-    this->m_Spacing = image->GetSpacing()[0];
     // convert narrow band (index space) to world space
     // (e.g. narrow band of 4 means 4 voxels (largest side)
     double narrow_band_world = image->GetSpacing().GetVnlVector().max_value() * narrow_band;
     domain->SetImage(image, narrow_band_world);
   }
 
+  return domain;
+}
+
+std::string Sampler::ImageDomainCacheKey(const std::string& image_file, double narrow_band)
+{
+  // 64-bit FNV-1a over the bytes of the file
+  std::ifstream in(image_file, std::ios::binary);
+  uint64_t hash = 14695981039346656037ull;
+  uint64_t file_size = 0;
+  std::vector<char> buffer(1 << 20);
+  while (in) {
+    in.read(buffer.data(), buffer.size());
+    const size_t bytes = static_cast<size_t>(in.gcount());
+    for (size_t i = 0; i < bytes; i++) {
+      hash = (hash ^ static_cast<unsigned char>(buffer[i])) * 1099511628211ull;
+    }
+    file_size += bytes;
+  }
+
+  // everything else the domain depends on: the file size, the narrow band and the pixel type
+  std::ostringstream key;
+  key << "v" << image_domain_cache_version << "_" << file_size << "_" << std::hex << std::setw(16)
+      << std::setfill('0') << hash << std::dec << "_nb" << std::setprecision(17) << narrow_band << "_"
+      << sizeof(PixelType);
+  return key.str();
+}
+
+Sampler::ImageDomainType::Pointer Sampler::LoadImageDomainCache(const std::string& cache_dir,
+                                                                const std::string& key)
+{
+  openvdb::initialize();
+  try {
+    openvdb::io::File file(image_domain_cache_file(cache_dir, key));
+    file.open(false);
+    const auto meta = file.getMetadata();
+    const auto cached_key = meta->getMetadata<openvdb::StringMetadata>("cache_key");
+    if (!cached_key || cached_key->value() != key) {
+      return nullptr;
+    }
+    const auto grids = file.getGrids();
+    file.close();
+
+    const auto domain = ImageDomainType::New();
+    if (!domain->LoadCache(*grids, *meta)) {
+      return nullptr;
+    }
+    return domain;
+  }
+  catch (openvdb::Exception&) {
+    // missing or unreadable, rebuild it
+    return nullptr;
+  }
+}
+
+void Sampler::SaveImageDomainCache(const std::string& cache_dir, const std::string& key,
+                                   ImageDomainType::Pointer domain)
+{
+  openvdb::GridPtrVec grids;
+  openvdb::MetaMap meta;
+  domain->SaveCache(grids, meta);
+  meta.insertMeta("cache_key", openvdb::StringMetadata(key));
+
+  // write to a temporary file and rename it, so that a concurrent run never reads a partial cache
+  const auto cache_file = image_domain_cache_file(cache_dir, key);
+  const auto temp_file = cache_file + "." + std::to_string(std::random_device{}()) + ".tmp";
+  try {
+    openvdb::io::File file(temp_file);
+    file.write(grids, meta);
+    file.close();
+#ifdef _WIN32
+    std::remove(cache_file.c_str()); // rename does not replace an existing file on windows
+#endif
+    if (std::rename(temp_file.c_str(), cache_file.c_str()) != 0) {
+      std::remove(temp_file.c_str());
+    }
+  }
+  catch (openvdb::Exception&) {
+    std::remove(temp_file.c_str());
+  }
+}
+
+void Sampler::AddImageDomain(ImageDomainType::Pointer domain)
+{
+  m_NeighborhoodList.push_back(this->CreateNeighborhood());
+
+  if (!domain->IsDomainFixed()) {
+    this->m_Spacing = domain->GetSpacing()[0];
+  }
+
   m_DomainList.push_back(domain);
 }
 
@@ -8,6 +8,7 @@
 #include "itkParticleCurvatureEntropyGradientFunction.h"
 #include "itkParticleMeanCurvatureAttribute.h"
 #include "itkParticleSurfaceNeighborhood.h"
+#include "itkParticleGridNeighborhood.h"
 #include "itkParticleOmegaGradientFunction.h"
 #include "DomainType.h"
 #include "MeshWrapper.h"
@@ -127,6 +128,29 @@ public:
 
   void AddImage(ImageType::Pointer image, double narrow_band);
 
+  using ImageDomainType = itk::ParticleImplicitSurfaceDomain<PixelType>;
+
+  //! Build the domain of an image, or a fixed domain if image is null.  Safe to call
+  //! concurrently for different images.
+  static ImageDomainType::Pointer CreateImageDomain(ImageType::Pointer image, double narrow_band);
+
+  //! Add a domain built by CreateImageDomain
+  void AddImageDomain(ImageDomainType::Pointer domain);
+
+  //! Key of the cached domain of an image file: a hash of the file contents, its size, the narrow band
+  //! and the pixel type
+  static std::string ImageDomainCacheKey(const std::string& image_file, double narrow_band);
+
+  //! Read the domain cached in cache_dir under the given key by SaveImageDomainCache, or return null if
+  //! there is none.  Safe to call concurrently for different keys.
+  static ImageDomainType::Pointer LoadImageDomainCache(const std::string& cache_dir, const std::string& key);
+
+  //! Write the grids and surface statistics of a domain to <cache_dir>/<key>.vdb, so that later runs can
+  //! skip reading the image and building the domain.  Failures are ignored, the cache is only an
+  //! optimization.
+  static void SaveImageDomainCache(const std::string& cache_dir, const std::string& key,
+                                   ImageDomainType::Pointer domain);
+
   void ApplyConstraintsToZeroCrossing(){
       std::cout << "ApplyConstraintsToZeroCrossing " << m_DomainList.size() << std::endl;
       for(size_t i = 0; i < m_DomainList.size(); i++){
@@ -360,6 +384,15 @@ public:
   void SetPairwisePotentialType(int pairwise_potential_type)
   { m_pairwise_potential_type = pairwise_potential_type; }
 
+  /** Use the flat cell grid neighborhood (ParticleGridNeighborhood) instead of
+      the PowerOfTwoPointTree based ParticleSurfaceNeighborhood.  Must be set
+      before any domains are added. */
+  void SetUseGridNeighborhood(bool value)
+  { m_UseGridNeighborhood = value; }
+
+  bool GetUseGridNeighborhood() const
+  { return m_UseGridNeighborhood; }
+
   int GetPairwisePotentialType()
   { return m_pairwise_potential_type; }
 
@@ -379,6 +412,8 @@ public:
   void ReadPointsFiles();
   virtual void AllocateDataCaches();
   virtual void AllocateDomainsAndNeighborhoods();
+
+  itk::ParticleNeighborhood<Dimension>::Pointer CreateNeighborhood() const;
   virtual void InitializeOptimizationFunctions();
 
 /** */
@@ -478,7 +513,8 @@ protected:
 
   std::vector<itk::ParticleDomain::Pointer> m_DomainList;
 
-  std::vector<itk::ParticleSurfaceNeighborhood<ImageType>::Pointer> m_NeighborhoodList;
+  std::vector<itk::ParticleNeighborhood<Dimension>::Pointer> m_NeighborhoodList;
+  bool m_UseGridNeighborhood{false};
 
   int m_pairwise_potential_type;
 
@@ -5,8 +5,6 @@
 #include <igl/per_vertex_normals.h>
 #include <igl/doublearea.h>
 
-#include <set>
-
 using namespace trimesh;
 
 namespace shapeworks {
@@ -49,9 +47,11 @@ TriMeshWrapper::TriMeshWrapper(std::shared_ptr<trimesh::TriMesh> mesh)
   mesh_->need_normals();
   mesh_->need_curvatures();
   ComputeMeshBounds();
-  ComputeGradN();
 
-  kd_tree_ = std::make_shared<KDtree>(mesh_->vertices);
+  GetIGLMesh(vertices_, faces_);
+  aabb_tree_.init(vertices_, faces_);
+
+  ComputeGradN();
 }
 
 double TriMeshWrapper::ComputeDistance(PointType pointa, PointType pointb) const
@@ -304,25 +304,6 @@ TriMeshWrapper::GradNType TriMeshWrapper::SampleGradNAtPoint(PointType p, int id
   return weighted_grad_normal;
 }
 
-int TriMeshWrapper::GetNearestVertex(point pt) const
-{
-  const float* match = kd_tree_->closest_to_pt(pt, 99999999);
-  int match_ind = (const point*) match - &(mesh_->vertices[0]);
-  return match_ind;
-}
-
-std::vector<int> TriMeshWrapper::GetKNearestVertices(point pt, int k) const
-{
-  std::vector<const float*> knn;
-  kd_tree_->find_k_closest_to_pt(knn, k, pt, 9999999);
-  std::vector<int> vertices;
-  for (int i = 0; i < knn.size(); i++) {
-    int match_ind = (const point*) knn[i] - &(mesh_->vertices[0]);
-    vertices.push_back(match_ind);
-  }
-  return vertices;
-}
-
 vec normalizeBary(const vec& bary)
 {
   float sum = abs(bary[0]) + abs(bary[1]) + abs(bary[2]);
@@ -335,19 +316,23 @@ inline bool TriMeshWrapper::IsBarycentricCoordinateValid(const trimesh::vec3& ba
          ((bary[2] >= -epsilon) && (bary[2] <= 1 + epsilon));
 }
 
-// Checks all of the neighbor faces of the 10 nearest vertices to pt.
-// Returns index of the first face that has valid barycentric coordinates, and its
-// barycentric coordinates in baryOut
+// Returns the index of the face that pt lies on, and its barycentric coordinates
+// in baryOut. The cached face of the particle is used if pt still projects into
+// it, otherwise the face of the closest point on the mesh is found in the AABB tree.
 int TriMeshWrapper::GetTriangleForPoint(point pt, int idx, vec& baryOut) const
 {
-  // given a guess, just check whether it is still valid.
-  if(idx != -1) {
-    // ensure that the cache has enough elements. this will never be resized to more than the number of particles,
-    if(idx >= particle2tri_.size()) {
-      particle2tri_.resize(idx + 1, 0);
-    }
+  // the cache is sized when particles are added (see InvalidateParticle), so
+  // it is never resized here, where particles are processed in parallel
+  const bool cached = idx >= 0 && idx < particle2tri_.size();
+
+  int guess = -1;
+  if (cached) {
+    std::lock_guard<std::mutex> lock(GetParticleCacheMutex(idx));
+    guess = particle2tri_[idx];
+  }
 
-    const int guess = particle2tri_[idx];
+  // given a guess, just check whether it is still valid.
+  if (guess != -1) {
     baryOut = this->ComputeBarycentricCoordinates(pt, guess);
     const vec norBary = normalizeBary(baryOut);
     if(IsBarycentricCoordinateValid(norBary)) {
@@ -355,52 +340,27 @@ int TriMeshWrapper::GetTriangleForPoint(point pt, int idx, vec& baryOut) const
     }
   }
 
-  double closestDistance = 99999999;
-  int closestFace = -1;
-
-  std::vector<int> vertices = GetKNearestVertices(pt, 10);
-  std::set<int> faceCandidatesSet;
-  for (int j = 0; j < vertices.size(); j++) {
-    int vert = vertices[j];
-    for (int i = 0; i < mesh_->adjacentfaces[vert].size(); i++) {
-      int face = mesh_->adjacentfaces[vert][i];
-
-      // Only check each face once
-      if (faceCandidatesSet.find(face) == faceCandidatesSet.end()) {
-        faceCandidatesSet.insert(face);
-        baryOut = this->ComputeBarycentricCoordinates(pt, face);
-        const vec norBary = normalizeBary(baryOut);
-        if (IsBarycentricCoordinateValid(norBary)) {
-          if(idx != -1) {
-            // update cache
-            particle2tri_[idx] = face;
-          }
-          return face;
-        }
-        else {
-          float distance = 0;
-          for (int k = 0; k < 3; k++) {
-            if (norBary[k] < 0) {
-              distance += -norBary[k];
-            }
-            else if (norBary[k] > 1) {
-              distance += norBary[k] - 1;
-            }
-          }
-          if (distance < closestDistance) {
-            closestFace = face;
-            closestDistance = distance;
-          }
-        }
-      }
-    }
-  }
-  baryOut = this->ComputeBarycentricCoordinates(pt, closestFace);
-  if(idx != -1) {
+  int face = -1;
+  Eigen::RowVector3d closest;
+  const Eigen::RowVector3d query(pt[0], pt[1], pt[2]);
+  aabb_tree_.squared_distance(vertices_, faces_, query, face, closest);
+
+  baryOut = this->ComputeBarycentricCoordinates(point(closest[0], closest[1], closest[2]), face);
+  if (cached) {
     // update cache
-    particle2tri_[idx] = closestFace;
+    std::lock_guard<std::mutex> lock(GetParticleCacheMutex(idx));
+    particle2tri_[idx] = face;
+  }
+  return face;
+}
+
+void TriMeshWrapper::InvalidateParticle(int idx)
+{
+  assert(idx >= 0); // should always be passed a valid particle
+  if (idx >= particle2tri_.size()) {
+    particle2tri_.resize(idx + 1, -1);
   }
-  return closestFace;
+  particle2tri_[idx] = -1;
 }
 
 vec3 TriMeshWrapper::ComputeBarycentricCoordinates(point pt, int face) const
@@ -492,10 +452,8 @@ void TriMeshWrapper::ComputeGradN()
   const int n_verts = mesh_->vertices.size();
   const int n_faces = mesh_->faces.size();
 
-  // Copy from trimesh to libigl data structures
-  Eigen::MatrixXd V;
-  Eigen::MatrixXi F;
-  GetIGLMesh(V, F);
+  const Eigen::MatrixXd& V = vertices_;
+  const Eigen::MatrixXi& F = faces_;
 
   // Compute normals
   Eigen::MatrixXd N;
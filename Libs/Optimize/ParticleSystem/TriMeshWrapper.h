@@ -2,11 +2,11 @@
 
 #include "vnl/vnl_vector_fixed.h"
 #include "TriMesh.h"
-#include "KDtree.h"
 #include "MeshWrapper.h"
 
 #include <Eigen/Core>
 #include <Eigen/Geometry>
+#include <igl/AABB.h>
 #include <vector>
 
 namespace shapeworks {
@@ -47,6 +47,8 @@ public:
     return mesh_upper_bound_;
   }
 
+  void InvalidateParticle(int idx) override;
+
 private:
 
   Eigen::Vector3d
@@ -68,9 +70,7 @@ private:
   trimesh::point GetBarycentricIntersection(trimesh::vec3 start, trimesh::vec3 end,
                                             int currentFace, int edge) const;
 
-  int GetNearestVertex(trimesh::point pt) const;
   int GetTriangleForPoint(trimesh::point pt, int idx, trimesh::vec& bary) const;
-  std::vector<int> GetKNearestVertices(trimesh::point pt, int k) const;
   trimesh::vec3 ComputeBarycentricCoordinates(trimesh::point pt, int face) const;
 
   static inline bool IsBarycentricCoordinateValid(const trimesh::vec3& b);
@@ -79,10 +79,19 @@ private:
   void GetIGLMesh(Eigen::MatrixXd& V, Eigen::MatrixXi& F);
 
   std::shared_ptr<trimesh::TriMesh> mesh_;
-  std::shared_ptr<trimesh::KDtree> kd_tree_;
 
-  // Maintains a map of particle index -> triangle index
+  // Copy of the mesh in libigl form and an AABB tree over its triangles, used
+  // for exact closest point queries
+  Eigen::MatrixXd vertices_;
+  Eigen::MatrixXi faces_;
+  igl::AABB<Eigen::MatrixXd, 3> aabb_tree_;
+
+  // Maintains a map of particle index -> triangle index (-1 if unknown)
   // Has to be mutable because all of the accessor APIs are const
+  // It is only resized by InvalidateParticle, which the particle system calls
+  // serially when a particle is added.  The parallel optimizer reads and writes
+  // the entries of neighboring particles as well, so each entry is accessed
+  // under its lock (see GetParticleCacheMutex).
   mutable std::vector<int> particle2tri_;
 
   std::vector<GradNType> grad_normals_;
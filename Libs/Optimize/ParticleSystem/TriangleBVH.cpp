@@ -0,0 +1,203 @@
+#include "TriangleBVH.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace shapeworks {
+
+namespace {
+// deeper subtrees are closed with larger leaves, this bounds the query stack
+constexpr int max_depth = 48;
+constexpr int stack_size = max_depth + 2;
+}
+
+//---------------------------------------------------------------------------
+void TriangleBVH::Build(const std::vector<Eigen::Vector3d>& a,
+                        const std::vector<Eigen::Vector3d>& b,
+                        const std::vector<Eigen::Vector3d>& c)
+{
+  const int num_triangles = static_cast<int>(a.size());
+
+  std::vector<Eigen::Vector3d> centroids(num_triangles);
+  std::vector<int> order(num_triangles);
+  for (int i = 0; i < num_triangles; i++) {
+    centroids[i] = (a[i] + b[i] + c[i]) / 3.0;
+    order[i] = i;
+  }
+
+  nodes_.clear();
+  nodes_.reserve(2 * (num_triangles / max_leaf_size_ + 1));
+  if (num_triangles > 0) {
+    BuildNode(order, centroids, 0, num_triangles, 0);
+  }
+
+  // store the triangles in leaf order so that each leaf is contiguous
+  triangles_.resize(num_triangles);
+  for (int i = 0; i < num_triangles; i++) {
+    const int id = order[i];
+    triangles_[i] = Triangle{a[id], b[id], c[id], id};
+  }
+
+  // compute the node bounds bottom up
+  for (auto& node : nodes_) {
+    node.lower.setConstant(std::numeric_limits<double>::max());
+    node.upper.setConstant(std::numeric_limits<double>::lowest());
+  }
+  for (int n = static_cast<int>(nodes_.size()) - 1; n >= 0; n--) {
+    Node& node = nodes_[n];
+    if (node.count > 0) {
+      for (int i = node.offset; i < node.offset + node.count; i++) {
+        const Triangle& t = triangles_[i];
+        node.lower = node.lower.cwiseMin(t.a).cwiseMin(t.b).cwiseMin(t.c);
+        node.upper = node.upper.cwiseMax(t.a).cwiseMax(t.b).cwiseMax(t.c);
+      }
+    }
+    else {
+      // children always follow their parent, so they are already done
+      const Node& left = nodes_[n + 1];
+      const Node& right = nodes_[node.offset];
+      node.lower = left.lower.cwiseMin(right.lower);
+      node.upper = left.upper.cwiseMax(right.upper);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+int TriangleBVH::BuildNode(std::vector<int>& order, const std::vector<Eigen::Vector3d>& centroids,
+                           int first, int count, int depth)
+{
+  const int index = static_cast<int>(nodes_.size());
+  nodes_.push_back(Node());
+
+  Eigen::Vector3d lower = centroids[order[first]];
+  Eigen::Vector3d upper = lower;
+  for (int i = first + 1; i < first + count; i++) {
+    lower = lower.cwiseMin(centroids[order[i]]);
+    upper = upper.cwiseMax(centroids[order[i]]);
+  }
+
+  int axis;
+  const double extent = (upper - lower).maxCoeff(&axis);
+  if (count <= max_leaf_size_ || depth >= max_depth || extent <= 0.0) {
+    nodes_[index].offset = first;
+    nodes_[index].count = count;
+    return index;
+  }
+
+  // median split along the longest axis of the centroid bounds
+  const int half = count / 2;
+  std::nth_element(order.begin() + first, order.begin() + first + half,
+                   order.begin() + first + count, [&](int i, int j) {
+                     return centroids[i][axis] < centroids[j][axis];
+                   });
+
+  BuildNode(order, centroids, first, half, depth + 1);
+  const int right = BuildNode(order, centroids, first + half, count - half, depth + 1);
+  nodes_[index].offset = right;
+  nodes_[index].count = 0;
+  return index;
+}
+
+//---------------------------------------------------------------------------
+int TriangleBVH::FindClosestPoint(const Eigen::Vector3d& p, Eigen::Vector3d& closest,
+                                  double& dist2) const
+{
+  int best = -1;
+  dist2 = std::numeric_limits<double>::max();
+  if (nodes_.empty()) {
+    return best;
+  }
+
+  int stack[stack_size];
+  int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0) {
+    const Node& node = nodes_[stack[--top]];
+    if (BoxDistance2(node, p) >= dist2) {
+      continue;
+    }
+
+    if (node.count > 0) {
+      for (int i = node.offset; i < node.offset + node.count; i++) {
+        const Eigen::Vector3d q = ClosestPointOnTriangle(triangles_[i], p);
+        const double d2 = (q - p).squaredNorm();
+        if (d2 < dist2) {
+          dist2 = d2;
+          closest = q;
+          best = triangles_[i].id;
+        }
+      }
+      continue;
+    }
+
+    // visit the nearer child first
+    const int left = static_cast<int>(&node - nodes_.data()) + 1;
+    const int right = node.offset;
+    if (BoxDistance2(nodes_[left], p) < BoxDistance2(nodes_[right], p)) {
+      stack[top++] = right;
+      stack[top++] = left;
+    }
+    else {
+      stack[top++] = left;
+      stack[top++] = right;
+    }
+  }
+
+  return best;
+}
+
+//---------------------------------------------------------------------------
+double TriangleBVH::BoxDistance2(const Node& node, const Eigen::Vector3d& p)
+{
+  const Eigen::Vector3d d = (node.lower - p).cwiseMax(p - node.upper).cwiseMax(0.0);
+  return d.squaredNorm();
+}
+
+//---------------------------------------------------------------------------
+Eigen::Vector3d TriangleBVH::ClosestPointOnTriangle(const Triangle& t, const Eigen::Vector3d& p)
+{
+  // Ericson, Real-Time Collision Detection, 5.1.5
+  const Eigen::Vector3d ab = t.b - t.a;
+  const Eigen::Vector3d ac = t.c - t.a;
+  const Eigen::Vector3d ap = p - t.a;
+  const double d1 = ab.dot(ap);
+  const double d2 = ac.dot(ap);
+  if (d1 <= 0.0 && d2 <= 0.0) {
+    return t.a;
+  }
+
+  const Eigen::Vector3d bp = p - t.b;
+  const double d3 = ab.dot(bp);
+  const double d4 = ac.dot(bp);
+  if (d3 >= 0.0 && d4 <= d3) {
+    return t.b;
+  }
+
+  const double vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+    return t.a + ab * (d1 / (d1 - d3));
+  }
+
+  const Eigen::Vector3d cp = p - t.c;
+  const double d5 = ab.dot(cp);
+  const double d6 = ac.dot(cp);
+  if (d6 >= 0.0 && d5 <= d6) {
+    return t.c;
+  }
+
+  const double vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+    return t.a + ac * (d2 / (d2 - d6));
+  }
+
+  const double va = d3 * d6 - d5 * d4;
+  if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) {
+    return t.b + (t.c - t.b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+  }
+
+  const double denom = 1.0 / (va + vb + vc);
+  return t.a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <vector>
+
+namespace shapeworks {
+
+//! Static bounding volume hierarchy over the triangles of a mesh
+/*!
+ * The hierarchy is built once and stored as a flat array of nodes in depth
+ * first order, the left child of an inner node directly follows it.  Queries
+ * are const and do not allocate, so they can be issued concurrently from any
+ * number of threads.
+ */
+class TriangleBVH {
+public:
+
+  TriangleBVH() = default;
+
+  //! Build the hierarchy, triangle i has corners a[i], b[i] and c[i]
+  void Build(const std::vector<Eigen::Vector3d>& a, const std::vector<Eigen::Vector3d>& b,
+             const std::vector<Eigen::Vector3d>& c);
+
+  //! Find the closest point on the mesh to p.  Returns the index of the
+  //! triangle containing it, or -1 if the hierarchy is empty.
+  int FindClosestPoint(const Eigen::Vector3d& p, Eigen::Vector3d& closest, double& dist2) const;
+
+  //! Number of triangles in the hierarchy
+  int GetNumberOfTriangles() const { return static_cast<int>(triangles_.size()); }
+
+private:
+
+  struct Node {
+    Eigen::Vector3d lower;
+    Eigen::Vector3d upper;
+    //! leaf: index of the first triangle, inner: index of the right child
+    int offset;
+    //! number of triangles in a leaf, 0 for inner nodes
+    int count;
+  };
+
+  struct Triangle {
+    Eigen::Vector3d a, b, c;
+    int id;
+  };
+
+  int BuildNode(std::vector<int>& order, const std::vector<Eigen::Vector3d>& centroids,
+                int first, int count, int depth);
+
+  static double BoxDistance2(const Node& node, const Eigen::Vector3d& p);
+
+  static Eigen::Vector3d ClosestPointOnTriangle(const Triangle& t, const Eigen::Vector3d& p);
+
+  std::vector<Node> nodes_;
+  std::vector<Triangle> triangles_;
+
+  static constexpr int max_leaf_size_ = 4;
+};
+
+}
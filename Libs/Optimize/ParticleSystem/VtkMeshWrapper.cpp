@@ -1,6 +1,5 @@
 #include "VtkMeshWrapper.h"
 
-#include <vtkCellLocator.h>
 #include <vtkPolyDataNormals.h>
 #include <vtkCellData.h>
 #include <vtkCell.h>
@@ -13,6 +12,8 @@
 #include <igl/grad.h>
 #include <igl/per_vertex_normals.h>
 
+#include <limits>
+
 namespace shapeworks {
 
 namespace {
@@ -70,8 +71,14 @@ VtkMeshWrapper::VtkMeshWrapper(vtkSmartPointer<vtkPolyData> poly_data)
   this->poly_data_->BuildCells();
   this->poly_data_->BuildLinks();
 
+  const int num_faces = this->poly_data_->GetNumberOfCells();
+  std::vector<Eigen::Vector3d> corners[3];
+  for (int k = 0; k < 3; k++) {
+    corners[k].resize(num_faces);
+  }
+
   vtkSmartPointer<vtkGenericCell> cell = vtkSmartPointer<vtkGenericCell>::New();
-  for (int i = 0; i < this->poly_data_->GetNumberOfCells(); i++) {
+  for (int i = 0; i < num_faces; i++) {
     this->poly_data_->GetCell(i, cell);
 
     vtkSmartPointer<vtkTriangle> triangle = vtkSmartPointer<vtkTriangle>::New();
@@ -84,12 +91,23 @@ VtkMeshWrapper::VtkMeshWrapper(vtkSmartPointer<vtkPolyData> poly_data)
     triangle->GetPoints()->SetPoint(2, cell->GetPoints()->GetPoint(2));
 
     this->triangles_.push_back(triangle);
+
+    for (int k = 0; k < 3; k++) {
+      double point[3];
+      triangle->GetPoints()->GetPoint(k, point);
+      corners[k][i] = Eigen::Vector3d(point[0], point[1], point[2]);
+    }
+  }
+
+  auto cell_normals = this->poly_data_->GetCellData()->GetNormals();
+  this->face_normals_.resize(num_faces);
+  for (int i = 0; i < num_faces; i++) {
+    double normal[3];
+    cell_normals->GetTuple(i, normal);
+    this->face_normals_[i] = Eigen::Vector3d(normal[0], normal[1], normal[2]);
   }
 
-  this->cell_locator_ = vtkSmartPointer<vtkCellLocator>::New();
-  this->cell_locator_->SetCacheCellBounds(true);
-  this->cell_locator_->SetDataSet(this->poly_data_);
-  this->cell_locator_->BuildLocator();
+  this->bvh_.Build(corners[0], corners[1], corners[2]);
 
   this->ComputeMeshBounds();
   this->ComputeGradN();
@@ -128,13 +146,12 @@ PointType VtkMeshWrapper::GeodesicWalk(PointType p, int idx,
   PointType new_point_pt = convert<Eigen::Vector3d, PointType>(new_point);
 
   // update cache
-  if (idx >= 0 && ending_face >= 0) {
-    if (idx >= particle_triangles_.size()) {
-      particle_triangles_.resize(idx + 1, -1);
+  if (idx >= 0 && idx < particle_triangles_.size() && ending_face >= 0) {
+    {
+      std::lock_guard<std::mutex> lock(GetParticleCacheMutex(idx));
+      particle_triangles_[idx] = ending_face;
     }
 
-    particle_triangles_[idx] = ending_face;
-
     this->CalculateNormalAtPoint(new_point_pt, idx);
   }
 
@@ -164,9 +181,7 @@ VtkMeshWrapper::ProjectVectorToSurfaceTangent(const PointType &pointa, int idx,
 
   int faceIndex = this->GetTriangleForPoint(point, idx, closest_point);
 
-  double* normal = this->poly_data_->GetCellData()->GetNormals()->GetTuple(faceIndex);
-
-  Eigen::Vector3d vec_normal = convert<double*, vec3>(normal);
+  const Eigen::Vector3d& vec_normal = this->face_normals_[faceIndex];
   Eigen::Vector3d vec_vector = convert<VectorType &, vec3>(vector);
 
   Eigen::Vector3d result = this->ProjectVectorToFace(vec_normal, vec_vector);
@@ -178,10 +193,13 @@ VtkMeshWrapper::ProjectVectorToSurfaceTangent(const PointType &pointa, int idx,
 NormalType VtkMeshWrapper::SampleNormalAtPoint(PointType p, int idx) const
 {
   // if the particle is not in the cache or it has changed position, we must recompute
-  if (idx < 0 || idx >= this->particle_normals_.size() || p != this->particle_positions_[idx]) {
-    return this->CalculateNormalAtPoint(p, idx);
+  if (idx >= 0 && idx < this->particle_normals_.size()) {
+    std::lock_guard<std::mutex> lock(GetParticleCacheMutex(idx));
+    if (p == this->particle_positions_[idx]) {
+      return this->particle_normals_[idx];
+    }
   }
-  return this->particle_normals_[idx];
+  return this->CalculateNormalAtPoint(p, idx);
 }
 
 //---------------------------------------------------------------------------
@@ -224,15 +242,18 @@ PointType VtkMeshWrapper::GetPointOnMesh() const
 //---------------------------------------------------------------------------
 int VtkMeshWrapper::GetTriangleForPoint(const double pt[3], int idx, double closest_point[3]) const
 {
+  // the cache is sized when particles are added (see InvalidateParticle), so
+  // it is never resized here, where particles are processed in parallel
+  const bool cached = idx >= 0 && idx < particle_triangles_.size();
+
   // given a guess, just check whether it is still valid.
-  if (idx >= 0) {
-    // ensure that the cache has enough elements. this will never be resized to more than the number of particles,
-    if (idx >= particle_triangles_.size()) {
-      particle_triangles_.resize(idx + 1, -1);
+  if (cached) {
+    int guess;
+    {
+      std::lock_guard<std::mutex> lock(GetParticleCacheMutex(idx));
+      guess = particle_triangles_[idx];
     }
 
-    const int guess = particle_triangles_[idx];
-
     if (guess != -1 && this->IsInTriangle(pt, guess)) {
       closest_point[0] = pt[0];
       closest_point[1] = pt[1];
@@ -241,15 +262,17 @@ int VtkMeshWrapper::GetTriangleForPoint(const double pt[3], int idx, double clos
     }
   }
 
-  //double closest_point[3];//the coordinates of the closest point will be returned here
+  Eigen::Vector3d closest; //the coordinates of the closest point will be returned here
   double closest_point_dist2; //the squared distance to the closest point will be returned here
-  vtkIdType cell_id; //the cell id of the cell containing the closest point will be returned here
-  int sub_id; //this is rarely used (in triangle strips only, I believe)
-
-  this->cell_locator_->FindClosestPoint(pt, closest_point, cell_id, sub_id, closest_point_dist2);
-
-  if (idx >= 0) {
-    // update cache, no need to check size as it was already checked above
+  const int cell_id = this->bvh_.FindClosestPoint(Eigen::Vector3d(pt[0], pt[1], pt[2]), closest,
+                                                  closest_point_dist2);
+  closest_point[0] = closest[0];
+  closest_point[1] = closest[1];
+  closest_point[2] = closest[2];
+
+  if (cached) {
+    // update cache
+    std::lock_guard<std::mutex> lock(GetParticleCacheMutex(idx));
     particle_triangles_[idx] = cell_id;
   }
 
@@ -402,10 +425,7 @@ Eigen::Vector3d VtkMeshWrapper::ComputeBarycentricCoordinates(Eigen::Vector3d pt
 //---------------------------------------------------------------------------
 const Eigen::Vector3d VtkMeshWrapper::GetFaceNormal(int face_index) const
 {
-  auto normals = this->poly_data_->GetCellData()->GetNormals();
-  double* normal = normals->GetTuple(face_index);
-  Eigen::Vector3d n(normal[0], normal[1], normal[2]);
-  return n;
+  return this->face_normals_[face_index];
 }
 
 //---------------------------------------------------------------------------
@@ -630,7 +650,7 @@ int VtkMeshWrapper::SlideAlongEdge(Eigen::Vector3d &point, Eigen::Vector3d &rema
 //---------------------------------------------------------------------------
 int VtkMeshWrapper::GetFacePointID(int face, int point_id) const
 {
-  return this->poly_data_->GetCell(face)->GetPointId(point_id);
+  return this->triangles_[face]->GetPointId(point_id);
 }
 
 //---------------------------------------------------------------------------
@@ -673,11 +693,8 @@ NormalType VtkMeshWrapper::CalculateNormalAtPoint(PointType p, int idx) const
     weighted_normal[2] = weighted_normal[2] + normal[2] * weights[i];
   }
 
-  if (idx >= 0) { // cache
-    if (idx >= this->particle_normals_.size()) {
-      this->particle_normals_.resize(idx + 1);
-      this->particle_positions_.resize(idx + 1);
-    }
+  if (idx >= 0 && idx < this->particle_normals_.size()) { // cache
+    std::lock_guard<std::mutex> lock(GetParticleCacheMutex(idx));
     this->particle_positions_[idx] = p;
     this->particle_normals_[idx] = weighted_normal;
   }
@@ -691,6 +708,11 @@ void VtkMeshWrapper::InvalidateParticle(int idx)
   assert(idx >= 0); // should always be passed a valid particle
   if (idx >= particle_triangles_.size()) {
     particle_triangles_.resize(idx + 1, -1);
+    // NaN positions never match, so new entries are recomputed on first use
+    PointType unset;
+    unset.Fill(std::numeric_limits<double>::quiet_NaN());
+    particle_normals_.resize(idx + 1);
+    particle_positions_.resize(idx + 1, unset);
   }
   this->particle_triangles_[idx] = -1;
 }
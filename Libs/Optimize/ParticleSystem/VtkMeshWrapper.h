@@ -1,12 +1,11 @@
 #pragma once
 
 #include "MeshWrapper.h"
+#include "TriangleBVH.h"
 
 #include <vtkPolyData.h>
 #include <vtkSmartPointer.h>
 
-class vtkCellLocator;
-
 namespace shapeworks {
 
 class VtkMeshWrapper : public MeshWrapper {
@@ -93,6 +92,11 @@ private:
 
   // Caches of triangle, normal and position
   // Has to be mutable because all of the accessor APIs are const
+  // They are only resized by InvalidateParticle, which the particle system
+  // calls serially when a particle is added.  The parallel optimizer reads and
+  // writes the entries of neighboring particles as well, so each entry is
+  // accessed under its lock (see GetParticleCacheMutex), and a normal is only
+  // used together with the position it was cached for.
   mutable std::vector<int> particle_triangles_;
   mutable std::vector<NormalType> particle_normals_;
   mutable std::vector<PointType> particle_positions_;
@@ -102,12 +106,15 @@ private:
   // cache of specialized cells for direct access
   std::vector<vtkSmartPointer<vtkTriangle>> triangles_;
 
+  // cache of the cell normals
+  std::vector<Eigen::Vector3d> face_normals_;
+
   // bounds of the mesh plus some buffer
   PointType mesh_lower_bound_;
   PointType mesh_upper_bound_;
 
-  // cell locator to find closest point on mesh
-  vtkSmartPointer<vtkCellLocator> cell_locator_;
+  // bounding volume hierarchy to find closest point on mesh
+  TriangleBVH bvh_;
 
 };
 }
\ No newline at end of file
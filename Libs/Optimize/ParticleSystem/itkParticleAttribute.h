@@ -62,7 +62,8 @@ public:
                                NeighborhoodSetEvent(false),
                                PositionSetEvent(false),
                                PositionAddEvent(false),
-                               PositionRemoveEvent(false) {}
+                               PositionRemoveEvent(false),
+                               PositionSetBatchEvent(false) {}
     bool Event;
     bool EventWithIndex;
     bool DomainAddEvent;
@@ -72,6 +73,7 @@ public:
     bool PositionSetEvent;
     bool PositionAddEvent;
     bool PositionRemoveEvent;
+    bool PositionSetBatchEvent;
   };
   
   DefinedCallbacksStruct  m_DefinedCallbacks;
@@ -101,6 +103,26 @@ public:
   virtual void PositionAddEventCallback(Object *, const EventObject &) {}
   virtual void PositionRemoveEventCallback(Object *, const EventObject &) {}
 
+  /** Called once for a range of positions that were set together.  The
+      default forwards every position in the range to
+      PositionSetEventCallback, so attributes that only define the single
+      position callback stay up to date.  Subclasses that set
+      m_DefinedCallbacks.PositionSetBatchEvent should override this to update
+      the whole range at once. */
+  virtual void PositionSetBatchEventCallback(Object *o, const EventObject &e)
+  {
+    const ParticlePositionSetBatchEvent &event = dynamic_cast<const ParticlePositionSetBatchEvent &>(e);
+    ParticlePositionSetEvent single;
+    single.SetThreadID(event.GetThreadID());
+    single.SetDomainIndex(event.GetDomainIndex());
+    const int end = event.GetPositionIndex() + event.GetNumberOfPositions();
+    for (int k = event.GetPositionIndex(); k < end; k++)
+      {
+      single.SetPositionIndex(k);
+      this->PositionSetEventCallback(o, single);
+      }
+  }
+
 protected:
   ParticleAttribute() {}
   virtual ~ParticleAttribute() {};
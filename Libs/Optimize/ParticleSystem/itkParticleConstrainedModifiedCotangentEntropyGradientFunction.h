@@ -181,27 +181,26 @@ public:
     virtual typename ParticleVectorFunction<VDimension>::Pointer Clone()
     {
         typename ParticleConstrainedModifiedCotangentEntropyGradientFunction<TGradientNumericType, VDimension>::Pointer copy = ParticleConstrainedModifiedCotangentEntropyGradientFunction<TGradientNumericType, VDimension>::New();
-        copy->SetParticleSystem(this->GetParticleSystem());
-        copy->m_Counter = this->m_Counter;
-        copy->m_CurrentWeights = this->m_CurrentWeights;
-        copy->m_CurrentNeighborhood = this->m_CurrentNeighborhood;
-        copy->m_GlobalSigma = this->m_GlobalSigma;
-
-        copy->m_MinimumNeighborhoodRadius = this->m_MinimumNeighborhoodRadius;
-        copy->m_MaximumNeighborhoodRadius = this->m_MaximumNeighborhoodRadius;
-        copy->m_FlatCutoff = this->m_FlatCutoff;
-        copy->m_NeighborhoodToSigmaRatio = this->m_NeighborhoodToSigmaRatio;
-
-        copy->m_DomainNumber = this->m_DomainNumber;
-        copy->m_ParticleSystem = this->m_ParticleSystem;
-
-        copy->m_DomainsPerShape    = this->m_DomainsPerShape;
-        copy->m_diagnostics_prefix = this->m_diagnostics_prefix;
-        copy->m_RunStatus          = this->m_RunStatus;
-
+        copy->ResetState(this, this->m_DomainNumber);
         return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
     }
 
+    virtual void ResetState(const ParticleVectorFunction<VDimension> *source, unsigned int d)
+    {
+        Superclass::ResetState(source, d);
+        const Self *s = static_cast<const Self *>(source);
+
+        m_Counter = s->m_Counter;
+        m_GlobalSigma = s->m_GlobalSigma;
+        m_DomainsPerShape = s->m_DomainsPerShape;
+        m_diagnostics_prefix = s->m_diagnostics_prefix;
+        m_RunStatus = s->m_RunStatus;
+
+        // computed for each particle by BeforeEvaluate
+        m_CurrentWeights.clear();
+        m_CurrentNeighborhood.clear();
+    }
+
 protected:
     ParticleConstrainedModifiedCotangentEntropyGradientFunction() :  m_Counter(0), m_DomainsPerShape(1), m_GlobalSigma(-1.0) {}
     virtual ~ParticleConstrainedModifiedCotangentEntropyGradientFunction() {}
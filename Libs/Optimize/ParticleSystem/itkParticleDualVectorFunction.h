@@ -419,30 +419,53 @@ public:
     virtual typename ParticleVectorFunction<VDimension>::Pointer Clone()
     {
         typename ParticleDualVectorFunction<VDimension>::Pointer copy = ParticleDualVectorFunction<VDimension>::New();
-        copy->m_AOn = this->m_AOn;
-        copy->m_BOn = this->m_BOn;
+        copy->ResetState(this, this->m_DomainNumber);
+        return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+    }
 
-        copy->m_RelativeGradientScaling = this->m_RelativeGradientScaling;
-        copy->m_RelativeEnergyScaling = this->m_RelativeEnergyScaling;
-        copy->m_AverageGradMagA = this->m_AverageGradMagA;
-        copy->m_AverageGradMagB = this->m_AverageGradMagB;
-        copy->m_AverageEnergyA = this->m_AverageEnergyA;
-        copy->m_AverageEnergyB = this->m_AverageEnergyB;
-        copy->m_Counter = this->m_Counter;
+    virtual void ResetState(const ParticleVectorFunction<VDimension> *source, unsigned int d)
+    {
+        Superclass::ResetState(source, d);
+        const Self *s = static_cast<const Self *>(source);
 
-        if (this->m_FunctionA) copy->m_FunctionA = this->m_FunctionA->Clone();
-        if (this->m_FunctionB) copy->m_FunctionB = this->m_FunctionB->Clone();
+        m_AOn = s->m_AOn;
+        m_BOn = s->m_BOn;
 
-        if (!copy->m_FunctionA) copy->m_AOn = false;
-        if (!copy->m_FunctionB) copy->m_BOn = false;
+        m_RelativeGradientScaling = s->m_RelativeGradientScaling;
+        m_RelativeEnergyScaling = s->m_RelativeEnergyScaling;
+        m_AverageGradMagA = s->m_AverageGradMagA;
+        m_AverageGradMagB = s->m_AverageGradMagB;
+        m_AverageEnergyA = s->m_AverageEnergyA;
+        m_AverageEnergyB = s->m_AverageEnergyB;
+        m_Counter = s->m_Counter;
 
-        copy->m_DomainNumber = this->m_DomainNumber;
-        copy->m_ParticleSystem = this->m_ParticleSystem;
+        ResetFunction(m_FunctionA, m_SourceA, s->m_FunctionA, d);
+        ResetFunction(m_FunctionB, m_SourceB, s->m_FunctionB, d);
 
-        return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+        if (!m_FunctionA) m_AOn = false;
+        if (!m_FunctionB) m_BOn = false;
     }
 
 protected:
+    /** Reset the clone of one of the functions of the source, or clone it
+        again if the source has been given another function since. */
+    static void ResetFunction(typename ParticleVectorFunction<VDimension>::Pointer &clone,
+                              typename ParticleVectorFunction<VDimension>::ConstPointer &clonedFrom,
+                              const typename ParticleVectorFunction<VDimension>::Pointer &source,
+                              unsigned int d)
+    {
+        if (!source) {
+            clone = nullptr;
+        }
+        else if (clone && clonedFrom.GetPointer() == source.GetPointer()) {
+            clone->ResetState(source, d);
+        }
+        else {
+            clone = source->Clone();
+        }
+        clonedFrom = source.GetPointer();
+    }
+
     ParticleDualVectorFunction() : m_AOn(true), m_BOn(false),
         m_RelativeGradientScaling(1.0),
         m_RelativeEnergyScaling(1.0)  {}
@@ -463,6 +486,10 @@ protected:
 
     typename ParticleVectorFunction<VDimension>::Pointer m_FunctionA;
     typename ParticleVectorFunction<VDimension>::Pointer m_FunctionB;
+
+    // functions of the source that m_FunctionA and m_FunctionB were cloned from, in a clone
+    typename ParticleVectorFunction<VDimension>::ConstPointer m_SourceA;
+    typename ParticleVectorFunction<VDimension>::ConstPointer m_SourceB;
 };
 
 
@@ -17,6 +17,7 @@
 
 #include "itkParticleShapeMatrixAttribute.h"
 #include "itkParticleVectorFunction.h"
+#include "itkParticleGramEigensystem.h"
 #include <vector>
 
 namespace itk
@@ -49,6 +50,7 @@ public:
   typedef typename ParticleSystemType::PointType PointType;
   typedef vnl_vector<DataType> vnl_vector_type;
   typedef vnl_matrix<DataType> vnl_matrix_type;
+  typedef Eigen::Matrix<DataType, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMajorMatrix;
   
   /** Method for creation through the object factory. */
   itkNewMacro(Self);
@@ -81,6 +83,11 @@ public:
       described by the covariance matrix.  The string argument is a prefix to
       the file names. */
   void WriteModes(const std::string &, int) const;
+
+  /** Compute the files WriteModes writes, their names and particle positions,
+      without writing them. */
+  void ComputeModes(const std::string &, int, std::vector<std::string> &,
+                    std::vector<std::vector<PointType> > &) const;
   
   /**Access the shape matrix. */
   void SetShapeMatrix( ShapeMatrixType *s)
@@ -155,29 +162,42 @@ public:
   int GetRecomputeCovarianceInterval() const
   { return m_RecomputeCovarianceInterval; }
 
+  /** Set/Get the number of covariance updates between two full eigen
+      decompositions of the Gram matrix, and the relative drift of the shape
+      matrix that forces an early refresh.  See ParticleGramEigensystem. */
+  void SetEigensystemRefreshInterval(int i)
+  { m_GramEigensystem.SetRefreshInterval(i); }
+  int GetEigensystemRefreshInterval() const
+  { return m_GramEigensystem.GetRefreshInterval(); }
+  void SetEigensystemDriftTolerance(double d)
+  { m_GramEigensystem.SetDriftTolerance(d); }
+  double GetEigensystemDriftTolerance() const
+  { return m_GramEigensystem.GetDriftTolerance(); }
+
   virtual typename ParticleVectorFunction<VDimension>::Pointer Clone()
   {
     typename ParticleEnsembleEntropyFunction<VDimension>::Pointer copy = ParticleEnsembleEntropyFunction<VDimension>::New();
-
-    copy->m_PointsUpdate = this->m_PointsUpdate;
-    copy->m_MinimumVariance = this->m_MinimumVariance;
-    copy->m_MinimumEigenValue = this->m_MinimumEigenValue;
-    copy->m_CurrentEnergy = this->m_CurrentEnergy;
-    copy->m_HoldMinimumVariance = this->m_HoldMinimumVariance;
-    copy->m_MinimumVarianceDecayConstant = this->m_MinimumVarianceDecayConstant;
-    copy->m_RecomputeCovarianceInterval = this->m_RecomputeCovarianceInterval;
-    copy->m_Counter = m_Counter;
-
-    copy->m_DomainNumber = this->m_DomainNumber;
-    copy->m_ParticleSystem = this->m_ParticleSystem;
-    copy->m_ShapeMatrix = this->m_ShapeMatrix;
-
-    copy->m_InverseCovMatrix = this->m_InverseCovMatrix;
-    copy->m_points_mean = this->m_points_mean;
-    copy->m_UseMeanEnergy = this->m_UseMeanEnergy;
-
+    copy->ResetState(this, this->m_DomainNumber);
     return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+  }
 
+  virtual void ResetState(const ParticleVectorFunction<VDimension> *source, unsigned int d)
+  {
+    Superclass::ResetState(source, d);
+    const Self *s = static_cast<const Self *>(source);
+
+    m_PointsUpdate = s->m_PointsUpdate;
+    m_MinimumVariance = s->m_MinimumVariance;
+    m_MinimumEigenValue = s->m_MinimumEigenValue;
+    m_CurrentEnergy = s->m_CurrentEnergy;
+    m_HoldMinimumVariance = s->m_HoldMinimumVariance;
+    m_MinimumVarianceDecayConstant = s->m_MinimumVarianceDecayConstant;
+    m_RecomputeCovarianceInterval = s->m_RecomputeCovarianceInterval;
+    m_Counter = s->m_Counter;
+    m_ShapeMatrix = s->m_ShapeMatrix;
+    m_InverseCovMatrix = s->m_InverseCovMatrix;
+    m_points_mean = s->m_points_mean;
+    m_UseMeanEnergy = s->m_UseMeanEnergy;
   }
 
 protected:
@@ -212,7 +232,9 @@ protected:
   bool m_UseMeanEnergy;
 
   std::shared_ptr<vnl_matrix_type> m_points_mean; // 3Nx3N - used for energy computation
-  std::shared_ptr<vnl_matrix_type> m_InverseCovMatrix; //3NxM - used for energy computation
+  std::shared_ptr<vnl_matrix_type> m_InverseCovMatrix; //3Nx3 - per-particle diagonal blocks, used for energy computation
+
+  ParticleGramEigensystem m_GramEigensystem;
 
 };
 
@@ -19,6 +19,7 @@
 #include "vnl/algo/vnl_symmetric_eigensystem.h"
 #include "itkParticleGaussianModeWriter.h"
 #include "Libs/Utils/Utils.h"
+#include <Eigen/Eigen>
 #include <string>
 
 namespace itk
@@ -36,6 +37,20 @@ ParticleEnsembleEntropyFunction<VDimension>
     writer->Update();
 }
 
+template <unsigned int VDimension>
+void
+ParticleEnsembleEntropyFunction<VDimension>
+::ComputeModes(const std::string &prefix, int n, std::vector<std::string> &filenames,
+               std::vector<std::vector<PointType> > &lists) const
+{
+    typename ParticleGaussianModeWriter<VDimension>::Pointer writer =
+            ParticleGaussianModeWriter<VDimension>::New();
+    writer->SetShapeMatrix(m_ShapeMatrix);
+    writer->SetFileName(prefix.c_str());
+    writer->SetNumberOfModes(n);
+    writer->ComputeModes(filenames, lists);
+}
+
 template <unsigned int VDimension>
 void
 ParticleEnsembleEntropyFunction<VDimension>
@@ -53,42 +68,28 @@ ParticleEnsembleEntropyFunction<VDimension>
         m_PointsUpdate->set_size(num_dims, num_samples);
         m_PointsUpdate->fill(0.0);
     }
-    vnl_matrix_type points_minus_mean;
-    points_minus_mean.clear();
-    points_minus_mean.set_size(num_dims, num_samples);
-    points_minus_mean.fill(0.0);
+    vnl_matrix_type points_minus_mean(num_dims, num_samples);
 
     m_points_mean->clear();
     m_points_mean->set_size(num_dims, 1);
 
+    // The dense products below run in Eigen on views of the (row major) vnl
+    // storage, using its blocked and multithreaded GEMM kernels.
+    Eigen::Map<const RowMajorMatrix> shape(m_ShapeMatrix->data_block(), num_dims, num_samples);
+    Eigen::Map<RowMajorMatrix> Y(points_minus_mean.data_block(), num_dims, num_samples);
+    Eigen::Map<Eigen::VectorXd> mean(m_points_mean->data_block(), num_dims);
+
     // Compute the covariance matrix.
     // (A is D' in Davies paper)
     // Compute the mean shape vector.
-    double _total = 0.0;
-    for (unsigned int j = 0; j < num_dims; j++)
-    {
-        double total = 0.0;
-        for (unsigned int i = 0; i < num_samples; i++)
-        {
-            total += m_ShapeMatrix->operator()(j, i);
-        }
-        m_points_mean->put(j,0, total/(double)num_samples);
-        _total += total;
-    }
+    mean = shape.rowwise().mean();
+    Y = shape.colwise() - mean;
 
-
-    for (unsigned int j = 0; j < num_dims; j++)
-    {
-        for (unsigned int i = 0; i < num_samples; i++)
-        {
-            points_minus_mean(j, i) = m_ShapeMatrix->operator()(j, i) - m_points_mean->get(j,0);
-        }
-    }
 //    std:cout << points_minus_mean.extract(num_dims, num_samples, 0, 0) << std::endl;
 
 #ifdef PARTICLE_DEBUG
     std::cout << "Shape Matrix : " << std::endl;
-    std::cout << "total : " << _total << std::endl;
+    std::cout << "total : " << shape.sum() << std::endl;
     for (unsigned int j = 0; j < num_dims; j++)
     {
         for(unsigned int i = 0; i < num_samples; i++)
@@ -102,12 +103,11 @@ ParticleEnsembleEntropyFunction<VDimension>
 
     vnl_diag_matrix<double> W;
 
-    vnl_matrix_type gramMat(num_samples, num_samples, 0.0);
-    vnl_matrix_type pinvMat(num_samples, num_samples, 0.0); //gramMat inverse
+    Eigen::Map<RowMajorMatrix> pointsUpdate(m_PointsUpdate->data_block(), num_dims, num_samples);
 
     if (this->m_UseMeanEnergy)
     {
-        pinvMat.set_identity();
+        pointsUpdate = Y;
         m_InverseCovMatrix->clear();
     }
     else
@@ -127,27 +127,39 @@ ParticleEnsembleEntropyFunction<VDimension>
 //        pinvMat = (V * invLambda) * V.transpose();
 //        m_InverseCovMatrix = (U * invLambda) * U.transpose();
 
-        gramMat = points_minus_mean.transpose()* points_minus_mean;
-
-        vnl_svd <double> svd(gramMat);
+        // Eigen decomposition of the Gram matrix, either from scratch or
+        // updated from the last refresh (see ParticleGramEigensystem).
+        vnl_matrix_type projMat;
+        m_GramEigensystem.Update(points_minus_mean, projMat);
 
-        vnl_matrix_type UG = svd.U();
-        W = svd.W();
+        const vnl_matrix_type &UG = m_GramEigensystem.GetBasis();
+        W = vnl_diag_matrix<double>(m_GramEigensystem.GetEigenvalues());
 
-        vnl_diag_matrix<double> invLambda = svd.W();
+        Eigen::VectorXd invLambda(num_samples);
+        for (unsigned int i = 0; i < num_samples; i++)
+        {
+            invLambda[i] = 1.0 / (W(i) / (double)(num_samples-1) + m_MinimumVariance);
+        }
 
-        invLambda.set_diagonal(invLambda.get_diagonal()/(double)(num_samples-1) + m_MinimumVariance);
-        invLambda.invert_in_place();
+        Eigen::Map<const RowMajorMatrix> proj(projMat.data_block(), num_dims, num_samples);
+        Eigen::Map<const RowMajorMatrix> basis(UG.data_block(), num_samples, num_samples);
+        const RowMajorMatrix lhs = proj * invLambda.asDiagonal();
 
-        pinvMat = (UG * invLambda) * UG.transpose();
+        // Y * pinv(Gram) = Y * U * invLambda * U^T = lhs * U^T, which avoids
+        // forming the num_samples x num_samples pseudo inverse.
+        pointsUpdate.noalias() = lhs * basis.transpose();
 
-        vnl_matrix_type projMat = points_minus_mean * UG;
-        const auto lhs = projMat * invLambda;
-        const auto rhs = invLambda * projMat.transpose(); // invLambda doesn't need to be transposed since its a diagonal matrix
-        m_InverseCovMatrix->set_size(num_dims, num_dims);
-        Utils::multiply_into(*m_InverseCovMatrix, lhs, rhs);
+        // Evaluate() only ever needs the VDimension x VDimension diagonal block of
+        // (lhs * lhs^T) belonging to each particle, so store just those blocks stacked
+        // vertically (num_dims x VDimension) instead of the full num_dims x num_dims matrix.
+        m_InverseCovMatrix->set_size(num_dims, VDimension);
+        Eigen::Map<RowMajorMatrix> Q(m_InverseCovMatrix->data_block(), num_dims, VDimension);
+        for (unsigned int k = 0; k + VDimension <= num_dims; k += VDimension)
+        {
+            const auto block = lhs.middleRows(k, VDimension);
+            Q.middleRows(k, VDimension).noalias() = block * block.transpose();
+        }
     }
-    m_PointsUpdate->update(points_minus_mean * pinvMat);
 
 //     std::cout << m_PointsUpdate.extract(num_dims, num_samples,0,0) << std::endl;
 
@@ -200,18 +212,17 @@ ParticleEnsembleEntropyFunction<VDimension>
         k += system->GetNumberOfParticles(i) * VDimension;
     k += idx*VDimension;
 
-    vnl_matrix_type Xi(3,1,0.0);
-    Xi(0,0) = m_ShapeMatrix->operator()(k  , d/DomainsPerShape) - m_points_mean->get(k, 0);
-    Xi(1,0) = m_ShapeMatrix->operator()(k+1, d/DomainsPerShape) - m_points_mean->get(k+1, 0);
-    Xi(2,0) = m_ShapeMatrix->operator()(k+2, d/DomainsPerShape) - m_points_mean->get(k+2, 0);
+    vnl_matrix_type Xi(VDimension,1,0.0);
+    for (unsigned int i = 0; i < VDimension; i++)
+        Xi(i,0) = m_ShapeMatrix->operator()(k+i, d/DomainsPerShape) - m_points_mean->get(k+i, 0);
 
 
-    vnl_matrix_type tmp1(3, 3, 0.0);
+    vnl_matrix_type tmp1(VDimension, VDimension, 0.0);
 
     if (this->m_UseMeanEnergy)
         tmp1.set_identity();
     else
-        tmp1 = m_InverseCovMatrix->extract(3,3,k,k);
+        tmp1 = m_InverseCovMatrix->extract(VDimension,VDimension,k,0);
 
     vnl_matrix_type tmp = Xi.transpose()*tmp1;
 
@@ -194,20 +194,20 @@ public:
   {
     typename ParticleEntropyGradientFunction<TGradientNumericType, VDimension>::Pointer copy =
       ParticleEntropyGradientFunction<TGradientNumericType, VDimension>::New();
-
-    // from itkParticleVectorFunction
-    copy->m_DomainNumber = this->m_DomainNumber;
-    copy->m_ParticleSystem = this->m_ParticleSystem;
-
-    // local
-    copy->m_FlatCutoff = this->m_FlatCutoff;
-    copy->m_MaximumNeighborhoodRadius = this->m_MaximumNeighborhoodRadius;
-    copy->m_MinimumNeighborhoodRadius = this->m_MinimumNeighborhoodRadius;
-    copy->m_NeighborhoodToSigmaRatio = this->m_NeighborhoodToSigmaRatio;
-    copy->m_SpatialSigmaCache =  this->m_SpatialSigmaCache;
-
+    copy->ResetState(this, this->m_DomainNumber);
     return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+  }
 
+  virtual void ResetState(const ParticleVectorFunction<VDimension> *source, unsigned int d)
+  {
+    Superclass::ResetState(source, d);
+    const Self *s = static_cast<const Self *>(source);
+
+    m_FlatCutoff = s->m_FlatCutoff;
+    m_MaximumNeighborhoodRadius = s->m_MaximumNeighborhoodRadius;
+    m_MinimumNeighborhoodRadius = s->m_MinimumNeighborhoodRadius;
+    m_NeighborhoodToSigmaRatio = s->m_NeighborhoodToSigmaRatio;
+    m_SpatialSigmaCache = s->m_SpatialSigmaCache;
   }
 
 protected:
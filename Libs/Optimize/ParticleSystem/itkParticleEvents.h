@@ -111,6 +111,56 @@ itkEventMacro( ParticlePositionSetEvent, ParticleEventWithIndex );
 itkEventMacro( ParticlePositionAddEvent, ParticleEventWithIndex );
 itkEventMacro( ParticlePositionRemoveEvent, ParticleEventWithIndex );
 
+/**
+ * \class ParticlePositionSetBatchEvent
+ *
+ *  Event that signals that a contiguous range of positions of one domain has
+ *  been set, starting at the position index.  This lets the optimizer commit
+ *  a whole domain once per iteration instead of invoking a
+ *  ParticlePositionSetEvent for every particle.  It is intentionally not a
+ *  ParticlePositionSetEvent, so observers of single position updates are not
+ *  invoked for it.
+ */
+class ITK_EXPORT ParticlePositionSetBatchEvent : public ParticleEventWithIndex
+{
+public:
+  typedef ParticlePositionSetBatchEvent Self;
+
+  ParticlePositionSetBatchEvent() : m_NumberOfPositions(0) {}
+  ~ParticlePositionSetBatchEvent() {}
+
+  /** Copy constructor and operator=. */
+  ParticlePositionSetBatchEvent(const ParticlePositionSetBatchEvent &v)
+    : ParticleEventWithIndex(v)
+  {
+    m_NumberOfPositions = v.m_NumberOfPositions;
+  }
+  const ParticlePositionSetBatchEvent &operator=(const ParticlePositionSetBatchEvent &v)
+  {
+    ParticleEventWithIndex::operator=(v);
+    m_NumberOfPositions = v.m_NumberOfPositions;
+    return *this;
+  }
+
+  /** Get/Set the number of positions in the range. */
+  inline void SetNumberOfPositions(int n)
+  {    m_NumberOfPositions = n;  }
+  int GetNumberOfPositions() const
+  { return m_NumberOfPositions; }
+
+  /** Standard ITK event members. */
+  virtual const char * GetEventName() const { return "ParticlePositionSetBatchEvent"; }
+
+  virtual bool CheckEvent(const ::itk::EventObject* e) const
+  { return dynamic_cast<const Self*>(e); }
+
+  virtual ::itk::EventObject* MakeObject() const
+  { return new Self; }
+
+private:
+  int m_NumberOfPositions;
+};
+
 } // end namespace itk
 
 
@@ -57,6 +57,11 @@ public:
   /** Write the first n modes to +- 3 std dev and the mean of the model
       described by the covariance matrix.  */
   void Update() const;
+
+  /** Compute the files written by Update, their names and the particle
+      positions of each, without writing them. */
+  void ComputeModes(std::vector<std::string> &filenames,
+                    std::vector<std::vector<PointType> > &lists) const;
   
   int GetNumberOfModes() const
   { return m_NumberOfModes; }
@@ -28,6 +28,29 @@ void
 ParticleGaussianModeWriter<VDimension>
 ::Update() const
 {
+  std::vector<std::string> filenames;
+  std::vector<std::vector<PointType> > lists;
+  this->ComputeModes(filenames, lists);
+
+  typename ParticlePositionWriter<VDimension>::Pointer writer
+    = ParticlePositionWriter<VDimension>::New();
+  for (unsigned int i = 0; i < filenames.size(); i++)
+    {
+    writer->SetFileName(filenames[i].c_str());
+    writer->SetInput(lists[i]);
+    writer->Update();
+    }
+}
+
+template <unsigned int VDimension>
+void
+ParticleGaussianModeWriter<VDimension>
+::ComputeModes(std::vector<std::string> &filenames,
+               std::vector<std::vector<PointType> > &lists) const
+{
+  filenames.clear();
+  lists.clear();
+
   // ASSUMES ALL SHAPES HAVE SAME NUMBER OF SAMPLES
   const int num_samples = m_ShapeMatrix->cols();
   const int num_dims = m_ShapeMatrix->rows();
@@ -101,12 +124,8 @@ ParticleGaussianModeWriter<VDimension>
       meanlist.push_back(p);
       }
     
-    std::string tmpstr = fn + ".mean";
-    typename ParticlePositionWriter<VDimension>::Pointer writer
-      = ParticlePositionWriter<VDimension>::New();
-    writer->SetFileName(tmpstr.c_str());
-    writer->SetInput(meanlist);
-    writer->Update();
+    filenames.push_back(fn + ".mean");
+    lists.push_back(meanlist);
     
     int modenum = 0;
     for (int mode = num_samples-1; mode > num_samples-(m_NumberOfModes+1); mode--, modenum++)
@@ -131,10 +150,8 @@ ParticleGaussianModeWriter<VDimension>
         
         char fp[255];
         ::sprintf(fp, ".%d.%d.mode", s, modenum);
-        tmpstr = fn + fp;
-        writer->SetFileName(tmpstr.c_str());
-        writer->SetInput(modelist);
-        writer->Update();
+        filenames.push_back(fn + fp);
+        lists.push_back(modelist);
         }
       }
     }
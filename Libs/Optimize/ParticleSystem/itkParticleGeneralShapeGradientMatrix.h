@@ -5,7 +5,7 @@
 #include "itkDataObject.h"
 #include "itkWeakPointer.h"
 #include "itkParticleContainer.h"
-#include "vnl/vnl_matrix.h"
+#include "itkParticleGrowableMatrix.h"
 
 #include "itkParticleImplicitSurfaceDomain.h"
 #include "itkParticleImageDomainWithGradients.h"
@@ -27,7 +27,7 @@ namespace itk
  */
 template <class T, unsigned int VDimension>
 class ITK_EXPORT ParticleGeneralShapeGradientMatrix
-        : public vnl_matrix<T>, public ParticleAttribute<VDimension>
+        : public ParticleGrowableMatrix<T>, public ParticleAttribute<VDimension>
 {
 public:
     /** Standard class typedefs */
@@ -74,26 +74,6 @@ public:
         m_use_normals[i] = val;
     }
 
-    virtual void SetMatrix(const vnl_matrix<T> &m)
-    {
-        vnl_matrix<T>::operator=(m);
-    }
-
-    virtual void ResizeMatrix(int rs, int cs)
-    {
-        vnl_matrix<T> tmp(*this); // copy existing  matrix
-
-        // Create new column (shape)
-        this->set_size(rs, cs);
-
-        // Copy old data into new matrix.
-        for (unsigned int c = 0; c < tmp.cols(); c++)
-        {
-            for (unsigned int r = 0; r < tmp.rows(); r++)
-                this->operator()(r,c) = tmp(r,c);
-        }
-    }
-
     void SetValues(const ParticleSystemType *ps, int idx, int d)
     {
         const typename itk::ParticleSystem<VDimension>::PointType posLocal = ps->GetPosition(idx, d);
@@ -250,17 +230,19 @@ public:
         const unsigned int idx = event.GetPositionIndex();
 
         int numRows = 0;
+        int reservedRows = 0;
         for (int i = 0; i < m_DomainsPerShape; i++)
         {
+            int valuesPerParticle = m_AttributesPerDomain[i];
             if (m_use_xyz[i])
-                numRows += VDimension * ps->GetNumberOfParticles(i);
+                valuesPerParticle += VDimension;
             if (m_use_normals[i])
-                numRows += VDimension * ps->GetNumberOfParticles(i);
-            numRows += m_AttributesPerDomain[i]* ps->GetNumberOfParticles(i);
+                valuesPerParticle += VDimension;
+            numRows += valuesPerParticle * ps->GetNumberOfParticles(i);
+            reservedRows += valuesPerParticle * ps->GetReservedNumberOfParticles(i);
         }
 
-        if (numRows > this->rows())
-            this->ResizeMatrix(numRows, this->cols());
+        this->GrowRows(numRows, reservedRows);
 
         this->SetValues(ps, idx, d);
     }
@@ -273,9 +255,22 @@ public:
         const int d = event.GetDomainIndex();
         const unsigned int idx = event.GetPositionIndex();
 
+        this->FinalizeResize();
         this->SetValues(ps, idx, d);
     }
 
+    virtual void PositionSetBatchEventCallback(Object *o, const EventObject &e)
+    {
+        const ParticlePositionSetBatchEvent &event = dynamic_cast<const ParticlePositionSetBatchEvent &>(e);
+        const ParticleSystemType *ps= dynamic_cast<const ParticleSystemType *>(o);
+        const int d = event.GetDomainIndex();
+        const int end = event.GetPositionIndex() + event.GetNumberOfPositions();
+
+        this->FinalizeResize();
+        for (int idx = event.GetPositionIndex(); idx < end; idx++)
+            this->SetValues(ps, idx, d);
+    }
+
     virtual void PositionRemoveEventCallback(Object *, const EventObject &)
     {
         // NEED TO IMPLEMENT THIS
@@ -289,6 +284,7 @@ protected:
         this->m_DefinedCallbacks.DomainAddEvent = true;
         this->m_DefinedCallbacks.PositionAddEvent = true;
         this->m_DefinedCallbacks.PositionSetEvent = true;
+        this->m_DefinedCallbacks.PositionSetBatchEvent = true;
         this->m_DefinedCallbacks.PositionRemoveEvent = true;
     }
     virtual ~ParticleGeneralShapeGradientMatrix() {}
@@ -25,7 +25,9 @@
 #include "itkParticleVectorFunction.h"
 #include "itkParticleImageDomainWithGradients.h"
 #include <algorithm>
+#include <chrono>
 #include <limits>
+#include <tbb/enumerable_thread_specific.h>
 
 namespace itk
 {
@@ -36,9 +38,12 @@ namespace itk
  * This class optimizes a list of particle system positions with respect to a
  * specified energy function using a simple gradient descent strategy.  A
  * function which computes the gradient of the function with respect to
- * particle position must be specified.  The optimization performs Jacobi
- * updates (each particle position is changed as soon as its new position is
- * computed).
+ * particle position must be specified.  By default the optimization performs
+ * Gauss-Seidel updates (each particle position is changed as soon as its new
+ * position is computed) and runs domains in parallel.  Optionally, Jacobi
+ * updates can be used instead, where the gradients of all particles in a domain
+ * are computed in parallel against the current positions and then committed
+ * together, which allows a single large domain to use all cores.
  *
  */
 template <class TGradientNumericType, unsigned int VDimension>
@@ -79,9 +84,15 @@ public:
   /** Start the optimization. */
   void StartOptimization()
   {
-    this->StartAdaptiveGaussSeidelOptimization();
+    if (m_UseJacobiUpdate) {
+      this->StartJacobiOptimization();
+    }
+    else {
+      this->StartAdaptiveGaussSeidelOptimization();
+    }
   }
   void StartAdaptiveGaussSeidelOptimization();
+  void StartJacobiOptimization();
 
   /** Stop the optimization.  This method sets a flag that aborts the
       StartOptimization method after the current iteration. */
@@ -116,14 +127,28 @@ public:
   /** Get/Set the precision of the solution. */
   itkGetMacro(Tolerance, double);
   itkSetMacro(Tolerance, double);
-  
+
+  /** Get/Set whether Jacobi updates (particles within a domain updated in
+      parallel) are used instead of Gauss-Seidel updates. */
+  itkGetMacro(UseJacobiUpdate, bool);
+  itkSetMacro(UseJacobiUpdate, bool);
+
   /** Get/Set the ParticleSystem modified by this optimizer. */
   itkGetObjectMacro(ParticleSystem, ParticleSystemType);
   itkSetObjectMacro(ParticleSystem, ParticleSystemType);
 
-  /** Get/Set the gradient function used by this optimizer. */
+  /** Get/Set the gradient function used by this optimizer.  The clones of
+      the previous gradient function held by the worker threads are dropped. */
   itkGetObjectMacro(GradientFunction, GradientFunctionType);
-  itkSetObjectMacro(GradientFunction, GradientFunctionType);
+  void SetGradientFunction(GradientFunctionType *f)
+  {
+    if (m_GradientFunction != f)
+    {
+      m_GradientFunction = f;
+      m_LocalGradientFunctions.clear();
+      this->Modified();
+    }
+  }
 
 protected:
   ParticleGradientDescentPositionOptimizer();
@@ -146,8 +171,23 @@ private:
   double m_TimeStep;
   std::vector< std::vector<double> > m_TimeSteps;
   unsigned int m_verbosity;
+  bool m_UseJacobiUpdate;
+
+  /** Per-thread clone of the gradient function, tagged with the iteration and domain it was last reset for. */
+  struct LocalGradientFunction
+  {
+    typename GradientFunctionType::Pointer function;
+    unsigned long generation = 0;
+    unsigned int domain = 0;
+  };
+  tbb::enumerable_thread_specific<LocalGradientFunction> m_LocalGradientFunctions;
+  unsigned long m_CloneGeneration;
 
   void ResetTimeStepVectors();
+  double ComputeMinimumTimeStep() const;
+  void FinishIteration(double maxchange, double totalenergy, double minimumTimeStep,
+                       std::chrono::steady_clock::time_point accTimerBegin);
+  GradientFunctionType *GetThreadLocalGradientFunction(unsigned int dom);
 };
 
 
@@ -37,6 +37,8 @@ namespace itk
     m_MaximumNumberOfIterations = 0;
     m_Tolerance = 0.0;
     m_TimeStep = 1.0;
+    m_CloneGeneration = 0;
+    m_UseJacobiUpdate = false;
   }
 
   template <class TGradientNumericType, unsigned int VDimension>
@@ -64,6 +66,81 @@ namespace itk
     }
   }
 
+  template <class TGradientNumericType, unsigned int VDimension>
+  typename ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>::GradientFunctionType *
+  ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>::GetThreadLocalGradientFunction(unsigned int dom)
+  {
+    // The gradient function is not thread-safe, so each worker thread keeps its own clone for the
+    // whole run.  Clones keep per-domain state (cached sigmas, the current neighborhood, ...) and a
+    // copy of the state BeforeIteration computes, so the clone is reset whenever its thread moves to
+    // another domain or a new iteration starts.  Within a domain the clone is used as is, which lets
+    // the Jacobi update share it between all the particles a thread handles.
+    LocalGradientFunction &local = m_LocalGradientFunctions.local();
+    if (local.function.IsNull()) {
+      local.function = m_GradientFunction->Clone();
+      local.function->SetDomainNumber(dom);
+    }
+    else if (local.generation != m_CloneGeneration || local.domain != dom) {
+      local.function->ResetState(m_GradientFunction, dom);
+    }
+    local.generation = m_CloneGeneration;
+    local.domain = dom;
+    return local.function.GetPointer();
+  }
+
+  template <class TGradientNumericType, unsigned int VDimension>
+  double ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>::ComputeMinimumTimeStep() const
+  {
+    double dampening = 1;
+    int startDampening = m_MaximumNumberOfIterations / 2;
+    if (m_NumberOfIterations > startDampening) {
+      dampening = exp(-double(m_NumberOfIterations - startDampening) * 5.0 / double(m_MaximumNumberOfIterations - startDampening));
+    }
+    return dampening;
+  }
+
+  template <class TGradientNumericType, unsigned int VDimension>
+  void ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
+    ::FinishIteration(double maxchange, double totalenergy, double minimumTimeStep,
+                      std::chrono::steady_clock::time_point accTimerBegin)
+  {
+    m_NumberOfIterations++;
+    m_GradientFunction->AfterIteration();
+
+    const auto accTimerEnd = std::chrono::steady_clock::now();
+    const auto msElapsed = std::chrono::duration_cast<std::chrono::milliseconds>(accTimerEnd - accTimerBegin).count();
+
+    if (m_verbosity > 2)
+    {
+      std::cout << m_NumberOfIterations << ". " << msElapsed << "ms";
+#ifdef LOG_MEMORY_USAGE
+      double vmUsage, residentSet;
+      process_mem_usage(vmUsage, residentSet);
+      std::cout << " | Mem=" << residentSet << "KB";
+#endif
+      std::cout << std::endl;
+    }
+    else if (m_verbosity > 1) {
+      if (m_NumberOfIterations % (m_MaximumNumberOfIterations / 10) == 0) {
+        std::cerr << "Iteration " << m_NumberOfIterations << ", maxchange = " << maxchange << ", energy = " << totalenergy << ", minimumTimeStep = " << minimumTimeStep << std::endl;
+      }
+    }
+
+    this->InvokeEvent(itk::IterationEvent());
+
+    // Check for convergence.  Optimization is considered to have converged if
+    // max number of iterations is reached or maximum distance moved by any
+    // particle is less than the specified precision.
+    if (maxchange < m_Tolerance) {
+      std::cerr << "Iteration " << m_NumberOfIterations << ", maxchange = " << maxchange << std::endl;
+      m_StopOptimization = true;
+    }
+
+    if (m_NumberOfIterations >= m_MaximumNumberOfIterations) {
+      m_StopOptimization = true;
+    }
+  }
+
   template <class TGradientNumericType, unsigned int VDimension>
   void ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
     ::StartAdaptiveGaussSeidelOptimization()
@@ -96,23 +173,27 @@ namespace itk
     unsigned int counter = 0;
 
     double maxchange = 0.0;
+    double totalenergy = 0.0;
+    std::vector<double> domainMaxChange;
+    std::vector<double> domainEnergy;
     while (m_StopOptimization == false) // iterations loop
     {
 
-      double dampening = 1;
-      int startDampening = m_MaximumNumberOfIterations / 2;
-      if (m_NumberOfIterations > startDampening) {
-        dampening = exp(-double(m_NumberOfIterations - startDampening) * 5.0 / double(m_MaximumNumberOfIterations - startDampening));
-      }
-      minimumTimeStep = dampening;
+      minimumTimeStep = this->ComputeMinimumTimeStep();
+
+      // per-domain accumulators, reduced in domain order after the parallel loop
+      domainMaxChange.assign(numdomains, 0.0);
+      domainEnergy.assign(numdomains, 0.0);
 
-      maxchange = 0.0;
       const auto accTimerBegin = std::chrono::steady_clock::now();
       m_GradientFunction->SetParticleSystem(m_ParticleSystem);
         if (counter % global_iteration == 0)
             m_GradientFunction->BeforeIteration();
         counter++;
 
+      // reset the thread local clones, BeforeIteration may have changed the function's state
+      m_CloneGeneration++;
+
         // Iterate over each domain
       tbb::parallel_for(
         tbb::blocked_range<size_t>{0, numdomains},
@@ -122,17 +203,14 @@ namespace itk
           // skip any flagged domains
           if (m_ParticleSystem->GetDomainFlag(dom) == true)
           {
-            // note that this is really a 'continue' statement for the loop, but using TBB,
-            // we are in an anonymous function, not a loop, so return is equivalent to continue here
-            return;
+            continue;
           }
 
           const ParticleDomain *domain = m_ParticleSystem->GetDomain(dom);
 
-          typename GradientFunctionType::Pointer localGradientFunction = m_GradientFunction;
-
-          // must clone this as we are in a thread and the gradient function is not thread-safe
-          localGradientFunction = m_GradientFunction->Clone();
+          GradientFunctionType *localGradientFunction = GetThreadLocalGradientFunction(dom);
+          double &domMaxChange = domainMaxChange[dom];
+          double &domEnergy = domainEnergy[dom];
 
           // Tell function which domain we are working on.
           localGradientFunction->SetDomainNumber(dom);
@@ -175,7 +253,9 @@ namespace itk
               // Step D compute the new point position
               PointType newpoint = domain->UpdateParticlePosition(pt, k, gradient);
 
-              // Step F update the point position in the particle system
+              // Step F update the point position in the particle system.  The attributes
+              // (shape matrices, curvature cache) must see the move before the new energy
+              // is computed, so this notifies them for every particle.
               m_ParticleSystem->SetPosition(newpoint, k, dom);
 
               // Step G compute the new energy of the particle system
@@ -184,7 +264,8 @@ namespace itk
               if (newenergy < energy) // good move, increase timestep for next time
               {
                 m_TimeSteps[dom][k] *= factor;
-                if (gradmag > maxchange) maxchange = gradmag;
+                if (gradmag > domMaxChange) domMaxChange = gradmag;
+                domEnergy += newenergy;
                 break;
               }
               else
@@ -199,7 +280,8 @@ namespace itk
                 }
                 else // keep the move with timestep 1.0 anyway
                 {
-                  if (gradmag > maxchange) maxchange = gradmag;
+                  if (gradmag > domMaxChange) domMaxChange = gradmag;
+                  domEnergy += newenergy;
                   break;
                 }
               }
@@ -208,41 +290,164 @@ namespace itk
         }// for each domain
       });
 
-      m_NumberOfIterations++;
-      m_GradientFunction->AfterIteration();
+      maxchange = 0.0;
+      totalenergy = 0.0;
+      for (unsigned int dom = 0; dom < numdomains; dom++) {
+        maxchange = std::max(maxchange, domainMaxChange[dom]);
+        totalenergy += domainEnergy[dom];
+      }
 
-      const auto accTimerEnd = std::chrono::steady_clock::now();
-      const auto msElapsed = std::chrono::duration_cast<std::chrono::milliseconds>(accTimerEnd - accTimerBegin).count();
+      this->FinishIteration(maxchange, totalenergy, minimumTimeStep, accTimerBegin);
 
-      if (m_verbosity > 2)
-      {
-        std::cout << m_NumberOfIterations << ". " << msElapsed << "ms";
-#ifdef LOG_MEMORY_USAGE
-        double vmUsage, residentSet;
-        process_mem_usage(vmUsage, residentSet);
-        std::cout << " | Mem=" << residentSet << "KB";
-#endif
-        std::cout << std::endl;
-      }
-      else if (m_verbosity > 1) {
-        if (m_NumberOfIterations % (m_MaximumNumberOfIterations / 10) == 0) {
-          std::cerr << "Iteration " << m_NumberOfIterations << ", maxchange = " << maxchange << ", minimumTimeStep = " << minimumTimeStep << std::endl;
+    } // end while stop optimization
+  }
+
+  template <class TGradientNumericType, unsigned int VDimension>
+  void ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
+    ::StartJacobiOptimization()
+  {
+    if (this->m_AbortProcessing) {
+      return;
+    }
+    const double factor = 1.1;
+
+    // NOTE: THIS METHOD WILL NOT WORK AS WRITTEN IF PARTICLES ARE
+    // ADDED TO THE SYSTEM DURING OPTIMIZATION.
+
+    m_StopOptimization = false;
+    if (m_NumberOfIterations >= m_MaximumNumberOfIterations) {
+      m_StopOptimization = true;
+    }
+
+    ResetTimeStepVectors();
+    double minimumTimeStep = 1.0;
+
+    unsigned int numdomains = m_ParticleSystem->GetNumberOfDomains();
+
+    unsigned int counter = 0;
+
+    double maxchange = 0.0;
+    double totalenergy = 0.0;
+
+    // scratch buffers for one domain, reused across domains and iterations
+    std::vector<VectorType> gradients;
+    std::vector<double> energies;
+    std::vector<double> newEnergies;
+    std::vector<double> maximumUpdates;
+    std::vector<double> gradmags;
+    std::vector<PointType> originalPoints;
+
+    while (m_StopOptimization == false) // iterations loop
+    {
+      minimumTimeStep = this->ComputeMinimumTimeStep();
+
+      maxchange = 0.0;
+      totalenergy = 0.0;
+
+      const auto accTimerBegin = std::chrono::steady_clock::now();
+      m_GradientFunction->SetParticleSystem(m_ParticleSystem);
+      if (counter % global_iteration == 0)
+        m_GradientFunction->BeforeIteration();
+      counter++;
+
+      // reset the thread local clones, BeforeIteration may have changed the function's state
+      m_CloneGeneration++;
+
+      for (unsigned int dom = 0; dom < numdomains; dom++) {
+
+        // skip any flagged domains
+        if (m_ParticleSystem->GetDomainFlag(dom) == true) {
+          continue;
         }
-      }
 
-      this->InvokeEvent(itk::IterationEvent());
+        const ParticleDomain *domain = m_ParticleSystem->GetDomain(dom);
+        const size_t numParticles = m_ParticleSystem->GetPositions(dom)->GetSize();
+
+        gradients.resize(numParticles);
+        energies.resize(numParticles);
+        newEnergies.resize(numParticles);
+        maximumUpdates.resize(numParticles);
+        gradmags.resize(numParticles);
+        originalPoints.resize(numParticles);
+
+        // Step 1 evaluate the gradient of every particle in parallel against the current positions
+        tbb::parallel_for(
+          tbb::blocked_range<size_t>{0, numParticles},
+          [&](const tbb::blocked_range<size_t>& r) {
+            GradientFunctionType *localGradientFunction = GetThreadLocalGradientFunction(dom);
+            localGradientFunction->SetDomainNumber(dom);
+            for (size_t k = r.begin(); k < r.end(); ++k) {
+              if (m_TimeSteps[dom][k] < minimumTimeStep) {
+                m_TimeSteps[dom][k] = minimumTimeStep;
+              }
+              energies[k] = 0.0;
+              localGradientFunction->BeforeEvaluate(k, dom, m_ParticleSystem);
+              gradients[k] = localGradientFunction->Evaluate(k, dom, m_ParticleSystem, maximumUpdates[k], energies[k]);
+            }
+          });
+
+        // Step 2 project, constrain and commit all of the updates.  This is serial because
+        // StagePosition updates the neighborhood, which is not thread-safe.
+        for (size_t k = 0; k < numParticles; k++) {
+          const PointType pt = m_ParticleSystem->GetPositions(dom)->Get(k);
+          originalPoints[k] = pt;
 
-      // Check for convergence.  Optimization is considered to have converged if
-      // max number of iterations is reached or maximum distance moved by any
-      // particle is less than the specified precision.
-      if (maxchange < m_Tolerance) {
-        std::cerr << "Iteration " << m_NumberOfIterations << ", maxchange = " << maxchange << std::endl;
-        m_StopOptimization = true;
-      }
+          VectorType gradient = domain->ProjectVectorToSurfaceTangent(gradients[k], pt, k) * m_TimeSteps[dom][k];
+          domain->GetConstraints()->applyBoundaryConstraints(gradient, pt);
 
-      if (m_NumberOfIterations >= m_MaximumNumberOfIterations) {
-        m_StopOptimization = true;
-      }
+          double gradmag = gradient.magnitude();
+          if (gradmag > maximumUpdates[k]) {
+            gradient = gradient * maximumUpdates[k] / gradmag;
+            gradmag = gradient.magnitude();
+          }
+          gradmags[k] = gradmag;
+
+          PointType newpoint = domain->UpdateParticlePosition(pt, k, gradient);
+          m_ParticleSystem->StagePosition(newpoint, k, dom);
+        }
+
+        // Notify the attributes of all the moves in one batch, the energies below read them
+        m_ParticleSystem->CommitPositions(dom);
+
+        // Step 3 evaluate the energy of the new configuration in parallel
+        tbb::parallel_for(
+          tbb::blocked_range<size_t>{0, numParticles},
+          [&](const tbb::blocked_range<size_t>& r) {
+            GradientFunctionType *localGradientFunction = GetThreadLocalGradientFunction(dom);
+            localGradientFunction->SetDomainNumber(dom);
+            for (size_t k = r.begin(); k < r.end(); ++k) {
+              localGradientFunction->BeforeEvaluate(k, dom, m_ParticleSystem);
+              newEnergies[k] = localGradientFunction->Energy(k, dom, m_ParticleSystem);
+            }
+          });
+
+        // Step 4 accept good moves, reset bad ones and adapt the time steps
+        bool reset = false;
+        for (size_t k = 0; k < numParticles; k++) {
+          if (newEnergies[k] < energies[k] || m_TimeSteps[dom][k] <= minimumTimeStep) {
+            if (newEnergies[k] < energies[k]) {
+              m_TimeSteps[dom][k] *= factor;
+            }
+            if (gradmags[k] > maxchange) maxchange = gradmags[k];
+            totalenergy += newEnergies[k];
+          }
+          else {
+            PointType pt = originalPoints[k];
+            domain->ApplyConstraints(pt, k);
+            m_ParticleSystem->StagePosition(pt, k, dom);
+            domain->InvalidateParticlePosition(k);
+            reset = true;
+
+            m_TimeSteps[dom][k] /= factor;
+          }
+        }
+
+        if (reset) {
+          m_ParticleSystem->CommitPositions(dom);
+        }
+      } // for each domain
+
+      this->FinishIteration(maxchange, totalenergy, minimumTimeStep, accTimerBegin);
 
     } // end while stop optimization
   }
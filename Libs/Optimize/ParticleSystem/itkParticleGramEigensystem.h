@@ -0,0 +1,164 @@
+/*=========================================================================
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleGramEigensystem_h
+#define __itkParticleGramEigensystem_h
+
+#include "vnl/vnl_matrix.h"
+#include "vnl/vnl_vector.h"
+#include <Eigen/Eigen>
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+/** \class ParticleGramEigensystem
+ *
+ * Maintains the eigen decomposition of the Gram matrix Y^T Y of a centered
+ * shape matrix Y (num_dims x num_samples) across optimizer iterations.
+ *
+ * With a refresh interval of 1 (the default) the Gram matrix is formed and
+ * decomposed from scratch on every update.  With a larger interval the
+ * eigenvectors of the last refresh are kept in between, and only the
+ * eigenvalues are updated from the Rayleigh quotients ||Y u_i||^2 of the
+ * stored eigenvectors.  This is the first order perturbation of the
+ * eigenvalues for the position deltas accumulated since the refresh, and it
+ * only needs the projection Y U that the entropy functions compute anyway,
+ * so both the O(num_dims num_samples^2) Gram product and the
+ * O(num_samples^3) decomposition are skipped.  A refresh is forced early when
+ * the relative change of Y since the last refresh exceeds the drift
+ * tolerance, or when the size of Y changes (e.g. after a split).
+ *
+ * The products and the decomposition run in Eigen on views of the vnl
+ * storage, using its blocked GEMM (multithreaded when OpenMP is enabled) and
+ * SelfAdjointEigenSolver on the symmetric Gram matrix.
+ */
+class ParticleGramEigensystem
+{
+public:
+  typedef vnl_matrix<double> MatrixType;
+  typedef vnl_vector<double> VectorType;
+
+  /** Row major Eigen matrix, matching the layout of vnl_matrix. */
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMajorMatrix;
+
+  ParticleGramEigensystem()
+    : m_RefreshInterval(1), m_DriftTolerance(0.05), m_IterationsSinceRefresh(0), m_ReferenceNorm(0.0)
+  {}
+
+  /** Set/Get the number of updates between two full decompositions. */
+  void SetRefreshInterval(int i)
+  { m_RefreshInterval = i; }
+  int GetRefreshInterval() const
+  { return m_RefreshInterval; }
+
+  /** Set/Get the bound on ||Y - Y_refresh|| / ||Y_refresh|| above which the
+      decomposition is recomputed before the interval has elapsed.  A value
+      of zero disables the check. */
+  void SetDriftTolerance(double d)
+  { m_DriftTolerance = d; }
+  double GetDriftTolerance() const
+  { return m_DriftTolerance; }
+
+  /** Update the decomposition for the centered shape matrix Y and write the
+      projection Y * U to projection.  Returns true if the decomposition was
+      recomputed from scratch. */
+  bool Update(const MatrixType &Y, MatrixType &projection)
+  {
+    const unsigned int num_dims = Y.rows();
+    const unsigned int num_samples = Y.cols();
+    Eigen::Map<const RowMajorMatrix> y(Y.data_block(), num_dims, num_samples);
+
+    const bool refresh = this->NeedsRefresh(Y);
+    if (refresh) {
+      Eigen::MatrixXd gram(num_samples, num_samples);
+      gram.setZero();
+      gram.selfadjointView<Eigen::Lower>().rankUpdate(y.transpose());
+
+      // Eigenvalues are returned in increasing order, store them decreasing
+      // like the singular values of the Gram matrix.  Round-off can leave
+      // tiny negative eigenvalues on a positive semi-definite matrix.
+      Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(gram.selfadjointView<Eigen::Lower>());
+      m_Basis.set_size(num_samples, num_samples);
+      m_Eigenvalues.set_size(num_samples);
+      Eigen::Map<RowMajorMatrix> basis(m_Basis.data_block(), num_samples, num_samples);
+      basis = solver.eigenvectors().rowwise().reverse();
+      for (unsigned int i = 0; i < num_samples; i++) {
+        m_Eigenvalues[i] = std::max(0.0, solver.eigenvalues()[num_samples - 1 - i]);
+      }
+
+      if (m_RefreshInterval > 1) {
+        m_Reference = Y;
+        m_ReferenceNorm = Y.frobenius_norm();
+      }
+      m_IterationsSinceRefresh = 0;
+    }
+    else {
+      m_IterationsSinceRefresh++;
+    }
+
+    projection.set_size(num_dims, num_samples);
+    Eigen::Map<RowMajorMatrix> proj(projection.data_block(), num_dims, num_samples);
+    Eigen::Map<const RowMajorMatrix> basis(m_Basis.data_block(), num_samples, num_samples);
+    proj.noalias() = y * basis;
+
+    if (!refresh) {
+      Eigen::Map<Eigen::VectorXd>(m_Eigenvalues.data_block(), num_samples) = proj.colwise().squaredNorm().transpose();
+    }
+    return refresh;
+  }
+
+  /** Eigenvectors of the Gram matrix, one per column. */
+  const MatrixType &GetBasis() const
+  { return m_Basis; }
+
+  /** Eigenvalues of the Gram matrix, in the order of the basis columns. */
+  const VectorType &GetEigenvalues() const
+  { return m_Eigenvalues; }
+
+private:
+  bool NeedsRefresh(const MatrixType &Y) const
+  {
+    if (m_RefreshInterval <= 1 || m_Basis.empty() || m_Basis.rows() != Y.cols()
+        || m_Reference.rows() != Y.rows() || m_Reference.cols() != Y.cols()) {
+      return true;
+    }
+    if (m_IterationsSinceRefresh + 1 >= m_RefreshInterval) {
+      return true;
+    }
+    if (m_DriftTolerance > 0.0) {
+      const double *a = Y.data_block();
+      const double *b = m_Reference.data_block();
+      const unsigned int n = Y.size();
+      double sum = 0.0;
+      for (unsigned int i = 0; i < n; i++) {
+        const double q = a[i] - b[i];
+        sum += q * q;
+      }
+      if (std::sqrt(sum) > m_DriftTolerance * m_ReferenceNorm) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  int m_RefreshInterval;
+  double m_DriftTolerance;
+  int m_IterationsSinceRefresh;
+
+  MatrixType m_Basis;
+  VectorType m_Eigenvalues;
+
+  /** Centered shape matrix at the last refresh, used for the drift bound. */
+  MatrixType m_Reference;
+  double m_ReferenceNorm;
+};
+
+} // end namespace itk
+
+#endif
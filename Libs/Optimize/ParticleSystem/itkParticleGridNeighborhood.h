@@ -0,0 +1,207 @@
+/*=========================================================================
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleGridNeighborhood_h
+#define __itkParticleGridNeighborhood_h
+
+#include "itkParticleNeighborhood.h"
+#include "vnl/vnl_vector_fixed.h"
+#include <atomic>
+#include <limits>
+#include <vector>
+
+namespace itk
+{
+/** \class ParticleGridNeighborhood
+ *
+ * ParticleGridNeighborhood computes neighborhoods based on distance from a
+ * point, like ParticleSurfaceNeighborhood, but stores the particles in a flat
+ * uniform grid of cells over the domain bounds instead of the linked lists of
+ * a PowerOfTwoPointTree.  The grid is stored in compressed (CSR) form: one
+ * array of particle indices sorted by cell, the coordinates of those particles
+ * in the same order (structure of arrays), and the offset of each cell into
+ * them, so a query reads the contiguous ranges of the cells overlapping its
+ * search box.
+ *
+ * A particle that moves out of its cell is not re-sorted right away.  Its
+ * coordinates are updated in place and queries widen their search box by the
+ * largest distance a particle has moved out of its cell, which still finds
+ * it.  Particles added since the last sort are kept in a short list that
+ * queries scan linearly.  The grid is sorted again, in one counting sort pass,
+ * when that distance exceeds half a cell or on the first position update after
+ * particles were added.  The cell size follows the search radius: queries
+ * record their radius, and once it has drifted by more than a factor of two
+ * from the cell size the grid is rebuilt on the next position update, so that
+ * a query always covers a handful of cells.  The buffer-based
+ * FindNeighborhoodPoints methods do not allocate once the caller's buffers
+ * have grown to their working size.
+ *
+ * The weighted FindNeighborhoodPoints method applies the same surface normal
+ * weighting as ParticleSurfaceNeighborhood, so this class can be used as a
+ * drop-in replacement via ParticleSystem::SetNeighborhood.
+ */
+template <unsigned int VDimension=3>
+class ITK_EXPORT ParticleGridNeighborhood : public ParticleNeighborhood<VDimension>
+{
+public:
+  /** Standard class typedefs */
+  typedef ParticleGridNeighborhood Self;
+  typedef ParticleNeighborhood<VDimension> Superclass;
+  typedef SmartPointer<Self>  Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+  typedef WeakPointer<const Self>  ConstWeakPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(ParticleGridNeighborhood, ParticleNeighborhood);
+
+  /** Dimensionality of the domain of the particle system. */
+  itkStaticConstMacro(Dimension, unsigned int, VDimension);
+
+  /** Inherited typedefs from parent class. */
+  typedef typename Superclass::PointType PointType;
+  typedef typename Superclass::PointContainerType PointContainerType;
+  typedef typename Superclass::DomainType DomainType;
+  typedef typename Superclass::PointVectorType PointVectorType;
+
+  typedef vnl_vector_fixed<float, VDimension> NormalType;
+
+  /** Compile a list of points that are within a specified radius of a given
+      point. */
+  virtual PointVectorType FindNeighborhoodPoints(const PointType &, int idx, double) const;
+  virtual PointVectorType FindNeighborhoodPoints(const PointType &, int idx, std::vector<double> &,
+                                                 double) const;
+
+  /** Allocation-free variants, the results are written to the given buffers
+      and the number of neighbors is returned. */
+  virtual unsigned int FindNeighborhoodPoints(const PointType &, int idx, double,
+                                              PointVectorType &) const;
+  virtual unsigned int FindNeighborhoodPoints(const PointType &, int idx, std::vector<double> &,
+                                              double, PointVectorType &) const;
+
+  /** Override SetDomain so that we can grab the region extent info and
+      construct our grid. */
+  virtual void SetDomain(DomainType *p);
+
+  /** Get the edge length of the grid cells. */
+  itkGetMacro(CellSize, double);
+
+  void PrintSelf(std::ostream& os, Indent indent) const
+  {
+    os << indent << "m_CellSize = " << m_CellSize << std::endl;
+    Superclass::PrintSelf(os, indent);
+  }
+
+  /**  For efficiency, itkNeighborhoods are not necessarily observers of
+      itkParticleSystem, but have specific methods invoked for various events.
+      AddPosition is called by itkParticleSystem when a particle location is
+      added.  SetPosition is called when a particle location is set.
+      RemovePosition is called when a particle location is removed.*/
+  virtual void AddPosition(const PointType &p, unsigned int idx, int threadId = 0);
+  virtual void SetPosition(const PointType &p, unsigned int idx, int threadId = 0);
+  virtual void RemovePosition(unsigned int idx, int threadId = 0);
+
+protected:
+  ParticleGridNeighborhood() : m_CellSize(0.0), m_FlatCutoff(0.30), m_SearchRadius(0.0), m_Drift(0.0)
+  {
+    for (unsigned int i = 0; i < VDimension; i++) {
+      m_Origin[i] = 0.0;
+      m_Extent[i] = 1.0;
+      m_InverseCellSize[i] = 1.0;
+      m_GridSize[i] = 1;
+    }
+  }
+  virtual ~ParticleGridNeighborhood() {};
+
+  /** Return the (clamped) grid coordinate of a position along the given axis. */
+  inline unsigned int CellCoordinate(double x, unsigned int axis) const
+  {
+    const double c = (x - m_Origin[axis]) * m_InverseCellSize[axis];
+    if (c <= 0.0) {
+      return 0;
+    }
+    const unsigned int ci = static_cast<unsigned int>(c);
+    return ci < m_GridSize[axis] ? ci : m_GridSize[axis] - 1;
+  }
+
+  /** Rebuild the grid with cells of (about) the given edge length and re-sort the particles. */
+  void RebuildGrid(double cellSize);
+
+  /** Rebuild the grid if the recent search radius no longer matches the cell size. */
+  void UpdateCellSize();
+
+  /** Sort the valid particles by cell into the CSR arrays. */
+  void SortIntoCells();
+
+  /** Return the flat cell index of a position. */
+  unsigned int CellIndex(const PointType &p) const;
+
+  /** Distance along the farthest axis from a position to a cell, the
+      boundary cells extending to infinity outside the grid. */
+  double DistanceToCell(const PointType &p, unsigned int cell) const;
+
+  /** Test the particle idx at the given position against the query and add it to ret. */
+  inline void TestNeighbor(const PointType &center, double radius2, double radius, unsigned int idx,
+                           const PointType &p, PointVectorType &ret) const;
+
+  /** Gather the points within radius of center into ret. */
+  void GatherNeighbors(const PointType &center, double radius, PointVectorType &ret) const;
+
+  /** Bound on the grid resolution, which keeps the cell array small for tiny radii. */
+  static constexpr unsigned int MaximumCellsPerDimension = 64;
+
+  /** Cells per axis of the domain bounds before the first query. */
+  static constexpr unsigned int InitialCellsPerDimension = 16;
+
+  /** Slot of a particle that is not in the sorted arrays. */
+  static constexpr unsigned int NotSorted = std::numeric_limits<unsigned int>::max();
+
+  double m_CellSize;
+  double m_FlatCutoff;
+  double m_Origin[VDimension];
+  double m_Extent[VDimension];
+  double m_InverseCellSize[VDimension];
+  unsigned int m_GridSize[VDimension];
+
+  /** Radius of the most recent query.  Queries may run concurrently, so this
+      is only read when positions are updated, which never overlaps them. */
+  mutable std::atomic<double> m_SearchRadius;
+
+  /** Particle coordinates, one contiguous array per axis, indexed by particle. */
+  std::vector<double> m_Coordinates[VDimension];
+  std::vector<bool> m_ParticleValid;
+
+  /** Cell each particle is sorted in and its slot in the sorted arrays. */
+  std::vector<unsigned int> m_ParticleCell;
+  std::vector<unsigned int> m_ParticleSlot;
+
+  /** The particles of cell c are in slots m_CellStart[c] to m_CellStart[c + 1]
+      of m_CellParticles, and their coordinates in the same slots of
+      m_CellCoordinates.  Removed particles keep their slot until the next sort. */
+  std::vector<unsigned int> m_CellStart;
+  std::vector<unsigned int> m_CellParticles;
+  std::vector<double> m_CellCoordinates[VDimension];
+
+  /** Particles added since the last sort, searched linearly. */
+  std::vector<unsigned int> m_Unsorted;
+
+  /** Largest distance by which a particle has moved out of the cell it is sorted in. */
+  double m_Drift;
+
+private:
+  ParticleGridNeighborhood(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+};
+
+} // end namespace itk
+
+#include "itkParticleGridNeighborhood.txx"
+
+#endif
@@ -0,0 +1,393 @@
+/*=========================================================================
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleGridNeighborhood_txx
+#define __itkParticleGridNeighborhood_txx
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace itk
+{
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>::SetDomain(DomainType *d)
+{
+  Superclass::SetDomain(d);
+
+  const PointType &lower = d->GetLowerBound();
+  const PointType &upper = d->GetUpperBound();
+
+  double maxExtent = 0.0;
+  for (unsigned int i = 0; i < VDimension; i++) {
+    m_Origin[i] = lower[i];
+    m_Extent[i] = upper[i] - lower[i];
+    if (m_Extent[i] <= 0.0) {
+      m_Extent[i] = 1.0;
+    }
+    maxExtent = std::max(maxExtent, m_Extent[i]);
+  }
+
+  // until the first query tells us the search radius, start from a coarse grid
+  const double radius = m_SearchRadius.load(std::memory_order_relaxed);
+  this->RebuildGrid(radius > 0.0 ? radius : maxExtent / InitialCellsPerDimension);
+}
+
+template <unsigned int VDimension>
+constexpr unsigned int ParticleGridNeighborhood<VDimension>::NotSorted;
+
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>::RebuildGrid(double cellSize)
+{
+  m_CellSize = cellSize;
+
+  unsigned int numCells = 1;
+  for (unsigned int i = 0; i < VDimension; i++) {
+    const double cells = std::ceil(m_Extent[i] / cellSize);
+    m_GridSize[i] = static_cast<unsigned int>(std::min(std::max(cells, 1.0), static_cast<double>(MaximumCellsPerDimension)));
+    m_InverseCellSize[i] = static_cast<double>(m_GridSize[i]) / m_Extent[i];
+    numCells *= m_GridSize[i];
+  }
+  m_CellStart.assign(numCells + 1, 0);
+
+  // sort the particles, including any added before the grid was constructed
+  this->SortIntoCells();
+}
+
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>::SortIntoCells()
+{
+  const unsigned int numCells = static_cast<unsigned int>(m_CellStart.size()) - 1;
+  const unsigned int numParticles = static_cast<unsigned int>(m_ParticleValid.size());
+
+  // counting sort: count the particles of each cell, then turn the counts into offsets
+  std::fill(m_CellStart.begin(), m_CellStart.end(), 0);
+  for (unsigned int idx = 0; idx < numParticles; idx++) {
+    m_ParticleSlot[idx] = NotSorted;
+    if (m_ParticleValid[idx]) {
+      PointType p;
+      for (unsigned int i = 0; i < VDimension; i++) {
+        p[i] = m_Coordinates[i][idx];
+      }
+      m_ParticleCell[idx] = this->CellIndex(p);
+      m_CellStart[m_ParticleCell[idx] + 1]++;
+    }
+  }
+  for (unsigned int c = 0; c < numCells; c++) {
+    m_CellStart[c + 1] += m_CellStart[c];
+  }
+
+  const unsigned int numSorted = m_CellStart[numCells];
+  m_CellParticles.resize(numSorted);
+  for (unsigned int i = 0; i < VDimension; i++) {
+    m_CellCoordinates[i].resize(numSorted);
+  }
+
+  // fill each cell from its end, in increasing particle order
+  for (unsigned int idx = numParticles; idx-- > 0;) {
+    if (m_ParticleValid[idx]) {
+      const unsigned int slot = --m_CellStart[m_ParticleCell[idx] + 1];
+      m_ParticleSlot[idx] = slot;
+      m_CellParticles[slot] = idx;
+      for (unsigned int i = 0; i < VDimension; i++) {
+        m_CellCoordinates[i][slot] = m_Coordinates[i][idx];
+      }
+    }
+  }
+  // the end offsets of the cells have moved down to their starts, shift them into place
+  std::copy(m_CellStart.begin() + 1, m_CellStart.end(), m_CellStart.begin());
+  m_CellStart[numCells] = numSorted;
+
+  m_Unsorted.clear();
+  m_Drift = 0.0;
+}
+
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>::UpdateCellSize()
+{
+  // Cells about as large as the search radius keep a query to the 3^d cells
+  // around it.  The factor of two hysteresis avoids rebuilding the grid while
+  // the radius fluctuates from particle to particle.
+  const double radius = m_SearchRadius.load(std::memory_order_relaxed);
+  if (radius > 0.0 && (radius > 2.0 * m_CellSize || radius < 0.5 * m_CellSize)) {
+    this->RebuildGrid(radius);
+  }
+}
+
+template <unsigned int VDimension>
+unsigned int ParticleGridNeighborhood<VDimension>::CellIndex(const PointType &p) const
+{
+  unsigned int cell = 0;
+  unsigned int stride = 1;
+  for (unsigned int i = 0; i < VDimension; i++) {
+    cell += this->CellCoordinate(p[i], i) * stride;
+    stride *= m_GridSize[i];
+  }
+  return cell;
+}
+
+template <unsigned int VDimension>
+double ParticleGridNeighborhood<VDimension>::DistanceToCell(const PointType &p, unsigned int cell) const
+{
+  double distance = 0.0;
+  for (unsigned int i = 0; i < VDimension; i++) {
+    const unsigned int c = cell % m_GridSize[i];
+    cell /= m_GridSize[i];
+    const double lower = m_Origin[i] + c / m_InverseCellSize[i];
+    const double upper = m_Origin[i] + (c + 1) / m_InverseCellSize[i];
+    if (c > 0 && p[i] < lower) {
+      distance = std::max(distance, lower - p[i]);
+    }
+    if (c + 1 < m_GridSize[i] && p[i] > upper) {
+      distance = std::max(distance, p[i] - upper);
+    }
+  }
+  return distance;
+}
+
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>
+::AddPosition(const PointType &p, unsigned int idx, int threadId)
+{
+  if (idx >= m_ParticleValid.size()) {
+    for (unsigned int i = 0; i < VDimension; i++) {
+      m_Coordinates[i].resize(idx + 1, 0.0);
+    }
+    m_ParticleValid.resize(idx + 1, false);
+    m_ParticleCell.resize(idx + 1, 0);
+    m_ParticleSlot.resize(idx + 1, NotSorted);
+  }
+
+  // a particle that is already stored (or was removed and keeps its slot) is moved
+  if (m_ParticleValid[idx] || m_ParticleSlot[idx] != NotSorted) {
+    m_ParticleValid[idx] = true;
+    this->SetPosition(p, idx, threadId);
+    return;
+  }
+
+  for (unsigned int i = 0; i < VDimension; i++) {
+    m_Coordinates[i][idx] = p[i];
+  }
+  m_ParticleValid[idx] = true;
+
+  // the grid is only available once the domain has been set
+  if (m_CellStart.empty()) {
+    return;
+  }
+
+  // Queries scan the new particles linearly until the next sort.  Sorting
+  // once they outnumber the sorted ones keeps adding particles linear overall.
+  m_Unsorted.push_back(idx);
+  if (m_Unsorted.size() > std::max<size_t>(m_CellParticles.size(), 64)) {
+    this->SortIntoCells();
+  }
+  this->UpdateCellSize();
+}
+
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>
+::SetPosition(const PointType &p, unsigned int idx, int threadId)
+{
+  if (idx >= m_ParticleValid.size() || !m_ParticleValid[idx]) {
+    this->AddPosition(p, idx, threadId);
+    return;
+  }
+
+  for (unsigned int i = 0; i < VDimension; i++) {
+    m_Coordinates[i][idx] = p[i];
+  }
+
+  // the grid is only available once the domain has been set
+  if (m_CellStart.empty()) {
+    return;
+  }
+
+  // positions are set once the new particles are in place, sort them in
+  if (!m_Unsorted.empty()) {
+    this->SortIntoCells();
+  }
+  else {
+    const unsigned int slot = m_ParticleSlot[idx];
+    for (unsigned int i = 0; i < VDimension; i++) {
+      m_CellCoordinates[i][slot] = p[i];
+    }
+
+    // Leave the particle in its cell and widen the queries instead, until
+    // particles have moved out of their cells by more than half a cell.
+    if (this->CellIndex(p) != m_ParticleCell[idx]) {
+      m_Drift = std::max(m_Drift, this->DistanceToCell(p, m_ParticleCell[idx]));
+      if (m_Drift > 0.5 * m_CellSize) {
+        this->SortIntoCells();
+      }
+    }
+  }
+  this->UpdateCellSize();
+}
+
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>
+::RemovePosition(unsigned int idx, int)
+{
+  if (idx >= m_ParticleValid.size() || !m_ParticleValid[idx]) {
+    return;
+  }
+  m_ParticleValid[idx] = false;
+
+  // a sorted particle keeps its slot, which queries skip, until the next sort
+  if (m_ParticleSlot[idx] == NotSorted) {
+    m_Unsorted.erase(std::remove(m_Unsorted.begin(), m_Unsorted.end(), idx), m_Unsorted.end());
+  }
+}
+
+template <unsigned int VDimension>
+inline void ParticleGridNeighborhood<VDimension>
+::TestNeighbor(const PointType &center, double radius2, double radius, unsigned int idx,
+               const PointType &p, PointVectorType &ret) const
+{
+  // Cheap rejection on the euclidean distance.  Domain distances (e.g.
+  // geodesic distances on meshes) are never shorter than this.
+  double sum = 0.0;
+  for (unsigned int i = 0; i < VDimension; i++) {
+    const double q = p[i] - center[i];
+    sum += q * q;
+  }
+  if (sum >= radius2 || sum == 0.0) {
+    return;
+  }
+
+  const double distance = this->GetDomain()->Distance(center, p);
+  if (distance < radius && distance > 0) {
+    ret.push_back(ParticlePointIndexPair<VDimension>(p, idx));
+  }
+}
+
+template <unsigned int VDimension>
+void ParticleGridNeighborhood<VDimension>
+::GatherNeighbors(const PointType &center, double radius, PointVectorType &ret) const
+{
+  ret.clear();
+  m_SearchRadius.store(radius, std::memory_order_relaxed);
+  if (m_CellStart.empty()) {
+    return;
+  }
+
+  // Range of cells overlapping the bounding box of the given hypersphere,
+  // widened by the distance particles may have moved out of their cells.
+  const double reach = radius + m_Drift;
+  unsigned int lo[VDimension], hi[VDimension], c[VDimension];
+  for (unsigned int i = 0; i < VDimension; i++) {
+    lo[i] = this->CellCoordinate(center[i] - reach, i);
+    hi[i] = this->CellCoordinate(center[i] + reach, i);
+    c[i] = lo[i];
+  }
+
+  const double radius2 = radius * radius;
+  PointType p;
+
+  while (true) {
+    // the cells along the first axis are contiguous in the sorted arrays
+    unsigned int cell = 0;
+    unsigned int stride = 1;
+    for (unsigned int i = 0; i < VDimension; i++) {
+      cell += c[i] * stride;
+      stride *= m_GridSize[i];
+    }
+    const unsigned int end = m_CellStart[cell + hi[0] - lo[0] + 1];
+    for (unsigned int slot = m_CellStart[cell]; slot < end; slot++) {
+      const unsigned int idx = m_CellParticles[slot];
+      if (!m_ParticleValid[idx]) {
+        continue;
+      }
+      for (unsigned int i = 0; i < VDimension; i++) {
+        p[i] = m_CellCoordinates[i][slot];
+      }
+      this->TestNeighbor(center, radius2, radius, idx, p, ret);
+    }
+
+    // advance to the next row of cells in the range
+    unsigned int axis = 1;
+    while (axis < VDimension && c[axis] == hi[axis]) {
+      c[axis] = lo[axis];
+      axis++;
+    }
+    if (axis == VDimension) {
+      break;
+    }
+    c[axis]++;
+  }
+
+  for (unsigned int n = 0; n < m_Unsorted.size(); n++) {
+    const unsigned int idx = m_Unsorted[n];
+    for (unsigned int i = 0; i < VDimension; i++) {
+      p[i] = m_Coordinates[i][idx];
+    }
+    this->TestNeighbor(center, radius2, radius, idx, p, ret);
+  }
+}
+
+template <unsigned int VDimension>
+unsigned int ParticleGridNeighborhood<VDimension>
+::FindNeighborhoodPoints(const PointType &center, int idx, double radius, PointVectorType &ret) const
+{
+  this->GatherNeighbors(center, radius, ret);
+  return static_cast<unsigned int>(ret.size());
+}
+
+template <unsigned int VDimension>
+unsigned int ParticleGridNeighborhood<VDimension>
+::FindNeighborhoodPoints(const PointType &center, int idx, std::vector<double> &weights,
+                         double radius, PointVectorType &ret) const
+{
+  weights.clear();
+  this->GatherNeighbors(center, radius, ret);
+  if (ret.empty()) {
+    return 0;
+  }
+
+  const DomainType *domain = this->GetDomain();
+  const NormalType posnormal = domain->SampleNormalAtPoint(center, idx);
+
+  for (unsigned int n = 0; n < ret.size(); n++) {
+    const NormalType pn = domain->SampleNormalAtPoint(ret[n].Point, ret[n].Index);
+    const double cosine = dot_product(posnormal, pn); // normals already normalized
+    if (cosine >= m_FlatCutoff) {
+      weights.push_back(1.0);
+    }
+    else {
+      // Drop to zero influence over 90 degrees.
+      weights.push_back(cos((m_FlatCutoff - cosine) / (1.0 + m_FlatCutoff) * 1.5708));
+    }
+  }
+
+  return static_cast<unsigned int>(ret.size());
+}
+
+template <unsigned int VDimension>
+typename ParticleGridNeighborhood<VDimension>::PointVectorType
+ParticleGridNeighborhood<VDimension>
+::FindNeighborhoodPoints(const PointType &center, int idx, double radius) const
+{
+  PointVectorType ret;
+  this->FindNeighborhoodPoints(center, idx, radius, ret);
+  return ret;
+}
+
+template <unsigned int VDimension>
+typename ParticleGridNeighborhood<VDimension>::PointVectorType
+ParticleGridNeighborhood<VDimension>
+::FindNeighborhoodPoints(const PointType &center, int idx, std::vector<double> &weights,
+                         double radius) const
+{
+  PointVectorType ret;
+  this->FindNeighborhoodPoints(center, idx, weights, radius, ret);
+  return ret;
+}
+
+} // end namespace itk
+
+#endif
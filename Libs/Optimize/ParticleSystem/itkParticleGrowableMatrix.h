@@ -0,0 +1,91 @@
+/*=========================================================================
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleGrowableMatrix_h
+#define __itkParticleGrowableMatrix_h
+
+#include "vnl/vnl_matrix.h"
+#include <algorithm>
+
+namespace itk
+{
+/** \class ParticleGrowableMatrix
+ *
+ * A vnl_matrix whose number of rows follows the number of particles, used as
+ * the storage of the shape matrix attributes.
+ *
+ * vnl_matrix has no capacity separate from its size, and the users of the
+ * shape matrices read rows(), so rows are over-allocated while particles are
+ * being added and trimmed to the exact count by FinalizeResize once the
+ * positions are set.  When the particle system has reserved room for the
+ * particles being added (e.g. the particle counts after a split or the size of
+ * a points file), GrowRows allocates exactly that many rows in one step and
+ * the trim is a no-op.  Otherwise the rows grow geometrically.
+ */
+template <class T>
+class ParticleGrowableMatrix : public vnl_matrix<T>
+{
+public:
+  virtual ~ParticleGrowableMatrix() {}
+
+  /** Resize to rs x cs, keeping the overlapping block of values.  The new
+      matrix is allocated once and the old values are copied into it. */
+  virtual void ResizeMatrix(int rs, int cs)
+  {
+    if (rs == static_cast<int>(this->rows()) && cs == static_cast<int>(this->cols()))
+      return;
+
+    vnl_matrix<T> tmp(rs, cs, T(0));
+    const unsigned int nr = std::min(static_cast<unsigned int>(rs), this->rows());
+    const unsigned int nc = std::min(static_cast<unsigned int>(cs), this->cols());
+    for (unsigned int r = 0; r < nr; r++)
+      std::copy(this->operator[](r), this->operator[](r) + nc, tmp[r]);
+    this->swap(tmp);
+  }
+
+  /** Note that at least rs rows are required and make room for them.  If
+      more rows are needed, the matrix grows to the reserved number of rows
+      when that is enough, or to twice its size otherwise. */
+  void GrowRows(unsigned int rs, unsigned int reserved)
+  {
+    m_RequiredRows = std::max(m_RequiredRows, rs);
+    if (rs > this->rows())
+      this->ResizeRows(reserved >= rs ? reserved : std::max(rs, 2 * this->rows()));
+  }
+
+  /** Trim the matrix to the number of rows required by the particles added
+      so far, in one pass.  This is a no-op if the matrix already has the
+      right size. */
+  void FinalizeResize()
+  {
+    if (this->rows() != m_RequiredRows)
+      this->ResizeRows(m_RequiredRows);
+  }
+
+  virtual void SetMatrix(const vnl_matrix<T> &m)
+  {
+    vnl_matrix<T>::operator=(m);
+    m_RequiredRows = m.rows();
+  }
+
+protected:
+  ParticleGrowableMatrix() : m_RequiredRows(0) {}
+
+  /** Change the number of rows.  Subclasses that keep storage of their own
+      with one entry per row resize it here as well. */
+  virtual void ResizeRows(unsigned int rs)
+  {
+    this->ResizeMatrix(rs, this->cols());
+  }
+
+  unsigned int m_RequiredRows;
+};
+
+} // end namespace itk
+
+#endif
@@ -16,7 +16,14 @@
 #include <itkImageToVTKImageFilter.h>
 #include <itkZeroCrossingImageFilter.h>
 #include <itkImageRegionConstIteratorWithIndex.h>
+#include <vnl/vnl_inverse.h>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
 
 // we have to undef foreach here because both Qt and OpenVDB define foreach
 #undef foreach
@@ -31,6 +38,39 @@
 
 namespace itk
 {
+/** \class VDBThreadLocalAccessor
+ *  Keeps one read-only OpenVDB ValueAccessor per thread for a grid.  An
+ *  accessor caches the path to the last visited leaf, and particles only move
+ *  a fraction of a voxel per step, so most lookups become cache hits instead
+ *  of walks from the root of the tree.  SetGrid must not be called while other
+ *  threads are sampling.
+ */
+template <class GridType>
+class VDBThreadLocalAccessor
+{
+public:
+  typedef typename GridType::ConstAccessor AccessorType;
+
+  void SetGrid(const typename GridType::Ptr &grid)
+  {
+    m_Accessors.clear();
+    m_Grid = grid;
+  }
+
+  const AccessorType &Get() const
+  {
+    auto &accessor = m_Accessors.local();
+    if (!accessor) {
+      accessor.reset(new AccessorType(m_Grid->getConstAccessor()));
+    }
+    return *accessor;
+  }
+
+private:
+  typename GridType::Ptr m_Grid;
+  mutable tbb::enumerable_thread_specific<std::unique_ptr<AccessorType>> m_Accessors;
+};
+
 /** \class ParticleImageDomain
  *  A bounding-box region domain that sets its bounding box according to the
  *  origin, spacing, and RequestedRegion of a specified itk::Image.  This
@@ -63,12 +103,13 @@ public:
     // (Downside: its more difficult to display the correct location of the point of failure.)
     m_VDBImage = openvdb::FloatGrid::create(1e8);
     m_VDBImage->setGridClass(openvdb::GRID_LEVEL_SET);
-    auto vdbAccessor = m_VDBImage->getAccessor();
+    m_VDBImageAccessor.SetGrid(m_VDBImage);
 
     // Save properties of the Image needed for the optimizer
     m_Size = I->GetRequestedRegion().GetSize();
     m_Spacing = I->GetSpacing();
     m_Origin = I->GetOrigin();
+    m_Direction = I->GetDirection();
     m_Index = I->GetRequestedRegion().GetIndex();
 
     // Transformation from index space to world space
@@ -79,20 +120,7 @@ public:
     const auto xform = openvdb::math::Transform::createLinearTransform(mat);
     m_VDBImage->setTransform(xform);
 
-    ImageRegionIterator<ImageType> it(I, I->GetRequestedRegion());
-    it.GoToBegin();
-
-    while(!it.IsAtEnd()) {
-      const auto idx = it.GetIndex();
-      const auto pixel = it.Get();
-      if(abs(pixel) > narrow_band) {
-        ++it;
-        continue;
-      }
-      const auto coord = openvdb::Coord(idx[0], idx[1], idx[2]);
-      vdbAccessor.setValue(coord, pixel);
-      ++it;
-    }
+    this->CopyNarrowBand(I, narrow_band);
 
     typename ImageType::PointType l0;
     I->TransformIndexToPhysicalPoint(m_Index, l0);
@@ -122,6 +150,117 @@ public:
     this->UpdateSurfaceArea(I);
   }
 
+  /** Append the grids and values computed by SetImage to a cache, from which
+      LoadCache restores the domain without the image.  Subclasses append
+      their own after calling the superclass. */
+  void SaveCache(openvdb::GridPtrVec &grids, openvdb::MetaMap &meta) const
+  {
+    AddCachedGrid(grids, m_VDBImage, "image");
+    meta.insertMeta("size", openvdb::Vec3IMetadata(openvdb::Vec3i(m_Size[0], m_Size[1], m_Size[2])));
+    meta.insertMeta("index", openvdb::Vec3IMetadata(openvdb::Vec3i(m_Index[0], m_Index[1], m_Index[2])));
+    meta.insertMeta("spacing", openvdb::Vec3DMetadata(openvdb::Vec3d(m_Spacing[0], m_Spacing[1], m_Spacing[2])));
+    meta.insertMeta("origin", openvdb::Vec3DMetadata(openvdb::Vec3d(m_Origin[0], m_Origin[1], m_Origin[2])));
+    openvdb::Mat4d direction = openvdb::Mat4d::identity();
+    for (unsigned int i = 0; i < DIMENSION; i++) {
+      for (unsigned int j = 0; j < DIMENSION; j++) {
+        direction(i, j) = m_Direction(i, j);
+      }
+    }
+    meta.insertMeta("direction", openvdb::Mat4DMetadata(direction));
+    const auto &l = this->GetLowerBound();
+    const auto &u = this->GetUpperBound();
+    meta.insertMeta("lower_bound", openvdb::Vec3DMetadata(openvdb::Vec3d(l[0], l[1], l[2])));
+    meta.insertMeta("upper_bound", openvdb::Vec3DMetadata(openvdb::Vec3d(u[0], u[1], u[2])));
+    meta.insertMeta("zero_crossing_point", openvdb::Vec3DMetadata(
+      openvdb::Vec3d(m_ZeroCrossingPoint[0], m_ZeroCrossingPoint[1], m_ZeroCrossingPoint[2])));
+
+    // the candidate zero crossings lie on voxels of the image, stored as the active voxels of an
+    // index space grid
+    const auto to_index = vnl_inverse(IndexToPhysicalMatrix());
+    auto zero_crossings = openvdb::BoolGrid::create(false);
+    auto accessor = zero_crossings->getAccessor();
+    for (const auto &p : m_possible_zero_crossings) {
+      openvdb::Coord ijk;
+      for (unsigned int i = 0; i < DIMENSION; i++) {
+        double x = 0.0;
+        for (unsigned int j = 0; j < DIMENSION; j++) {
+          x += to_index(i, j) * (p[j] - m_Origin[j]);
+        }
+        ijk[i] = static_cast<int>(std::lround(x));
+      }
+      accessor.setValueOn(ijk, true);
+    }
+    AddCachedGrid(grids, zero_crossings, "zero_crossings");
+  }
+
+  /** Restore a domain saved by SaveCache, in place of SetImage.  Returns false
+      if anything is missing, in which case the domain is left partially set
+      and must be discarded. */
+  bool LoadCache(const openvdb::GridPtrVec &grids, const openvdb::MetaMap &meta)
+  {
+    const auto image = FindCachedGrid<openvdb::FloatGrid>(grids, "image");
+    const auto size = meta.getMetadata<openvdb::Vec3IMetadata>("size");
+    const auto index = meta.getMetadata<openvdb::Vec3IMetadata>("index");
+    const auto spacing = meta.getMetadata<openvdb::Vec3DMetadata>("spacing");
+    const auto origin = meta.getMetadata<openvdb::Vec3DMetadata>("origin");
+    const auto lower = meta.getMetadata<openvdb::Vec3DMetadata>("lower_bound");
+    const auto upper = meta.getMetadata<openvdb::Vec3DMetadata>("upper_bound");
+    const auto direction = meta.getMetadata<openvdb::Mat4DMetadata>("direction");
+    const auto zero_crossing = meta.getMetadata<openvdb::Vec3DMetadata>("zero_crossing_point");
+    const auto zero_crossings = FindCachedGrid<openvdb::BoolGrid>(grids, "zero_crossings");
+    if (!image || !size || !index || !spacing || !origin || !direction || !lower || !upper || !zero_crossing ||
+        !zero_crossings) {
+      return false;
+    }
+
+    this->m_FixedDomain = false;
+    this->Modified();
+
+    m_VDBImage = image;
+    m_VDBImageAccessor.SetGrid(m_VDBImage);
+
+    PointType l, u;
+    for (unsigned int i = 0; i < DIMENSION; i++) {
+      m_Size[i] = size->value()[i];
+      m_Index[i] = index->value()[i];
+      m_Spacing[i] = spacing->value()[i];
+      m_Origin[i] = origin->value()[i];
+      m_ZeroCrossingPoint[i] = zero_crossing->value()[i];
+      l[i] = lower->value()[i];
+      u[i] = upper->value()[i];
+      for (unsigned int j = 0; j < DIMENSION; j++) {
+        m_Direction(i, j) = direction->value()(i, j);
+      }
+    }
+    this->SetLowerBound(l);
+    this->SetUpperBound(u);
+
+    // back to physical points in the reverse raster order of SetupImageForCrossingPointUpdate
+    std::vector<openvdb::Coord> voxels;
+    voxels.reserve(zero_crossings->activeVoxelCount());
+    for (auto it = zero_crossings->cbeginValueOn(); it.test(); ++it) {
+      voxels.push_back(it.getCoord());
+    }
+    std::sort(voxels.begin(), voxels.end(), [](const openvdb::Coord &a, const openvdb::Coord &b) {
+      return a.z() != b.z() ? a.z() > b.z() : (a.y() != b.y() ? a.y() > b.y() : a.x() > b.x());
+    });
+    const auto to_physical = IndexToPhysicalMatrix();
+    m_possible_zero_crossings.clear();
+    m_possible_zero_crossings.reserve(voxels.size());
+    for (const auto &ijk : voxels) {
+      // as itk::ImageBase::TransformIndexToPhysicalPoint, so the points are identical
+      PointType pos;
+      for (unsigned int i = 0; i < DIMENSION; i++) {
+        pos[i] = m_Origin[i];
+        for (unsigned int j = 0; j < DIMENSION; j++) {
+          pos[i] += to_physical(i, j) * ijk[j];
+        }
+      }
+      m_possible_zero_crossings.push_back(pos);
+    }
+    return true;
+  }
+
   inline double GetSurfaceArea() const override
   {
     throw std::runtime_error("Surface area is not computed currently.");
@@ -156,12 +295,26 @@ public:
   {
     if(this->IsInsideBuffer(p)) {
       const auto coord = this->ToVDBCoord(p);
-      return openvdb::tools::BoxSampler::sample(m_VDBImage->tree(), coord);
+      return openvdb::tools::BoxSampler::sample(m_VDBImageAccessor.Get(), coord);
     } else {
       itkExceptionMacro("Distance transform queried for a Point, " << p << ", outside the given image domain. Consider increasing the narrow band" );
     }
   }
 
+  /** Sample the image at many points, reusing the same accessor for all of
+      them.  This method performs bounds checking. */
+  void SampleMany(const std::vector<PointType> &points, std::vector<T> &values) const
+  {
+    values.resize(points.size());
+    const auto &accessor = m_VDBImageAccessor.Get();
+    for (size_t i = 0; i < points.size(); i++) {
+      if (!this->IsInsideBuffer(points[i])) {
+        itkExceptionMacro("Distance transform queried for a Point, " << points[i] << ", outside the given image domain. Consider increasing the narrow band" );
+      }
+      values[i] = openvdb::tools::BoxSampler::sample(accessor, this->ToVDBCoord(points[i]));
+    }
+  }
+
   inline double GetMaxDiameter() const override
   {
     double bestRadius = 0;
@@ -181,6 +334,7 @@ public:
   void DeleteImages() override
   {
     m_VDBImage = 0;
+    m_VDBImageAccessor.SetGrid(m_VDBImage);
   }
 
   // Updates zero crossing points. Raster scans candidate zero crossing points, and finds one that does not violate any constraints.
@@ -211,6 +365,31 @@ protected:
     os << indent << "VDB Active Voxels = " << m_VDBImage->activeVoxelCount() << std::endl;
   }
 
+  /** Helpers for SaveCache and LoadCache.  Grids are stored as shallow copies
+      under the given name. */
+  static void AddCachedGrid(openvdb::GridPtrVec &grids, const openvdb::GridBase::Ptr &grid, const std::string &name)
+  {
+    auto copy = grid->copyGrid();
+    copy->setName(name);
+    grids.push_back(copy);
+  }
+
+  template <class GridType>
+  static typename GridType::Ptr FindCachedGrid(const openvdb::GridPtrVec &grids, const std::string &name)
+  {
+    for (const auto &grid : grids) {
+      if (grid && grid->getName() == name) {
+        return openvdb::gridPtrCast<GridType>(grid);
+      }
+    }
+    return nullptr;
+  }
+
+  /** Candidate zero crossing points of the image, in reverse raster order. */
+  const std::vector<PointType> &GetPossibleZeroCrossings() const {
+    return m_possible_zero_crossings;
+  }
+
   inline openvdb::math::Transform::Ptr transform() const {
     return this->m_VDBImage->transformPtr();
   }
@@ -223,7 +402,7 @@ protected:
     const auto idxCoord = this->transform()->worldToIndex(worldCoord);
 
     // Make sure the coordinate is part of the narrow band
-    if(m_VDBImage->tree().isValueOff(openvdb::Coord::round(idxCoord))) { // `isValueOff` requires an integer coordinate
+    if(!m_VDBImageAccessor.Get().isValueOn(openvdb::Coord::round(idxCoord))) { // `isValueOn` requires an integer coordinate
       // If multiple threads crash here at the same time, the error message displayed is just "terminate called recursively",
       // which isn't helpful. So we std::cerr the error to make sure its printed to the console.
       std::cerr << "Sampled point outside the narrow band: " << p << std::endl;
@@ -236,14 +415,28 @@ protected:
 private:
 
   openvdb::FloatGrid::Ptr m_VDBImage;
+  VDBThreadLocalAccessor<openvdb::FloatGrid> m_VDBImageAccessor;
   typename ImageType::SizeType m_Size;
   typename ImageType::SpacingType m_Spacing;
   PointType m_Origin;
+  typename ImageType::DirectionType m_Direction;
   PointType m_ZeroCrossingPoint;
   typename ImageType::RegionType::IndexType m_Index; // Index defining the corner of the region
   double m_SurfaceArea;
   std::vector<PointType> m_possible_zero_crossings;
 
+  // The matrix from image index to physical point offsets, as computed by itk::ImageBase
+  vnl_matrix_fixed<double, DIMENSION, DIMENSION> IndexToPhysicalMatrix() const
+  {
+    vnl_matrix_fixed<double, DIMENSION, DIMENSION> m;
+    for (unsigned int i = 0; i < DIMENSION; i++) {
+      for (unsigned int j = 0; j < DIMENSION; j++) {
+        m(i, j) = m_Direction(i, j) * m_Spacing[j];
+      }
+    }
+    return m;
+  }
+
   // Computes possible zero crossing points. Later on, one can find the ones that do not violate constraints.
   void SetupImageForCrossingPointUpdate(ImageType *I){
       typename itk::ZeroCrossingImageFilter < ImageType, ImageType > ::Pointer zc =
@@ -263,6 +456,70 @@ private:
       }
   }
 
+  // Copies the voxels of the requested region within the narrow band to the grid.  Each block of
+  // the image covered by a leaf node is converted concurrently, and only blocks containing voxels
+  // in the band allocate a leaf, so the dense image is read once and nothing else is densified.
+  void CopyNarrowBand(ImageType *I, double narrow_band)
+  {
+    typedef openvdb::FloatTree::LeafNodeType LeafType;
+    const int dim = LeafType::DIM;
+
+    const auto region = I->GetRequestedRegion();
+    const auto buffered = I->GetBufferedRegion();
+    const T *buffer = I->GetBufferPointer();
+    const openvdb::Coord lower(region.GetIndex()[0], region.GetIndex()[1], region.GetIndex()[2]);
+    const openvdb::Coord upper = lower + openvdb::Coord(region.GetSize()[0] - 1, region.GetSize()[1] - 1,
+                                                        region.GetSize()[2] - 1);
+    const openvdb::Coord buffer_origin(buffered.GetIndex()[0], buffered.GetIndex()[1], buffered.GetIndex()[2]);
+    const size_t stride_y = buffered.GetSize()[0];
+    const size_t stride_z = stride_y * buffered.GetSize()[1];
+
+    // origins of the leaf nodes overlapping the region
+    const openvdb::Coord first = lower & ~(dim - 1);
+    std::vector<openvdb::Coord> origins;
+    for (int z = first.z(); z <= upper.z(); z += dim) {
+      for (int y = first.y(); y <= upper.y(); y += dim) {
+        for (int x = first.x(); x <= upper.x(); x += dim) {
+          origins.push_back(openvdb::Coord(x, y, z));
+        }
+      }
+    }
+
+    const float background = m_VDBImage->background();
+    std::vector<LeafType *> leaves(origins.size(), nullptr);
+    tbb::parallel_for(tbb::blocked_range<size_t>{0, origins.size()}, [&](const tbb::blocked_range<size_t> &r) {
+      for (size_t n = r.begin(); n < r.end(); n++) {
+        const openvdb::Coord begin = openvdb::Coord::maxComponent(origins[n], lower);
+        const openvdb::Coord end = openvdb::Coord::minComponent(origins[n].offsetBy(dim - 1), upper);
+        LeafType *leaf = nullptr;
+        for (int z = begin.z(); z <= end.z(); z++) {
+          for (int y = begin.y(); y <= end.y(); y++) {
+            const T *row = buffer + (z - buffer_origin.z()) * stride_z + (y - buffer_origin.y()) * stride_y
+                           + (begin.x() - buffer_origin.x());
+            for (int x = begin.x(); x <= end.x(); x++) {
+              const T pixel = row[x - begin.x()];
+              if (std::abs(pixel) > narrow_band) {
+                continue;
+              }
+              if (!leaf) {
+                leaf = new LeafType(origins[n], background, false);
+              }
+              leaf->setValueOn(LeafType::coordToOffset(openvdb::Coord(x, y, z)), pixel);
+            }
+          }
+        }
+        leaves[n] = leaf;
+      }
+    });
+
+    // the tree takes ownership of the leaves
+    for (auto leaf : leaves) {
+      if (leaf) {
+        m_VDBImage->tree().addLeaf(leaf);
+      }
+    }
+  }
+
   void UpdateSurfaceArea(ImageType *I) {
     //TODO: This code has been copied from Optimize.cpp. It does not work
     /*
@@ -42,7 +42,36 @@ public:
     // Computes partial derivatives in parent class
     Superclass::SetImage(I, narrow_band);
     m_VDBCurvature = openvdb::tools::meanCurvature(*this->GetVDBImage());
-    this->ComputeSurfaceStatistics(I);
+    m_VDBCurvatureAccessor.SetGrid(m_VDBCurvature);
+    this->ComputeSurfaceStatistics();
+  }
+
+  /** Append the curvature and surface statistics to a cache, see
+      ParticleImageDomain::SaveCache. */
+  void SaveCache(openvdb::GridPtrVec &grids, openvdb::MetaMap &meta) const
+  {
+    Superclass::SaveCache(grids, meta);
+    this->AddCachedGrid(grids, m_VDBCurvature, "curvature");
+    meta.insertMeta("surface_mean_curvature", openvdb::DoubleMetadata(m_SurfaceMeanCurvature));
+    meta.insertMeta("surface_stddev_curvature", openvdb::DoubleMetadata(m_SurfaceStdDevCurvature));
+  }
+
+  /** Restore a domain saved by SaveCache, see ParticleImageDomain::LoadCache. */
+  bool LoadCache(const openvdb::GridPtrVec &grids, const openvdb::MetaMap &meta)
+  {
+    if (!Superclass::LoadCache(grids, meta)) {
+      return false;
+    }
+    m_VDBCurvature = this->template FindCachedGrid<openvdb::FloatGrid>(grids, "curvature");
+    m_VDBCurvatureAccessor.SetGrid(m_VDBCurvature);
+    const auto mean = meta.getMetadata<openvdb::DoubleMetadata>("surface_mean_curvature");
+    const auto stddev = meta.getMetadata<openvdb::DoubleMetadata>("surface_stddev_curvature");
+    if (!m_VDBCurvature || !mean || !stddev) {
+      return false;
+    }
+    m_SurfaceMeanCurvature = mean->value();
+    m_SurfaceStdDevCurvature = stddev->value();
+    return true;
   }
 
   double GetCurvature(const PointType &p, int idx) const override
@@ -51,7 +80,7 @@ public:
       return 0;
     }
     const auto coord = this->ToVDBCoord(p);
-    return openvdb::tools::BoxSampler::sample(m_VDBCurvature->tree(), coord);
+    return openvdb::tools::BoxSampler::sample(m_VDBCurvatureAccessor.Get(), coord);
   }
 
   inline double GetSurfaceMeanCurvature() const override
@@ -76,54 +105,35 @@ protected:
 
 private:
   openvdb::FloatGrid::Ptr m_VDBCurvature;
+  VDBThreadLocalAccessor<openvdb::FloatGrid> m_VDBCurvatureAccessor;
 
   // Cache surface statistics
   double m_SurfaceMeanCurvature;
   double m_SurfaceStdDevCurvature;
 
-  void ComputeSurfaceStatistics(ImageType *I)
+  void ComputeSurfaceStatistics()
   {
     // TODO: This computation is copied from itkParticleMeanCurvatureAttribute
     // Since the entire Image is not available after the initial load, its simplest
     // to calculate it now. But it should be a part of itkParticleMeanCurvatureAttribute
 
-    // Loop through a zero crossing image, project all the zero crossing points
-    // to the surface, and use those points to comput curvature stats.
-    typedef itk::ZeroCrossingImageFilter<ImageType, ImageType> ZeroCrossingImageFilterType;
-    typename ZeroCrossingImageFilterType::Pointer zc = ZeroCrossingImageFilterType::New();
-
-    zc->SetInput(I);
-    zc->Update();
-
-    itk::ImageRegionConstIteratorWithIndex<ImageType> it(zc->GetOutput(),
-                                                         zc->GetOutput()->GetRequestedRegion());
+    // Project all the zero crossing points of the image to the surface, and use
+    // those points to compute curvature stats.  The parent class has already found
+    // them, in reverse raster order.
+    const auto &crossings = this->GetPossibleZeroCrossings();
     std::vector<double> datalist;
     m_SurfaceMeanCurvature = 0.0;
     m_SurfaceStdDevCurvature = 0.0;
 
-    for (; !it.IsAtEnd(); ++it) {
-      if (it.Get() == 1.0) {
-        // Find closest pixel location to surface.
-        PointType pos;
-        //dynamic_cast<const DomainType
-        //*>(system->GetDomain(d))->GetImage()->TransformIndexToPhysicalPoint(it.GetIndex(), pos);
-        I->TransformIndexToPhysicalPoint(it.GetIndex(), pos);
-
-        // Project point to surface.
-        // Make sure constraints are enabled
-        //      bool c = domain->GetConstraintsEnabled();
-
-        //      domain->EnableConstraints();
-        this->ApplyConstraints(pos);
-
-        //      domain->SetConstraintsEnabled(c);
-
-        // Compute curvature at point.
-//      std::cout << "pos : " << pos[0] << ' ' << pos[1] << ' ' << pos[2] << std::endl;
-        double mc = this->GetCurvature(pos, -1);
-        m_SurfaceMeanCurvature += mc;
-        datalist.push_back(mc);
-      }
+    for (auto it = crossings.rbegin(); it != crossings.rend(); ++it) {
+      // Project point to surface.
+      PointType pos = *it;
+      this->ApplyConstraints(pos);
+
+      // Compute curvature at point.
+      double mc = this->GetCurvature(pos, -1);
+      m_SurfaceMeanCurvature += mc;
+      datalist.push_back(mc);
     }
     double n = static_cast<double>(datalist.size());
     m_SurfaceMeanCurvature /= n;
@@ -52,6 +52,7 @@ public:
     const auto grad = this->GetVDBGradient();
 
     // Compute the gradient of normals component-wise
+    openvdb::VectorGrid::Ptr grad_norms[3];
     for(int i=0; i<3; i++) {
       auto norm_i = openvdb::FloatGrid::create();
       norm_i->setTransform(this->transform());
@@ -61,10 +62,46 @@ public:
         norm_i_accessor.setValue(it.getCoord(), v[i] / v.length());
       }
 
-      m_VDBGradNorms[i] = openvdb::tools::gradient(*norm_i);
+      grad_norms[i] = openvdb::tools::gradient(*norm_i);
     }
+
+    PackGradN(grad_norms);
   } // end setimage
 
+  /** Append the gradient of normals to a cache, see ParticleImageDomain::SaveCache.  The
+      rows are stored as vector grids "gradn_0" to "gradn_2". */
+  void SaveCache(openvdb::GridPtrVec &grids, openvdb::MetaMap &meta) const
+  {
+    Superclass::SaveCache(grids, meta);
+    for(int i=0; i<3; i++) {
+      auto row = openvdb::VectorGrid::create();
+      row->setTransform(this->transform());
+      auto accessor = row->getAccessor();
+      for(openvdb::Int32Grid::ValueOnCIter it = m_VDBGradNIndex->cbeginValueOn(); it.test(); ++it) {
+        const float *v = &m_GradNValues[9 * static_cast<size_t>(*it) + 3 * i];
+        accessor.setValue(it.getCoord(), openvdb::Vec3f(v[0], v[1], v[2]));
+      }
+      this->AddCachedGrid(grids, row, "gradn_" + std::to_string(i));
+    }
+  }
+
+  /** Restore a domain saved by SaveCache, see ParticleImageDomain::LoadCache. */
+  bool LoadCache(const openvdb::GridPtrVec &grids, const openvdb::MetaMap &meta)
+  {
+    if (!Superclass::LoadCache(grids, meta)) {
+      return false;
+    }
+    openvdb::VectorGrid::Ptr grad_norms[3];
+    for(int i=0; i<3; i++) {
+      grad_norms[i] = this->template FindCachedGrid<openvdb::VectorGrid>(grids, "gradn_" + std::to_string(i));
+      if(!grad_norms[i]) {
+        return false;
+      }
+    }
+    PackGradN(grad_norms);
+    return true;
+  }
+
   /** Sample the GradN at a point.  This method performs no bounds checking.
       To check bounds, use IsInsideBuffer.  SampleGradN returns a vnl
       matrix of size VDimension x VDimension. */
@@ -72,21 +109,45 @@ public:
   {
     const auto coord = this->ToVDBCoord(p);
 
+    // Trilinear interpolation of all 9 components at once, equivalent to
+    // openvdb::tools::BoxSampler on each of the component grids.
+    const openvdb::Coord ijk = openvdb::Coord::floor(coord);
+    const openvdb::Vec3R uvw = coord - ijk.asVec3d();
+    const auto &accessor = m_VDBGradNIndexAccessor.Get();
+
+    double values[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+    for(int dz=0; dz<2; dz++) {
+      for(int dy=0; dy<2; dy++) {
+        for(int dx=0; dx<2; dx++) {
+          const int32_t offset = accessor.getValue(ijk.offsetBy(dx, dy, dz));
+          if(offset < 0) {
+            continue; // background, zero gradient
+          }
+          const double weight = (dx ? uvw[0] : 1.0 - uvw[0]) *
+                                (dy ? uvw[1] : 1.0 - uvw[1]) *
+                                (dz ? uvw[2] : 1.0 - uvw[2]);
+          const float *v = &m_GradNValues[9 * static_cast<size_t>(offset)];
+          for(int c=0; c<9; c++) {
+            values[c] += weight * v[c];
+          }
+        }
+      }
+    }
+
     GradNType grad_n;
     for(int i=0; i<3; i++) {
-      auto grad_ni = openvdb::tools::BoxSampler::sample(m_VDBGradNorms[i]->tree(), coord);
-      grad_n.set(i, 0, grad_ni[0]);
-      grad_n.set(i, 1, grad_ni[1]);
-      grad_n.set(i, 2, grad_ni[2]);
+      grad_n.set(i, 0, values[3 * i + 0]);
+      grad_n.set(i, 1, values[3 * i + 1]);
+      grad_n.set(i, 2, values[3 * i + 2]);
     }
     return grad_n;
   }
 
   void DeletePartialDerivativeImages() override
   {
-    for (unsigned int i = 0; i < DIMENSION; i++) {
-      m_VDBGradNorms[i] = 0;
-    }
+    m_VDBGradNIndex = 0;
+    m_VDBGradNIndexAccessor.SetGrid(m_VDBGradNIndex);
+    std::vector<float>().swap(m_GradNValues);
   }
 
   /** Used when a domain is fixed. */
@@ -107,7 +168,40 @@ protected:
 
   
 private:
-  typename openvdb::VectorGrid::Ptr m_VDBGradNorms[3];
+  // Pack the three component gradients into a single grid sharing one topology.  Each active
+  // voxel of the index grid stores the offset of its 3x3 matrix (row major) in m_GradNValues,
+  // so that one traversal yields the whole gradient of normals.
+  void PackGradN(const openvdb::VectorGrid::Ptr grad_norms[3])
+  {
+    m_VDBGradNIndex = openvdb::Int32Grid::create(-1);
+    m_VDBGradNIndex->setTransform(this->transform());
+    for(int i=0; i<3; i++) {
+      m_VDBGradNIndex->tree().topologyUnion(grad_norms[i]->tree());
+    }
+    m_VDBGradNIndex->tree().voxelizeActiveTiles();
+
+    m_GradNValues.clear();
+    m_GradNValues.reserve(9 * m_VDBGradNIndex->activeVoxelCount());
+    openvdb::Vec3SGrid::ConstAccessor accessors[3] = {grad_norms[0]->getConstAccessor(),
+                                                      grad_norms[1]->getConstAccessor(),
+                                                      grad_norms[2]->getConstAccessor()};
+    int32_t offset = 0;
+    for(openvdb::Int32Grid::ValueOnIter it = m_VDBGradNIndex->beginValueOn(); it.test(); ++it) {
+      const openvdb::Coord ijk = it.getCoord();
+      for(int i=0; i<3; i++) {
+        const openvdb::Vec3f& v = accessors[i].getValue(ijk);
+        m_GradNValues.push_back(v[0]);
+        m_GradNValues.push_back(v[1]);
+        m_GradNValues.push_back(v[2]);
+      }
+      it.setValue(offset++);
+    }
+    m_VDBGradNIndexAccessor.SetGrid(m_VDBGradNIndex);
+  }
+
+  openvdb::Int32Grid::Ptr m_VDBGradNIndex;
+  std::vector<float> m_GradNValues;
+  VDBThreadLocalAccessor<openvdb::Int32Grid> m_VDBGradNIndexAccessor;
 };
 
 } // end namespace itk
@@ -44,6 +44,23 @@ public:
   void SetImage(ImageType *I, double narrow_band) {
     ParticleImageDomain<T>::SetImage(I, narrow_band);
     m_VDBGradient = openvdb::tools::gradient(*this->GetVDBImage());
+    m_VDBGradientAccessor.SetGrid(m_VDBGradient);
+  }
+
+  /** Append the gradient to a cache, see ParticleImageDomain::SaveCache. */
+  void SaveCache(openvdb::GridPtrVec &grids, openvdb::MetaMap &meta) const {
+    ParticleImageDomain<T>::SaveCache(grids, meta);
+    this->AddCachedGrid(grids, m_VDBGradient, "gradient");
+  }
+
+  /** Restore a domain saved by SaveCache, see ParticleImageDomain::LoadCache. */
+  bool LoadCache(const openvdb::GridPtrVec &grids, const openvdb::MetaMap &meta) {
+    if (!ParticleImageDomain<T>::LoadCache(grids, meta)) {
+      return false;
+    }
+    m_VDBGradient = this->template FindCachedGrid<openvdb::VectorGrid>(grids, "gradient");
+    m_VDBGradientAccessor.SetGrid(m_VDBGradient);
+    return m_VDBGradient != nullptr;
   }
 
   inline vnl_vector_fixed<float, DIMENSION> SampleGradientAtPoint(const PointType &p, int idx) const {
@@ -73,6 +90,7 @@ public:
   {
     ParticleImageDomain<T>::DeleteImages();
     m_VDBGradient = 0;
+    m_VDBGradientAccessor.SetGrid(m_VDBGradient);
   }
   
 protected:
@@ -104,7 +122,7 @@ private:
   inline VectorType SampleGradient(const PointType &p, int idx) const {
     if (this->IsInsideBuffer(p)) {
       const auto coord = this->ToVDBCoord(p);
-      const auto _v = openvdb::tools::BoxSampler::sample(m_VDBGradient->tree(), coord);
+      const auto _v = openvdb::tools::BoxSampler::sample(m_VDBGradientAccessor.Get(), coord);
       const VectorType v(_v.asPointer()); // This copies 3 floats from a VDB vector to a vnl vector
       return v;
     }
@@ -115,6 +133,7 @@ private:
 
 
   openvdb::VectorGrid::Ptr m_VDBGradient;
+  VDBThreadLocalAccessor<openvdb::VectorGrid> m_VDBGradientAccessor;
 };
 
 } // end namespace itk
@@ -74,6 +74,17 @@ public:
     this->ComputeMeanCurvature(ps, event.GetPositionIndex(), event.GetDomainIndex());
   }
   
+  virtual void PositionSetBatchEventCallback(Object *o, const EventObject &e)
+  {
+    const ParticlePositionSetBatchEvent &event = dynamic_cast<const ParticlePositionSetBatchEvent &>(e);
+    const ParticleSystemType *ps= dynamic_cast<const ParticleSystemType *>(o);
+    const int end = event.GetPositionIndex() + event.GetNumberOfPositions();
+    for (int idx = event.GetPositionIndex(); idx < end; idx++)
+      {
+      this->ComputeMeanCurvature(ps, idx, event.GetDomainIndex());
+      }
+  }
+
   virtual void DomainAddEventCallback(Object *o, const EventObject &e)
   {
     Superclass::DomainAddEventCallback(o, e);
@@ -109,6 +120,7 @@ protected:
   ParticleMeanCurvatureAttribute()
   {
     this->m_DefinedCallbacks.PositionSetEvent = true;
+    this->m_DefinedCallbacks.PositionSetBatchEvent = true;
     this->m_DefinedCallbacks.DomainAddEvent = true;
   }
   virtual ~ParticleMeanCurvatureAttribute() {};
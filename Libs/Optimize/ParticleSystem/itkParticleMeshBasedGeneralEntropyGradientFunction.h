@@ -11,6 +11,7 @@
 #include <numeric>
 #include "itkParticleGeneralShapeMatrix.h"
 #include "itkParticleGeneralShapeGradientMatrix.h"
+#include "itkParticleGramEigensystem.h"
 
 namespace itk
 {
@@ -39,6 +40,7 @@ public:
     typedef typename ParticleSystemType::PointType PointType;
     typedef vnl_vector<DataType> vnl_vector_type;
     typedef vnl_matrix<DataType> vnl_matrix_type;
+    typedef Eigen::Matrix<DataType, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMajorMatrix;
 
     /** Method for creation through the object factory. */
     itkNewMacro(Self)
@@ -131,6 +133,18 @@ public:
     int GetRecomputeCovarianceInterval() const
     { return m_RecomputeCovarianceInterval; }
 
+    /** Set/Get the number of updates between two full eigen decompositions
+        of the Gram matrix, and the relative drift of the shape data that
+        forces an early refresh.  See ParticleGramEigensystem. */
+    void SetEigensystemRefreshInterval(int i)
+    { m_GramEigensystem.SetRefreshInterval(i); }
+    int GetEigensystemRefreshInterval() const
+    { return m_GramEigensystem.GetRefreshInterval(); }
+    void SetEigensystemDriftTolerance(double d)
+    { m_GramEigensystem.SetDriftTolerance(d); }
+    double GetEigensystemDriftTolerance() const
+    { return m_GramEigensystem.GetDriftTolerance(); }
+
     void SetAttributeScales( const std::vector<double> &s)
     { m_AttributeScales = s; }
 
@@ -182,35 +196,36 @@ public:
     {
         typename ParticleMeshBasedGeneralEntropyGradientFunction<VDimension>::Pointer copy =
                 ParticleMeshBasedGeneralEntropyGradientFunction<VDimension>::New();
-
-        // from itkParticleVectorFunction
-        copy->m_DomainNumber = this->m_DomainNumber;
-        copy->m_ParticleSystem = this->m_ParticleSystem;
-
-        // local
-        copy->m_AttributeScales = this->m_AttributeScales;
-        copy->m_Counter = this->m_Counter;
-        copy->m_CurrentEnergy = this->m_CurrentEnergy;
-        copy->m_HoldMinimumVariance = this->m_HoldMinimumVariance;
-        copy->m_MinimumEigenValue  = this->m_MinimumEigenValue;
-        copy->m_MinimumVariance = this->m_MinimumVariance;
-        copy->m_MinimumVarianceDecayConstant = this->m_MinimumVarianceDecayConstant;
-        copy->m_PointsUpdate = this->m_PointsUpdate;
-        copy->m_RecomputeCovarianceInterval = this->m_RecomputeCovarianceInterval;
-        copy->m_AttributesPerDomain = this->m_AttributesPerDomain;
-        copy->m_DomainsPerShape = this->m_DomainsPerShape;
-        copy->m_UseMeanEnergy = this->m_UseMeanEnergy;
-        copy->m_points_mean = this->m_points_mean;
-        copy->m_UseNormals = this->m_UseNormals;
-        copy->m_UseXYZ = this->m_UseXYZ;
-        copy->m_InverseCovMatrix = this->m_InverseCovMatrix;
-
-        copy->m_ShapeData = this->m_ShapeData;
-        copy->m_ShapeGradient = this->m_ShapeGradient;
-
+        copy->ResetState(this, this->m_DomainNumber);
         return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
     }
 
+    virtual void ResetState(const ParticleVectorFunction<VDimension> *source, unsigned int d)
+    {
+        Superclass::ResetState(source, d);
+        const Self *s = static_cast<const Self *>(source);
+
+        m_AttributeScales = s->m_AttributeScales;
+        m_Counter = s->m_Counter;
+        m_CurrentEnergy = s->m_CurrentEnergy;
+        m_HoldMinimumVariance = s->m_HoldMinimumVariance;
+        m_MinimumEigenValue = s->m_MinimumEigenValue;
+        m_MinimumVariance = s->m_MinimumVariance;
+        m_MinimumVarianceDecayConstant = s->m_MinimumVarianceDecayConstant;
+        m_PointsUpdate = s->m_PointsUpdate;
+        m_RecomputeCovarianceInterval = s->m_RecomputeCovarianceInterval;
+        m_AttributesPerDomain = s->m_AttributesPerDomain;
+        m_DomainsPerShape = s->m_DomainsPerShape;
+        m_UseMeanEnergy = s->m_UseMeanEnergy;
+        m_points_mean = s->m_points_mean;
+        m_UseNormals = s->m_UseNormals;
+        m_UseXYZ = s->m_UseXYZ;
+        m_InverseCovMatrix = s->m_InverseCovMatrix;
+
+        m_ShapeData = s->m_ShapeData;
+        m_ShapeGradient = s->m_ShapeGradient;
+    }
+
 protected:
     ParticleMeshBasedGeneralEntropyGradientFunction()
     {
@@ -238,6 +253,18 @@ protected:
     typename ShapeGradientType::Pointer m_ShapeGradient;
 
     virtual void ComputeUpdates(const ParticleSystemType *c);
+
+    /** Number of rows of the shape data per particle of domain d. */
+    int GetValuesPerParticle(int d) const
+    {
+        int n = m_AttributesPerDomain[d];
+        if (m_UseXYZ[d])
+            n += 3;
+        if (m_UseNormals[d])
+            n += 3;
+        return n;
+    }
+
     std::shared_ptr<vnl_matrix_type> m_PointsUpdate;
 
     double m_MinimumVariance;
@@ -256,6 +283,7 @@ protected:
     std::vector<bool> m_UseNormals;
     std::shared_ptr<vnl_matrix_type> m_points_mean;
     std::shared_ptr<vnl_matrix_type> m_InverseCovMatrix;
+    ParticleGramEigensystem m_GramEigensystem;
     int num_dims, num_samples;
 };
 } // end namespace
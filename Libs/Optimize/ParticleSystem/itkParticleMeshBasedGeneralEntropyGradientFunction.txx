@@ -16,6 +16,9 @@
 #include "itkParticleImageDomainWithGradients.h"
 #include "itkParticleImageDomainWithGradN.h"
 #include "Libs/Utils/Utils.h"
+#include <Eigen/Eigen>
+#include <tbb/parallel_for.h>
+#include <algorithm>
 
 namespace itk
 {
@@ -38,17 +41,19 @@ ParticleMeshBasedGeneralEntropyGradientFunction<VDimension>
 
     m_PointsUpdate->fill(0.0);
 
-    vnl_matrix_type points_minus_mean(num_dims, num_samples, 0.0);
+    vnl_matrix_type points_minus_mean(num_dims, num_samples);
 
     m_points_mean->clear();
     m_points_mean->set_size(num_dims,1);
-    m_points_mean->fill(0.0);
 
-    for (unsigned int i = 0; i < num_dims; i++)
-    {
-        m_points_mean->put(i,0, (m_ShapeData->get_n_rows(i, 1)).mean());
-        points_minus_mean.set_row(i, m_ShapeData->get_row(i) - m_points_mean->get(i,0) );
-    }
+    // The dense products below run in Eigen on views of the (row major) vnl
+    // storage, using its blocked and multithreaded GEMM kernels.
+    Eigen::Map<const RowMajorMatrix> shape(m_ShapeData->data_block(), num_dims, num_samples);
+    Eigen::Map<RowMajorMatrix> Y(points_minus_mean.data_block(), num_dims, num_samples);
+    Eigen::Map<Eigen::VectorXd> mean(m_points_mean->data_block(), num_dims);
+
+    mean = shape.rowwise().mean();
+    Y = shape.colwise() - mean;
 
 //    if (this->CheckForNans(points_minus_mean))
 //        std::cout << "MGEG: 1. Nans exist!!!" << std::endl;
@@ -57,12 +62,11 @@ ParticleMeshBasedGeneralEntropyGradientFunction<VDimension>
 
     vnl_diag_matrix<double> W;
 
-    vnl_matrix_type gramMat(num_samples, num_samples, 0.0);
-    vnl_matrix_type pinvMat(num_samples, num_samples, 0.0); //gramMat inverse
+    RowMajorMatrix Q; // points_minus_mean * pinv(gramMat)
 
     if (this->m_UseMeanEnergy)
     {
-        pinvMat.set_identity();
+        Q = Y;
         m_InverseCovMatrix->clear();
     }
     else
@@ -82,28 +86,51 @@ ParticleMeshBasedGeneralEntropyGradientFunction<VDimension>
 //        pinvMat = (V * invLambda) * V.transpose();
 //        m_InverseCovMatrix = (U * invLambda) * U.transpose();
 
-        gramMat = points_minus_mean.transpose()* points_minus_mean;
-
-        vnl_svd <double> svd(gramMat);
-
-        vnl_matrix_type UG = svd.U();
-        W = svd.W();
+        // Eigen decomposition of the Gram matrix, either from scratch or
+        // updated from the last refresh (see ParticleGramEigensystem).
+        vnl_matrix_type projMat;
+        m_GramEigensystem.Update(points_minus_mean, projMat);
 
-        vnl_diag_matrix<double> invLambda = svd.W();
-        invLambda.set_diagonal(invLambda.get_diagonal()/(double)(num_samples-1) + m_MinimumVariance);
-        invLambda.invert_in_place();
+        const vnl_matrix_type &UG = m_GramEigensystem.GetBasis();
+        W = vnl_diag_matrix<double>(m_GramEigensystem.GetEigenvalues());
 
-        pinvMat = (UG * invLambda) * UG.transpose();
+        Eigen::VectorXd invLambda(num_samples);
+        for (unsigned int i = 0; i < num_samples; i++)
+        {
+            invLambda[i] = 1.0 / (W(i)/(double)(num_samples-1) + m_MinimumVariance);
+        }
 
-        vnl_matrix_type projMat = points_minus_mean * UG;
-        const auto lhs = projMat * invLambda;
-        const auto rhs = invLambda * projMat.transpose(); // invLambda doesn't need to be transposed since its a diagonal matrix
-        m_InverseCovMatrix->set_size(num_dims, num_dims);
-        Utils::multiply_into(*m_InverseCovMatrix, lhs, rhs);
+        Eigen::Map<const RowMajorMatrix> proj(projMat.data_block(), num_dims, num_samples);
+        Eigen::Map<const RowMajorMatrix> basis(UG.data_block(), num_samples, num_samples);
+        const RowMajorMatrix lhs = proj * invLambda.asDiagonal();
+
+        // Y * pinv(Gram) = Y * U * invLambda * U^T = lhs * U^T, which avoids
+        // forming the num_samples x num_samples pseudo inverse.
+        Q.noalias() = lhs * basis.transpose();
+
+        // Evaluate() only needs the diagonal block of (lhs * lhs^T) belonging to
+        // each particle, whose size is the number of values per particle of its
+        // domain.  Store just those blocks stacked vertically, left aligned in
+        // num_dims x (largest block size), instead of the full num_dims x num_dims
+        // matrix.
+        int block_cols = 0;
+        for (int d = 0; d < m_DomainsPerShape; d++)
+            block_cols = std::max(block_cols, this->GetValuesPerParticle(d));
+        m_InverseCovMatrix->set_size(num_dims, block_cols);
+        m_InverseCovMatrix->fill(0.0);
+        Eigen::Map<RowMajorMatrix> invCov(m_InverseCovMatrix->data_block(), num_dims, block_cols);
+        int row = 0;
+        for (int d = 0; d < m_DomainsPerShape; d++)
+        {
+            const int sz = this->GetValuesPerParticle(d);
+            for (unsigned int p = 0; p < c->GetNumberOfParticles(d) && row + sz <= num_dims; p++, row += sz)
+            {
+                const auto block = lhs.middleRows(row, sz);
+                invCov.block(row, 0, sz, sz).noalias() = block * block.transpose();
+            }
+        }
     }
 
-    vnl_matrix_type Q = points_minus_mean * pinvMat;
-
 //    if (this->CheckForNans(Q))
 //        std::cout << "MGEG: 2. Nans exist!!!" << std::endl;
 //    else
@@ -114,10 +141,15 @@ ParticleMeshBasedGeneralEntropyGradientFunction<VDimension>
     // Jacobian.  Each shape gradient must be transformed by a different Jacobian
     // so we have to do this individually for each shape (sample).
 
-    {
-    vnl_matrix_type Jmatrix;
-    vnl_matrix_type v;
-    for (int j = 0; j < num_samples; j++)
+    // The shapes are independent, each one writes its own column of the
+    // update matrix.
+    Eigen::Map<const RowMajorMatrix> gradient(m_ShapeGradient->data_block(),
+                                              m_ShapeGradient->rows(), m_ShapeGradient->cols());
+    Eigen::Map<RowMajorMatrix> pointsUpdate(m_PointsUpdate->data_block(), rows, num_samples);
+    tbb::parallel_for(
+      tbb::blocked_range<int>{0, num_samples},
+      [&](const tbb::blocked_range<int> &r) {
+    for (int j = r.begin(); j < r.end(); j++)
     {
         int num = 0;
         int num2 = 0;
@@ -143,26 +175,18 @@ ParticleMeshBasedGeneralEntropyGradientFunction<VDimension>
                 if (m_UseNormals[d])
                     num_attr += 3;
 
-                Jmatrix.clear();
-                Jmatrix.set_size(num_attr, VDimension);
-                Jmatrix.fill(0.0);
-                v.clear();
-                v.set_size(num_attr, 1);
-                v.fill(0.0);
-
                 for (unsigned int p = 0; p < c->GetNumberOfParticles(dom); p++)
                 {
-                    v = Q.extract( num_attr, 1, num + p*num_attr, j );
-                    Jmatrix = m_ShapeGradient->extract( num_attr, 3, num + p*num_attr, 3*j );
-
-                    vnl_matrix_type dx = Jmatrix.transpose() * v;
+                    const int row = num + p*num_attr;
+                    const Eigen::Vector3d dx = gradient.block(row, 3*j, num_attr, 3).transpose()
+                                               * Q.block(row, j, num_attr, 1);
                     for (unsigned int vd = 0; vd < VDimension; vd++)
-                        m_PointsUpdate->put(num2 + p*VDimension + vd, j, dx(vd, 0));
+                        pointsUpdate(num2 + p*VDimension + vd, j) = dx(vd);
                 }
             }
         }
     }
-    }
+      });
 
 //    if (this->CheckForNans(m_PointsUpdate))
 //        std::cout << "MGEG: 3. Nans exist!!!" << std::endl;
@@ -215,33 +239,19 @@ ParticleMeshBasedGeneralEntropyGradientFunction<VDimension>
     int dom = d % m_DomainsPerShape; //domain number within shape
     int sampNum = d/m_DomainsPerShape; //shape number
 
-    int sz_Yidx = 0;
-    if (m_UseXYZ[dom])
-        sz_Yidx += 3;
-    if (m_UseNormals[dom])
-        sz_Yidx += 3;
-    sz_Yidx += m_AttributesPerDomain[dom];
+    const int sz_Yidx = this->GetValuesPerParticle(dom);
 
     int num = sz_Yidx * idx;
 
     for (unsigned int i = 0; i < dom; i++)
-    {
-        int num1 = 0;
-        if (m_UseXYZ[i])
-            num1 += 3;
-        if (m_UseNormals[i])
-            num1 += 3;
-        num1 += m_AttributesPerDomain[i];
-
-        num += num1 * system->GetNumberOfParticles(i);
-    }
+        num += this->GetValuesPerParticle(i) * system->GetNumberOfParticles(i);
 
     vnl_matrix_type tmp1(sz_Yidx, sz_Yidx, 0.0);
 
     if (this->m_UseMeanEnergy)
         tmp1.set_identity();
     else
-        tmp1 = m_InverseCovMatrix->extract(sz_Yidx, sz_Yidx, num, num);
+        tmp1 = m_InverseCovMatrix->extract(sz_Yidx, sz_Yidx, num, 0);
 
     vnl_matrix_type Y_dom_idx(sz_Yidx, 1, 0.0);
 
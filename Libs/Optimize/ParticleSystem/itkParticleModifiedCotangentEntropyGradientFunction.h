@@ -154,18 +154,16 @@ public:
     virtual typename ParticleVectorFunction<VDimension>::Pointer Clone()
     {
         typename ParticleModifiedCotangentEntropyGradientFunction<TGradientNumericType, VDimension>::Pointer copy = ParticleModifiedCotangentEntropyGradientFunction<TGradientNumericType, VDimension>::New();
-        copy->SetParticleSystem(this->GetParticleSystem());
-        copy->m_GlobalSigma = this->m_GlobalSigma;
-
-        copy->m_MinimumNeighborhoodRadius = this->m_MinimumNeighborhoodRadius;
-        copy->m_MaximumNeighborhoodRadius = this->m_MaximumNeighborhoodRadius;
-        copy->m_FlatCutoff = this->m_FlatCutoff;
-        copy->m_NeighborhoodToSigmaRatio = this->m_NeighborhoodToSigmaRatio;
+        copy->ResetState(this, this->m_DomainNumber);
+        return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+    }
 
-        copy->m_DomainNumber = this->m_DomainNumber;
-        copy->m_ParticleSystem = this->m_ParticleSystem;
+    virtual void ResetState(const ParticleVectorFunction<VDimension> *source, unsigned int d)
+    {
+        Superclass::ResetState(source, d);
+        const Self *s = static_cast<const Self *>(source);
 
-        return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
+        m_GlobalSigma = s->m_GlobalSigma;
     }
 
 protected:
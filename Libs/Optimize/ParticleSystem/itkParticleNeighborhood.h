@@ -86,10 +86,21 @@ public:
   {
     itkExceptionMacro("No algorithm for finding neighbors has been specified.");
   }
-  virtual unsigned int  FindNeighborhoodPoints(const PointType &, int idx, double, PointVectorType &) const
+
+  /** Variants of the methods above that write their results into
+      caller-provided buffers, so that repeated queries can reuse the
+      allocations.  The default implementations forward to the methods above. */
+  virtual unsigned int  FindNeighborhoodPoints(const PointType &p, int idx, double radius,
+                                               PointVectorType &ret) const
   {
-    itkExceptionMacro("No algorithm for finding neighbors has been specified.");
-    return 0;
+    ret = this->FindNeighborhoodPoints(p, idx, radius);
+    return static_cast<unsigned int>(ret.size());
+  }
+  virtual unsigned int  FindNeighborhoodPoints(const PointType &p, int idx, std::vector<double> &weights,
+                                               double radius, PointVectorType &ret) const
+  {
+    ret = this->FindNeighborhoodPoints(p, idx, weights, radius);
+    return static_cast<unsigned int>(ret.size());
   }
 
   /** Set the Domain that this neighborhood will use.  The Domain object is
@@ -175,31 +175,29 @@ public:
   virtual typename ParticleVectorFunction<VDimension>::Pointer Clone()
   {
     typename ParticleOmegaGradientFunction<TGradientNumericType, VDimension>::Pointer copy = ParticleOmegaGradientFunction<TGradientNumericType, VDimension>::New();
-    copy->SetParticleSystem(this->GetParticleSystem());
-    copy->m_Counter = this->m_Counter;
-    copy->m_Rho = this->m_Rho;
-    copy->m_avgKappa = this->m_avgKappa;
-    copy->m_CurrentSigma = this->m_CurrentSigma;
-    copy->m_CurrentWeights = this->m_CurrentWeights;
-    copy->m_CurrentNeighborhood = this->m_CurrentNeighborhood;
-
-    copy->m_MinimumNeighborhoodRadius = this->m_MinimumNeighborhoodRadius;
-    copy->m_MaximumNeighborhoodRadius = this->m_MaximumNeighborhoodRadius;
-    copy->m_FlatCutoff = this->m_FlatCutoff;
-    copy->m_NeighborhoodToSigmaRatio = this->m_NeighborhoodToSigmaRatio;
-
-    copy->m_SpatialSigmaCache = this->m_SpatialSigmaCache;
-    copy->m_MeanCurvatureCache = this->m_MeanCurvatureCache;
-
-    copy->m_DomainNumber = this->m_DomainNumber;
-    copy->m_ParticleSystem = this->m_ParticleSystem;
-    copy->planePts = this->planePts;
-    copy->spherePts = this->spherePts;
-    copy->CToP = this->CToP;
-
+    copy->ResetState(this, this->m_DomainNumber);
     return (typename ParticleVectorFunction<VDimension>::Pointer)copy;
   }
 
+  virtual void ResetState(const ParticleVectorFunction<VDimension> *source, unsigned int d)
+  {
+    Superclass::ResetState(source, d);
+    const Self *s = static_cast<const Self *>(source);
+
+    m_Counter = s->m_Counter;
+    m_Rho = s->m_Rho;
+    m_avgKappa = s->m_avgKappa;
+    m_MeanCurvatureCache = s->m_MeanCurvatureCache;
+    planePts = s->planePts;
+    spherePts = s->spherePts;
+    CToP = s->CToP;
+
+    // computed for each particle by BeforeEvaluate
+    m_CurrentSigma = 0.0;
+    m_CurrentWeights.clear();
+    m_CurrentNeighborhood.clear();
+  }
+
 protected:
   ParticleOmegaGradientFunction() :  m_Counter(0),
                                                m_Rho(1.0) {}
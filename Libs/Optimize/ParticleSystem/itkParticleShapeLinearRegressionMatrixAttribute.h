@@ -18,6 +18,8 @@
 #include "itkParticleShapeMatrixAttribute.h"
 #include "vnl/vnl_vector.h"
 #include "itkParticleSystem.h"
+#include <Eigen/Eigen>
+#include <algorithm>
 
 namespace itk
 {
@@ -38,6 +40,9 @@ public:
   typedef SmartPointer<Self>  Pointer;
   typedef SmartPointer<const Self>  ConstPointer;
   typedef WeakPointer<const Self>  ConstWeakPointer;
+
+  /** Row major Eigen matrix, matching the layout of vnl_matrix. */
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMajorMatrix;
   
   /** Method for creation through the object factory. */
   itkNewMacro(Self);
@@ -48,12 +53,15 @@ public:
   
   void UpdateMeanMatrix()
   {
-    // for each sample
-    for (unsigned int i = 0; i < m_MeanMatrix.cols(); i++)
-      {
-      // compute the mean
-      m_MeanMatrix.set_column(i, m_Intercept + m_Slope * m_Expl(i));
-      }
+    // the mean of each sample is intercept + slope * t
+    const unsigned int nr = std::min<unsigned int>(m_MeanMatrix.rows(), m_Slope.size());
+    const unsigned int nc = m_MeanMatrix.cols();
+    Eigen::Map<RowMajorMatrix> mean(m_MeanMatrix.data_block(), m_MeanMatrix.rows(), nc);
+    Eigen::Map<const Eigen::VectorXd> t(m_Expl.data_block(), nc);
+    Eigen::Map<const Eigen::VectorXd> slope(m_Slope.data_block(), nr);
+    Eigen::Map<const Eigen::VectorXd> intercept(m_Intercept.data_block(), nr);
+    mean.topRows(nr).noalias() = slope * t.transpose();
+    mean.topRows(nr).colwise() += intercept;
   }
   
   inline vnl_vector<double> ComputeMean(double k) const
@@ -71,7 +79,8 @@ public:
     m_Slope.set_size(n);
     
     // Copy old data into new vector.
-    for (unsigned int r = 0; r < tmpA.size(); r++)
+    const unsigned int nr = std::min(n, static_cast<unsigned int>(tmpA.size()));
+    for (unsigned int r = 0; r < nr; r++)
       {
       m_Intercept(r) = tmpA(r);
       m_Slope(r) = tmpB(r);
@@ -80,23 +89,22 @@ public:
   
   virtual void ResizeMeanMatrix(int rs, int cs)
   {
-    vnl_matrix<T> tmp = m_MeanMatrix; // copy existing  matrix
-    
-    // Create new column (shape)
-    m_MeanMatrix.set_size(rs, cs);
-    
-    m_MeanMatrix.fill(0.0);
+    if (rs == static_cast<int>(m_MeanMatrix.rows()) && cs == static_cast<int>(m_MeanMatrix.cols()))
+      {
+      return;
+      }
     
-    // Copy old data into new matrix.
-    for (unsigned int c = 0; c < tmp.cols(); c++)
+    // Create new matrix and copy the overlapping block of the old data.
+    vnl_matrix<T> tmp(rs, cs, T(0));
+    const unsigned int nr = std::min(static_cast<unsigned int>(rs), m_MeanMatrix.rows());
+    const unsigned int nc = std::min(static_cast<unsigned int>(cs), m_MeanMatrix.cols());
+    for (unsigned int r = 0; r < nr; r++)
       {
-      for (unsigned int r = 0; r < tmp.rows(); r++)
-        {
-        m_MeanMatrix(r,c) = tmp(r,c);
-        }
-      } 
+      std::copy(m_MeanMatrix[r], m_MeanMatrix[r] + nc, tmp[r]);
+      }
+    m_MeanMatrix.swap(tmp);
   }
-  
+
   void ResizeExplanatory(unsigned int n)
   {
     if (n > m_Expl.size())
@@ -146,16 +154,11 @@ public:
     
     const unsigned int PointsPerDomain = ps ->GetNumberOfParticles(d);
     
-    // Make sure we have enough rows.
-    if ((ps->GetNumberOfParticles(d) * VDimension * this->m_DomainsPerShape)
-        > this->rows())
-      {
-      this->ResizeParameters(PointsPerDomain * VDimension * this->m_DomainsPerShape);
-      this->ResizeMatrix(PointsPerDomain * VDimension * this->m_DomainsPerShape,
-                         this->cols());
-      this->ResizeMeanMatrix(PointsPerDomain * VDimension * this->m_DomainsPerShape,
-                             this->cols());
-      }
+    // Make sure we have enough rows, see ParticleGrowableMatrix::GrowRows.
+    const unsigned int numRows = PointsPerDomain * VDimension * this->m_DomainsPerShape;
+    const unsigned int reservedRows
+      = ps->GetReservedNumberOfParticles(d) * VDimension * this->m_DomainsPerShape;
+    this->GrowRows(numRows, reservedRows);
     
     // CANNOT ADD POSITION INFO UNTIL ALL POINTS PER DOMAIN IS KNOWN
     // Add position info to the matrix
@@ -180,6 +183,8 @@ public:
     const unsigned int idx = event.GetPositionIndex();
     const typename itk::ParticleSystem<VDimension>::PointType pos = ps->GetTransformedPosition(idx, d);
     const unsigned int PointsPerDomain = ps ->GetNumberOfParticles(d);
+
+    this->FinalizeResize();
     
     // Modify matrix info
     //    unsigned int k = VDimension * idx;
@@ -193,6 +198,33 @@ public:
       }
   }
   
+  virtual void PositionSetBatchEventCallback(Object *o, const EventObject &e)
+  {
+    const itk::ParticlePositionSetBatchEvent &event
+      = dynamic_cast <const itk::ParticlePositionSetBatchEvent &>(e);
+
+    const itk::ParticleSystem<VDimension> *ps
+      = dynamic_cast<const itk::ParticleSystem<VDimension> *>(o);
+    const int d = event.GetDomainIndex();
+    const unsigned int first = event.GetPositionIndex();
+    const unsigned int end = first + event.GetNumberOfPositions();
+    const unsigned int PointsPerDomain = ps ->GetNumberOfParticles(d);
+    const unsigned int col = d / this->m_DomainsPerShape;
+
+    this->FinalizeResize();
+
+    unsigned int k = ((d % this->m_DomainsPerShape) * PointsPerDomain * VDimension)
+      + (first * VDimension);
+    for (unsigned int idx = first; idx < end; idx++, k += VDimension)
+      {
+      const typename itk::ParticleSystem<VDimension>::PointType pos = ps->GetTransformedPosition(idx, d);
+      for (unsigned int i = 0; i < VDimension; i++)
+        {
+        this->operator()(i+k, col) = pos[i] - m_MeanMatrix(i+k, col);
+        }
+      }
+  }
+
   virtual void PositionRemoveEventCallback(Object *, const EventObject &) 
   {
     // NEED TO IMPLEMENT THIS
@@ -251,35 +283,29 @@ public:
     //    std::cout << "Estimating params" << std::endl;
     //    std::cout << "Explanatory: " << m_Expl << std::endl;
 
-    vnl_matrix<double> X = *this + m_MeanMatrix;
+    const unsigned int nr = this->rows();
+    const unsigned int num_samples = this->cols();
 
-    // Number of samples
-    double n = static_cast<double>(X.cols());
-    
-    vnl_vector<double> sumtx = m_Expl[0] * X.get_column(0);
-    vnl_vector<double> sumx = X.get_column(0);
-    double sumt = m_Expl[0];
-    double sumt2 = m_Expl[0] * m_Expl[0];    
-    for (unsigned int k = 1; k < X.cols(); k++)      // k is the sample number
-      {
-      sumtx += m_Expl[k] * X.get_column(k);
-      sumx  += X.get_column(k);
-      sumt  += m_Expl[k];
-      sumt2 += m_Expl[k] * m_Expl[k];      
-      }
+    Eigen::Map<const RowMajorMatrix> shape(this->data_block(), nr, num_samples);
+    Eigen::Map<const RowMajorMatrix> mean(m_MeanMatrix.data_block(), m_MeanMatrix.rows(), m_MeanMatrix.cols());
+    Eigen::Map<const Eigen::VectorXd> t(m_Expl.data_block(), num_samples);
+    const RowMajorMatrix X = shape + mean.topLeftCorner(nr, num_samples);
 
-    m_Slope = (n * sumtx - (sumx * sumt)) / (n * sumt2 - (sumt*sumt));
+    // Number of samples
+    const double n = static_cast<double>(num_samples);
 
+    // Least squares fit of every row of X against the explanatory variable.
+    const Eigen::VectorXd sumtx = X * t;
+    const Eigen::VectorXd sumx = X.rowwise().sum();
+    const double sumt = t.sum();
+    const double sumt2 = t.squaredNorm();
 
-    vnl_vector<double> sumbt = m_Slope * m_Expl[0];
-    for (unsigned int k = 1; k < X.cols(); k++)
-      {
-      sumbt += m_Slope * m_Expl[k];
-      }
-    
-    
-    m_Intercept = (sumx - sumbt) / n;
-    
+    m_Slope.set_size(nr);
+    m_Intercept.set_size(nr);
+    Eigen::Map<Eigen::VectorXd> slope(m_Slope.data_block(), nr);
+    Eigen::Map<Eigen::VectorXd> intercept(m_Intercept.data_block(), nr);
+    slope = (n * sumtx - sumt * sumx) / (n * sumt2 - (sumt*sumt));
+    intercept = (sumx - sumt * slope) / n;
   }
   
   // 
@@ -307,6 +333,15 @@ public:
   { return m_RegressionInterval; }
   
 protected:
+  /** The parameters and the mean matrix have one entry per row of the
+      shape matrix, so they are resized with it. */
+  virtual void ResizeRows(unsigned int rs)
+  {
+    this->ResizeParameters(rs);
+    this->ResizeMatrix(rs, this->cols());
+    this->ResizeMeanMatrix(rs, this->cols());
+  }
+
   ParticleShapeLinearRegressionMatrixAttribute() 
   {
     this->m_DefinedCallbacks.DomainAddEvent = true;
@@ -19,7 +19,7 @@
 #include "itkWeakPointer.h"
 #include "itkParticleAttribute.h"
 #include "itkParticleContainer.h"
-#include "vnl/vnl_matrix.h"
+#include "itkParticleGrowableMatrix.h"
 
 namespace itk
 {
@@ -34,7 +34,7 @@ namespace itk
  */
 template <class T, unsigned int VDimension>
 class ITK_EXPORT ParticleShapeMatrixAttribute
-        : public vnl_matrix<T>, public ParticleAttribute<VDimension>
+        : public ParticleGrowableMatrix<T>, public ParticleAttribute<VDimension>
 {
 public:
     /** Standard class typedefs */
@@ -64,21 +64,6 @@ public:
             this->ResizeMatrix(this->rows(), this->cols()+1);
     }
 
-    virtual void ResizeMatrix(int rs, int cs)
-    {
-        vnl_matrix<T> tmp(*this); // copy existing  matrix
-
-        // Create new column (shape)
-        this->set_size(rs, cs);
-
-        // Copy old data into new matrix.
-        for (unsigned int c = 0; c < tmp.cols(); c++)
-        {
-            for (unsigned int r = 0; r < tmp.rows(); r++)
-                this->operator()(r,c) = tmp(r,c);
-        }
-    }
-
     virtual void PositionAddEventCallback(Object *o, const EventObject &e)
     {
         const itk::ParticlePositionAddEvent &event = dynamic_cast<const itk::ParticlePositionAddEvent &>(e);
@@ -88,11 +73,14 @@ public:
         const typename itk::ParticleSystem<VDimension>::PointType pos = ps->GetTransformedPosition(idx, d);
 
         int numRows = 0;
+        int reservedRows = 0;
         for (int i = 0; i < m_DomainsPerShape; i++)
+        {
             numRows += VDimension * ps->GetNumberOfParticles(i);
+            reservedRows += VDimension * ps->GetReservedNumberOfParticles(i);
+        }
 
-        if (numRows > this->rows())
-            this->ResizeMatrix(numRows, this->cols());
+        this->GrowRows(numRows, reservedRows);
 
         unsigned int k = 0;
         int dom = d % m_DomainsPerShape;
@@ -112,6 +100,8 @@ public:
         const unsigned int idx = event.GetPositionIndex();
         const typename itk::ParticleSystem<VDimension>::PointType pos = ps->GetTransformedPosition(idx, d);
 
+        this->FinalizeResize();
+
         unsigned int k = 0;
         int dom = d % m_DomainsPerShape;
         for (int i = 0; i < dom; i++)
@@ -122,6 +112,32 @@ public:
             this->operator()(i+k, d / m_DomainsPerShape) = pos[i];
     }
 
+    virtual void PositionSetBatchEventCallback(Object *o, const EventObject &e)
+    {
+        const itk::ParticlePositionSetBatchEvent &event = dynamic_cast<const itk::ParticlePositionSetBatchEvent &>(e);
+        const itk::ParticleSystem<VDimension> *ps= dynamic_cast<const itk::ParticleSystem<VDimension> *>(o);
+        const int d = event.GetDomainIndex();
+        const unsigned int first = event.GetPositionIndex();
+        const unsigned int end = first + event.GetNumberOfPositions();
+
+        this->FinalizeResize();
+
+        // The rows of a domain are contiguous, so the offset is computed once.
+        unsigned int k = 0;
+        int dom = d % m_DomainsPerShape;
+        for (int i = 0; i < dom; i++)
+            k += VDimension * ps->GetNumberOfParticles(i);
+        k += first * VDimension;
+
+        const unsigned int col = d / m_DomainsPerShape;
+        for (unsigned int idx = first; idx < end; idx++, k += VDimension)
+        {
+            const typename itk::ParticleSystem<VDimension>::PointType pos = ps->GetTransformedPosition(idx, d);
+            for (unsigned int i = 0; i < VDimension; i++)
+                this->operator()(i+k, col) = pos[i];
+        }
+    }
+
     virtual void PositionRemoveEventCallback(Object *, const EventObject &)
     {
         // NEED TO IMPLEMENT THIS
@@ -169,17 +185,13 @@ public:
     virtual void BeforeIteration() {}
     virtual void AfterIteration() {}
 
-    virtual void SetMatrix(const vnl_matrix<T> &m)
-    {
-        vnl_matrix<T>::operator=(m);
-    }
-
 protected:
     ParticleShapeMatrixAttribute() : m_DomainsPerShape(1)
     {
         this->m_DefinedCallbacks.DomainAddEvent = true;
         this->m_DefinedCallbacks.PositionAddEvent = true;
         this->m_DefinedCallbacks.PositionSetEvent = true;
+        this->m_DefinedCallbacks.PositionSetBatchEvent = true;
         this->m_DefinedCallbacks.PositionRemoveEvent = true;
     }
     virtual ~ParticleShapeMatrixAttribute() {}
@@ -6,7 +6,9 @@
 #include "itkParticleShapeMatrixAttribute.h"
 #include "vnl/vnl_vector.h"
 #include "itkParticleSystem.h"
-#include "vnl/vnl_trace.h"
+#include <Eigen/Eigen>
+#include <tbb/parallel_for.h>
+#include <vector>
 
 namespace itk
 {
@@ -27,6 +29,9 @@ public:
   typedef SmartPointer<Self>  Pointer;
   typedef SmartPointer<const Self>  ConstPointer;
   typedef WeakPointer<const Self>  ConstWeakPointer;
+
+  /** Row major Eigen matrix, matching the layout of vnl_matrix. */
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMajorMatrix;
   
   /** Method for creation through the object factory. */
   itkNewMacro(Self);
@@ -67,7 +72,8 @@ public:
     m_Slope.set_size(n);
     
     // Copy old data into new vector.
-    for (unsigned int r = 0; r < tmpA.size(); r++)
+    const unsigned int nr = std::min(n, static_cast<unsigned int>(tmpA.size()));
+    for (unsigned int r = 0; r < nr; r++)
       {
       m_Intercept(r) = tmpA(r);
       m_Slope(r) = tmpB(r);
@@ -76,23 +82,22 @@ public:
   
   virtual void ResizeMeanMatrix(int rs, int cs)
   {
-    vnl_matrix<T> tmp = m_MeanMatrix; // copy existing  matrix
-    
-    // Create new column (shape)
-    m_MeanMatrix.set_size(rs, cs);
-    
-    m_MeanMatrix.fill(0.0);
+    if (rs == static_cast<int>(m_MeanMatrix.rows()) && cs == static_cast<int>(m_MeanMatrix.cols()))
+      {
+      return;
+      }
     
-    // Copy old data into new matrix.
-    for (unsigned int c = 0; c < tmp.cols(); c++)
+    // Create new matrix and copy the overlapping block of the old data.
+    vnl_matrix<T> tmp(rs, cs, T(0));
+    const unsigned int nr = std::min(static_cast<unsigned int>(rs), m_MeanMatrix.rows());
+    const unsigned int nc = std::min(static_cast<unsigned int>(cs), m_MeanMatrix.cols());
+    for (unsigned int r = 0; r < nr; r++)
       {
-      for (unsigned int r = 0; r < tmp.rows(); r++)
-        {
-        m_MeanMatrix(r,c) = tmp(r,c);
-        }
-      } 
+      std::copy(m_MeanMatrix[r], m_MeanMatrix[r] + nc, tmp[r]);
+      }
+    m_MeanMatrix.swap(tmp);
   }
-  
+
   void ResizeExplanatory(unsigned int n)
   {
     if (n > m_Expl.size())
@@ -142,15 +147,11 @@ public:
     
     const unsigned int PointsPerDomain = ps ->GetNumberOfParticles(d);
     
-    // Make sure we have enough rows.
-    if ( (ps->GetNumberOfParticles(d) * VDimension * this->m_DomainsPerShape) > this->rows() )
-      {
-      this->ResizeParameters(PointsPerDomain * VDimension * this->m_DomainsPerShape);
-      this->ResizeMatrix(PointsPerDomain * VDimension * this->m_DomainsPerShape,
-                         this->cols());
-      this->ResizeMeanMatrix(PointsPerDomain * VDimension * this->m_DomainsPerShape,
-                             this->cols());
-      }
+    // Make sure we have enough rows, see ParticleGrowableMatrix::GrowRows.
+    const unsigned int numRows = PointsPerDomain * VDimension * this->m_DomainsPerShape;
+    const unsigned int reservedRows
+      = ps->GetReservedNumberOfParticles(d) * VDimension * this->m_DomainsPerShape;
+    this->GrowRows(numRows, reservedRows);
     
     // CANNOT ADD POSITION INFO UNTIL ALL POINTS PER DOMAIN IS KNOWN
     // Add position info to the matrix
@@ -175,6 +176,8 @@ public:
     const unsigned int idx = event.GetPositionIndex();
     const typename itk::ParticleSystem<VDimension>::PointType pos = ps->GetTransformedPosition(idx, d);
     const unsigned int PointsPerDomain = ps ->GetNumberOfParticles(d);
+
+    this->FinalizeResize();
     
     // Modify matrix info
     //    unsigned int k = VDimension * idx;
@@ -188,6 +191,33 @@ public:
       }
   }
   
+  virtual void PositionSetBatchEventCallback(Object *o, const EventObject &e)
+  {
+    const itk::ParticlePositionSetBatchEvent &event
+      = dynamic_cast <const itk::ParticlePositionSetBatchEvent &>(e);
+
+    const itk::ParticleSystem<VDimension> *ps
+      = dynamic_cast<const itk::ParticleSystem<VDimension> *>(o);
+    const int d = event.GetDomainIndex();
+    const unsigned int first = event.GetPositionIndex();
+    const unsigned int end = first + event.GetNumberOfPositions();
+    const unsigned int PointsPerDomain = ps ->GetNumberOfParticles(d);
+    const unsigned int col = d / this->m_DomainsPerShape;
+
+    this->FinalizeResize();
+
+    unsigned int k = ((d % this->m_DomainsPerShape) * PointsPerDomain * VDimension)
+      + (first * VDimension);
+    for (unsigned int idx = first; idx < end; idx++, k += VDimension)
+      {
+      const typename itk::ParticleSystem<VDimension>::PointType pos = ps->GetTransformedPosition(idx, d);
+      for (unsigned int i = 0; i < VDimension; i++)
+        {
+        this->operator()(i+k, col) = pos[i] - m_MeanMatrix(i+k, col);
+        }
+      }
+  }
+
   virtual void PositionRemoveEventCallback(Object *, const EventObject &) 
   {
     // NEED TO IMPLEMENT THIS
@@ -262,119 +292,88 @@ public:
     //    std::cout << "Estimating params" << std::endl;
     //    std::cout << "Explanatory: " << m_Expl << std::endl;
 
-    vnl_matrix<double> X = *this + m_MeanMatrix;
-    	
-    // Number of samples
-    int num_shapes = static_cast<double>(X.cols());
-    this->m_NumIndividuals = num_shapes / this->GetTimeptsPerIndividual();
-    int nr = X.rows(); //number of points*3
-    	
-	//set the sizes of random slope and intercept matrix
-	m_SlopeRand.set_size(m_NumIndividuals, nr); //num_groups X num_points*3
-	m_InterceptRand.set_size(m_NumIndividuals, nr); //num_groups X num_points*3
-  	
-	vnl_matrix<double> fixed; //slopes + intercepts for all points
-	vnl_matrix<double> random; //slopes + intercepts for all groups, for all points
-	fixed.set_size(2, nr);
-	random.set_size(2, nr*m_NumIndividuals);
-    vnl_matrix<double> Ds(2,2); //covariance matrix of random parameters (2x2)
-	Ds.set_identity();  //initialize to identity
-	double sigma2s = 1;  //variance of error
-    vnl_matrix<double> identity_n;
-	identity_n.set_size(m_TimeptsPerIndividual, m_TimeptsPerIndividual);
-	identity_n.set_identity();
-	vnl_matrix<double> identity_2;
-	identity_2.set_size(2,2);
-	identity_2.set_identity();
-	vnl_matrix<double> *Ws=NULL, *Vs=NULL;
-	Ws = new vnl_matrix<double>[m_NumIndividuals];
-	Vs = new vnl_matrix<double>[m_NumIndividuals];
-	for (int i = 0; i < m_NumIndividuals; i++)
-	{
-		Vs[i].set_size(m_TimeptsPerIndividual, m_TimeptsPerIndividual); 
-		Ws[i].set_size(m_TimeptsPerIndividual, m_TimeptsPerIndividual);
-	}
-	
-	vnl_matrix<double> sum_mat1(2,2,0);
-    vnl_vector<double> sum_mat2(2); sum_mat2.fill(0.0);
-	vnl_vector<double> residual; residual.set_size(m_TimeptsPerIndividual); residual.fill(0.0);
-	double ecorr = 0.0;
-	double tracevar = 0.0;
-	vnl_matrix<double> bscorr(2,2,0.0); 
-	vnl_matrix<double> bsvar(2,2,0.0);
-    vnl_matrix<double> Xp; Xp.set_size(m_TimeptsPerIndividual, 2);
-	vnl_vector<double> y; y.set_size(m_TimeptsPerIndividual);
-	vnl_vector<double> tempvect; tempvect.set_size(2);
-	for (int i = 0; i < nr; i++) //for all points (x,y,z coordinates)
-	{
-		sigma2s = 1.0;
-		Ds.set_identity();
-		for (int j = 0; j < 50; j++) //EM iterations
-		{
-			sum_mat1.fill(0.0); sum_mat2.fill(0.0);
-			residual.fill(0.0);
-			ecorr = 0.0; 
-			tracevar = 0.0;
-			bscorr.fill(0.0);
-			bsvar.fill(0.0);
-			for (int k = 0; k < m_NumIndividuals; k++)
-			{
-				for (int l = 0; l < m_TimeptsPerIndividual; l++)
-				{
-					Xp(l,0) = m_Expl(k*m_TimeptsPerIndividual + l);
-					Xp(l,1) = 1;
-					y(l) = X(i, k*m_TimeptsPerIndividual + l);
-				}
-				Vs[k] = (identity_n * sigma2s) + Xp * Ds * vnl_transpose(Xp);
-				//Ws = static_cast<vnl_matrix> (vnl_matrix_inverse<double>(Vs));
-				Ws[k] = vnl_inverse(Vs[k]);
-				sum_mat1 = sum_mat1 + vnl_transpose(Xp) * Ws[k] * Xp;
-				sum_mat2 = sum_mat2 + vnl_transpose(Xp) * Ws[k] * y;
-			}
-			tempvect = vnl_inverse(sum_mat1) * sum_mat2; 
-			fixed.set_column(i, tempvect);
-			for (int k = 0; k < m_NumIndividuals; k++)
-			{
-				for (int l = 0; l < m_TimeptsPerIndividual; l++)
-				{
-					Xp(l,0) = m_Expl(k*m_TimeptsPerIndividual + l);
-					Xp(l,1) = 1;
-					y(l) = X(i, k*m_TimeptsPerIndividual + l);
-				}
-				tempvect = Ds * vnl_transpose(Xp) * Ws[k] * (y - (Xp * fixed.get_column(i)));
-				random.set_column(i*m_NumIndividuals + k, tempvect);
-				residual = y - (Xp * fixed.get_column(i)) - (Xp * random.get_column(i*m_NumIndividuals + k));
-				ecorr = ecorr + dot_product(residual, residual);
-				tracevar = tracevar + (m_TimeptsPerIndividual - sigma2s * vnl_trace(Ws[k]));
-				bscorr = bscorr + outer_product(random.get_column(i*m_NumIndividuals + k), random.get_column(i*m_NumIndividuals + k));
-				bsvar = bsvar + (identity_2 - (vnl_transpose(Xp) * Ws[k] * Xp * Ds));
-			}
-			sigma2s = (ecorr + sigma2s * tracevar) / (num_shapes);
-			Ds = (bscorr + Ds * bsvar) / m_NumIndividuals;
-		}//endfor EM iterations
-		//printf ("point #%d\n", i);
-	}//endfor all points on shape (x,y & z)
-	
-	m_Slope = fixed.get_row(0);
-	m_Intercept = fixed.get_row(1);
-	for (int i = 0; i < m_NumIndividuals; i++)
-	{
-		for (int j = 0; j < nr; j++) //for all points * 3
-		{
-			m_SlopeRand(i,j) = random(0, j*m_NumIndividuals+i);
-			m_InterceptRand(i,j) = random(1, j*m_NumIndividuals+i);
-		}
-	}
-    delete [] Vs;
-	delete [] Ws;
-	//printf ("points:\n");
-	//for (int k = 0; k < m_NumIndividuals; k++)
-	//	for (int l = 0; l < m_TimeptsPerIndividual; l++)
-	//		printf ("%g   %g\n", X(0,k*m_TimeptsPerIndividual + l), m_Expl(k*m_TimeptsPerIndividual + l));
-
-	//printf ("fixed: slope %g, intercept %g", m_Slope(0), m_Intercept(0));
-	//printf ("random: slopes %g %g, intercepts %g %g", m_SlopeRand(0,0), m_SlopeRand(1,0), m_InterceptRand(0,0), m_InterceptRand(1,0));
+    const int nr = this->rows(); //number of points*3
+    const int num_shapes = this->cols();
+    const int num_timepts = this->GetTimeptsPerIndividual();
+    this->m_NumIndividuals = num_shapes / num_timepts;
+    const int num_individuals = this->m_NumIndividuals;
+
+    Eigen::Map<const RowMajorMatrix> shape(this->data_block(), nr, num_shapes);
+    Eigen::Map<const RowMajorMatrix> mean(m_MeanMatrix.data_block(), m_MeanMatrix.rows(), m_MeanMatrix.cols());
+    const RowMajorMatrix X = shape + mean.topLeftCorner(nr, num_shapes);
 
+    // Design matrix [t 1] of each individual, it is the same for all points.
+    std::vector<Eigen::MatrixXd> Xp(num_individuals, Eigen::MatrixXd(num_timepts, 2));
+    for (int k = 0; k < num_individuals; k++)
+      {
+      for (int l = 0; l < num_timepts; l++)
+        {
+        Xp[k](l,0) = m_Expl(k*num_timepts + l);
+        Xp[k](l,1) = 1.0;
+        }
+      }
+
+    //set the sizes of fixed and random slopes and intercepts
+    m_Slope.set_size(nr);
+    m_Intercept.set_size(nr);
+    m_SlopeRand.set_size(num_individuals, nr); //num_groups X num_points*3
+    m_InterceptRand.set_size(num_individuals, nr); //num_groups X num_points*3
+
+    // The EM estimation is independent for each point coordinate, and each
+    // one only writes its own column of the parameters.
+    tbb::parallel_for(
+      tbb::blocked_range<int>{0, nr},
+      [&](const tbb::blocked_range<int> &r) {
+        const Eigen::MatrixXd identity_n = Eigen::MatrixXd::Identity(num_timepts, num_timepts);
+        std::vector<Eigen::MatrixXd> Ws(num_individuals);
+        std::vector<Eigen::Vector2d> random(num_individuals); //slope + intercept of each group
+
+        for (int i = r.begin(); i < r.end(); i++) //for all points (x,y,z coordinates)
+          {
+          Eigen::Matrix2d Ds = Eigen::Matrix2d::Identity(); //covariance matrix of random parameters
+          double sigma2s = 1.0; //variance of error
+          Eigen::Vector2d fixed = Eigen::Vector2d::Zero(); //slope + intercept
+
+          for (int j = 0; j < 50; j++) //EM iterations
+            {
+            Eigen::Matrix2d sum_mat1 = Eigen::Matrix2d::Zero();
+            Eigen::Vector2d sum_mat2 = Eigen::Vector2d::Zero();
+            for (int k = 0; k < num_individuals; k++)
+              {
+              const auto y = X.row(i).segment(k*num_timepts, num_timepts).transpose();
+              Ws[k] = (identity_n * sigma2s + Xp[k] * Ds * Xp[k].transpose()).inverse();
+              sum_mat1 += Xp[k].transpose() * Ws[k] * Xp[k];
+              sum_mat2 += Xp[k].transpose() * Ws[k] * y;
+              }
+            fixed = sum_mat1.inverse() * sum_mat2;
+
+            double ecorr = 0.0;
+            double tracevar = 0.0;
+            Eigen::Matrix2d bscorr = Eigen::Matrix2d::Zero();
+            Eigen::Matrix2d bsvar = Eigen::Matrix2d::Zero();
+            for (int k = 0; k < num_individuals; k++)
+              {
+              const Eigen::VectorXd fit = X.row(i).segment(k*num_timepts, num_timepts).transpose() - Xp[k] * fixed;
+              random[k] = Ds * Xp[k].transpose() * Ws[k] * fit;
+              const Eigen::VectorXd residual = fit - Xp[k] * random[k];
+              ecorr += residual.squaredNorm();
+              tracevar += num_timepts - sigma2s * Ws[k].trace();
+              bscorr += random[k] * random[k].transpose();
+              bsvar += Eigen::Matrix2d::Identity() - Xp[k].transpose() * Ws[k] * Xp[k] * Ds;
+              }
+            sigma2s = (ecorr + sigma2s * tracevar) / num_shapes;
+            Ds = (bscorr + Ds * bsvar) / num_individuals;
+            }//endfor EM iterations
+
+          m_Slope[i] = fixed(0);
+          m_Intercept[i] = fixed(1);
+          for (int k = 0; k < num_individuals; k++)
+            {
+            m_SlopeRand(k,i) = random[k](0);
+            m_InterceptRand(k,i) = random[k](1);
+            }
+          }//endfor all points on shape (x,y & z)
+      });
   }
   
   // 
@@ -405,6 +404,15 @@ public:
   { return m_RegressionInterval; }
   
 protected:
+  /** The parameters and the mean matrix have one entry per row of the
+      shape matrix, so they are resized with it. */
+  virtual void ResizeRows(unsigned int rs)
+  {
+    this->ResizeParameters(rs);
+    this->ResizeMatrix(rs, this->cols());
+    this->ResizeMeanMatrix(rs, this->cols());
+  }
+
   ParticleShapeMixedEffectsMatrixAttribute() 
   {
     this->m_DefinedCallbacks.DomainAddEvent = true;
@@ -29,6 +29,7 @@
 #include "itkEventObject.h"
 #include "itkParticleNeighborhood.h"
 #include "vnl/vnl_inverse.h"
+#include <algorithm>
 #include <map>
 #include <vector>
 #include <random>
@@ -124,6 +125,18 @@ public:
   /** Returns the number of particles in domain k. */
   unsigned long int GetNumberOfParticles(unsigned int d = 0) const
   { return m_Positions[d]->GetSize(); }
+
+  /** Note that domain d will hold n particles once a batch of positions has
+      been added, e.g. by a split.  The attributes size their storage for the
+      reserved number of particles in one step instead of growing it while
+      the particles are added one at a time. */
+  void ReserveParticles(unsigned int d, unsigned long int n)
+  { m_ReservedParticles[d] = n; }
+
+  /** Returns the number of particles reserved in domain d, or the number of
+      particles if that is larger. */
+  unsigned long int GetReservedNumberOfParticles(unsigned int d = 0) const
+  { return std::max(m_ReservedParticles[d], this->GetNumberOfParticles(d)); }
   
   /**  Add/Set/Remove a single particle position.  The actual position added or
       set will be returned.  If, for example, the domain imposes any
@@ -138,6 +151,20 @@ public:
   const PointType &AddPosition( const PointType &, unsigned int d=0, int threadId=0);
   const PointType &SetPosition( const PointType &,  unsigned long int k,  unsigned int d=0, int threadId=0);
 
+  /** Set a particle position like SetPosition, but without notifying the
+      attributes.  The domain constraints and the neighborhood are still
+      updated immediately.  CommitPositions must be called once the batch of
+      updates is complete so that the attributes see the new positions, and
+      before anything reads the attributes (e.g. an energy evaluation). */
+  const PointType &StagePosition( const PointType &,  unsigned long int k,  unsigned int d=0, int threadId=0);
+
+  /** Notify the attributes that the positions [first, first + n) of domain d
+      have been set, with a single ParticlePositionSetBatchEvent.  The second
+      form commits every position of the domain. */
+  void CommitPositions(unsigned int d, unsigned long int first, unsigned long int n, int threadId=0);
+  void CommitPositions(unsigned int d, int threadId=0)
+  { this->CommitPositions(d, 0, this->GetNumberOfParticles(d), threadId); }
+
   //  inline const PointType &SetTransformedPosition(const PointType &p,
   //                                                 unsigned long int k,  unsigned int d=0, int threadId=0)
   //  {
@@ -192,6 +219,10 @@ public:
                                                 std::vector<double> &w,
                                                 double r, unsigned int d = 0) const
   {  return m_Neighborhoods[d]->FindNeighborhoodPoints(p,idx,w,r); }
+  inline unsigned int FindNeighborhoodPoints(const PointType &p, int idx,
+                                             std::vector<double> &w, double r,
+                                             PointVectorType &ret, unsigned int d = 0) const
+  {  return m_Neighborhoods[d]->FindNeighborhoodPoints(p, idx, w, r, ret); }
   inline PointVectorType FindNeighborhoodPoints(unsigned int idx,
                                                 double r, unsigned int d = 0) const
   {  return m_Neighborhoods[d]->FindNeighborhoodPoints(this->GetPosition(idx,d),idx, r); }
@@ -509,6 +540,9 @@ private:
   /** A counter used to assign indicies for new particle locations. */
   std::vector< unsigned long int> m_IndexCounters;
 
+  /** The number of particles reserved in each domain, see ReserveParticles. */
+  std::vector< unsigned long int> m_ReservedParticles;
+
   /** An array that indicates which domains are flagged.  A domain may be
       flagged for various purposes depending on the application.  This array
       was created to flag which domains are "fixed" during optimization, for
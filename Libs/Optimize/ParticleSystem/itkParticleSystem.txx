@@ -43,6 +43,7 @@ ParticleSystem<VDimension>
   m_InversePrefixTransforms.resize(num);
   m_Positions.resize(num);
   m_IndexCounters.resize(num);
+  m_ReservedParticles.resize(num);
   m_Neighborhoods.resize(num);
   while(num >= this->m_DomainFlags.size()) {
     m_DomainFlags.push_back(false);
@@ -63,6 +64,7 @@ void ParticleSystem<VDimension>
       m_Domains[idx] = input;
       m_Positions[idx]  =  PointContainerType::New();
       m_IndexCounters[idx] = 0;
+      m_ReservedParticles[idx] = 0;
       return;
       }
     }
@@ -153,6 +155,9 @@ ParticleSystem<VDimension>
       // debugg
       //std::cout << "d" << d << " before apply " << m_Positions[d]->operator[](m_IndexCounters[d]);
     const auto idx = m_IndexCounters[d];
+    // Lets the domain size its per particle caches while particles are added
+    // serially, before they are queried from the parallel optimizer.
+    m_Domains[d]->InvalidateParticlePosition(idx);
     m_Domains[d]->ApplyConstraints( m_Positions[d]->operator[](idx), idx);
       // debugg
       //std::cout << " after apply " << m_Positions[d]->operator[](m_IndexCounters[d]) << std::endl;
@@ -181,6 +186,25 @@ const typename ParticleSystem<VDimension>::PointType &
 ParticleSystem<VDimension>
 ::SetPosition(const PointType &p,  unsigned long int k,
                                         unsigned int d,  int threadId)
+{
+  this->StagePosition(p, k, d, threadId);
+
+  // Notify any observers.
+  ParticlePositionSetEvent e;
+  e.SetThreadID(threadId);
+  e.SetDomainIndex(d);
+  e.SetPositionIndex(k);
+
+  this->InvokeEvent(e);
+
+  return m_Positions[d]->operator[](k);
+}
+
+template <unsigned int VDimension>
+const typename ParticleSystem<VDimension>::PointType &
+ParticleSystem<VDimension>
+::StagePosition(const PointType &p,  unsigned long int k,
+                                        unsigned int d,  int threadId)
 {
   if (m_FixedParticleFlags[d % m_DomainsPerShape][k] == false)
   {
@@ -199,15 +223,26 @@ ParticleSystem<VDimension>
 
   }
 
+  return m_Positions[d]->operator[](k);
+}
+
+template <unsigned int VDimension>
+void
+ParticleSystem<VDimension>
+::CommitPositions(unsigned int d, unsigned long int first, unsigned long int n, int threadId)
+{
+  if (n == 0) {
+    return;
+  }
+
   // Notify any observers.
-  ParticlePositionSetEvent e;
+  ParticlePositionSetBatchEvent e;
   e.SetThreadID(threadId);
   e.SetDomainIndex(d);
-  e.SetPositionIndex(k);
+  e.SetPositionIndex(first);
+  e.SetNumberOfPositions(n);
 
   this->InvokeEvent(e);
-
-  return m_Positions[d]->operator[](k);
 }
 
 template <unsigned int VDimension>
@@ -235,6 +270,8 @@ ParticleSystem<VDimension>
 ::AddPositionList(const std::vector<PointType> &p,
                                             unsigned int d, int threadId )
 {
+  this->ReserveParticles(d, this->GetNumberOfParticles(d) + p.size());
+
   // Traverse the list and add each point to the domain.
   for (typename std::vector<PointType>::const_iterator it= p.begin(); it != p.end(); it++) {
     this->AddPosition(*it, d, threadId);
@@ -311,6 +348,11 @@ void ParticleSystem<VDimension>::AdvancedAllParticleSplitting(double epsilon)
   }
   */
 
+  // Each particle is split in two, one new position per domain at a time.
+  for (size_t domain = 0; domain < num_doms; domain++) {
+    this->ReserveParticles(domain, 2 * lists[domain].size());
+  }
+
   if (lists.size() > 0) {
     for (size_t i = 0; i < lists[0].size(); i++) {
       // While the random vector updated violates plane constraints
@@ -381,8 +423,14 @@ ParticleSystem<VDimension>
        it != endIt; it++)
     {    list.push_back(*it);    }
 
-  int k = 0;
-  for (typename std::vector<PointType>::const_iterator it = list.begin(); it != list.end(); it++, k++) {
+  // The new positions are all added before the original ones are moved, so
+  // the attributes grow their storage once and then see the moves as a
+  // single batch.
+  this->ReserveParticles(domain, 2 * list.size());
+
+  std::vector<PointType> moved;
+  moved.reserve(list.size());
+  for (typename std::vector<PointType>::const_iterator it = list.begin(); it != list.end(); it++) {
     // Add epsilon times random direction to existing point and apply domain
     // constraints to generate a new particle position.  Add the new position.
     PointType startingPos = *it;
@@ -398,12 +446,15 @@ ParticleSystem<VDimension>
 
     // Apply opposite update to each original point in the split.
     auto neg_projected = -projected;
-    newpos = this->GetDomain(domain)->UpdateParticlePosition(startingPos, neg_projected);
-    this->SetPosition(newpos, k, domain, threadId);
-    const ParticleDomain *particle_domain = this->GetDomain(domain);
-    particle_domain->InvalidateParticlePosition(k);
+    moved.push_back(this->GetDomain(domain)->UpdateParticlePosition(startingPos, neg_projected));
+  }
 
+  const ParticleDomain *particle_domain = this->GetDomain(domain);
+  for (unsigned long int k = 0; k < moved.size(); k++) {
+    this->StagePosition(moved[k], k, domain, threadId);
+    particle_domain->InvalidateParticlePosition(k);
   }
+  this->CommitPositions(domain, 0, moved.size(), threadId);
 }
 
 template <unsigned int VDimension>
@@ -462,6 +513,16 @@ ParticleSystem<VDimension>
     tmpcmd->SetCallbackFunction(attr, &ParticleAttribute<VDimension>::PositionSetEventCallback);
     this->AddObserver(ParticlePositionSetEvent(), tmpcmd);
     }
+  // Attributes that only handle single position updates are still registered
+  // for batches, the default batch callback forwards each position.
+  if (attr->m_DefinedCallbacks.PositionSetBatchEvent == true
+      || attr->m_DefinedCallbacks.PositionSetEvent == true)
+    {
+    typename MemberCommand< ParticleAttribute<VDimension> >::Pointer tmpcmd
+      = MemberCommand< ParticleAttribute<VDimension> >::New();
+    tmpcmd->SetCallbackFunction(attr, &ParticleAttribute<VDimension>::PositionSetBatchEventCallback);
+    this->AddObserver(ParticlePositionSetBatchEvent(), tmpcmd);
+    }
   if (attr->m_DefinedCallbacks.PositionAddEvent == true)
     {
     typename MemberCommand< ParticleAttribute<VDimension> >::Pointer tmpcmd
@@ -102,6 +102,17 @@ public:
     return nullptr;
   }
 
+  /** Reset a clone of source to evaluate the particles of domain d.  The
+      state of source, which may have changed since the clone was made (e.g. in
+      BeforeIteration), is copied again and the state cached for the previous
+      domain is dropped.  This lets a solver keep one clone per thread for a
+      whole run.  Subclasses that implement Clone() reset their own state. */
+  virtual void ResetState(const ParticleVectorFunction *source, unsigned int d)
+  {
+    m_ParticleSystem = source->m_ParticleSystem;
+    m_DomainNumber = d;
+  }
+
 protected:
   ParticleVectorFunction() : m_ParticleSystem(0), m_DomainNumber(0) {}
   virtual ~ParticleVectorFunction() {}
@@ -0,0 +1,105 @@
+#include "MappedFile.h"
+
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace shapeworks {
+
+//---------------------------------------------------------------------------
+MappedFile::~MappedFile()
+{
+  Close();
+}
+
+//---------------------------------------------------------------------------
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this != &other) {
+    Close();
+    // moving the vector keeps its buffer, so data_ stays valid
+    data_ = other.data_;
+    size_ = other.size_;
+    mapped_ = other.mapped_;
+    owned_ = std::move(other.owned_);
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.mapped_ = nullptr;
+    other.owned_.clear();
+  }
+  return *this;
+}
+
+//---------------------------------------------------------------------------
+bool MappedFile::Open(const std::string& filename)
+{
+  Close();
+
+#ifndef _WIN32
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    return false;
+  }
+  const size_t size = static_cast<size_t>(info.st_size);
+  if (size > 0) {
+    // an empty file cannot be mapped, it is left with no data
+    void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      ::close(fd);
+      return false;
+    }
+    mapped_ = mapped;
+    data_ = static_cast<const char*>(mapped);
+  }
+  ::close(fd);
+  size_ = size;
+#else
+  std::ifstream in(filename, std::ios::binary | std::ios::ate);
+  if (!in) {
+    return false;
+  }
+  owned_.resize(static_cast<size_t>(in.tellg()));
+  in.seekg(0);
+  if (!in.read(owned_.data(), owned_.size())) {
+    owned_.clear();
+    return false;
+  }
+  data_ = owned_.data();
+  size_ = owned_.size();
+#endif
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void MappedFile::Close()
+{
+#ifndef _WIN32
+  if (mapped_) {
+    ::munmap(mapped_, size_);
+  }
+#endif
+  mapped_ = nullptr;
+  owned_.clear();
+  owned_.shrink_to_fit();
+  data_ = nullptr;
+  size_ = 0;
+}
+
+//---------------------------------------------------------------------------
+bool MappedFile::HasMagic(const char (&magic)[8]) const
+{
+  return size_ >= sizeof(magic) && std::memcmp(data_, magic, sizeof(magic)) == 0;
+}
+
+} // shapeworks
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace shapeworks {
+
+/// Read only view of the contents of a binary file
+///
+/// The file is memory mapped, so its contents are paged in as they are used
+/// and never copied.  On Windows the contents are read into memory instead.
+/// The data is aligned for any fundamental type.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /// take over the contents of other, which is left closed
+  MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  /// map the whole file, returns false if it cannot be read
+  bool Open(const std::string& filename);
+
+  /// release the contents, pointers into them become invalid
+  void Close();
+
+  const char* GetData() const { return data_; }
+  size_t GetSize() const { return size_; }
+
+  /// whether the file starts with the given 8 byte magic
+  bool HasMagic(const char (&magic)[8]) const;
+
+private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+
+  void* mapped_ = nullptr;
+  std::vector<char> owned_;
+};
+
+} // shapeworks
@@ -0,0 +1,185 @@
+#include "ParticleFile.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <locale>
+#include <sstream>
+
+namespace shapeworks {
+
+namespace {
+
+const char fileMagic[8] = {'S', 'W', 'P', 'A', 'R', 'T', 'C', 'L'};
+const uint32_t fileVersion = 1;
+
+// the values follow the header, which keeps them 8 byte aligned
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t precision;   // bytes per value
+  uint64_t numParticles;
+  uint32_t valuesPerParticle;
+  uint32_t reserved;
+};
+
+}
+
+//---------------------------------------------------------------------------
+bool ParticleFile::Open(const std::string& filename)
+{
+  file_.Close();
+  owned_.clear();
+  data_ = nullptr;
+  numParticles_ = 0;
+  valuesPerParticle_ = 0;
+
+  if (!file_.Open(filename)) {
+    return false;
+  }
+  if (!file_.HasMagic(fileMagic)) {
+    file_.Close();
+    return ReadAscii(filename);
+  }
+
+  FileHeader header;
+  if (file_.GetSize() < sizeof(header)) {
+    file_.Close();
+    return false;
+  }
+  std::memcpy(&header, file_.GetData(), sizeof(header));
+
+  // a corrupt particle count must not overflow the size of the values
+  if (header.version != fileVersion || header.valuesPerParticle == 0 ||
+      (header.precision != 4 && header.precision != 8) ||
+      header.numParticles > (SIZE_MAX - sizeof(FileHeader)) / header.precision / header.valuesPerParticle) {
+    file_.Close();
+    return false;
+  }
+  const size_t numValues = header.numParticles * header.valuesPerParticle;
+  if (file_.GetSize() < sizeof(FileHeader) + header.precision * numValues) {
+    file_.Close();
+    return false;
+  }
+
+  const char* values = file_.GetData() + sizeof(FileHeader);
+  if (header.precision == 8) {
+    data_ = reinterpret_cast<const double*>(values);
+  }
+  else {
+    const float* floats = reinterpret_cast<const float*>(values);
+    owned_.assign(floats, floats + numValues);
+    file_.Close();
+    data_ = owned_.data();
+  }
+
+  format_ = static_cast<Format>(header.precision);
+  numParticles_ = header.numParticles;
+  valuesPerParticle_ = header.valuesPerParticle;
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool ParticleFile::ReadAscii(const std::string& filename)
+{
+  std::ifstream in(filename);
+  if (!in) {
+    return false;
+  }
+
+  // one particle per line, the first line sets the number of values per particle
+  std::string line;
+  std::istringstream values;
+  values.imbue(std::locale::classic());
+  while (std::getline(in, line)) {
+    values.clear();
+    values.str(line);
+    size_t line_values = 0;
+    double value;
+    while (values >> value) {
+      owned_.push_back(value);
+      line_values++;
+    }
+    if (!values.eof()) {
+      return false; // not a number
+    }
+    if (line_values == 0) {
+      continue;
+    }
+    if (valuesPerParticle_ == 0) {
+      valuesPerParticle_ = static_cast<unsigned>(line_values);
+    }
+    else if (line_values != valuesPerParticle_) {
+      return false;
+    }
+    numParticles_++;
+  }
+
+  format_ = Format::Ascii;
+  data_ = owned_.data();
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool ParticleFile::Write(const std::string& filename, const double* values, size_t num_particles,
+                         unsigned values_per_particle, Format format)
+{
+  if (format == Format::Ascii) {
+    std::ofstream out(filename);
+    if (!out) {
+      return false;
+    }
+    out.imbue(std::locale::classic());
+    for (size_t i = 0; i < num_particles; i++) {
+      for (unsigned k = 0; k < values_per_particle; k++) {
+        out << values[i * values_per_particle + k] << " ";
+      }
+      out << "\n";
+    }
+    return static_cast<bool>(out);
+  }
+
+  std::ofstream out(filename, std::ios::binary);
+  if (!out) {
+    return false;
+  }
+
+  FileHeader header;
+  std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+  header.version = fileVersion;
+  header.precision = static_cast<uint32_t>(format);
+  header.numParticles = num_particles;
+  header.valuesPerParticle = values_per_particle;
+  header.reserved = 0;
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  const size_t num_values = num_particles * values_per_particle;
+  if (format == Format::Float64) {
+    out.write(reinterpret_cast<const char*>(values), sizeof(double) * num_values);
+  }
+  else {
+    const std::vector<float> floats(values, values + num_values);
+    out.write(reinterpret_cast<const char*>(floats.data()), sizeof(float) * num_values);
+  }
+  return static_cast<bool>(out);
+}
+
+//---------------------------------------------------------------------------
+bool ParticleFile::ParseFormat(const std::string& name, Format& format)
+{
+  if (name == "ascii") {
+    format = Format::Ascii;
+  }
+  else if (name == "binary") {
+    format = Format::Float64;
+  }
+  else if (name == "binary32") {
+    format = Format::Float32;
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+} // shapeworks
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace shapeworks {
+
+/// Reads and writes particle files
+///
+/// A particle file holds a fixed number of values for each particle, its
+/// position optionally followed by features such as normals.  Files are either
+/// ascii, one particle per line, or binary: a header followed by the values of
+/// all particles in particle order as float64 or float32.  The format is
+/// detected from the first bytes of the file, so the readers built on this
+/// class accept both.
+/// Binary float64 files are memory mapped and their values are used in place.
+class ParticleFile
+{
+public:
+  enum class Format { Ascii = 0, Float32 = 4, Float64 = 8 };
+
+  ParticleFile() = default;
+  ParticleFile(const ParticleFile&) = delete;
+  ParticleFile& operator=(const ParticleFile&) = delete;
+
+  /// read a file in any format, returns false if it cannot be read
+  bool Open(const std::string& filename);
+
+  Format GetFormat() const { return format_; }
+  size_t GetNumberOfParticles() const { return numParticles_; }
+  unsigned GetValuesPerParticle() const { return valuesPerParticle_; }
+
+  /// values of all particles, in particle order
+  const double* GetData() const { return data_; }
+
+  /// k-th value of particle i
+  double GetValue(size_t i, unsigned k) const { return data_[i * valuesPerParticle_ + k]; }
+
+  /// write values_per_particle values for each particle, returns false if the file cannot be written
+  static bool Write(const std::string& filename, const double* values, size_t num_particles,
+                    unsigned values_per_particle, Format format);
+
+  /// parse the name of a format ("ascii", "binary" for float64 or "binary32"), returns false if unknown
+  static bool ParseFormat(const std::string& name, Format& format);
+
+private:
+  bool ReadAscii(const std::string& filename);
+
+  Format format_ = Format::Ascii;
+  size_t numParticles_ = 0;
+  unsigned valuesPerParticle_ = 0;
+
+  // view of the values, into owned_ or the mapped file
+  const double* data_ = nullptr;
+  std::vector<double> owned_;
+  MappedFile file_;
+};
+
+} // shapeworks
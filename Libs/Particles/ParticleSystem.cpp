@@ -1,4 +1,5 @@
 #include "ParticleSystem.h"
+#include "ParticleFile.h"
 
 namespace shapeworks {
 
@@ -13,27 +14,30 @@ ParticleSystem::ParticleSystem(const std::vector<std::string> &_paths)
   const int VDimension = 3; //TODO Don't hardcode VDimension
   assert(N > 0);
 
-  //TODO: We're using the existing particle file reader here. This is not ideal
-  // since this particle reader loads into a std::vector, which subsequently
-  // is copied to Eigen. Refactor it to load directly to Eigen. (This is not a
-  // huge problem for now because the particle files are quite small)
-  typename itk::ParticlePositionReader<VDimension>::Pointer reader0
-          = itk::ParticlePositionReader<VDimension>::New();
-
-  // Read the first file to find dimensions
-  reader0->SetFileName(paths[0]);
-  reader0->Update();
-  const int D = reader0->GetOutput().size() * VDimension;
-
-  P.resize(D, N);
-  P.col(0) = Eigen::Map<const Eigen::VectorXd>((double *) reader0->GetOutput().data(), D);
-
-  for (int i = 1; i < N; i++) {
-    typename itk::ParticlePositionReader<VDimension>::Pointer reader
-            = itk::ParticlePositionReader<VDimension>::New();
-    reader->SetFileName(paths[i]);
-    reader->Update();
-    P.col(i) = Eigen::Map<const Eigen::VectorXd>((double *) reader->GetOutput().data(), D);
+  // Each column holds the positions of one file.  Binary files are memory mapped, so their
+  // positions are copied straight from the file.
+  int D = 0;
+  for (int i = 0; i < N; i++) {
+    ParticleFile file;
+    if (!file.Open(paths[i])) {
+      throw std::runtime_error("Could not open point file for input: " + paths[i]);
+    }
+    if (file.GetNumberOfParticles() > 0 && file.GetValuesPerParticle() < VDimension) {
+      throw std::runtime_error("Point file has fewer than 3 values per point: " + paths[i]);
+    }
+
+    // the first file sets the dimensions
+    if (i == 0) {
+      D = file.GetNumberOfParticles() * VDimension;
+      P.resize(D, N);
+    }
+    if (static_cast<int>(file.GetNumberOfParticles()) * VDimension != D) {
+      throw std::runtime_error("Point file has a different number of points: " + paths[i]);
+    }
+
+    const Eigen::Map<const Eigen::MatrixXd, 0, Eigen::OuterStride<>> positions(
+      file.GetData(), VDimension, file.GetNumberOfParticles(), Eigen::OuterStride<>(file.GetValuesPerParticle()));
+    Eigen::Map<Eigen::MatrixXd>(P.col(i).data(), VDimension, file.GetNumberOfParticles()) = positions;
   }
 }
 
@@ -15,7 +15,7 @@
 #ifndef __itkParticlePositionReader_txx
 #define __itkParticlePositionReader_txx
 
-#include <fstream>
+#include "ParticleFile.h"
 #include "itkParticlePositionReader.h"
 namespace itk
 {
@@ -23,32 +23,24 @@ namespace itk
 template <unsigned int VDimension>
 void ParticlePositionReader<VDimension>::Update()
 {
-  int counter = 0;
-  // Open the ascii file.
-  std::ifstream in( m_FileName.c_str() );
-  if ( !in )
+  shapeworks::ParticleFile file;
+  if (!file.Open(m_FileName))
     {
     itkExceptionMacro("Could not open point file for input: " << m_FileName.c_str());
     }
+  if (file.GetNumberOfParticles() > 0 && file.GetValuesPerParticle() < VDimension)
+    {
+    itkExceptionMacro("Point file has fewer than " << VDimension << " values per point: " << m_FileName.c_str());
+    }
 
-  //  in >> num_points;
-
-  // Read all of the points, one point per line.
-  while (in)
+  m_Output.resize(file.GetNumberOfParticles());
+  for (size_t i = 0; i < m_Output.size(); i++)
     {
-    PointType pt;
     for (unsigned int d = 0; d < VDimension; d++)
       {
-      in >> pt[d];
+      m_Output[i][d] = file.GetValue(i, d);
       }
-
-    m_Output.push_back(pt);
-        counter++;
     }
-  // this algorithm pushes the last point twice
-  m_Output.pop_back();
-  //  std::cout << "Read " << counter-1 << " points. " << std::endl;
-  in.close();
 }
 
 }
@@ -26,11 +26,12 @@ namespace itk
 {
 /** \class ParticlePositionReader
  *  This class reads a set of Points from disk and stores them in a vector.
- *  The file format is simple an ascii list of VDimension-tuples stored one per
- *  line (delimited by std::endl).  There is no header required for the file,
- *  but the file should not contain leading or trailing empty lines.
+ *  The file is either an ascii list of VDimension-tuples stored one per
+ *  line (delimited by std::endl), or a binary particle file (see
+ *  shapeworks::ParticleFile), which is detected automatically.  Values after
+ *  the first VDimension of each particle, such as features, are ignored.
  *
- * In 3D, for example, a fragment of a points file looks like this:
+ * In 3D, for example, a fragment of an ascii points file looks like this:
  *
  * 1.0 2.0 5.4
  * 2.3 8.7 33.0
@@ -1,5 +1,6 @@
 
 #include "Utils.h"
+#include "ParticleFile.h"
 
 #include <vtkMath.h>
 #include <cmath>
@@ -31,91 +32,53 @@ std::vector<int> Utils::randperm(int n)
 
 // ------------------- IO ------------------------------------
 
-void Utils::readSparseShape(vtkSmartPointer<vtkPoints>& points, char* filename, int number_of_particles)
+// reads the positions from a particle file in any format, only the first number_of_particles if it is positive
+static void readParticlePositions(shapeworks::ParticleFile& file, char* filename, int number_of_particles, size_t& count)
 {
-    points->Reset();
-
-    std::ifstream ifs;
-    ifs.open(filename);
-    if(!ifs.good())
-        throw std::runtime_error("Could not open file for output: " + std::string(filename));
+    if(!file.Open(filename) || file.GetValuesPerParticle() < 3)
+        throw std::runtime_error("Could not read particle file: " + std::string(filename));
 
-    if (number_of_particles>0)
+    count = file.GetNumberOfParticles();
+    if (number_of_particles > 0)
     {
-        for (unsigned int ii = 0 ;ii < number_of_particles; ii++)
-        {
-            double p[3];
-            ifs >> p[0] >> p[1] >> p[2];
-
-            points->InsertNextPoint(p[0], p[1], p[2]);
-            //ofs << p[0] << "," << p[1] << ","<< p[2] << std::endl;
-        }
+        if (static_cast<size_t>(number_of_particles) > count)
+            throw std::runtime_error("Particle file has fewer than " + std::to_string(number_of_particles)
+                                     + " particles: " + std::string(filename));
+        count = number_of_particles;
     }
-    else
-    {
-        std::string line;
-        while(!std::getline(ifs, line, '\n').eof())
-        {
-            std::istringstream reader(line);
-
-            std::string::const_iterator i = line.begin();
-            std::vector<double> lineData;
-            while(!reader.eof()) {
-                double val;
-                reader >> val;
-
-                lineData.push_back(val);
-            }
-            points->InsertNextPoint(lineData[0], lineData[1], lineData[2]);
-        }
+}
 
-    }
+void Utils::readSparseShape(vtkSmartPointer<vtkPoints>& points, char* filename, int number_of_particles)
+{
+    points->Reset();
+
+    shapeworks::ParticleFile file;
+    size_t count;
+    readParticlePositions(file, filename, number_of_particles, count);
+
+    points->Allocate(count);
+    for (size_t ii = 0; ii < count; ii++)
+        points->InsertNextPoint(file.GetValue(ii, 0), file.GetValue(ii, 1), file.GetValue(ii, 2));
 
-    ifs.close();
     std::cout << "total number of correspondences read: " << points->GetNumberOfPoints() << std::endl;
 }
 
 void Utils::readSparseShape(std::vector<itk::Point<double> > & points, char* filename, int number_of_particles)
 {
     points.clear();
-    std::ifstream ifs;
-    ifs.open(filename);
-    if(!ifs.good())
-        throw std::runtime_error("Could not open file for output: " + std::string(filename));
 
-    if (number_of_particles>0)
-    {
-        for (unsigned int ii = 0 ;ii < number_of_particles; ii++)
-        {
-            itk::Point<double> p;
-            ifs >> p[0] >> p[1] >> p[2];
+    shapeworks::ParticleFile file;
+    size_t count;
+    readParticlePositions(file, filename, number_of_particles, count);
 
-            points.push_back(p);
-        }
-    }
-    else
+    points.reserve(count);
+    for (size_t ii = 0; ii < count; ii++)
     {
-        std::string line;
-        while(!std::getline(ifs, line, '\n').eof())
-        {
-            std::istringstream reader(line);
-
-            std::string::const_iterator i = line.begin();
-            std::vector<double> lineData;
-            while(!reader.eof()) {
-                double val;
-                reader >> val;
-
-                lineData.push_back(val);
-            }
-
-            itk::Point<double> p;
-            p[0] = lineData[0]; p[1] = lineData[1]; p[2] = lineData[2];
-            points.push_back(p);
-        }
+        itk::Point<double> p;
+        p[0] = file.GetValue(ii, 0); p[1] = file.GetValue(ii, 1); p[2] = file.GetValue(ii, 2);
+        points.push_back(p);
     }
 
-    ifs.close();
     std::cout << "total number of correspondences read: " << points.size() << std::endl;
 }
 
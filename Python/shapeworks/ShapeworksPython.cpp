@@ -587,13 +587,18 @@ PYBIND11_MODULE(shapeworks, m)
        },
        "rasterizes mesh to create binary images, automatically computing size and origin if necessary",
        "spacing"_a=std::vector<double>({1.0, 1.0, 1.0}), "size"_a=std::vector<unsigned>({0, 0, 0}), "origin"_a=std::vector<double>({-1.0, -1.0, -1.0}))
-  .def("distance",              &Mesh::distance, "computes surface to surface distance", "target"_a, "method"_a=Mesh::DistanceMethod::POINT_TO_POINT)
+  .def("distance",
+       [](Mesh& mesh, const Mesh& target, const Mesh::DistanceMethod method, bool storeClosest) -> decltype(auto) {
+         return mesh.distance(target, method, storeClosest);
+       },
+       "computes surface to surface distance", "target"_a, "method"_a=Mesh::DistanceMethod::POINT_TO_POINT, "storeClosest"_a=false)
   .def("toDistanceTransform",
-       [](Mesh& mesh, std::vector<double>& v, std::vector<unsigned>& d, std::vector<double>& p) -> decltype(auto) {
-         return mesh.toDistanceTransform(makeVector({v[0], v[1], v[2]}), Dims({d[0], d[1], d[2]}), Point({p[0], p[1], p[2]}));
+       [](Mesh& mesh, std::vector<double>& v, std::vector<unsigned>& d, std::vector<double>& p, bool exact, double narrowBand) -> decltype(auto) {
+         return mesh.toDistanceTransform(makeVector({v[0], v[1], v[2]}), Dims({d[0], d[1], d[2]}), Point({p[0], p[1], p[2]}), exact, narrowBand);
        },
        "converts mesh to distance transform, automatically computing size and origin if necessary",
-       "spacing"_a=std::vector<double>({1.0, 1.0, 1.0}), "size"_a=std::vector<unsigned>({0, 0, 0}), "origin"_a=std::vector<double>({-1.0, -1.0, -1.0}))
+       "spacing"_a=std::vector<double>({1.0, 1.0, 1.0}), "size"_a=std::vector<unsigned>({0, 0, 0}), "origin"_a=std::vector<double>({-1.0, -1.0, -1.0}),
+       "exact"_a=false, "narrowBand"_a=0.0)
   .def("center",                &Mesh::center, "center of mesh")
   .def("centerOfMass",          &Mesh::centerOfMass, "center of mass of mesh")
   .def("numPoints",             &Mesh::numPoints, "number of points")
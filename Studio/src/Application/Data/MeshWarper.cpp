@@ -77,8 +77,8 @@ void MeshWarper::check_warp_ready()
     (double*) this->reference_particles_.data_block(),
     this->reference_particles_.size());
   this->points_.resize(3, this->reference_particles_.size() / 3);
-  this->warp_ = MeshUtils::generateWarpMatrix(this->vertices_, this->faces_,
-                                              this->points_.transpose());
+  this->warp_ = MeshUtils::generateSparseWarpMatrix(this->vertices_, this->faces_,
+                                                    this->points_.transpose());
   this->needs_warp_ = false;
 }
 
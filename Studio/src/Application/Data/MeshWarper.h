@@ -10,6 +10,7 @@
 #include <vector>
 #include <string>
 #include <Libs/Mesh/Mesh.h>
+#include <Eigen/Sparse>
 #include <QMutex>
 
 namespace shapeworks {
@@ -37,7 +38,7 @@ private:
   Eigen::MatrixXd vertices_;
   Eigen::MatrixXi faces_;
   Eigen::MatrixXd points_;
-  Eigen::MatrixXd warp_;
+  Eigen::SparseMatrix<double> warp_;
 
   bool needs_warp_ = true;
 
@@ -13,6 +13,8 @@
 
 #include <vtkCenterOfMass.h>
 
+#include <Libs/Particles/ParticleFile.h>
+
 #include <Data/MeshGenerator.h>
 #include <Data/StudioLog.h>
 #include <Visualization/Visualizer.h>
@@ -500,31 +502,25 @@ void Shape::generate_meshes(std::vector<string> filenames, QSharedPointer<Studio
 //---------------------------------------------------------------------------
 bool Shape::import_point_file(QString filename, vnl_vector<double>& points)
 {
-  std::ifstream in(filename.toStdString().c_str());
-  if (!in.good()) {
+  ParticleFile file;
+  if (!file.Open(filename.toStdString())) {
     QMessageBox::warning(0, "Unable to open file", "Error opening file: " + filename);
     return false;
   }
-  vtkSmartPointer<vtkPoints> vtk_points = vtkSmartPointer<vtkPoints>::New();
-  auto test = filename.toStdString();
-  int num_points = 0;
-  while (in.good()) {
-    double x, y, z;
-    in >> x >> y >> z;
-    if (!in.good()) { break; }
-    vtk_points->InsertNextPoint(x, y, z);
-    num_points++;
+  if (file.GetNumberOfParticles() > 0 && file.GetValuesPerParticle() < 3) {
+    QMessageBox::warning(0, "Unable to read file", "Not a point file: " + filename);
+    return false;
   }
-  in.close();
+
+  const size_t num_points = file.GetNumberOfParticles();
   points.clear();
   points.set_size(num_points * 3);
 
   int idx = 0;
-  for (int i = 0; i < num_points; i++) {
-    double* pos = vtk_points->GetPoint(i);
-    points[idx++] = pos[0];
-    points[idx++] = pos[1];
-    points[idx++] = pos[2];
+  for (size_t i = 0; i < num_points; i++) {
+    points[idx++] = file.GetValue(i, 0);
+    points[idx++] = file.GetValue(i, 1);
+    points[idx++] = file.GetValue(i, 2);
   }
   return true;
 }
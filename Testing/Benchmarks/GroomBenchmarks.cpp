@@ -0,0 +1,110 @@
+#include "Testing.h"
+
+#include <Libs/Groom/Groom.h>
+#include <Libs/Project/Project.h>
+#include <Libs/Mesh/MeshUtils.h>
+
+#include <vtkSphereSource.h>
+
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+
+using namespace shapeworks;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start)
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+}
+
+//---------------------------------------------------------------------------
+// Meshes written and read back per second for each supported type, at 1, 4
+// and 16 threads.  The vtk and vtp types run concurrently, the other types
+// share the mesh I/O lock.
+TEST(GroomBenchmarks, mesh_io_throughput)
+{
+  const int num_meshes = 64;
+  std::vector<Mesh> meshes;
+  for (int i = 0; i < num_meshes; i++) {
+    auto sphere = vtkSmartPointer<vtkSphereSource>::New();
+    sphere->SetThetaResolution(100 + i);
+    sphere->SetPhiResolution(100);
+    sphere->Update();
+    meshes.push_back(Mesh(sphere->GetOutput()));
+  }
+
+  std::cout << std::setw(6) << "type" << std::setw(9) << "threads" << std::setw(12) << "seconds"
+            << std::setw(12) << "meshes/s" << std::setw(10) << "speedup" << "\n";
+
+  for (const auto& type : Mesh::getSupportedTypes()) {
+    double serial_time = 0.0;
+    for (int threads : {1, 4, 16}) {
+      tbb::task_arena arena(threads);
+      const auto start = Clock::now();
+      arena.execute([&] {
+        tbb::parallel_for(tbb::blocked_range<int>{0, num_meshes, 1}, [&](const tbb::blocked_range<int>& r) {
+          for (int i = r.begin(); i < r.end(); i++) {
+            std::string filename = "mesh_io_benchmark_" + std::to_string(i) + "." + type;
+            MeshUtils::threadSafeWriteMesh(filename, meshes[i]);
+            MeshUtils::threadSafeReadMesh(filename);
+          }
+        });
+      });
+      const double elapsed = seconds_since(start);
+      if (threads == 1) {
+        serial_time = elapsed;
+      }
+
+      std::cout << std::setw(6) << type << std::setw(9) << threads << std::fixed << std::setprecision(3)
+                << std::setw(12) << elapsed << std::setprecision(1) << std::setw(12) << num_meshes / elapsed
+                << std::setprecision(2) << std::setw(10) << serial_time / elapsed << "\n";
+      std::cout.unsetf(std::ios::fixed);
+    }
+
+    for (int i = 0; i < num_meshes; i++) {
+      std::remove(("mesh_io_benchmark_" + std::to_string(i) + "." + type).c_str());
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+// Time to groom the sphere project, whose subjects are groomed in parallel,
+// at 1, 4 and 16 threads.
+TEST(GroomBenchmarks, groom_throughput)
+{
+  std::string test_location = std::string(TEST_DATA_DIR) + std::string("/sphere");
+  chdir(test_location.c_str());
+
+  std::cout << std::setw(9) << "threads" << std::setw(12) << "seconds" << std::setw(10) << "speedup" << "\n";
+
+  double serial_time = 0.0;
+  for (int threads : {1, 4, 16}) {
+    ProjectHandle project = std::make_shared<Project>();
+    project->load("groom.xlsx");
+    Groom app(project);
+
+    tbb::task_arena arena(threads);
+    bool success = false;
+    const auto start = Clock::now();
+    arena.execute([&] { success = app.run(); });
+    const double elapsed = seconds_since(start);
+    ASSERT_TRUE(success);
+    if (threads == 1) {
+      serial_time = elapsed;
+    }
+
+    std::cout << std::setw(9) << threads << std::fixed << std::setprecision(3) << std::setw(12) << elapsed
+              << std::setprecision(2) << std::setw(10) << serial_time / elapsed << "\n";
+    std::cout.unsetf(std::ios::fixed);
+  }
+}
@@ -0,0 +1,356 @@
+#include <itkImageFileReader.h>
+#include <itkImageFileWriter.h>
+#include <itkApproximateSignedDistanceMapImageFilter.h>
+#include <itkImageRegionIterator.h>
+
+#include "Testing.h"
+
+#include "Optimize.h"
+#include "OptimizeParameterFile.h"
+#include "ParticleSystem/itkParticleImplicitSurfaceDomain.h"
+#include "ParticleSystem/itkParticleSurfaceNeighborhood.h"
+#include "ParticleSystem/itkParticleGridNeighborhood.h"
+#include "ParticleSystem/itkParticleEnsembleEntropyFunction.h"
+#include "ParticleSystem/itkParticleMeshBasedGeneralEntropyGradientFunction.h"
+#include "ParticleSystem/VtkMeshWrapper.h"
+
+#include <vtkSphereSource.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace shapeworks;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start)
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void prep_distance_transform(std::string input, std::string output)
+{
+  using ImageType = itk::Image<float, 3>;
+  using ReaderType = itk::ImageFileReader<ImageType>;
+  using WriterType = itk::ImageFileWriter<ImageType>;
+
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(input.c_str());
+
+  using FilterType = itk::ApproximateSignedDistanceMapImageFilter<ImageType, ImageType>;
+  FilterType::Pointer dt = FilterType::New();
+  dt->SetInput(reader->GetOutput());
+  dt->SetInsideValue(0);
+  dt->SetOutsideValue(1);
+  dt->Update();
+
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetFileName(output.c_str());
+  writer->SetInput(dt->GetOutput());
+  writer->SetUseCompression(true);
+  writer->Update();
+}
+
+void prep_spheres()
+{
+  std::string test_location = std::string(TEST_DATA_DIR) + std::string("/sphere");
+  chdir(test_location.c_str());
+
+  prep_distance_transform("sphere10.nrrd", "sphere10_DT.nrrd");
+  prep_distance_transform("sphere20.nrrd", "sphere20_DT.nrrd");
+  prep_distance_transform("sphere30.nrrd", "sphere30_DT.nrrd");
+  prep_distance_transform("sphere40.nrrd", "sphere40_DT.nrrd");
+}
+
+// creates an in-memory signed distance transform of a sphere
+itk::Image<float, 3>::Pointer create_sphere_distance_transform(int size, double radius)
+{
+  using ImageType = itk::Image<float, 3>;
+  ImageType::Pointer image = ImageType::New();
+  ImageType::RegionType region;
+  region.SetSize({static_cast<itk::SizeValueType>(size), static_cast<itk::SizeValueType>(size),
+                  static_cast<itk::SizeValueType>(size)});
+  image->SetRegions(region);
+  image->Allocate();
+
+  const double center = (size - 1) / 2.0;
+  itk::ImageRegionIterator<ImageType> it(image, region);
+  for (it.GoToBegin(); !it.IsAtEnd(); ++it) {
+    const auto idx = it.GetIndex();
+    double sum = 0.0;
+    for (int i = 0; i < 3; i++) {
+      sum += (idx[i] - center) * (idx[i] - center);
+    }
+    it.Set(static_cast<float>(std::sqrt(sum) - radius));
+  }
+  return image;
+}
+
+// A particle system with one domain per shape and the same number of
+// particles in every domain.  The shape matrices are set directly, the
+// positions only provide the particle counts.
+itk::ParticleSystem<3>::Pointer create_particle_system(int num_shapes, int num_particles)
+{
+  auto domain = itk::ParticleImplicitSurfaceDomain<float>::New();
+  domain->SetImage(create_sphere_distance_transform(48, 16.0), 1e10);
+
+  auto system = itk::ParticleSystem<3>::New();
+  system->SetDomainsPerShape(1);
+  itk::ParticleSystem<3>::PointType point;
+  point[0] = 23.5; point[1] = 23.5; point[2] = 39.5;
+  for (int d = 0; d < num_shapes; d++) {
+    system->AddDomain(domain);
+    for (int p = 0; p < num_particles; p++) {
+      system->AddPosition(point, d);
+    }
+  }
+  return system;
+}
+
+vnl_matrix<double> random_matrix(int rows, int cols, std::mt19937 &generator)
+{
+  std::normal_distribution<double> normal(0.0, 1.0);
+  vnl_matrix<double> m(rows, cols);
+  for (int r = 0; r < rows; r++) {
+    for (int c = 0; c < cols; c++) {
+      m(r, c) = normal(generator) * (c % 8 + 1);
+    }
+  }
+  return m;
+}
+
+// Average seconds per BeforeIteration call.  Every call sees a slightly
+// moved shape matrix, as it would between two optimizer iterations.
+template <class FunctionType, class MatrixType>
+double time_before_iteration(FunctionType *function, MatrixType *matrix, const vnl_matrix<double> &shapes,
+                             std::mt19937 &generator)
+{
+  const vnl_matrix<double> moved = shapes + 1e-3 * random_matrix(shapes.rows(), shapes.cols(), generator);
+  const int repeats = 10;
+  double elapsed = 0.0;
+  for (int r = 0; r < repeats; r++) {
+    matrix->SetMatrix(r % 2 ? moved : shapes);
+    const auto start = Clock::now();
+    function->BeforeIteration();
+    elapsed += seconds_since(start);
+  }
+  return elapsed / repeats;
+}
+
+}
+
+//---------------------------------------------------------------------------
+// Time to reach the optimization tolerance on the sphere data with the
+// Gauss-Seidel and the Jacobi update, for a few particle counts.  The Jacobi
+// update takes more iterations to converge, but each of them runs the
+// particles of a domain in parallel.
+TEST(OptimizeBenchmarks, jacobi_convergence)
+{
+  prep_spheres();
+
+  std::cout << std::setw(10) << "update" << std::setw(11) << "particles"
+            << std::setw(12) << "iterations" << std::setw(12) << "seconds"
+            << std::setw(16) << "iterations/s" << "\n";
+
+  for (int particles : {32, 128, 512}) {
+    for (bool jacobi : {false, true}) {
+      Optimize app;
+      OptimizeParameterFile param;
+      ASSERT_TRUE(param.load_parameter_file("sphere.xml", &app));
+      app.SetNumberOfParticles({particles});
+      app.SetUseJacobiUpdate(jacobi);
+      app.SetFileOutputEnabled(false);
+
+      int iterations = 0;
+      app.SetIterationCallbackFunction([&iterations]() { iterations++; });
+
+      const auto start = Clock::now();
+      app.Run();
+      const double elapsed = seconds_since(start);
+
+      std::cout << std::setw(10) << (jacobi ? "jacobi" : "gauss") << std::setw(11) << particles
+                << std::setw(12) << iterations << std::setw(12) << std::fixed << std::setprecision(2)
+                << elapsed << std::setw(16) << std::setprecision(1) << iterations / elapsed << "\n";
+      std::cout.unsetf(std::ios::fixed);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+// Neighborhood queries per second of the point tree and of the grid, for
+// particles spread over a sphere at a few search radii.
+TEST(OptimizeBenchmarks, grid_neighborhood_throughput)
+{
+  using DomainType = itk::ParticleImplicitSurfaceDomain<float>;
+  using PointType = DomainType::PointType;
+
+  auto domain = DomainType::New();
+  domain->SetImage(create_sphere_distance_transform(48, 16.0), 1e10);
+
+  auto surface_neighborhood = itk::ParticleSurfaceNeighborhood<itk::Image<float, 3>>::New();
+  auto grid = itk::ParticleGridNeighborhood<3>::New();
+  surface_neighborhood->SetDomain(domain);
+  grid->SetDomain(domain);
+
+  // use the base class interface, the subclasses hide some of the overloads
+  itk::ParticleNeighborhood<3> *tree = surface_neighborhood.GetPointer();
+
+  std::mt19937 generator(42);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  const int num_particles = 4096;
+  std::vector<PointType> points(num_particles);
+  for (int i = 0; i < num_particles; i++) {
+    double v[3] = {normal(generator), normal(generator), normal(generator)};
+    double mag = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    for (int d = 0; d < 3; d++) {
+      points[i][d] = 23.5 + 16.0 * v[d] / mag;
+    }
+    tree->AddPosition(points[i], i);
+    grid->AddPosition(points[i], i);
+  }
+
+  std::cout << std::setw(8) << "radius" << std::setw(12) << "neighbors"
+            << std::setw(16) << "tree queries/s" << std::setw(16) << "grid queries/s" << "\n";
+
+  itk::ParticleNeighborhood<3>::PointVectorType grid_result;
+  const int repeats = 10;
+  for (double radius : {1.0, 3.0, 8.0}) {
+    // let the grid adapt its cells to the radius before timing it
+    grid->FindNeighborhoodPoints(points[0], 0, radius, grid_result);
+    grid->SetPosition(points[0], 0);
+
+    auto start = Clock::now();
+    size_t tree_count = 0;
+    for (int r = 0; r < repeats; r++) {
+      for (int i = 0; i < num_particles; i++) {
+        tree_count += tree->FindNeighborhoodPoints(points[i], i, radius).size();
+      }
+    }
+    const double tree_time = seconds_since(start);
+
+    start = Clock::now();
+    size_t grid_count = 0;
+    for (int r = 0; r < repeats; r++) {
+      for (int i = 0; i < num_particles; i++) {
+        grid_count += grid->FindNeighborhoodPoints(points[i], i, radius, grid_result);
+      }
+    }
+    const double grid_time = seconds_since(start);
+    ASSERT_EQ(tree_count, grid_count);
+
+    std::cout << std::setw(8) << radius << std::setw(12) << tree_count / (repeats * num_particles)
+              << std::setw(16) << std::fixed << std::setprecision(0) << repeats * num_particles / tree_time
+              << std::setw(16) << repeats * num_particles / grid_time << "\n";
+    std::cout.unsetf(std::ios::fixed);
+  }
+}
+
+//---------------------------------------------------------------------------
+// Time of the correspondence term update done before every iteration, for the
+// ensemble entropy (positions) and mesh based (positions and normals)
+// functions, across shape and particle counts.
+TEST(OptimizeBenchmarks, correspondence_before_iteration)
+{
+  using EnsembleType = itk::ParticleEnsembleEntropyFunction<3>;
+  using MeshBasedType = itk::ParticleMeshBasedGeneralEntropyGradientFunction<3>;
+
+  std::mt19937 generator(42);
+
+  std::cout << std::setw(8) << "shapes" << std::setw(11) << "particles"
+            << std::setw(14) << "ensemble ms" << std::setw(16) << "mesh based ms" << "\n";
+
+  for (int num_shapes : {8, 32, 128}) {
+    for (int num_particles : {128, 512, 2048}) {
+      auto system = create_particle_system(num_shapes, num_particles);
+
+      const vnl_matrix<double> positions = random_matrix(3 * num_particles, num_shapes, generator);
+      auto shape_matrix = EnsembleType::ShapeMatrixType::New();
+      auto ensemble = EnsembleType::New();
+      ensemble->SetShapeMatrix(shape_matrix);
+      ensemble->SetParticleSystem(system);
+      ensemble->UseEntropy();
+      const double ensemble_time = time_before_iteration(ensemble.GetPointer(), shape_matrix.GetPointer(),
+                                                         positions, generator);
+
+      // positions and normals, 6 values per particle
+      const vnl_matrix<double> values = random_matrix(6 * num_particles, num_shapes, generator);
+      auto shape_data = MeshBasedType::ShapeDataType::New();
+      auto shape_gradient = MeshBasedType::ShapeGradientType::New();
+      shape_gradient->SetMatrix(random_matrix(6 * num_particles, 3 * num_shapes, generator));
+      auto mesh_based = MeshBasedType::New();
+      mesh_based->SetShapeData(shape_data);
+      mesh_based->SetShapeGradient(shape_gradient);
+      mesh_based->SetParticleSystem(system);
+      mesh_based->SetDomainsPerShape(1);
+      mesh_based->SetAttributesPerDomain({0});
+      mesh_based->SetXYZ(0, true);
+      mesh_based->SetNormals(0, true);
+      mesh_based->UseEntropy();
+      const double mesh_based_time = time_before_iteration(mesh_based.GetPointer(), shape_data.GetPointer(),
+                                                           values, generator);
+
+      std::cout << std::setw(8) << num_shapes << std::setw(11) << num_particles << std::fixed
+                << std::setprecision(2) << std::setw(14) << 1000.0 * ensemble_time
+                << std::setw(16) << 1000.0 * mesh_based_time << "\n";
+      std::cout.unsetf(std::ios::fixed);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+// Points snapped to a tessellated sphere per second, at 1, 4 and 16 threads.
+TEST(OptimizeBenchmarks, mesh_snap_throughput)
+{
+  const double radius = 10.0;
+  auto sphere = vtkSmartPointer<vtkSphereSource>::New();
+  sphere->SetRadius(radius);
+  sphere->SetThetaResolution(400);
+  sphere->SetPhiResolution(400);
+  sphere->Update();
+
+  shapeworks::VtkMeshWrapper mesh(sphere->GetOutput());
+
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<double> uniform(-2.0 * radius, 2.0 * radius);
+  const int num_points = 100000;
+  std::vector<shapeworks::VtkMeshWrapper::PointType> points(num_points);
+  for (auto &p : points) {
+    for (int i = 0; i < 3; i++) {
+      p[i] = uniform(generator);
+    }
+  }
+
+  std::cout << std::setw(8) << "threads" << std::setw(12) << "seconds"
+            << std::setw(12) << "points/s" << std::setw(10) << "speedup" << "\n";
+
+  std::vector<shapeworks::VtkMeshWrapper::PointType> snapped(num_points);
+  double serial_time = 0.0;
+  for (int threads : {1, 4, 16}) {
+    tbb::task_arena arena(threads);
+    const auto start = Clock::now();
+    arena.execute([&] {
+      tbb::parallel_for(tbb::blocked_range<int>{0, num_points}, [&](const tbb::blocked_range<int> &r) {
+        for (int n = r.begin(); n < r.end(); n++) {
+          snapped[n] = mesh.SnapToMesh(points[n], -1);
+        }
+      });
+    });
+    const double elapsed = seconds_since(start);
+    if (threads == 1) {
+      serial_time = elapsed;
+    }
+
+    std::cout << std::setw(8) << threads << std::fixed << std::setprecision(3) << std::setw(12) << elapsed
+              << std::setprecision(0) << std::setw(12) << num_points / elapsed
+              << std::setprecision(2) << std::setw(10) << serial_time / elapsed << "\n";
+    std::cout.unsetf(std::ios::fixed);
+  }
+}
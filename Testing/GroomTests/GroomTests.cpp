@@ -4,6 +4,11 @@
 
 #include <Libs/Groom/Groom.h>
 #include <Libs/Project/Project.h>
+#include <Libs/Mesh/MeshUtils.h>
+
+#include <vtkSphereSource.h>
+
+#include <tbb/parallel_for.h>
 
 using namespace shapeworks;
 
@@ -28,3 +33,38 @@ TEST(GroomTests, basic_test)
   ASSERT_TRUE(image == ground_truth);
 
 }
+
+//---------------------------------------------------------------------------
+TEST(GroomTests, mesh_io_concurrency_test)
+{
+  // a differently sized mesh per file, so a read or write that mixes up files is caught
+  const int num_meshes = 32;
+  std::vector<Mesh> meshes;
+  for (int i = 0; i < num_meshes; i++) {
+    auto sphere = vtkSmartPointer<vtkSphereSource>::New();
+    sphere->SetThetaResolution(50 + i);
+    sphere->SetPhiResolution(50);
+    sphere->Update();
+    meshes.push_back(Mesh(sphere->GetOutput()));
+  }
+
+  // the same concurrent reads and writes the mesh pipeline performs, for each supported type
+  for (const auto& type : Mesh::getSupportedTypes()) {
+    std::vector<vtkIdType> points(num_meshes), faces(num_meshes);
+    tbb::parallel_for(tbb::blocked_range<int>{0, num_meshes, 1}, [&](const tbb::blocked_range<int>& r) {
+      for (int i = r.begin(); i < r.end(); i++) {
+        std::string filename = "mesh_io_" + std::to_string(i) + "." + type;
+        MeshUtils::threadSafeWriteMesh(filename, meshes[i]);
+        Mesh mesh = MeshUtils::threadSafeReadMesh(filename);
+        points[i] = mesh.numPoints();
+        faces[i] = mesh.numFaces();
+      }
+    });
+
+    for (int i = 0; i < num_meshes; i++) {
+      ASSERT_EQ(points[i], meshes[i].numPoints()) << type;
+      ASSERT_EQ(faces[i], meshes[i].numFaces()) << type;
+      std::remove(("mesh_io_" + std::to_string(i) + "." + type).c_str());
+    }
+  }
+}
@@ -3,8 +3,19 @@
 #include "MeshUtils.h"
 #include "Image.h"
 #include "ParticleSystem.h"
+#include "GeodesicStore.h"
+#include "meshFIM.h"
+#include "TriMesh_algo.h"
+#include "PreviewMeshQC/FEAreaCoverage.h"
+#include "PreviewMeshQC/FEVTKImport.h"
 
 #include <igl/point_mesh_squared_distance.h>
+#include <vtkCellArray.h>
+#include <vtkSphereSource.h>
+
+#include <fstream>
+#include <memory>
+#include <random>
 
 using namespace shapeworks;
 
@@ -267,6 +278,25 @@ TEST(MeshTests, toDistanceTransformTest1)
   ASSERT_TRUE(image == ground_truth);
 }
 
+TEST(MeshTests, toDistanceTransformTest2)
+{
+  Mesh femur(std::string(TEST_DATA_DIR) + "/femur.ply");
+  Image raster = femur.toImage();
+  Image exact = femur.toDistanceTransform(makeVector({1.0, 1.0, 1.0}), {0, 0, 0}, Point3({-1.0, -1.0, -1.0}), true);
+  Image banded = femur.toDistanceTransform(makeVector({1.0, 1.0, 1.0}), {0, 0, 0}, Point3({-1.0, -1.0, -1.0}), true, 2.0);
+
+  auto numPixels = exact.getITKImage()->GetLargestPossibleRegion().GetNumberOfPixels();
+  const float* r = raster.getITKImage()->GetBufferPointer();
+  const float* e = exact.getITKImage()->GetBufferPointer();
+  const float* b = banded.getITKImage()->GetBufferPointer();
+  for (size_t i = 0; i < numPixels; i++) {
+    // away from the surface the sign agrees with the rasterization
+    if (std::abs(e[i]) > 1.0)
+      ASSERT_EQ(e[i] < 0, r[i] > 0);
+    ASSERT_NEAR(b[i], std::max(-2.0f, std::min(2.0f, e[i])), 1e-5);
+  }
+}
+
 TEST(MeshTests, coverageTest)
 {
   Mesh femur(std::string(TEST_DATA_DIR) + "/femur.vtk");
@@ -277,6 +307,51 @@ TEST(MeshTests, coverageTest)
   ASSERT_TRUE(pelvis == baseline);
 }
 
+TEST(MeshTests, coverageSearchTest)
+{
+  // two overlapping jittered spheres, so rays hit faces at many angles and distances
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> jitter(-0.01, 0.01);
+  auto makeSphere = [&](double radius, double x) {
+    auto sphere = vtkSmartPointer<vtkSphereSource>::New();
+    sphere->SetRadius(radius);
+    sphere->SetCenter(x, 0.0, 0.0);
+    sphere->SetThetaResolution(60);
+    sphere->SetPhiResolution(60);
+    sphere->Update();
+    vtkSmartPointer<vtkPolyData> poly = sphere->GetOutput();
+    for (vtkIdType i = 0; i < poly->GetNumberOfPoints(); i++) {
+      double p[3];
+      poly->GetPoint(i, p);
+      poly->GetPoints()->SetPoint(i, p[0] + jitter(rng), p[1] + jitter(rng), p[2] + jitter(rng));
+    }
+    FEVTKimport import;
+    return std::shared_ptr<FEMesh>(import.Load(poly));
+  };
+  auto surf1 = makeSphere(1.0, 0.0);
+  auto surf2 = makeSphere(1.1, 0.4);
+  ASSERT_TRUE(surf1 && surf2);
+
+  // the bounding volume hierarchy finds the same intersections as testing every face
+  for (bool back : {false, true}) {
+    for (double angle : {0.0, 0.5}) {
+      std::vector<double> values[2];
+      for (bool bvh : {false, true}) {
+        FEAreaCoverage areaCoverage;
+        areaCoverage.AllowBackIntersection(back);
+        areaCoverage.SetAngleThreshold(angle);
+        areaCoverage.SetBackSearchRadius(back ? 0.2 : 0.0);
+        areaCoverage.UseBVH(bvh);
+        values[bvh] = areaCoverage.Apply(surf1, surf2);
+      }
+
+      ASSERT_EQ(values[0], values[1]);
+      ASSERT_GT(std::count(values[0].begin(), values[0].end(), 1.0), 0);
+      ASSERT_GT(std::count(values[0].begin(), values[0].end(), 0.0), 0);
+    }
+  }
+}
+
 TEST(MeshTests, distanceTest1)
 {
   Mesh femur(std::string(TEST_DATA_DIR) + "/femur.vtk");
@@ -303,6 +378,64 @@ TEST(MeshTests, distanceTest2)
   ASSERT_TRUE(femur2 == rev);
 }
 
+TEST(MeshTests, distanceTest3)
+{
+  Mesh femur1(std::string(TEST_DATA_DIR) + "/m03_L_femur.ply");
+  Mesh femur2(std::string(TEST_DATA_DIR) + "/m04_L_femur.ply");
+  Mesh::DistanceSummary summary;
+  femur1.distance(femur2, Mesh::DistanceMethod::POINT_TO_CELL, true, &summary);
+  femur2.distance(femur1, Mesh::DistanceMethod::POINT_TO_CELL);
+  auto standalone = femur1.distanceSummary(femur2, Mesh::DistanceMethod::POINT_TO_CELL);
+  ASSERT_NEAR(summary.mean, standalone.mean, 1e-6);
+  ASSERT_NEAR(summary.hausdorff, standalone.hausdorff, 1e-6);
+
+  auto fwd = femur1.getFieldRange("distance");
+  auto rev = femur2.getFieldRange("distance");
+  ASSERT_NEAR(summary.forwardMax, fwd[1], 1e-6);
+  ASSERT_NEAR(summary.backwardMax, rev[1], 1e-6);
+  ASSERT_NEAR(summary.hausdorff, std::max(fwd[1], rev[1]), 1e-6);
+  ASSERT_NEAR(summary.forwardMean, femur1.getFieldMean("distance"), 1e-6);
+
+  // the stored closest point is at the stored distance
+  auto closest = femur1.getField<vtkDataArray>("closest_point");
+  for (int i = 0; i < femur1.numPoints(); i += 100) {
+    double c[3];
+    closest->GetTuple(i, c);
+    Point3 p = femur1.getPoint(i);
+    double d = std::sqrt(std::pow(p[0] - c[0], 2) + std::pow(p[1] - c[1], 2) + std::pow(p[2] - c[2], 2));
+    ASSERT_NEAR(d, femur1.getFieldValue("distance", i), 1e-6);
+  }
+}
+
+TEST(MeshTests, distanceTest4)
+{
+  auto makeSphere = [](double radius) {
+    auto sphere = vtkSmartPointer<vtkSphereSource>::New();
+    sphere->SetRadius(radius);
+    sphere->SetThetaResolution(30);
+    sphere->SetPhiResolution(30);
+    sphere->Update();
+    return vtkSmartPointer<vtkPolyData>(sphere->GetOutput());
+  };
+
+  // a poly line inside the target has no surface to be closest to
+  vtkSmartPointer<vtkPolyData> withLine = makeSphere(1.0);
+  const vtkIdType line[3] = {withLine->GetPoints()->InsertNextPoint(0.0, 0.0, 0.5),
+                             withLine->GetPoints()->InsertNextPoint(0.5, 0.0, 0.0),
+                             withLine->GetPoints()->InsertNextPoint(0.0, 0.5, 0.0)};
+  auto lines = vtkSmartPointer<vtkCellArray>::New();
+  lines->InsertNextCell(3, line);
+  withLine->SetLines(lines);
+
+  Mesh source1(makeSphere(0.5));
+  Mesh source2(makeSphere(0.5));
+  source1.distance(Mesh(makeSphere(1.0)), Mesh::DistanceMethod::POINT_TO_CELL);
+  source2.distance(Mesh(withLine), Mesh::DistanceMethod::POINT_TO_CELL);
+  for (int i = 0; i < source1.numPoints(); i++) {
+    ASSERT_NEAR(source1.getFieldValue("distance", i), source2.getFieldValue("distance", i), 1e-6);
+  }
+}
+
 TEST(MeshTests, fieldTest1)
 {
   Mesh dist(std::string(TEST_DATA_DIR) + "/meshdistance2.vtk");
@@ -396,3 +529,150 @@ TEST(MeshTests, warpTest2)
   Mesh output = MeshUtils::warpMesh(movingPoints.transpose(), W, Fref);
   ASSERT_TRUE(output == ellipsoid_warped);
 }
+
+TEST(MeshTests, warpTest3)
+{
+  Mesh ellipsoid(std::string(TEST_DATA_DIR) + "/ellipsoid_0.ply");
+  Eigen::MatrixXd Vref = MeshUtils::distilVertexInfo(ellipsoid);
+  Eigen::MatrixXi Fref = MeshUtils::distilFaceInfo(ellipsoid);
+  std::string staticPath = std::string(TEST_DATA_DIR) + "/ellipsoid_0.particles";
+  std::string movingPath = std::string(TEST_DATA_DIR) + "/ellipsoid_1.particles";
+  std::vector<std::string> paths;
+  paths.push_back(staticPath);
+  paths.push_back(movingPath);
+  ParticleSystem particlesystem(paths);
+  Eigen::MatrixXd allPts = particlesystem.Particles();
+  Eigen::MatrixXd staticPoints = allPts.col(0);
+  Eigen::MatrixXd movingPoints = allPts.col(1);
+  staticPoints.resize(3, 128);
+  movingPoints.resize(3, 128);
+  Eigen::MatrixXd W = MeshUtils::generateWarpMatrix(Vref, Fref, staticPoints.transpose());
+  double maxDropped;
+  Eigen::SparseMatrix<double> sparseW = MeshUtils::sparsifyWarpMatrix(W, 1e-3, 0, &maxDropped);
+  Mesh dense = MeshUtils::warpMesh(movingPoints.transpose(), W, Fref);
+  Mesh sparse = MeshUtils::warpMesh(movingPoints.transpose(), sparseW, Fref);
+
+  ASSERT_LT(sparseW.nonZeros(), W.size());
+  ASSERT_LT(maxDropped, 0.1);
+  ASSERT_TRUE(dense.compareAllFaces(sparse));
+  Eigen::MatrixXd denseV = MeshUtils::distilVertexInfo(dense);
+  Eigen::MatrixXd diff = denseV - MeshUtils::distilVertexInfo(sparse);
+  double extent = (denseV.colwise().maxCoeff() - denseV.colwise().minCoeff()).norm();
+  ASSERT_LT(diff.rowwise().norm().maxCoeff(), 1e-2 * extent);
+
+  // solved directly in sparse form, the warp matches the sparsified dense one
+  Eigen::SparseMatrix<double> directW = MeshUtils::generateSparseWarpMatrix(Vref, Fref, staticPoints.transpose(), 1e-3);
+  ASSERT_EQ(directW.rows(), sparseW.rows());
+  ASSERT_EQ(directW.cols(), sparseW.cols());
+  Mesh direct = MeshUtils::warpMesh(movingPoints.transpose(), directW, Fref);
+  diff = MeshUtils::distilVertexInfo(direct) - MeshUtils::distilVertexInfo(sparse);
+  ASSERT_LT(diff.rowwise().norm().maxCoeff(), 1e-3 * extent);
+}
+
+TEST(MeshTests, warpTest4)
+{
+  Mesh ellipsoid(std::string(TEST_DATA_DIR) + "/ellipsoid_0.ply");
+  Mesh ellipsoid_warped(std::string(TEST_DATA_DIR) + "/ellipsoid_warped.ply");
+  Eigen::MatrixXd Vref = MeshUtils::distilVertexInfo(ellipsoid);
+  Eigen::MatrixXi Fref = MeshUtils::distilFaceInfo(ellipsoid);
+  std::string staticPath = std::string(TEST_DATA_DIR) + "/ellipsoid_0.particles";
+  std::string movingPath = std::string(TEST_DATA_DIR) + "/ellipsoid_1.particles";
+  std::vector<std::string> paths;
+  paths.push_back(staticPath);
+  paths.push_back(movingPath);
+  ParticleSystem particlesystem(paths);
+  Eigen::MatrixXd allPts = particlesystem.Particles();
+  Eigen::MatrixXd staticPoints = allPts.col(0);
+  staticPoints.resize(3, 128);
+  Eigen::MatrixXd W = MeshUtils::generateWarpMatrix(Vref, Fref, staticPoints.transpose());
+  std::vector<Mesh> outputs = MeshUtils::warpMeshes(allPts, W, Fref);
+
+  ASSERT_EQ(outputs.size(), 2);
+  ASSERT_TRUE(outputs[1] == ellipsoid_warped);
+  ASSERT_EQ(outputs[0].getVTKMesh()->GetPolys()->GetData(), outputs[1].getVTKMesh()->GetPolys()->GetData());
+}
+
+TEST(MeshTests, geodesicStoreTest)
+{
+  GeodesicStore store;
+  store.resize(5);
+  store.insert(3, 1, 2.0f);
+  store.insert(0, 4, 1.5f);
+  store.insert(1, 3, 2.5f);
+  store.finalize();
+
+  ASSERT_EQ(store.numEntries(), 2);
+  ASSERT_EQ(store.getDistance(1, 3, -1.0f), 2.5f);
+  ASSERT_EQ(store.getDistance(4, 0, -1.0f), 1.5f);
+  ASSERT_EQ(store.getDistance(2, 3, -1.0f), -1.0f);
+
+  const std::string filename = "geodesic_store_test.geo";
+  ASSERT_TRUE(store.save(filename, 10.0f, GeodesicStore::Precision::Float16));
+
+  GeodesicStore loaded;
+  float stopDistance = 0.0f;
+  ASSERT_TRUE(loaded.load(filename, stopDistance));
+  ASSERT_EQ(stopDistance, 10.0f);
+  ASSERT_EQ(loaded.numVertices(), 5);
+  ASSERT_EQ(loaded.getDistance(3, 1, -1.0f), 2.5f);
+  ASSERT_EQ(loaded.getDistance(0, 4, -1.0f), 1.5f);
+
+  // merging into a mapped store copies it
+  loaded.insert(2, 0, 0.75f);
+  loaded.finalize();
+  ASSERT_EQ(loaded.numEntries(), 3);
+  ASSERT_EQ(loaded.getDistance(0, 2, -1.0f), 0.75f);
+  ASSERT_EQ(loaded.getDistance(1, 3, -1.0f), 2.5f);
+
+  // corrupt files are rejected instead of being read out of bounds
+  auto corrupt = [&](std::streamoff position, uint64_t value) {
+    ASSERT_TRUE(store.save(filename, 10.0f, GeodesicStore::Precision::Float16));
+    std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(position);
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  const std::streamoff numEntriesPosition = 24, offsetsPosition = 32;
+  GeodesicStore rejected;
+  corrupt(numEntriesPosition, UINT64_MAX / 2);  // section offsets overflow
+  ASSERT_FALSE(rejected.load(filename, stopDistance));
+  corrupt(numEntriesPosition, 1);               // last row offset past the entries
+  ASSERT_FALSE(rejected.load(filename, stopDistance));
+  corrupt(offsetsPosition + 8 * 2, 5);          // row offset past the entries
+  ASSERT_FALSE(rejected.load(filename, stopDistance));
+  corrupt(offsetsPosition + 8 * 3, 2);          // decreasing row offsets
+  ASSERT_FALSE(rejected.load(filename, stopDistance));
+
+  std::remove(filename.c_str());
+}
+
+TEST(MeshTests, fimParallelSolveTest)
+{
+  // unit sphere, where the geodesic distance between two points is the angle between them
+  std::unique_ptr<TriMesh> sphere(trimesh::make_sphere_subdiv(20, 3));
+  meshFIM fim;
+  fim.setSpeedType(ONE);
+  fim.SetMesh(sphere.get());
+
+  const int nv = sphere->vertices.size();
+  const std::vector<int> seeds = {0, nv / 2};
+  for (float stopDistance : {0.5f, 10.0f}) {
+    const std::vector<float> serial = fim.ComputeDistances(seeds, stopDistance, false);
+    const std::vector<float> parallel = fim.ComputeDistances(seeds, stopDistance, true);
+    ASSERT_EQ(serial.size(), nv);
+    ASSERT_EQ(parallel.size(), nv);
+
+    for (int v = 0; v < nv; v++) {
+      float exact = 10.0f;
+      for (int seed : seeds) {
+        const float cosine = normalized(sphere->vertices[v]) DOT normalized(sphere->vertices[seed]);
+        exact = std::min(exact, std::acos(std::max(-1.0f, std::min(1.0f, cosine))));
+      }
+
+      // both solvers find the distances within the stop distance, and agree on them
+      if (exact < 0.8f * stopDistance) {
+        ASSERT_NEAR(serial[v], exact, 0.05f + 0.05f * exact);
+        ASSERT_NEAR(parallel[v], serial[v], 1e-3f * (1.0f + serial[v]));
+      }
+    }
+  }
+}
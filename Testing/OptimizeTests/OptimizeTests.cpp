@@ -8,9 +8,32 @@
 
 #include "Optimize.h"
 #include "OptimizeParameterFile.h"
+#include "CheckpointWriter.h"
 #include <Libs/Project/Project.h>
 #include <Libs/Optimize/OptimizeParameters.h>
 #include "ParticleShapeStatistics.h"
+#include "ParticleSystem/itkParticleImplicitSurfaceDomain.h"
+#include "ParticleSystem/itkParticleSurfaceNeighborhood.h"
+#include "ParticleSystem/itkParticleGridNeighborhood.h"
+#include "ParticleSystem/itkParticleGramEigensystem.h"
+#include "ParticleSystem/itkParticleEnsembleEntropyFunction.h"
+#include "ParticleSystem/itkParticleMeshBasedGeneralEntropyGradientFunction.h"
+#include "ParticleSystem/itkParticleGradientDescentPositionOptimizer.h"
+#include "ParticleSystem/itkParticleShapeMatrixAttribute.h"
+#include "ParticleSystem/VtkMeshWrapper.h"
+
+#include <vnl/algo/vnl_svd.h>
+
+#include <vtkSphereSource.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <type_traits>
 
 using namespace shapeworks;
 
@@ -419,3 +442,760 @@ TEST(OptimizeTests, project_test) {
   double value = values[values.size() - 1];
   ASSERT_LT(value, 100);
 }
+
+//---------------------------------------------------------------------------
+// creates an in-memory signed distance transform of a sphere
+static itk::Image<float, 3>::Pointer create_sphere_distance_transform(int size, double radius)
+{
+  using ImageType = itk::Image<float, 3>;
+  ImageType::Pointer image = ImageType::New();
+  ImageType::RegionType region;
+  region.SetSize({static_cast<itk::SizeValueType>(size), static_cast<itk::SizeValueType>(size),
+                  static_cast<itk::SizeValueType>(size)});
+  image->SetRegions(region);
+  image->Allocate();
+
+  const double center = (size - 1) / 2.0;
+  itk::ImageRegionIterator<ImageType> it(image, region);
+  for (it.GoToBegin(); !it.IsAtEnd(); ++it) {
+    const auto idx = it.GetIndex();
+    double sum = 0.0;
+    for (int i = 0; i < 3; i++) {
+      sum += (idx[i] - center) * (idx[i] - center);
+    }
+    it.Set(static_cast<float>(std::sqrt(sum) - radius));
+  }
+  return image;
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, grid_neighborhood_test)
+{
+  using DomainType = itk::ParticleImplicitSurfaceDomain<float>;
+  using PointType = DomainType::PointType;
+
+  auto domain = DomainType::New();
+  domain->SetImage(create_sphere_distance_transform(48, 16.0), 1e10);
+
+  auto surface_neighborhood = itk::ParticleSurfaceNeighborhood<itk::Image<float, 3>>::New();
+  auto grid = itk::ParticleGridNeighborhood<3>::New();
+  surface_neighborhood->SetDomain(domain);
+  grid->SetDomain(domain);
+
+  // use the base class interface, the subclasses hide some of the overloads
+  itk::ParticleNeighborhood<3> *tree = surface_neighborhood.GetPointer();
+
+  // random particles on the sphere surface
+  std::mt19937 generator(42);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  const int num_particles = 4096;
+  std::vector<PointType> points(num_particles);
+  for (int i = 0; i < num_particles; i++) {
+    double v[3] = {normal(generator), normal(generator), normal(generator)};
+    double mag = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    for (int d = 0; d < 3; d++) {
+      points[i][d] = 23.5 + 16.0 * v[d] / mag;
+    }
+    tree->AddPosition(points[i], i);
+    grid->AddPosition(points[i], i);
+  }
+
+  itk::ParticleNeighborhood<3>::PointVectorType grid_result;
+  std::vector<double> tree_weights, grid_weights;
+  std::vector<bool> present(num_particles, true);
+
+  // the two neighborhoods must return the same neighbors and weights
+  auto compare = [&](double radius) {
+    for (int i = 0; i < points.size(); i++) {
+      if (!present[i]) {
+        continue;
+      }
+      auto tree_result = tree->FindNeighborhoodPoints(points[i], i, tree_weights, radius);
+      grid->FindNeighborhoodPoints(points[i], i, grid_weights, radius, grid_result);
+      ASSERT_EQ(tree_result.size(), grid_result.size());
+
+      std::vector<std::pair<unsigned int, double>> a, b;
+      for (int n = 0; n < tree_result.size(); n++) {
+        a.push_back(std::make_pair(tree_result[n].Index, tree_weights[n]));
+        b.push_back(std::make_pair(grid_result[n].Index, grid_weights[n]));
+      }
+      std::sort(a.begin(), a.end());
+      std::sort(b.begin(), b.end());
+      for (int n = 0; n < a.size(); n++) {
+        ASSERT_EQ(a[n].first, b[n].first);
+        ASSERT_DOUBLE_EQ(a[n].second, b[n].second);
+      }
+    }
+  };
+
+  // the grid adapts its cells to the search radius, so check a range of radii
+  for (double radius : {3.0, 8.0, 1.0}) {
+    // query once so the grid sees the new radius, then move some of the
+    // particles around, which rebuilds the grid for it
+    grid->FindNeighborhoodPoints(points[0], 0, radius, grid_result);
+    for (int i = 0; i < num_particles; i += 3) {
+      points[i][0] += radius / 2.0;
+      tree->SetPosition(points[i], i);
+      grid->SetPosition(points[i], i);
+    }
+    ASSERT_GE(grid->GetCellSize(), radius / 2.0);
+    ASSERT_LE(grid->GetCellSize(), radius * 2.0);
+    compare(radius);
+  }
+
+  const double radius = 3.0;
+  grid->FindNeighborhoodPoints(points[0], 0, radius, grid_result);
+
+  // removed particles keep their sorted slot until the next sort, and
+  // particles added in between are searched without sorting
+  for (int i = 0; i < num_particles; i += 5) {
+    tree->RemovePosition(i);
+    grid->RemovePosition(i);
+    present[i] = false;
+  }
+  for (int i = 0; i < 16; i++) {
+    PointType p = points[i];
+    p[1] += 0.5;
+    points.push_back(p);
+    present.push_back(true);
+    tree->AddPosition(p, points.size() - 1);
+    grid->AddPosition(p, points.size() - 1);
+  }
+  compare(radius);
+
+  // small moves leave the particles in the cells they are sorted in
+  for (int step = 0; step < 4; step++) {
+    for (int i = 1; i < points.size(); i += 2) {
+      if (present[i]) {
+        points[i][2] += radius / 16.0;
+        tree->SetPosition(points[i], i);
+        grid->SetPosition(points[i], i);
+      }
+    }
+    compare(radius);
+  }
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, gram_eigensystem_test)
+{
+  using MatrixType = itk::ParticleGramEigensystem::MatrixType;
+
+  std::mt19937 generator(42);
+  std::normal_distribution<double> normal(0.0, 1.0);
+
+  const int num_dims = 300;
+  const int num_samples = 20;
+  MatrixType Y(num_dims, num_samples);
+  for (int r = 0; r < num_dims; r++) {
+    for (int c = 0; c < num_samples; c++) {
+      Y(r, c) = normal(generator) * (c + 1);
+    }
+  }
+
+  itk::ParticleGramEigensystem eigensystem;
+  eigensystem.SetRefreshInterval(5);
+  eigensystem.SetDriftTolerance(0.05);
+
+  MatrixType projection;
+  ASSERT_TRUE(eigensystem.Update(Y, projection));
+
+  // a small move keeps the basis and only updates the eigenvalues
+  MatrixType Y2 = Y;
+  for (int r = 0; r < num_dims; r++) {
+    for (int c = 0; c < num_samples; c++) {
+      Y2(r, c) += 0.001 * normal(generator);
+    }
+  }
+  ASSERT_FALSE(eigensystem.Update(Y2, projection));
+
+  vnl_svd<double> svd(Y2.transpose() * Y2);
+  std::vector<double> exact, updated;
+  for (int i = 0; i < num_samples; i++) {
+    exact.push_back(svd.W(i));
+    updated.push_back(eigensystem.GetEigenvalues()[i]);
+  }
+  std::sort(exact.begin(), exact.end());
+  std::sort(updated.begin(), updated.end());
+  for (int i = 0; i < num_samples; i++) {
+    ASSERT_NEAR(exact[i], updated[i], 1e-3 * exact[i]);
+  }
+
+  // a large move exceeds the drift tolerance and forces a refresh
+  ASSERT_TRUE(eigensystem.Update(Y2 * 2.0, projection));
+}
+
+//---------------------------------------------------------------------------
+// A particle system with one domain per shape and the same number of
+// particles in every domain.  The shape matrices are set directly, the
+// positions only provide the particle counts.
+static itk::ParticleSystem<3>::Pointer create_particle_system(int num_shapes, int num_particles)
+{
+  auto domain = itk::ParticleImplicitSurfaceDomain<float>::New();
+  domain->SetImage(create_sphere_distance_transform(48, 16.0), 1e10);
+
+  auto system = itk::ParticleSystem<3>::New();
+  system->SetDomainsPerShape(1);
+  itk::ParticleSystem<3>::PointType point;
+  point[0] = 23.5; point[1] = 23.5; point[2] = 39.5;
+  for (int d = 0; d < num_shapes; d++) {
+    system->AddDomain(domain);
+    for (int p = 0; p < num_particles; p++) {
+      system->AddPosition(point, d);
+    }
+  }
+  return system;
+}
+
+//---------------------------------------------------------------------------
+// Y * (Y^T Y / (num_samples - 1) + min_variance * I)^-1 for the centered shape matrix Y
+static vnl_matrix<double> reference_points_update(const vnl_matrix<double>& Y, double min_variance)
+{
+  const unsigned int num_samples = Y.cols();
+  vnl_matrix<double> A = Y.transpose() * Y / static_cast<double>(num_samples - 1);
+  for (unsigned int i = 0; i < num_samples; i++) {
+    A(i, i) += min_variance;
+  }
+  return Y * vnl_svd<double>(A).inverse();
+}
+
+//---------------------------------------------------------------------------
+static vnl_matrix<double> centered(const vnl_matrix<double>& shapes)
+{
+  vnl_matrix<double> Y = shapes;
+  for (unsigned int r = 0; r < Y.rows(); r++) {
+    const double mean = Y.get_row(r).mean();
+    for (unsigned int c = 0; c < Y.cols(); c++) {
+      Y(r, c) -= mean;
+    }
+  }
+  return Y;
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, ensemble_entropy_update_test)
+{
+  using FunctionType = itk::ParticleEnsembleEntropyFunction<3>;
+  const double min_variance = 1e-3;
+
+  std::mt19937 generator(42);
+  std::normal_distribution<double> normal(0.0, 1.0);
+
+  for (int num_samples : {5, 20}) {
+    for (int num_particles : {16, 128}) {
+      auto system = create_particle_system(num_samples, num_particles);
+
+      const int num_dims = 3 * num_particles;
+      vnl_matrix<double> shapes(num_dims, num_samples);
+      for (int r = 0; r < num_dims; r++) {
+        for (int c = 0; c < num_samples; c++) {
+          shapes(r, c) = normal(generator) * (c + 1);
+        }
+      }
+      auto shape_matrix = FunctionType::ShapeMatrixType::New();
+      shape_matrix->SetMatrix(shapes);
+
+      auto function = FunctionType::New();
+      function->SetShapeMatrix(shape_matrix);
+      function->SetParticleSystem(system);
+      function->SetMinimumVariance(min_variance);
+      function->UseEntropy();
+      function->BeforeIteration();
+
+      const vnl_matrix<double> Y = centered(shapes);
+      const vnl_matrix<double> B = reference_points_update(Y, min_variance);
+
+      for (int d = 0; d < num_samples; d++) {
+        for (int idx = 0; idx < num_particles; idx++) {
+          double maxdt, energy;
+          const auto gradient = function->Evaluate(idx, d, system, maxdt, energy);
+
+          // the energy uses the 3x3 block of B B^T belonging to the particle
+          const vnl_matrix<double> Bk = B.extract(3, num_samples, 3 * idx, 0);
+          const vnl_vector<double> x = Y.get_column(d).extract(3, 3 * idx);
+          const vnl_vector<double> Bx = Bk.transpose() * x;
+          ASSERT_NEAR(energy, dot_product(Bx, Bx), 1e-8 * (1.0 + dot_product(Bx, Bx)));
+
+          for (int i = 0; i < 3; i++) {
+            ASSERT_NEAR(gradient[i], B(3 * idx + i, d), 1e-8 * B.frobenius_norm());
+          }
+        }
+      }
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, mesh_based_entropy_update_test)
+{
+  using FunctionType = itk::ParticleMeshBasedGeneralEntropyGradientFunction<3>;
+  const double min_variance = 1e-3;
+
+  std::mt19937 generator(42);
+  std::normal_distribution<double> normal(0.0, 1.0);
+
+  for (int num_samples : {5, 20}) {
+    for (int num_particles : {16, 128}) {
+      auto system = create_particle_system(num_samples, num_particles);
+
+      // positions and normals, 6 values per particle
+      const int values_per_particle = 6;
+      const int num_dims = values_per_particle * num_particles;
+      vnl_matrix<double> shapes(num_dims, num_samples);
+      for (int r = 0; r < num_dims; r++) {
+        for (int c = 0; c < num_samples; c++) {
+          shapes(r, c) = normal(generator) * (c + 1);
+        }
+      }
+      vnl_matrix<double> gradients(num_dims, 3 * num_samples);
+      for (int r = 0; r < num_dims; r++) {
+        for (int c = 0; c < 3 * num_samples; c++) {
+          gradients(r, c) = normal(generator);
+        }
+      }
+      auto shape_data = FunctionType::ShapeDataType::New();
+      shape_data->SetMatrix(shapes);
+      auto shape_gradient = FunctionType::ShapeGradientType::New();
+      shape_gradient->SetMatrix(gradients);
+
+      auto function = FunctionType::New();
+      function->SetShapeData(shape_data);
+      function->SetShapeGradient(shape_gradient);
+      function->SetParticleSystem(system);
+      function->SetDomainsPerShape(1);
+      function->SetAttributesPerDomain({0});
+      function->SetXYZ(0, true);
+      function->SetNormals(0, true);
+      function->SetMinimumVariance(min_variance);
+      function->UseEntropy();
+      function->BeforeIteration();
+
+      const vnl_matrix<double> Y = centered(shapes);
+      const vnl_matrix<double> B = reference_points_update(Y, min_variance);
+
+      for (int d = 0; d < num_samples; d++) {
+        for (int idx = 0; idx < num_particles; idx++) {
+          double maxdt, energy;
+          const auto gradient = function->Evaluate(idx, d, system, maxdt, energy);
+
+          // the energy uses the 6x6 block of B B^T belonging to the particle
+          const int row = values_per_particle * idx;
+          const vnl_matrix<double> Bk = B.extract(values_per_particle, num_samples, row, 0);
+          const vnl_vector<double> y = Y.get_column(d).extract(values_per_particle, row);
+          const vnl_vector<double> By = Bk.transpose() * y;
+          ASSERT_NEAR(energy, dot_product(By, By), 1e-8 * (1.0 + dot_product(By, By)));
+
+          // the update of the shape values is mapped to the particle position
+          // through the gradient of the values
+          const vnl_matrix<double> J = gradients.extract(values_per_particle, 3, row, 3 * d);
+          const vnl_vector<double> expected = J.transpose() * B.get_column(d).extract(values_per_particle, row);
+          for (int i = 0; i < 3; i++) {
+            ASSERT_NEAR(gradient[i], expected[i], 1e-8 * B.frobenius_norm());
+          }
+        }
+      }
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, mesh_snap_parallel_test)
+{
+  const double radius = 10.0;
+  auto sphere = vtkSmartPointer<vtkSphereSource>::New();
+  sphere->SetRadius(radius);
+  sphere->SetThetaResolution(400);
+  sphere->SetPhiResolution(400);
+  sphere->Update();
+
+  shapeworks::VtkMeshWrapper mesh(sphere->GetOutput());
+
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<double> uniform(-2.0 * radius, 2.0 * radius);
+  const int num_points = 10000;
+  std::vector<shapeworks::VtkMeshWrapper::PointType> points(num_points);
+  for (auto &p : points) {
+    for (int i = 0; i < 3; i++) {
+      p[i] = uniform(generator);
+    }
+  }
+
+  // snapped points lie on the (tessellated) sphere, serially and in parallel
+  std::vector<shapeworks::VtkMeshWrapper::PointType> expected(num_points);
+  for (int n = 0; n < num_points; n++) {
+    expected[n] = mesh.SnapToMesh(points[n], -1);
+    ASSERT_NEAR(expected[n].GetVectorFromOrigin().GetNorm(), radius, 0.01);
+  }
+
+  std::vector<shapeworks::VtkMeshWrapper::PointType> snapped(num_points);
+  tbb::task_arena arena(4);
+  arena.execute([&] {
+    tbb::parallel_for(tbb::blocked_range<int>{0, num_points}, [&](const tbb::blocked_range<int> &r) {
+      for (int n = r.begin(); n < r.end(); n++) {
+        snapped[n] = mesh.SnapToMesh(points[n], -1);
+      }
+    });
+  });
+  for (int n = 0; n < num_points; n++) {
+    ASSERT_EQ(snapped[n], expected[n]);
+  }
+
+  // particles query the cached normals of their neighbors while their own
+  // entries are updated on other threads, like in the Jacobi update
+  const int num_particles = 1000;
+  for (int k = 0; k < num_particles; k++) {
+    mesh.InvalidateParticle(k);
+  }
+  std::vector<shapeworks::VtkMeshWrapper::NormalType> normals(num_points);
+  for (int n = 0; n < num_points; n++) {
+    normals[n] = mesh.SampleNormalAtPoint(expected[n], -1);
+  }
+
+  const int num_neighbors = 8;
+  std::vector<int> mismatches(num_particles, 0);
+  arena.execute([&] {
+    tbb::parallel_for(tbb::blocked_range<int>{0, num_particles}, [&](const tbb::blocked_range<int> &r) {
+      for (int k = r.begin(); k < r.end(); k++) {
+        for (int round = 0; round < num_points / num_particles; round++) {
+          for (int j = 0; j <= num_neighbors; j++) {
+            const int particle = (k + j) % num_particles;
+            const int n = (particle + round * num_particles) % num_points;
+            const auto normal = mesh.SampleNormalAtPoint(expected[n], particle);
+            if ((normal - normals[n]).magnitude() > 1e-4) {
+              mismatches[k]++;
+            }
+          }
+        }
+      }
+    });
+  });
+  for (int k = 0; k < num_particles; k++) {
+    ASSERT_EQ(mismatches[k], 0);
+  }
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, domain_cache_test)
+{
+  std::string test_location = std::string(TEST_DATA_DIR) + std::string("/sphere");
+  chdir(test_location.c_str());
+
+  const std::string filename = "sphere10_DT_baseline.nrrd";
+  const std::string cache_dir = ".";
+  const double narrow_band = 4.0;
+
+  auto reader = itk::ImageFileReader<Optimize::ImageType>::New();
+  reader->SetFileName(filename);
+  reader->Update();
+  auto built = Sampler::CreateImageDomain(reader->GetOutput(), narrow_band);
+
+  const auto key = Sampler::ImageDomainCacheKey(filename, narrow_band);
+  const auto other_key = Sampler::ImageDomainCacheKey(filename, narrow_band + 1.0);
+  ASSERT_EQ(key, Sampler::ImageDomainCacheKey(filename, narrow_band));
+  ASSERT_NE(key, other_key);
+  ASSERT_NE(key, Sampler::ImageDomainCacheKey("sphere10.nrrd", narrow_band));
+  std::remove((cache_dir + "/" + key + ".vdb").c_str());
+  ASSERT_TRUE(Sampler::LoadImageDomainCache(cache_dir, key).IsNull());
+
+  Sampler::SaveImageDomainCache(cache_dir, key, built);
+  ASSERT_TRUE(Sampler::LoadImageDomainCache(cache_dir, other_key).IsNull());
+  auto cached = Sampler::LoadImageDomainCache(cache_dir, key);
+  ASSERT_FALSE(cached.IsNull());
+
+  ASSERT_EQ(cached->GetSize(), built->GetSize());
+  ASSERT_EQ(cached->GetIndex(), built->GetIndex());
+  ASSERT_EQ(cached->GetLowerBound(), built->GetLowerBound());
+  ASSERT_EQ(cached->GetUpperBound(), built->GetUpperBound());
+  ASSERT_EQ(cached->GetSurfaceMeanCurvature(), built->GetSurfaceMeanCurvature());
+  ASSERT_EQ(cached->GetSurfaceStdDevCurvature(), built->GetSurfaceStdDevCurvature());
+
+  // the zero crossing candidates come back in the same order
+  built->UpdateZeroCrossingPoint();
+  cached->UpdateZeroCrossingPoint();
+  ASSERT_EQ(cached->GetZeroCrossingPoint(), built->GetZeroCrossingPoint());
+
+  // the cached grids sample the same values near the surface
+  auto p = built->GetValidLocationNear(built->GetLowerBound());
+  ASSERT_EQ(cached->GetValidLocationNear(cached->GetLowerBound()), p);
+  built->ApplyConstraints(p, -1);
+  ASSERT_EQ(cached->Sample(p), built->Sample(p));
+  ASSERT_EQ(cached->SampleGradientAtPoint(p, -1), built->SampleGradientAtPoint(p, -1));
+  ASSERT_EQ(cached->SampleGradNAtPoint(p, -1), built->SampleGradNAtPoint(p, -1));
+  ASSERT_EQ(cached->GetCurvature(p, -1), built->GetCurvature(p, -1));
+
+  std::remove((cache_dir + "/" + key + ".vdb").c_str());
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, narrow_band_conversion_test)
+{
+  std::string test_location = std::string(TEST_DATA_DIR) + std::string("/sphere");
+  chdir(test_location.c_str());
+
+  auto reader = itk::ImageFileReader<Optimize::ImageType>::New();
+  reader->SetFileName("sphere10_DT_baseline.nrrd");
+  reader->Update();
+  auto image = reader->GetOutput();
+
+  const double narrow_band = 4.0;
+  auto domain = Sampler::CreateImageDomain(image, narrow_band);
+
+  // every voxel within the band is copied exactly
+  const double narrow_band_world = image->GetSpacing().GetVnlVector().max_value() * narrow_band;
+  int num_in_band = 0;
+  itk::ImageRegionConstIteratorWithIndex<Optimize::ImageType> it(image, image->GetRequestedRegion());
+  for (; !it.IsAtEnd(); ++it) {
+    if (std::abs(it.Get()) > narrow_band_world) {
+      continue;
+    }
+    Optimize::ImageType::PointType p;
+    image->TransformIndexToPhysicalPoint(it.GetIndex(), p);
+    ASSERT_NEAR(domain->Sample(p), it.Get(), 1e-4);
+    num_in_band++;
+  }
+  ASSERT_GT(num_in_band, 0);
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, checkpoint_writer_test)
+{
+  const std::string filename = "checkpoint_writer_test.txt";
+  std::remove(filename.c_str());
+
+  auto checkpoint_of = [&](int value, int delay_ms) {
+    return CheckpointWriter::Checkpoint{{filename, [value, delay_ms](const std::string& temp_file) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+      std::ofstream out(temp_file);
+      out << value;
+      return static_cast<bool>(out);
+    }}};
+  };
+  auto read_value = [&] {
+    int value = -1;
+    std::ifstream in(filename);
+    in >> value;
+    return value;
+  };
+
+  // checkpoints are written in order, the last one queued wins
+  {
+    CheckpointWriter writer(2);
+    for (int i = 0; i < 10; i++) {
+      writer.Enqueue(checkpoint_of(i, 5));
+    }
+    writer.Flush();
+    ASSERT_EQ(read_value(), 9);
+
+    // a synchronous write comes after the pending ones
+    writer.Enqueue(checkpoint_of(10, 20));
+    ASSERT_TRUE(writer.Write(checkpoint_of(11, 0)));
+    ASSERT_EQ(read_value(), 11);
+
+    // pending checkpoints are written on destruction
+    writer.Enqueue(checkpoint_of(12, 20));
+  }
+  ASSERT_EQ(read_value(), 12);
+
+  // a failed write leaves the previous file in place
+  CheckpointWriter::Checkpoint failing{{filename, [](const std::string&) { return false; }}};
+  {
+    CheckpointWriter writer;
+    ASSERT_FALSE(writer.Write(failing));
+  }
+  ASSERT_EQ(read_value(), 12);
+
+  // a failed background write is reported once, by the next call
+  {
+    CheckpointWriter writer;
+    writer.Enqueue(failing);
+    ASSERT_THROW(writer.Flush(), std::runtime_error);
+    writer.Flush();
+
+    writer.Enqueue(failing);
+    ASSERT_THROW(writer.Write(checkpoint_of(13, 0)), std::runtime_error);
+    ASSERT_EQ(read_value(), 12);
+    ASSERT_TRUE(writer.Write(checkpoint_of(13, 0)));
+  }
+  ASSERT_EQ(read_value(), 13);
+
+  // a failure nobody asked about is only logged by the destructor, which does not throw
+  static_assert(std::is_nothrow_destructible<CheckpointWriter>::value, "CheckpointWriter destructor throws");
+  auto write_failing = [&] {
+    CheckpointWriter writer;
+    writer.Enqueue(failing);
+  };
+  ASSERT_NO_THROW(write_failing());
+  ASSERT_EQ(read_value(), 13);
+
+  std::remove(filename.c_str());
+}
+
+//---------------------------------------------------------------------------
+// Energy read from the shape matrix, like the correspondence term: the energy
+// of a particle is its x coordinate as seen by the shape matrix attribute.
+// Particle 0 is pushed downhill (-x) and particle 1 uphill (+x).
+class ShapeMatrixEnergyFunction : public itk::ParticleVectorFunction<3> {
+public:
+  typedef ShapeMatrixEnergyFunction Self;
+  typedef itk::SmartPointer<Self> Pointer;
+  itkNewMacro(Self);
+
+  using ShapeMatrixType = itk::ParticleShapeMatrixAttribute<double, 3>;
+
+  VectorType Evaluate(unsigned int idx, unsigned int d, const ParticleSystemType *system,
+                      double &maxtimestep) const override
+  {
+    double energy;
+    return Evaluate(idx, d, system, maxtimestep, energy);
+  }
+
+  VectorType Evaluate(unsigned int idx, unsigned int d, const ParticleSystemType *system,
+                      double &maxtimestep, double &energy) const override
+  {
+    maxtimestep = 1e10;
+    energy = Energy(idx, d, system);
+    VectorType gradient(0.0);
+    gradient[0] = idx == 0 ? 1.0 : -1.0;
+    return gradient;
+  }
+
+  double Energy(unsigned int idx, unsigned int d, const ParticleSystemType *) const override
+  {
+    return m_ShapeMatrix->operator()(3 * idx, d);
+  }
+
+  itk::ParticleVectorFunction<3>::Pointer Clone() override
+  {
+    Pointer copy = Self::New();
+    copy->m_ShapeMatrix = m_ShapeMatrix;
+    return copy.GetPointer();
+  }
+
+  ShapeMatrixType::Pointer m_ShapeMatrix;
+};
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, position_update_rejection_test)
+{
+  using DomainType = itk::ParticleImplicitSurfaceDomain<float>;
+  using OptimizerType = itk::ParticleGradientDescentPositionOptimizer<float, 3>;
+
+  auto domain = DomainType::New();
+  domain->SetImage(create_sphere_distance_transform(48, 16.0), 1e10);
+
+  for (bool jacobi : {false, true}) {
+    auto system = itk::ParticleSystem<3>::New();
+    system->SetDomainsPerShape(1);
+    auto shape_matrix = ShapeMatrixEnergyFunction::ShapeMatrixType::New();
+    system->RegisterAttribute(shape_matrix);
+    system->AddDomain(domain);
+    system->SetNeighborhood(0, itk::ParticleSurfaceNeighborhood<itk::Image<float, 3>>::New());
+
+    // the poles of the sphere, where the x axis is tangent to the surface
+    DomainType::PointType top, bottom;
+    top[0] = 23.5; top[1] = 23.5; top[2] = 39.5;
+    bottom[0] = 23.5; bottom[1] = 23.5; bottom[2] = 7.5;
+    system->AddPosition(top, 0);
+    system->AddPosition(bottom, 0);
+    const auto start0 = system->GetPosition(0, 0);
+    const auto start1 = system->GetPosition(1, 0);
+
+    auto function = ShapeMatrixEnergyFunction::New();
+    function->m_ShapeMatrix = shape_matrix;
+
+    // a single iteration late in the optimization, where the minimum time step is small
+    auto optimizer = OptimizerType::New();
+    optimizer->SetParticleSystem(system);
+    optimizer->SetGradientFunction(function);
+    optimizer->SetVerbosity(0);
+    optimizer->SetTolerance(0.0);
+    optimizer->SetMaximumNumberOfIterations(10);
+    optimizer->SetNumberOfIterations(9);
+    optimizer->SetUseJacobiUpdate(jacobi);
+    optimizer->StartOptimization();
+
+    // the downhill step lowers the energy seen through the shape matrix and is
+    // accepted with the full time step.  With a stale shape matrix the energy
+    // would not change and the step would be rejected.
+    const auto end0 = system->GetPosition(0, 0);
+    ASSERT_LT(end0[0], start0[0] - 0.5);
+
+    // the uphill step is rejected.  Jacobi resets the particle, Gauss-Seidel
+    // backs off until the minimum time step and keeps that small step.
+    const auto end1 = system->GetPosition(1, 0);
+    if (jacobi) {
+      ASSERT_NEAR(end1.EuclideanDistanceTo(start1), 0.0, 1e-4);
+    }
+    else {
+      ASSERT_GT(end1[0], start1[0]);
+      ASSERT_LT(end1[0], start1[0] + 0.05);
+    }
+
+    // the attributes see the final positions
+    for (unsigned int k = 0; k < 2; k++) {
+      for (unsigned int i = 0; i < 3; i++) {
+        ASSERT_EQ(shape_matrix->operator()(3 * k + i, 0), system->GetPosition(k, 0)[i]);
+      }
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+static std::vector<double> read_particle_values(const std::string& filename)
+{
+  std::vector<double> values;
+  std::ifstream in(filename);
+  double value;
+  while (in >> value) {
+    values.push_back(value);
+  }
+  return values;
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, jacobi_update_test)
+{
+  std::string test_location = std::string(TEST_DATA_DIR) + std::string("/sphere");
+  chdir(test_location.c_str());
+
+  // prep/groom
+  prep_distance_transform("sphere10.nrrd", "sphere10_DT.nrrd");
+  prep_distance_transform("sphere20.nrrd", "sphere20_DT.nrrd");
+  prep_distance_transform("sphere30.nrrd", "sphere30_DT.nrrd");
+  prep_distance_transform("sphere40.nrrd", "sphere40_DT.nrrd");
+
+  const std::vector<std::string> point_files = {
+    "output/sphere10_DT_world.particles", "output/sphere20_DT_world.particles",
+    "output/sphere30_DT_world.particles", "output/sphere40_DT_world.particles"};
+
+  // run twice, the Jacobi update does not depend on thread scheduling
+  std::vector<std::vector<double>> runs;
+  for (int run = 0; run < 2; run++) {
+    for (const auto& file : point_files) {
+      std::remove(file.c_str());
+    }
+    Optimize app;
+    OptimizeParameterFile param;
+    ASSERT_TRUE(param.load_parameter_file("sphere.xml", &app));
+    app.SetUseJacobiUpdate(true);
+    app.Run();
+
+    std::vector<double> values;
+    for (const auto& file : point_files) {
+      auto file_values = read_particle_values(file);
+      ASSERT_EQ(file_values.size(), 32 * 3);
+      values.insert(values.end(), file_values.begin(), file_values.end());
+    }
+    runs.push_back(values);
+  }
+  ASSERT_EQ(runs[0], runs[1]);
+
+  // the optimization converges to the same correspondence as the Gauss-Seidel
+  // update in the sample test: with Procrustes scaling the first mode is small
+  ParticleShapeStatistics stats;
+  stats.ReadPointFiles("analyze.xml");
+  stats.ComputeModes();
+  stats.PrincipalComponentProjections();
+  auto values = stats.Eigenvalues();
+  ASSERT_LT(values[values.size() - 1], 100);
+}
@@ -1,8 +1,14 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
 #include <vector>
 #include <string>
 
 #include "Testing.h"
 
+#include "ParticleFile.h"
 #include "ParticleSystem.h"
 #include "ShapeEvaluation.h"
 
@@ -47,3 +53,72 @@ TEST(ParticlesTests, specificity)
   const double specificity = ShapeEvaluation::ComputeSpecificity(particleSystem, 1);
   ASSERT_NEAR(specificity, 0.262809, 1e-1f);
 }
+
+TEST(ParticlesTests, binary_format)
+{
+  ParticleSystem ascii(filenames);
+
+  // the same particles written as binary files are detected and read back
+  for (auto format : {ParticleFile::Format::Float64, ParticleFile::Format::Float32}) {
+    std::vector<std::string> binary_filenames;
+    for (int i = 0; i < filenames.size(); i++) {
+      ParticleFile file;
+      ASSERT_TRUE(file.Open(filenames[i]));
+      ASSERT_EQ(file.GetFormat(), ParticleFile::Format::Ascii);
+      ASSERT_EQ(file.GetValuesPerParticle(), 3u);
+
+      binary_filenames.push_back("binary_format_" + std::to_string(i) + ".particles");
+      ASSERT_TRUE(ParticleFile::Write(binary_filenames.back(), file.GetData(), file.GetNumberOfParticles(),
+                                      file.GetValuesPerParticle(), format));
+    }
+
+    ParticleSystem binary(binary_filenames);
+    if (format == ParticleFile::Format::Float64) {
+      ASSERT_TRUE(binary.Particles() == ascii.Particles());
+    }
+    else {
+      ASSERT_TRUE(binary.Particles().isApprox(ascii.Particles(), 1e-6));
+    }
+
+    for (const auto& filename : binary_filenames) {
+      std::remove(filename.c_str());
+    }
+  }
+}
+
+TEST(ParticlesTests, corrupt_binary_format)
+{
+  const std::vector<double> values = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+  const std::string filename = "corrupt_binary_format.particles";
+  auto write = [&](size_t size) {
+    ASSERT_TRUE(ParticleFile::Write(filename, values.data(), 3, 3, ParticleFile::Format::Float64));
+    std::ifstream in(filename, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), std::min(size, bytes.size()));
+  };
+
+  ParticleFile file;
+  write(SIZE_MAX);
+  ASSERT_TRUE(file.Open(filename));
+  ASSERT_EQ(file.GetNumberOfParticles(), 3u);
+
+  // truncated values and a truncated header
+  write(32 + 8 * 8);
+  ASSERT_FALSE(file.Open(filename));
+  write(20);
+  ASSERT_FALSE(file.Open(filename));
+
+  // a particle count whose size in bytes wraps around to zero
+  write(SIZE_MAX);
+  {
+    std::fstream out(filename, std::ios::in | std::ios::out | std::ios::binary);
+    const uint64_t numParticles = uint64_t(1) << 61;
+    out.seekp(16);
+    out.write(reinterpret_cast<const char*>(&numParticles), sizeof(numParticles));
+  }
+  ASSERT_FALSE(file.Open(filename));
+
+  std::remove(filename.c_str());
+}